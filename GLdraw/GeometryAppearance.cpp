@@ -10,6 +10,7 @@
 #include <meshing/VolumeGrid.h>
 #include <meshing/Expand.h>
 #include <geometry/Conversions.h>
+#include <geometry/NarrowBandVolumeGrid.h>
 #include <KrisLibrary/Timer.h>
 
 using namespace Geometry;
@@ -193,7 +194,7 @@ void drawExpanded(Geometry::AnyCollisionGeometry3D& geom,Real p)
       glPopMatrix();
     }
   }
-  else if(geom.type == Geometry::AnyCollisionGeometry3D::ImplicitSurface) {
+  else if(geom.type == Geometry::AnyCollisionGeometry3D::ImplicitSurface || geom.type == Geometry::AnyCollisionGeometry3D::SparseImplicitSurface) {
         LOG4CXX_ERROR(KrisLibrary::logger(),"TODO: draw implicit surface\n");
   }
   else if(geom.type == Geometry::AnyCollisionGeometry3D::Primitive) {
@@ -269,7 +270,7 @@ void GeometryAppearance::Refresh()
 void GeometryAppearance::Set(const Geometry::AnyCollisionGeometry3D& _geom)
 {
   geom = &_geom;
-  if(geom->type == AnyGeometry3D::ImplicitSurface) {
+  if(geom->type == AnyGeometry3D::ImplicitSurface || geom->type == AnyGeometry3D::SparseImplicitSurface) {
     Set(*geom);
   }
   else if(geom->type == AnyGeometry3D::PointCloud) {
@@ -317,6 +318,13 @@ void GeometryAppearance::Set(const AnyGeometry3D& _geom)
     ImplicitSurfaceToMesh(*g,*implicitSurfaceMesh);
     drawFaces = true;
   }
+  else if(geom->type == AnyGeometry3D::SparseImplicitSurface) {
+    Meshing::VolumeGrid g;
+    geom->AsSparseImplicitSurface().GetDense(g);
+    if(!implicitSurfaceMesh) implicitSurfaceMesh.reset(new Meshing::TriMesh);
+    ImplicitSurfaceToMesh(g,*implicitSurfaceMesh);
+    drawFaces = true;
+  }
   else if(geom->type == AnyGeometry3D::PointCloud) {
     Timer timer;
     drawVertices = true;
@@ -411,7 +419,7 @@ void GeometryAppearance::DrawGL()
 {
   if(drawVertices) {   
     const vector<Vector3>* verts = NULL;
-    if(geom->type == AnyGeometry3D::ImplicitSurface) 
+    if(geom->type == AnyGeometry3D::ImplicitSurface || geom->type == AnyGeometry3D::SparseImplicitSurface) 
       verts = &implicitSurfaceMesh->verts;
     else if(geom->type == AnyGeometry3D::TriangleMesh) 
       verts = &geom->AsTriangleMesh().verts;
@@ -535,7 +543,7 @@ void GeometryAppearance::DrawGL()
       faceDisplayList.beginCompile();
   
       const Meshing::TriMesh* trimesh = NULL;
-      if(geom->type == AnyGeometry3D::ImplicitSurface) 
+      if(geom->type == AnyGeometry3D::ImplicitSurface || geom->type == AnyGeometry3D::SparseImplicitSurface) 
         trimesh = implicitSurfaceMesh.get();
       else if(geom->type == AnyGeometry3D::PointCloud) 
   trimesh = implicitSurfaceMesh.get();
@@ -7,6 +7,7 @@
 #include <GLdraw/GeometryAppearance.h>
 #include "CollisionPointCloud.h"
 #include "CollisionImplicitSurface.h"
+#include "CollisionSparseImplicitSurface.h"
 #include <utils/stringutils.h>
 #include <meshing/IO.h>
 #include <Timer.h>
@@ -102,6 +103,19 @@ int PointIndex(const CollisionImplicitSurface& s,const Vector3& ptworld)
   return cell.a*s.baseGrid.value.n*s.baseGrid.value.p + cell.b*s.baseGrid.value.p + cell.c;
 }
 
+int PointIndex(const CollisionSparseImplicitSurface& s,const Vector3& ptworld)
+{
+  Vector3 plocal;
+  s.currentTransform.mulInverse(ptworld,plocal);
+  IntTriple cell;
+  s.grid.GetIndex(plocal,cell);
+  const IntTriple& size = s.grid.size;
+  cell.a = Max(0,Min(cell.a,size.a-1));
+  cell.b = Max(0,Min(cell.b,size.b-1));
+  cell.c = Max(0,Min(cell.c,size.c-1));
+  return cell.a*size.b*size.c + cell.b*size.c + cell.c;
+}
+
 AnyDistanceQueryResult::AnyDistanceQueryResult()
 :hasPenetration(0),hasElements(0),hasClosestPoints(0),hasDirections(0),d(Inf)
 {}
@@ -132,6 +146,10 @@ AnyGeometry3D::AnyGeometry3D(const Meshing::VolumeGrid& grid)
   :type(ImplicitSurface),data(grid)
 {}
 
+AnyGeometry3D::AnyGeometry3D(const NarrowBandVolumeGrid& grid)
+  :type(SparseImplicitSurface),data(grid)
+{}
+
 AnyGeometry3D::AnyGeometry3D(const vector<AnyGeometry3D>& group)
   :type(Group),data(group)
 {}
@@ -142,11 +160,13 @@ const GeometricPrimitive3D& AnyGeometry3D::AsPrimitive() const { return *AnyCast
 const Meshing::TriMesh& AnyGeometry3D::AsTriangleMesh() const { return *AnyCast_Raw<Meshing::TriMesh>(&data); }
 const Meshing::PointCloud3D& AnyGeometry3D::AsPointCloud() const { return *AnyCast_Raw<Meshing::PointCloud3D>(&data); }
 const Meshing::VolumeGrid& AnyGeometry3D::AsImplicitSurface() const { return *AnyCast_Raw<Meshing::VolumeGrid>(&data); }
+const NarrowBandVolumeGrid& AnyGeometry3D::AsSparseImplicitSurface() const { return *AnyCast_Raw<NarrowBandVolumeGrid>(&data); }
 const vector<AnyGeometry3D>& AnyGeometry3D::AsGroup() const { return *AnyCast_Raw<vector<AnyGeometry3D> >(&data); }
 GeometricPrimitive3D& AnyGeometry3D::AsPrimitive() { return *AnyCast_Raw<GeometricPrimitive3D>(&data); }
 Meshing::TriMesh& AnyGeometry3D::AsTriangleMesh() { return *AnyCast_Raw<Meshing::TriMesh>(&data); }
 Meshing::PointCloud3D& AnyGeometry3D::AsPointCloud() { return *AnyCast_Raw<Meshing::PointCloud3D>(&data); }
 Meshing::VolumeGrid& AnyGeometry3D::AsImplicitSurface() { return *AnyCast_Raw<Meshing::VolumeGrid>(&data); }
+NarrowBandVolumeGrid& AnyGeometry3D::AsSparseImplicitSurface() { return *AnyCast_Raw<NarrowBandVolumeGrid>(&data); }
 vector<AnyGeometry3D>& AnyGeometry3D::AsGroup() { return *AnyCast_Raw<vector<AnyGeometry3D> >(&data); }
 
 //appearance casts
@@ -161,6 +181,7 @@ const char* AnyGeometry3D::TypeName(Type type)
   case PointCloud: return "PointCloud";
   case ImplicitSurface: return "ImplicitSurface";
   case Group: return "Group";
+  case SparseImplicitSurface: return "SparseImplicitSurface";
   default: return "Error";
   }
 }
@@ -176,6 +197,8 @@ bool AnyGeometry3D::Empty() const
     return AsPointCloud().points.empty();
   case ImplicitSurface:
     return false;
+  case SparseImplicitSurface:
+    return AsSparseImplicitSurface().IsEmpty();
   case Group:
     return AsGroup().empty();
   }
@@ -217,6 +240,7 @@ void AnyGeometry3D::Merge(const vector<AnyGeometry3D>& geoms)
       group = true;
       break;
     case ImplicitSurface:
+    case SparseImplicitSurface:
       group = true;
       break;
     case Group:
@@ -246,6 +270,34 @@ bool AnyGeometry3D::Convert(Type restype,AnyGeometry3D& res,double param) const
   }
   if(restype == Group) return false;
   Assert(param >= 0);
+  //sparse implicit surfaces are converted via dense ones.  When converting
+  //from a dense implicit surface, param gives the band width
+  if(restype == SparseImplicitSurface && type != Group) {
+    const Meshing::VolumeGrid* grid;
+    AnyGeometry3D dense;
+    Real bandWidth = 0;
+    if(type == ImplicitSurface) {
+      grid = &AsImplicitSurface();
+      bandWidth = param;
+    }
+    else {
+      if(!Convert(ImplicitSurface,dense,param)) return false;
+      grid = &dense.AsImplicitSurface();
+    }
+    if(bandWidth == 0) {
+      Vector3 h = grid->GetCellSize();
+      bandWidth = 3*Max(h.x,h.y,h.z);
+    }
+    NarrowBandVolumeGrid sparse;
+    sparse.Build(*grid,bandWidth);
+    res = AnyGeometry3D(sparse);
+    return true;
+  }
+  if(type == SparseImplicitSurface) {
+    Meshing::VolumeGrid grid;
+    AsSparseImplicitSurface().GetDense(grid);
+    return AnyGeometry3D(grid).Convert(restype,res,param);
+  }
   switch(type) {
     case Primitive:
       switch(restype) {
@@ -410,6 +462,11 @@ size_t AnyGeometry3D::NumElements() const
       IntTriple size = AsImplicitSurface().value.size();
       return size.a*size.b*size.c;
     }
+  case SparseImplicitSurface:
+    {
+      const IntTriple& size = AsSparseImplicitSurface().size;
+      return size.a*size.b*size.c;
+    }
   case Group:
     return AsGroup().size();
   }
@@ -442,6 +499,16 @@ GeometricPrimitive3D AnyGeometry3D::GetElement(int elem) const
     grid.GetCell(cell,bb);
     return GeometricPrimitive3D(bb);
   }
+  else if(type == SparseImplicitSurface) {
+    const NarrowBandVolumeGrid& grid = AsSparseImplicitSurface();
+    IntTriple cell;
+    cell.a = elem/(grid.size.b*grid.size.c);
+    cell.b = (elem/grid.size.c)%grid.size.b;
+    cell.c = elem%grid.size.c;
+    AABB3D bb;
+    grid.GetCell(cell,bb);
+    return GeometricPrimitive3D(bb);
+  }
   else if(type == Group) {
     const vector<AnyGeometry3D>& items = AsGroup();
     if(items[elem].type != Primitive)
@@ -548,6 +615,7 @@ bool AnyGeometry3D::Save(const char* fn) const
     return true;
     }
     break;
+  case SparseImplicitSurface:
   case Group:
     break;
   }
@@ -592,6 +660,11 @@ bool AnyGeometry3D::Load(istream& in)
     data = Meshing::VolumeGrid();
     in >> this->AsImplicitSurface();
   }
+  else if(typestr == "SparseImplicitSurface") {
+    type = SparseImplicitSurface;
+    data = NarrowBandVolumeGrid();
+    in >> this->AsSparseImplicitSurface();
+  }
   else if(typestr == "Group") {
     int n;
     in >> n;
@@ -626,6 +699,9 @@ bool AnyGeometry3D::Save(ostream& out) const
   case ImplicitSurface:
     out<<this->AsImplicitSurface()<<endl;
     break;
+  case SparseImplicitSurface:
+    out<<this->AsSparseImplicitSurface()<<endl;
+    break;
   case Group:
     {
       const vector<AnyGeometry3D>& grp = this->AsGroup();
@@ -661,8 +737,21 @@ void AnyGeometry3D::Transform(const Matrix4& T)
       if(T(0,1) != 0 || T(0,2) != 0 || T(1,2) != 0 || T(1,0) != 0 || T(2,0) != 0 || T(2,1) != 0 ) {
 	FatalError("Cannot transform volume grid except via translation / scale");
       }
-      AsImplicitSurface().bb.bmin = T*AsImplicitSurface().bb.bmin;
-      AsImplicitSurface().bb.bmax = T*AsImplicitSurface().bb.bmax;
+      AABB3D& bb = AsImplicitSurface().bb;
+      Vector3 bmin = bb.bmin, bmax = bb.bmax;
+      T.mulPoint(bmin,bb.bmin);
+      T.mulPoint(bmax,bb.bmax);
+    }
+    break;
+  case SparseImplicitSurface:
+    {
+      if(T(0,1) != 0 || T(0,2) != 0 || T(1,2) != 0 || T(1,0) != 0 || T(2,0) != 0 || T(2,1) != 0 ) {
+	FatalError("Cannot transform sparse volume grid except via translation / scale");
+      }
+      AABB3D& bb = AsSparseImplicitSurface().bb;
+      Vector3 bmin = bb.bmin, bmax = bb.bmax;
+      T.mulPoint(bmin,bb.bmin);
+      T.mulPoint(bmax,bb.bmax);
     }
     break;
   case Group:
@@ -694,6 +783,9 @@ AABB3D AnyGeometry3D::GetAABB() const
   case ImplicitSurface:
     return AsImplicitSurface().bb;
     break;
+  case SparseImplicitSurface:
+    return AsSparseImplicitSurface().bb;
+    break;
   case Group:
     {
       const vector<AnyGeometry3D>& items = AsGroup();
@@ -741,6 +833,12 @@ AnyCollisionGeometry3D::AnyCollisionGeometry3D(const Meshing::VolumeGrid& grid)
 }
 
 
+AnyCollisionGeometry3D::AnyCollisionGeometry3D(const NarrowBandVolumeGrid& grid)
+  :AnyGeometry3D(grid),margin(0)
+{
+  currentTransform.setIdentity();
+}
+
 AnyCollisionGeometry3D::AnyCollisionGeometry3D(const vector<AnyGeometry3D>& items)
   :AnyGeometry3D(items),margin(0)
 {
@@ -768,12 +866,17 @@ AnyCollisionGeometry3D& AnyCollisionGeometry3D::operator =(const AnyCollisionGeo
   if(!geom.collisionData.empty()) {
     switch(type) {
     case Primitive:
+      collisionData = geom.collisionData;
+      break;
     case ImplicitSurface:
       {
         const CollisionImplicitSurface& cmesh = geom.ImplicitSurfaceCollisionData();
         collisionData = CollisionImplicitSurface(cmesh);
       }
       break;
+    case SparseImplicitSurface:
+      collisionData = CollisionSparseImplicitSurface(geom.SparseImplicitSurfaceCollisionData());
+      break;
     case TriangleMesh:
       {
         const CollisionMesh& cmesh = geom.TriangleMeshCollisionData();
@@ -805,11 +908,13 @@ AnyCollisionGeometry3D& AnyCollisionGeometry3D::operator =(const AnyCollisionGeo
   const CollisionMesh& AnyCollisionGeometry3D::TriangleMeshCollisionData() const { return *AnyCast_Raw<CollisionMesh>(&collisionData); }
   const CollisionPointCloud& AnyCollisionGeometry3D::PointCloudCollisionData() const { return *AnyCast_Raw<CollisionPointCloud>(&collisionData); }
   const CollisionImplicitSurface& AnyCollisionGeometry3D::ImplicitSurfaceCollisionData() const { return *AnyCast_Raw<CollisionImplicitSurface>(&collisionData); }
+  const CollisionSparseImplicitSurface& AnyCollisionGeometry3D::SparseImplicitSurfaceCollisionData() const { return *AnyCast_Raw<CollisionSparseImplicitSurface>(&collisionData); }
   const vector<AnyCollisionGeometry3D>& AnyCollisionGeometry3D::GroupCollisionData() const { return *AnyCast_Raw<vector<AnyCollisionGeometry3D> >(&collisionData); }
   RigidTransform& AnyCollisionGeometry3D::PrimitiveCollisionData() { return currentTransform; }
   CollisionMesh& AnyCollisionGeometry3D::TriangleMeshCollisionData() { return *AnyCast_Raw<CollisionMesh>(&collisionData); }
   CollisionPointCloud& AnyCollisionGeometry3D::PointCloudCollisionData() { return *AnyCast_Raw<CollisionPointCloud>(&collisionData); }
   CollisionImplicitSurface& AnyCollisionGeometry3D::ImplicitSurfaceCollisionData() { return *AnyCast_Raw<CollisionImplicitSurface>(&collisionData); }
+  CollisionSparseImplicitSurface& AnyCollisionGeometry3D::SparseImplicitSurfaceCollisionData() { return *AnyCast_Raw<CollisionSparseImplicitSurface>(&collisionData); }
   vector<AnyCollisionGeometry3D>& AnyCollisionGeometry3D::GroupCollisionData() { return *AnyCast_Raw<vector<AnyCollisionGeometry3D> >(&collisionData); }
 
 void AnyCollisionGeometry3D::InitCollisionData()
@@ -828,6 +933,9 @@ void AnyCollisionGeometry3D::ReinitCollisionData()
   case ImplicitSurface:
     collisionData = CollisionImplicitSurface(AsImplicitSurface());
     break;
+  case SparseImplicitSurface:
+    collisionData = CollisionSparseImplicitSurface(AsSparseImplicitSurface());
+    break;
   case TriangleMesh:
     collisionData = CollisionMesh(AsTriangleMesh());
     break;
@@ -902,6 +1010,7 @@ AABB3D AnyCollisionGeometry3D::GetAABBTight() const
   switch(type) {
   case Primitive:
   case ImplicitSurface:
+  case SparseImplicitSurface:
     return GetAABB();
     break;
   case TriangleMesh:
@@ -969,6 +1078,7 @@ AABB3D AnyCollisionGeometry3D::GetAABB() const
   case TriangleMesh:
   case PointCloud:
   case ImplicitSurface:
+  case SparseImplicitSurface:
     {
       AABB3D bb;
       Box3D b = GetBB();
@@ -1015,6 +1125,9 @@ Box3D AnyCollisionGeometry3D::GetBB() const
     case ImplicitSurface:
       b.setTransformed(AsImplicitSurface().bb,ImplicitSurfaceCollisionData().currentTransform);
       break;
+    case SparseImplicitSurface:
+      b.setTransformed(AsSparseImplicitSurface().bb,SparseImplicitSurfaceCollisionData().currentTransform);
+      break;
     case Group:
       {
 	AABB3D bb = GetAABB();
@@ -1046,6 +1159,9 @@ void AnyCollisionGeometry3D::SetTransform(const RigidTransform& T)
     case ImplicitSurface:
       ImplicitSurfaceCollisionData().currentTransform = T;
       break;
+    case SparseImplicitSurface:
+      SparseImplicitSurfaceCollisionData().currentTransform = T;
+      break;
     case TriangleMesh:
       TriangleMeshCollisionData().UpdateTransform(T);
       break;
@@ -1079,6 +1195,8 @@ Real AnyCollisionGeometry3D::Distance(const Vector3& pt)
       return ::Distance(vg,pt);
     }
     break;
+  case SparseImplicitSurface:
+    return ::Distance(SparseImplicitSurfaceCollisionData(),pt)-margin;
   case TriangleMesh:
     {
       Vector3 cp;
@@ -1148,6 +1266,17 @@ AnyDistanceQueryResult AnyCollisionGeometry3D::Distance(const Vector3& pt,const
       //cout<<"Doing ImplicitSurface - point collision detection, with direction "<<res.dir2<<endl;
       return res;
     }
+  case SparseImplicitSurface:
+    {
+      const CollisionSparseImplicitSurface& s = SparseImplicitSurfaceCollisionData();
+      res.d = ::Distance(s,pt,res.cp1,res.dir2);
+      res.dir1.setNegative(res.dir2);
+      res.hasPenetration = true;
+      res.hasDirections = true;
+      res.elem1 = PointIndex(s,res.cp1);
+      Offset1(res,margin);
+      return res;
+    }
   case TriangleMesh:
     {
       int tri = ClosestPoint(TriangleMeshCollisionData(),pt,res.cp1);
@@ -1202,6 +1331,21 @@ bool Collides(const CollisionImplicitSurface& grid,const GeometricPrimitive3D& a
   return false;
 }
 
+bool Collides(const CollisionSparseImplicitSurface& s,const GeometricPrimitive3D& a,Real margin,
+	      vector<int>& selements,size_t maxContacts)
+{
+  if(a.type != GeometricPrimitive3D::Point && a.type != GeometricPrimitive3D::Sphere) {
+    FatalError("Can't collide a sparse implicit surface and a non-sphere primitive yet\n");
+  }
+  Vector3 sclosest,aclosest,grad;
+  if(::Distance(s,a,sclosest,aclosest,grad) <= margin) {
+    selements.resize(1);
+    selements[0] = PointIndex(s,sclosest);
+    return true;
+  }
+  return false;
+}
+
 bool Collides(const GeometricPrimitive3D& a,const GeometricPrimitive3D& b,Real margin)
 {
   if(margin==0) return a.Collides(b);
@@ -1273,6 +1417,8 @@ bool Collides(const CollisionPointCloud& a,Real margin,AnyCollisionGeometry3D& b
         vector<int>& elements1,vector<int>& elements2,size_t maxContacts);
 bool Collides(const CollisionImplicitSurface& a,Real margin,AnyCollisionGeometry3D& b,
         vector<int>& elements1,vector<int>& elements2,size_t maxContacts);
+bool Collides(const CollisionSparseImplicitSurface& a,Real margin,AnyCollisionGeometry3D& b,
+        vector<int>& elements1,vector<int>& elements2,size_t maxContacts);
 
 template <class T>
 bool Collides(const T& a,vector<AnyCollisionGeometry3D>& bitems,Real margin,
@@ -1508,6 +1654,16 @@ bool Collides(const CollisionPointCloud& a,Real margin,const CollisionImplicitSu
   return res;
 }
 
+bool Collides(const CollisionPointCloud& a,Real margin,const CollisionSparseImplicitSurface& b,
+  vector<int>& elements1,vector<int>& elements2,size_t maxContacts)
+{
+  bool res=Geometry::Collides(b,a,margin,elements1,maxContacts);
+  elements2.resize(elements1.size());
+  for(size_t i=0;i<elements1.size();i++)
+    elements2[i] = PointIndex(b,a.currentTransform*a.points[elements1[i]]);
+  return res;
+}
+
 
 
 bool Collides(const GeometricPrimitive3D& a,Real margin,AnyCollisionGeometry3D& b,
@@ -1532,6 +1688,12 @@ bool Collides(const GeometricPrimitive3D& a,Real margin,AnyCollisionGeometry3D&
       return true;
     }
     return false;
+  case AnyCollisionGeometry3D::SparseImplicitSurface:
+    if(::Collides(b.SparseImplicitSurfaceCollisionData(),a,margin+b.margin,elements2,maxContacts)) {
+      elements1.push_back(0);
+      return true;
+    }
+    return false;
   case AnyCollisionGeometry3D::TriangleMesh:
     if(::Collides(a,b.TriangleMeshCollisionData(),margin+b.margin,elements2,maxContacts)) {
       elements1.push_back(0);
@@ -1582,6 +1744,10 @@ bool Collides(const CollisionImplicitSurface& a,Real margin,AnyCollisionGeometry
     }
   case AnyCollisionGeometry3D::ImplicitSurface:
     return ::Collides(a,b.ImplicitSurfaceCollisionData(),margin+b.margin,elements1,elements2,maxContacts);
+  case AnyCollisionGeometry3D::SparseImplicitSurface:
+    //unsupported; reported as not colliding
+    fprintf(stderr,"Unable to do implicit surface/sparse implicit surface collision yet\n");
+    return false;
   case AnyCollisionGeometry3D::TriangleMesh:
     return ::Collides(a,b.TriangleMeshCollisionData(),margin+b.margin,elements1,elements2,maxContacts);
   case AnyCollisionGeometry3D::PointCloud:
@@ -1605,6 +1771,46 @@ bool Collides(const CollisionImplicitSurface& a,Real margin,AnyCollisionGeometry
   return false;
 }
 
+bool Collides(const CollisionSparseImplicitSurface& a,Real margin,AnyCollisionGeometry3D& b,
+        vector<int>& elements1,vector<int>& elements2,size_t maxContacts)
+{
+  switch(b.type) {
+  case AnyCollisionGeometry3D::Primitive:
+    {
+      GeometricPrimitive3D bw=b.AsPrimitive();
+      bw.Transform(b.GetTransform());
+      if(::Collides(a,bw,margin+b.margin,elements1,maxContacts)) {
+        elements2.push_back(0);
+        return true;
+      }
+      return false;
+    }
+  case AnyCollisionGeometry3D::ImplicitSurface:
+  case AnyCollisionGeometry3D::SparseImplicitSurface:
+    //unsupported; reported as not colliding
+    fprintf(stderr,"Unable to do sparse implicit surface/implicit surface collision yet\n");
+    return false;
+  case AnyCollisionGeometry3D::TriangleMesh:
+    {
+      vector<Vector3> pts;
+      bool res = Geometry::Collides(a,b.TriangleMeshCollisionData(),margin+b.margin,elements2,pts,maxContacts);
+      for(size_t i=0;i<pts.size();i++)
+        elements1.push_back(PointIndex(a,pts[i]));
+      return res;
+    }
+  case AnyCollisionGeometry3D::PointCloud:
+    return ::Collides(b.PointCloudCollisionData(),margin+b.margin,a,elements2,elements1,maxContacts);
+  case AnyCollisionGeometry3D::Group:
+    {
+      vector<AnyCollisionGeometry3D>& bitems = b.GroupCollisionData();
+      return ::Collides(a,bitems,margin+b.margin,elements1,elements2,maxContacts);
+    }
+  default:
+    FatalError("Invalid type");
+  }
+  return false;
+}
+
 bool Collides(const CollisionMesh& a,Real margin,AnyCollisionGeometry3D& b,
         vector<int>& elements1,vector<int>& elements2,size_t maxContacts)
 {
@@ -1621,6 +1827,15 @@ bool Collides(const CollisionMesh& a,Real margin,AnyCollisionGeometry3D& b,
     }
   case AnyCollisionGeometry3D::ImplicitSurface:
     return ::Collides(b.ImplicitSurfaceCollisionData(),a,margin+b.margin,elements2,elements1,maxContacts);
+  case AnyCollisionGeometry3D::SparseImplicitSurface:
+    {
+      const CollisionSparseImplicitSurface& s = b.SparseImplicitSurfaceCollisionData();
+      vector<Vector3> pts;
+      bool res = Geometry::Collides(s,a,margin+b.margin,elements1,pts,maxContacts);
+      for(size_t i=0;i<pts.size();i++)
+        elements2.push_back(PointIndex(s,pts[i]));
+      return res;
+    }
   case AnyCollisionGeometry3D::TriangleMesh:
     return ::Collides(a,b.TriangleMeshCollisionData(),margin+b.margin,elements1,elements2,maxContacts);
   case AnyCollisionGeometry3D::PointCloud:
@@ -1665,6 +1880,8 @@ bool Collides(const CollisionPointCloud& a,Real margin,AnyCollisionGeometry3D& b
       bool res=::Collides(a,margin,b.ImplicitSurfaceCollisionData(),elements1,elements2,maxContacts);
       return res;
     }
+  case AnyCollisionGeometry3D::SparseImplicitSurface:
+    return ::Collides(a,margin+b.margin,b.SparseImplicitSurfaceCollisionData(),elements1,elements2,maxContacts);
   case AnyCollisionGeometry3D::Group:
     {
       vector<AnyCollisionGeometry3D>& bitems = b.GroupCollisionData();
@@ -1716,6 +1933,8 @@ bool AnyCollisionGeometry3D::Collides(AnyCollisionGeometry3D& geom,
     return ::Collides(AsPrimitive(),GetTransform(),margin,geom,elements1,elements2,maxContacts);
   case ImplicitSurface:
     return ::Collides(ImplicitSurfaceCollisionData(),margin,geom,elements1,elements2,maxContacts);
+  case SparseImplicitSurface:
+    return ::Collides(SparseImplicitSurfaceCollisionData(),margin,geom,elements1,elements2,maxContacts);
   case TriangleMesh:
     return ::Collides(TriangleMeshCollisionData(),margin,geom,elements1,elements2,maxContacts);
   case PointCloud:
@@ -1761,6 +1980,20 @@ AnyDistanceQueryResult Distance(const GeometricPrimitive3D& a,const CollisionImp
   return res;
 }
 
+AnyDistanceQueryResult Distance(const GeometricPrimitive3D& a,const CollisionSparseImplicitSurface& b,const AnyDistanceQuerySettings& settings)
+{
+  AnyDistanceQueryResult res;
+  res.hasElements = true;
+  res.hasPenetration = true;
+  res.hasClosestPoints = true;
+  res.hasDirections = true;
+  res.elem1 = 0;
+  res.d = Geometry::Distance(b,a,res.cp2,res.cp1,res.dir1);
+  res.elem2 = PointIndex(b,res.cp2);
+  res.dir2.setNegative(res.dir1);
+  return res;
+}
+
 AnyDistanceQueryResult Distance(const GeometricPrimitive3D& a,const CollisionPointCloud& b,const AnyDistanceQuerySettings& settings)
 {
   AnyDistanceQueryResult res;
@@ -1786,6 +2019,22 @@ AnyDistanceQueryResult Distance(const CollisionImplicitSurface& a,const Collisio
   return res;
 }
 
+AnyDistanceQueryResult Distance(const CollisionSparseImplicitSurface& a,const CollisionPointCloud& b,const AnyDistanceQuerySettings& settings)
+{
+  AnyDistanceQueryResult res;
+  res.hasElements = true;
+  res.hasPenetration = true;
+  res.hasClosestPoints = true;
+  res.hasDirections = true;
+  res.d = Geometry::Distance(a,b,res.elem2,settings.upperBound);
+  if(res.elem2 < 0) return res;
+  res.cp2 = b.currentTransform*b.points[res.elem2];
+  Geometry::Distance(a,res.cp2,res.cp1,res.dir1);
+  res.dir2.setNegative(res.dir1);
+  res.elem1 = PointIndex(a,res.cp1);
+  return res;
+}
+
 AnyDistanceQueryResult Distance(const CollisionMesh& a,const CollisionMesh& b,const AnyDistanceQuerySettings& settings)
 {
   AnyDistanceQueryResult res;
@@ -1801,6 +2050,7 @@ AnyDistanceQueryResult Distance(const CollisionMesh& a,const CollisionMesh& b,co
 //advance declarations
 AnyDistanceQueryResult Distance(const GeometricPrimitive3D& a,const AnyCollisionGeometry3D& b,const AnyDistanceQuerySettings& settings);
 AnyDistanceQueryResult Distance(const CollisionImplicitSurface& a,const AnyCollisionGeometry3D& b,const AnyDistanceQuerySettings& settings);
+AnyDistanceQueryResult Distance(const CollisionSparseImplicitSurface& a,const AnyCollisionGeometry3D& b,const AnyDistanceQuerySettings& settings);
 AnyDistanceQueryResult Distance(const CollisionMesh& a,const AnyCollisionGeometry3D& b,const AnyDistanceQuerySettings& settings);
 AnyDistanceQueryResult Distance(const CollisionPointCloud& a,const AnyCollisionGeometry3D& b,const AnyDistanceQuerySettings& settings);
 
@@ -1842,6 +2092,12 @@ AnyDistanceQueryResult Distance(const GeometricPrimitive3D& a,const AnyCollision
       Offset2(res,b.margin);
     }
     break;
+  case AnyCollisionGeometry3D::SparseImplicitSurface:
+    {
+      res = Distance(a,b.SparseImplicitSurfaceCollisionData(),modsettings);
+      Offset2(res,b.margin);
+    }
+    break;
   case AnyCollisionGeometry3D::TriangleMesh:
     fprintf(stderr,"Unable to do primitive/triangle mesh distance yet\n");
     break;
@@ -1881,6 +2137,48 @@ AnyDistanceQueryResult Distance(const CollisionImplicitSurface& a,const AnyColli
     }
     break;
   case AnyCollisionGeometry3D::ImplicitSurface:
+  case AnyCollisionGeometry3D::SparseImplicitSurface:
+    fprintf(stderr,"Unable to do implicit surface/implicit surface distance yet\n");
+    break;
+  case AnyCollisionGeometry3D::TriangleMesh:
+    fprintf(stderr,"Unable to do implicit surface/triangle mesh distance yet\n");
+    break;
+  case AnyCollisionGeometry3D::PointCloud:
+    {
+      res = Distance(a,b.PointCloudCollisionData(),modsettings);
+      Offset2(res,b.margin);
+      break;
+    }
+  case AnyCollisionGeometry3D::Group:
+    {
+      const vector<AnyCollisionGeometry3D>& bitems = b.GroupCollisionData();
+      res = ::Distance_Group(a,bitems,modsettings);
+      Offset2(res,b.margin);
+      return res;
+    }
+  default:
+    FatalError("Invalid type");
+  }
+  return res;
+}
+
+AnyDistanceQueryResult Distance(const CollisionSparseImplicitSurface& a,const AnyCollisionGeometry3D& b,const AnyDistanceQuerySettings& settings)
+{
+  AnyDistanceQueryResult res;
+  AnyDistanceQuerySettings modsettings = settings;
+  modsettings.upperBound += b.margin;
+  switch(b.type) {
+  case AnyCollisionGeometry3D::Primitive:
+    {
+      GeometricPrimitive3D bw=b.AsPrimitive();
+      bw.Transform(b.GetTransform());
+      res = Distance(bw,a,modsettings);
+      Flip(res);
+      Offset2(res,b.margin);
+    }
+    break;
+  case AnyCollisionGeometry3D::ImplicitSurface:
+  case AnyCollisionGeometry3D::SparseImplicitSurface:
     fprintf(stderr,"Unable to do implicit surface/implicit surface distance yet\n");
     break;
   case AnyCollisionGeometry3D::TriangleMesh:
@@ -1915,6 +2213,7 @@ AnyDistanceQueryResult Distance(const CollisionMesh& a,const AnyCollisionGeometr
     fprintf(stderr,"Unable to do triangle mesh/primitive distance yet\n");
     break;
   case AnyCollisionGeometry3D::ImplicitSurface:
+  case AnyCollisionGeometry3D::SparseImplicitSurface:
     fprintf(stderr,"Unable to do triangle mesh/implicit surface distance yet\n");
     break;
   case AnyCollisionGeometry3D::TriangleMesh:
@@ -1975,6 +2274,13 @@ AnyDistanceQueryResult Distance(const CollisionPointCloud& a,const AnyCollisionG
       Offset2(res,b.margin);
       return res;
     }
+  case AnyCollisionGeometry3D::SparseImplicitSurface:
+    {
+      res = ::Distance(b.SparseImplicitSurfaceCollisionData(),a,modsettings);
+      Flip(res);
+      Offset2(res,b.margin);
+      return res;
+    }
   case AnyCollisionGeometry3D::Group:
     {
       const vector<AnyCollisionGeometry3D>& bitems = b.GroupCollisionData();
@@ -2032,6 +2338,10 @@ AnyDistanceQueryResult AnyCollisionGeometry3D::Distance(AnyCollisionGeometry3D&
     result = ::Distance(ImplicitSurfaceCollisionData(),geom,modsettings);
     Offset1(result,margin);
     return result;
+  case SparseImplicitSurface:
+    result = ::Distance(SparseImplicitSurfaceCollisionData(),geom,modsettings);
+    Offset1(result,margin);
+    return result;
   case TriangleMesh:
     result = ::Distance(TriangleMeshCollisionData(),geom,modsettings);
     Offset1(result,margin);
@@ -2068,6 +2378,8 @@ bool AnyCollisionGeometry3D::WithinDistance(AnyCollisionGeometry3D& geom,Real to
     return ::Collides(AsPrimitive(),GetTransform(),margin+tol,geom,elements1,elements2,maxContacts);
   case ImplicitSurface:
     return ::Collides(ImplicitSurfaceCollisionData(),margin+tol,geom,elements1,elements2,maxContacts);
+  case SparseImplicitSurface:
+    return ::Collides(SparseImplicitSurfaceCollisionData(),margin+tol,geom,elements1,elements2,maxContacts);
   case TriangleMesh:
     return ::Collides(TriangleMeshCollisionData(),margin+tol,geom,elements1,elements2,maxContacts);
   case PointCloud:
@@ -2105,6 +2417,15 @@ bool AnyCollisionGeometry3D::RayCast(const Ray3D& r,Real* distance,int* element)
   case ImplicitSurface:
     FatalError("Can't ray-cast implicit surfaces yet\n");
     break;
+  case SparseImplicitSurface:
+    {
+      const CollisionSparseImplicitSurface& s = SparseImplicitSurfaceCollisionData();
+      Vector3 worldpt;
+      if(!::RayCast(s,r,margin,worldpt)) return false;
+      if(distance) *distance = worldpt.distance(r.source);
+      if(element) *element = PointIndex(s,worldpt);
+      return true;
+    }
   case TriangleMesh:
     {
       Vector3 worldpt;
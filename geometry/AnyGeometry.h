@@ -8,7 +8,7 @@ class TiXmlElement;
 
 //forward declarations
 namespace Meshing { template <class T> class VolumeGridTemplate; typedef VolumeGridTemplate<Real> VolumeGrid; class PointCloud3D; }
-namespace Geometry { class CollisionPointCloud; class CollisionImplicitSurface; }
+namespace Geometry { class CollisionPointCloud; class CollisionImplicitSurface; class NarrowBandVolumeGrid; class CollisionSparseImplicitSurface; }
 namespace Math3D { class GeometricPrimitive3D; }
 namespace GLDraw { class GeometryAppearance; }
 
@@ -41,14 +41,16 @@ class AnyGeometry3D
    * - PointCloud: PointCloud3D
    * - ImplicitSurface: VolumeGrid
    * - Group: vector<AnyGeometry3D>
+   * - SparseImplicitSurface: NarrowBandVolumeGrid
    */
-  enum Type { Primitive, TriangleMesh, PointCloud, ImplicitSurface, Group };
+  enum Type { Primitive, TriangleMesh, PointCloud, ImplicitSurface, Group, SparseImplicitSurface };
 
   AnyGeometry3D();
   AnyGeometry3D(const GeometricPrimitive3D& primitive);
   AnyGeometry3D(const Meshing::TriMesh& mesh);
   AnyGeometry3D(const Meshing::PointCloud3D& pc);
   AnyGeometry3D(const Meshing::VolumeGrid& grid);
+  AnyGeometry3D(const NarrowBandVolumeGrid& grid);
   AnyGeometry3D(const vector<AnyGeometry3D>& items);
   AnyGeometry3D(const AnyGeometry3D& geom) = default;
   AnyGeometry3D(AnyGeometry3D&& geom) = default;
@@ -60,11 +62,13 @@ class AnyGeometry3D
   const Meshing::TriMesh& AsTriangleMesh() const;
   const Meshing::PointCloud3D& AsPointCloud() const;
   const Meshing::VolumeGrid& AsImplicitSurface() const;
+  const NarrowBandVolumeGrid& AsSparseImplicitSurface() const;
   const vector<AnyGeometry3D>& AsGroup() const;
   GeometricPrimitive3D& AsPrimitive();
   Meshing::TriMesh& AsTriangleMesh();
   Meshing::PointCloud3D& AsPointCloud();
   Meshing::VolumeGrid& AsImplicitSurface();
+  NarrowBandVolumeGrid& AsSparseImplicitSurface();
   vector<AnyGeometry3D>& AsGroup();
   GLDraw::GeometryAppearance* TriangleMeshAppearanceData();
   const GLDraw::GeometryAppearance* TriangleMeshAppearanceData() const;
@@ -103,6 +107,7 @@ class AnyCollisionGeometry3D : public AnyGeometry3D
   AnyCollisionGeometry3D(const Meshing::TriMesh& mesh);
   AnyCollisionGeometry3D(const Meshing::PointCloud3D& pc);
   AnyCollisionGeometry3D(const Meshing::VolumeGrid& grid);
+  AnyCollisionGeometry3D(const NarrowBandVolumeGrid& grid);
   AnyCollisionGeometry3D(const AnyGeometry3D& geom);
   AnyCollisionGeometry3D(const vector<AnyGeometry3D>& group);
   AnyCollisionGeometry3D(const AnyCollisionGeometry3D& geom);
@@ -124,11 +129,13 @@ class AnyCollisionGeometry3D : public AnyGeometry3D
   const CollisionMesh& TriangleMeshCollisionData() const;
   const CollisionPointCloud& PointCloudCollisionData() const;
   const CollisionImplicitSurface& ImplicitSurfaceCollisionData() const;
+  const CollisionSparseImplicitSurface& SparseImplicitSurfaceCollisionData() const;
   const vector<AnyCollisionGeometry3D>& GroupCollisionData() const;
   RigidTransform& PrimitiveCollisionData();
   CollisionMesh& TriangleMeshCollisionData();
   CollisionPointCloud& PointCloudCollisionData();
   CollisionImplicitSurface& ImplicitSurfaceCollisionData();
+  CollisionSparseImplicitSurface& SparseImplicitSurfaceCollisionData();
   vector<AnyCollisionGeometry3D>& GroupCollisionData();
   ///Performs a type conversion, also copying the active transform.  May be a bit faster than
   ///AnyGeometry3D.Convert for some conversions (TriangleMesh->VolumeGrid, specifically)
@@ -171,6 +178,7 @@ class AnyCollisionGeometry3D : public AnyGeometry3D
    * - PointCloud: CollisionPointCloud
    * - VolumeGrid: CollisionImplicitSurface
    * - Group: vector<AnyCollisionGeometry3D>
+   * - NarrowBandVolumeGrid: CollisionSparseImplicitSurface
    */
   AnyValue collisionData;
   ///Amount by which the underlying geometry is "fattened"
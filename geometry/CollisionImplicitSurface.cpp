@@ -193,10 +193,79 @@ Real Distance(const CollisionImplicitSurface& grid,const GeometricPrimitive3D& a
   }
 }
 
+//number of points sampled together by the batch sampler
+static const int kBatchLanes = 8;
+
+//Evaluates Distance() for up to kBatchLanes points, given in the frame
+//(R,t) relative to the surface.  Equivalent to VolumeGrid::TrilinearInterpolate
+//plus the distance to the grid's box, but with each stage done across all
+//lanes so that the compiler can vectorize everything except the gathers.
+static void SampleBatch(const Meshing::VolumeGrid& grid,const Matrix3& R,const Vector3& t,const Vector3* pts,int n,Real* out)
+{
+  Real x[kBatchLanes],y[kBatchLanes],z[kBatchLanes];
+  Real fu[kBatchLanes],fv[kBatchLanes],fw[kBatchLanes],dbb[kBatchLanes];
+  int base[kBatchLanes],di[kBatchLanes],dj[kBatchLanes],dk[kBatchLanes];
+  for(int l=0;l<n;l++) {
+    x[l] = R(0,0)*pts[l].x + R(0,1)*pts[l].y + R(0,2)*pts[l].z + t.x;
+    y[l] = R(1,0)*pts[l].x + R(1,1)*pts[l].y + R(1,2)*pts[l].z + t.y;
+    z[l] = R(2,0)*pts[l].x + R(2,1)*pts[l].y + R(2,2)*pts[l].z + t.z;
+  }
+  const int m = grid.value.m, np = grid.value.n, p = grid.value.p;
+  const Vector3& bmin = grid.bb.bmin, &bmax = grid.bb.bmax;
+  const Real su = m/(bmax.x-bmin.x), sv = np/(bmax.y-bmin.y), sw = p/(bmax.z-bmin.z);
+  for(int l=0;l<n;l++) {
+    //distance to the box
+    Real ex = Max(Max(bmin.x-x[l],x[l]-bmax.x),0.0);
+    Real ey = Max(Max(bmin.y-y[l],y[l]-bmax.y),0.0);
+    Real ez = Max(Max(bmin.z-z[l],z[l]-bmax.z),0.0);
+    dbb[l] = Sqrt(ex*ex+ey*ey+ez*ez);
+    //continuous cell-center coordinates, clamped to the grid so that
+    //clamped stencils reproduce VolumeGrid's border behavior
+    Real u = Min(Max((x[l]-bmin.x)*su-0.5,0.0),Real(m-1));
+    Real v = Min(Max((y[l]-bmin.y)*sv-0.5,0.0),Real(np-1));
+    Real w = Min(Max((z[l]-bmin.z)*sw-0.5,0.0),Real(p-1));
+    int i = Min((int)u,Max(m-2,0));
+    int j = Min((int)v,Max(np-2,0));
+    int k = Min((int)w,Max(p-2,0));
+    fu[l] = Min(u-i,1.0);
+    fv[l] = Min(v-j,1.0);
+    fw[l] = Min(w-k,1.0);
+    base[l] = (i*np+j)*p+k;
+    di[l] = (m > 1 ? np*p : 0);
+    dj[l] = (np > 1 ? p : 0);
+    dk[l] = (p > 1 ? 1 : 0);
+  }
+  const Real* vals = grid.value.getData();
+  for(int l=0;l<n;l++) {
+    const Real* c = vals+base[l];
+    Real c000=c[0], c001=c[dk[l]], c010=c[dj[l]], c011=c[dj[l]+dk[l]];
+    c += di[l];
+    Real c100=c[0], c101=c[dk[l]], c110=c[dj[l]], c111=c[dj[l]+dk[l]];
+    Real w = fw[l], v = fv[l], u = fu[l];
+    Real v11 = c000 + w*(c001-c000);
+    Real v12 = c010 + w*(c011-c010);
+    Real v21 = c100 + w*(c101-c100);
+    Real v22 = c110 + w*(c111-c110);
+    Real w1 = v11 + v*(v12-v11);
+    Real w2 = v21 + v*(v22-v21);
+    out[l] = w1 + u*(w2-w1) + dbb[l];
+  }
+}
+
+void Distances(const CollisionImplicitSurface& s,const vector<Vector3>& points,const RigidTransform& T,vector<Real>& distances)
+{
+  RigidTransform Tlocal;
+  Tlocal.mulInverseA(s.currentTransform,T);
+  distances.resize(points.size());
+  for(size_t i=0;i<points.size();i+=kBatchLanes) {
+    int n = (int)Min(points.size()-i,(size_t)kBatchLanes);
+    SampleBatch(s.baseGrid,Tlocal.R,Tlocal.t,&points[i],n,&distances[i]);
+  }
+}
+
 bool Collides(const CollisionImplicitSurface& s,const CollisionPointCloud& pc,Real margin,vector<int>& collidingPoints,size_t maxContacts)
 {
   //first do a quick reject test
-  Timer timer;
   Box3D pcbb;
   GetBB(pc,pcbb);
   Box3D sbb;
@@ -206,7 +275,6 @@ bool Collides(const CollisionImplicitSurface& s,const CollisionPointCloud& pc,Re
   sbbexpanded.origin -= margin*(sbb.xbasis+sbb.ybasis+sbb.zbasis);
   //quick reject test
   if(!pcbb.intersectsApprox(sbbexpanded)) {
-    //LOG4CXX_INFO(KrisLibrary::logger(),"0 contacts (quick reject) time "<<timer.ElapsedTime());
     return false;
   }
   RigidTransform Tw_pc;
@@ -219,22 +287,21 @@ bool Collides(const CollisionImplicitSurface& s,const CollisionPointCloud& pc,Re
   vector<Vector3> apoints;
   vector<int> aids;
   pc.octree->BoxQuery(sbb_pc,apoints,aids);
-  RigidTransform Tident; Tident.setIdentity();
-  //test all points, linearly
-  for(size_t i=0;i<apoints.size();i++) {
-    Vector3 p_w = pc.currentTransform*apoints[i];
-    if(Distance(s,p_w) <= margin) {
-      collidingPoints.push_back(aids[i]);
-      if(collidingPoints.size() >= maxContacts) {
-        LOG4CXX_INFO(KrisLibrary::logger(),"PointCloud-ImplicitSurface "<<maxContacts<<" contacts time "<<timer.ElapsedTime());
-
-        //LOG4CXX_INFO(KrisLibrary::logger(),"Collision in time "<<timer.ElapsedTime());
-        return true;
+  //test the candidate points in batches, stopping after the batch that
+  //fills up maxContacts
+  RigidTransform Tlocal;
+  Tlocal.mulInverseA(s.currentTransform,pc.currentTransform);
+  Real d[kBatchLanes];
+  for(size_t i=0;i<apoints.size();i+=kBatchLanes) {
+    int n = (int)Min(apoints.size()-i,(size_t)kBatchLanes);
+    SampleBatch(s.baseGrid,Tlocal.R,Tlocal.t,&apoints[i],n,d);
+    for(int l=0;l<n;l++) {
+      if(d[l] <= margin) {
+        collidingPoints.push_back(aids[i+l]);
+        if(collidingPoints.size() >= maxContacts) return true;
       }
     }
   }
-  LOG4CXX_INFO(KrisLibrary::logger(),"PointCloud-ImplicitSurface "<<maxContacts<<" contacts time "<<timer.ElapsedTime());     
-  // LOG4CXX_INFO(KrisLibrary::logger(),"No collision in time "<<timer.ElapsedTime());
   return !collidingPoints.empty();
 
   /*
@@ -328,17 +395,12 @@ Real Distance(const CollisionImplicitSurface& s,const CollisionPointCloud& pc,in
   Real bruteForceDmin = upperBound;
   if(DEBUG_DISTANCE_CHECKING || pc.points.size() < BRUTE_FORCE_DISTANCE_CHECKING_NPOINTS) {
     bruteForceClosestPoint = -1;
-    for(size_t i=0;i<pc.points.size();i++) {
-      Vector3 ptlocal;
-      Tpc_s.mul(pc.points[i],ptlocal);
-      Vector3 pt_clamped;
-      Real sdf_value = s.baseGrid.TrilinearInterpolate(ptlocal);
-      if(sdf_value < bruteForceDmin) {
-        Real d_bb = s.baseGrid.bb.distance(ptlocal,pt_clamped);
-        if(sdf_value + d_bb < bruteForceDmin) {
-          bruteForceClosestPoint = (int)i;
-          bruteForceDmin = sdf_value + d_bb;
-        }
+    vector<Real> distances;
+    Distances(s,pc.points,pc.currentTransform,distances);
+    for(size_t i=0;i<distances.size();i++) {
+      if(distances[i] < bruteForceDmin) {
+        bruteForceClosestPoint = (int)i;
+        bruteForceDmin = distances[i];
       }
     }
     //printf("Naive distance checking result %g, %d, time %g\n",bruteForceDmin,bruteForceClosestPoint,timer.ElapsedTime());
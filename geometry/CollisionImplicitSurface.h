@@ -60,8 +60,15 @@ Real Distance(const CollisionImplicitSurface& s,const Vector3& pt,Vector3& surfa
 ///Only points and spheres are currently supported
 Real Distance(const CollisionImplicitSurface& s,const GeometricPrimitive3D& geom,Vector3& surfacePt,Vector3& geomPt,Vector3& direction);
 
+///Evaluates the distance at a batch of points given in the frame T (e.g., a point cloud's current transform),
+///with the same result as calling Distance(s,T*points[i]) for each point.  Points are processed in fixed-size
+///blocks whose transform, index computation, and interpolation are laid out lane-by-lane so that they vectorize.
+void Distances(const CollisionImplicitSurface& s,const std::vector<Vector3>& points,const RigidTransform& T,std::vector<Real>& distances);
+
 ///Returns true if the point cloud is within margin distance of the geometry represented by s. One or more colliding 
-///points can also be returned in collidingPoints.
+///points can also be returned in collidingPoints.  Candidate points are sampled in batches; with the default
+///maxContacts=1 this exits after the first colliding batch, and with maxContacts >= the number of points
+///(e.g., INT_MAX) all contacts are returned.
 bool Collides(const CollisionImplicitSurface& s,const CollisionPointCloud& pc,Real margin,std::vector<int>& collidingPoints,size_t maxContacts=1);
 
 ///Returns the distance and closest point to a CollisionPointCloud
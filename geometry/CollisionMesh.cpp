@@ -1758,6 +1758,99 @@ int RayCast(const CollisionMesh& mesh,const Ray3D& r,Vector3& pt)
   return callback.closestTri;
 }
 
+int ClosestPointLocal(const CollisionMesh& mesh,const Vector3& p,Vector3& cp)
+{
+  ClosestPointCallback cb;
+  cb.Execute(*mesh.pqpModel,p);
+  cp = cb.cp;
+  return cb.closestTri;
+}
+
+//signed solid angle of the triangle (a,b,c) as seen from the origin
+//(Van Oosterom and Strackee, 1983)
+inline Real SolidAngle(const Vector3& a,const Vector3& b,const Vector3& c)
+{
+  Real la=a.norm(),lb=b.norm(),lc=c.norm();
+  Real num = a.dot(cross(b,c));
+  Real den = la*lb*lc + a.dot(b)*lc + b.dot(c)*la + c.dot(a)*lb;
+  return Two*Atan2(num,den);
+}
+
+//accumulates area-weighted normals and centers, bottom up
+static void WindingNumberDipoles(const PQP_Model& m,int b,CollisionMeshWindingNumber& w,Real& area)
+{
+  if(m.b[b].Leaf()) {
+    int t = -m.b[b].first_child - 1;
+    Triangle3D tri;
+    Copy(m.tris[t].p1,tri.a);
+    Copy(m.tris[t].p2,tri.b);
+    Copy(m.tris[t].p3,tri.c);
+    w.normals[b] = Half*cross(tri.b-tri.a,tri.c-tri.a);
+    area = w.normals[b].norm();
+    w.centers[b] = (tri.a+tri.b+tri.c)*third;
+    w.radii[b] = Max(w.centers[b].distance(tri.a),w.centers[b].distance(tri.b),w.centers[b].distance(tri.c));
+  }
+  else {
+    int c1 = m.b[b].first_child;
+    int c2 = c1+1;
+    Real a1,a2;
+    WindingNumberDipoles(m,c1,w,a1);
+    WindingNumberDipoles(m,c2,w,a2);
+    area = a1+a2;
+    w.normals[b] = w.normals[c1]+w.normals[c2];
+    if(area > 0) w.centers[b] = (a1*w.centers[c1]+a2*w.centers[c2])/area;
+    else w.centers[b] = (w.centers[c1]+w.centers[c2])*Half;
+    w.radii[b] = Max(w.centers[b].distance(w.centers[c1])+w.radii[c1],
+                     w.centers[b].distance(w.centers[c2])+w.radii[c2]);
+  }
+}
+
+static Real WindingNumberRecurse(const PQP_Model& m,int b,const CollisionMeshWindingNumber& w,const Vector3& p)
+{
+  Vector3 d = w.centers[b]-p;
+  Real r = d.norm();
+  if(r > w.accuracy*w.radii[b]) 
+    return w.normals[b].dot(d)/(r*r*r);
+  if(m.b[b].Leaf()) {
+    int t = -m.b[b].first_child - 1;
+    Vector3 a,bv,c;
+    Copy(m.tris[t].p1,a);
+    Copy(m.tris[t].p2,bv);
+    Copy(m.tris[t].p3,c);
+    return SolidAngle(a-p,bv-p,c-p);
+  }
+  int c1 = m.b[b].first_child;
+  return WindingNumberRecurse(m,c1,w,p) + WindingNumberRecurse(m,c1+1,w,p);
+}
+
+CollisionMeshWindingNumber::CollisionMeshWindingNumber()
+  :mesh(NULL),accuracy(2)
+{}
+
+CollisionMeshWindingNumber::CollisionMeshWindingNumber(const CollisionMesh& _mesh)
+  :mesh(NULL),accuracy(2)
+{
+  Init(_mesh);
+}
+
+void CollisionMeshWindingNumber::Init(const CollisionMesh& _mesh)
+{
+  mesh = &_mesh;
+  const PQP_Model& m = *mesh->pqpModel;
+  normals.resize(m.num_bvs);
+  centers.resize(m.num_bvs);
+  radii.resize(m.num_bvs);
+  if(m.num_bvs == 0) return;
+  Real area;
+  WindingNumberDipoles(m,0,*this,area);
+}
+
+Real CollisionMeshWindingNumber::EvalLocal(const Vector3& p) const
+{
+  if(normals.empty()) return 0;
+  return WindingNumberRecurse(*mesh->pqpModel,0,*this,p)/(4*Pi);
+}
+
 int RayCastLocal(const CollisionMesh& mesh,const Ray3D& r,Vector3& pt)
 {
   RayCastCallback callback(*mesh.pqpModel,r);
@@ -124,6 +124,33 @@ class CollisionMeshQueryEnhanced : public CollisionMeshQuery
 
 
 
+/** @ingroup Geometry
+ * @brief Fast evaluation of the generalized winding number of a mesh.
+ *
+ * The winding number is 1 inside a closed, outward-oriented mesh and 0
+ * outside, and degrades gracefully for meshes with holes or
+ * self-intersections, so it is a robust inside/outside test.  The PQP
+ * hierarchy of the mesh is used, with a dipole approximation for bounds
+ * that are far from the query point (accuracy controls how far).
+ *
+ * Points are given in the local frame of the mesh.  After Init, EvalLocal
+ * may be called from several threads.
+ */
+class CollisionMeshWindingNumber
+{
+ public:
+  CollisionMeshWindingNumber();
+  CollisionMeshWindingNumber(const CollisionMesh& mesh);
+  void Init(const CollisionMesh& mesh);
+  Real EvalLocal(const Vector3& p) const;
+
+  const CollisionMesh* mesh;
+  Real accuracy;
+  ///For each PQP bound, the area-weighted normal, center, and radius
+  std::vector<Vector3> normals,centers;
+  std::vector<Real> radii;
+};
+
 /** @addtogroup Geometry */
 /**\@{*/
 
@@ -173,6 +200,9 @@ Real Distance(const CollisionMesh& m1,const CollisionMesh& m2,Real absErr,Real r
 ///Finds the closest point pt to p on m and returns the triangle index. cp is given in the mesh's local frame
 int ClosestPoint(const CollisionMesh& m,const Vector3& p,Vector3& cp);
 
+///Same as ClosestPoint, but p is given in the local frame of the mesh
+int ClosestPointLocal(const CollisionMesh& m,const Vector3& p,Vector3& cp);
+
 
 /// Convenience function to compute closest points between two meshes
 void ClosestPoints(const CollisionMesh& m1,const CollisionMesh& m2,Real absErr,Real relErr,Vector3& v1,Vector3& v2);
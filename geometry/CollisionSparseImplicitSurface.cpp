@@ -0,0 +1,353 @@
+#include "CollisionSparseImplicitSurface.h"
+#include "CollisionPointCloud.h"
+#include "CollisionMesh.h"
+#include <math3d/clip.h>
+#include <structs/Heap.h>
+#include <algorithm>
+
+using namespace std;
+
+namespace Geometry {
+
+CollisionSparseImplicitSurface::CollisionSparseImplicitSurface()
+{
+  currentTransform.setIdentity();
+}
+
+CollisionSparseImplicitSurface::CollisionSparseImplicitSurface(const NarrowBandVolumeGrid& _grid)
+  :grid(_grid)
+{
+  currentTransform.setIdentity();
+}
+
+//signed distance at a point in the local frame; outside of the grid's box the
+//distance to the box is added on
+inline Real DistanceLocal(const NarrowBandVolumeGrid& grid,const Vector3& ptlocal)
+{
+  return grid.TrilinearInterpolate(ptlocal) + grid.bb.distance(ptlocal);
+}
+
+Real Distance(const CollisionSparseImplicitSurface& s,const Vector3& pt)
+{
+  Vector3 ptlocal;
+  s.currentTransform.mulInverse(pt,ptlocal);
+  return DistanceLocal(s.grid,ptlocal);
+}
+
+Real Distance(const CollisionSparseImplicitSurface& s,const Vector3& pt,Vector3& surfacePt,Vector3& direction)
+{
+  Vector3 ptlocal;
+  s.currentTransform.mulInverse(pt,ptlocal);
+  Real sdf_value = s.grid.TrilinearInterpolate(ptlocal);
+  Vector3 pt_clamped;
+  Real d_bb = s.grid.bb.distance(ptlocal,pt_clamped);
+
+  s.grid.Gradient(pt_clamped,direction);
+  direction.inplaceNormalize();
+  surfacePt = pt_clamped - direction*sdf_value;
+  if(d_bb > 0) {
+    direction = surfacePt - ptlocal;
+    direction.inplaceNormalize();
+  }
+  else
+    direction.inplaceNegative();
+  surfacePt = s.currentTransform*surfacePt;
+  direction = s.currentTransform.R*direction;
+  return sdf_value + d_bb;
+}
+
+Real Distance(const CollisionSparseImplicitSurface& s,const GeometricPrimitive3D& a,Vector3& surfacePt,Vector3& geomPt,Vector3& direction)
+{
+  if(a.type == GeometricPrimitive3D::Point) {
+    const Vector3& pt = *AnyCast_Raw<Vector3>(&a.data);
+    geomPt = pt;
+    return Distance(s,pt,surfacePt,direction);
+  }
+  else if(a.type == GeometricPrimitive3D::Sphere) {
+    const Sphere3D* sphere=AnyCast_Raw<Sphere3D>(&a.data);
+    Real d = Distance(s,sphere->center,surfacePt,direction);
+    geomPt = sphere->center - Min(sphere->radius,Max(d,-sphere->radius))*direction;
+    return d - sphere->radius;
+  }
+  else {
+    FatalError("Can't collide a sparse implicit surface and a non-sphere primitive yet\n");
+    return 0;
+  }
+}
+
+//Bounds the distance from s to any point in the point cloud octree node
+//(whose box is given in the local frame of s).  Returns false if the node
+//is empty.
+static bool DistanceRange(const NarrowBandVolumeGrid& grid,const OctreeNode& n,const Matrix4& Mpc_s,AABB3D& bblocal,Real& dmin,Real& dmax)
+{
+  if(n.bb.bmin.x > n.bb.bmax.x) return false;
+  bblocal.setTransform(n.bb,Mpc_s);
+  Real d_bb = bblocal.distance(grid.bb);
+  Real vmin,vmax;
+  grid.ValueRange(bblocal,vmin,vmax);
+  dmin = vmin + d_bb;
+  if(grid.bb.contains(bblocal)) dmax = vmax;
+  else dmax = Inf;
+  return true;
+}
+
+static void GetAllPointIDs(const OctreePointSet& octree,int node,vector<int>& ids,size_t maxContacts)
+{
+  vector<int> stack(1,node),leafids;
+  while(!stack.empty() && ids.size() < maxContacts) {
+    const OctreeNode& n = octree.Node(stack.back());
+    int index = stack.back();
+    stack.pop_back();
+    if(octree.IsLeaf(n)) {
+      octree.GetPointIDs(index,leafids);
+      for(size_t i=0;i<leafids.size() && ids.size() < maxContacts;i++)
+        ids.push_back(leafids[i]);
+    }
+    else {
+      for(int c=0;c<8;c++)
+        stack.push_back(n.childIndices[c]);
+    }
+  }
+}
+
+bool Collides(const CollisionSparseImplicitSurface& s,const CollisionPointCloud& pc,Real margin,vector<int>& collidingPoints,size_t maxContacts)
+{
+  if(s.grid.IsEmpty() || pc.points.empty()) return false;
+  RigidTransform Tpc_s;
+  Tpc_s.mulInverseA(s.currentTransform,pc.currentTransform);
+  Matrix4 Mpc_s(Tpc_s);
+  AABB3D bblocal;
+  Real dmin,dmax;
+  vector<int> stack(1,0),pointids;
+  while(!stack.empty()) {
+    int index = stack.back();
+    stack.pop_back();
+    const OctreeNode& n = pc.octree->Node(index);
+    if(!DistanceRange(s.grid,n,Mpc_s,bblocal,dmin,dmax)) continue;
+    if(dmin > margin) continue;
+    if(dmax <= margin) {
+      //every point in the node collides
+      GetAllPointIDs(*pc.octree,index,collidingPoints,maxContacts);
+    }
+    else if(pc.octree->IsLeaf(n)) {
+      pc.octree->GetPointIDs(index,pointids);
+      for(size_t i=0;i<pointids.size();i++) {
+        Vector3 ptlocal;
+        Tpc_s.mul(pc.points[pointids[i]],ptlocal);
+        if(DistanceLocal(s.grid,ptlocal) <= margin) {
+          collidingPoints.push_back(pointids[i]);
+          if(collidingPoints.size() >= maxContacts) break;
+        }
+      }
+    }
+    else {
+      for(int c=0;c<8;c++)
+        stack.push_back(n.childIndices[c]);
+    }
+    if(collidingPoints.size() >= maxContacts) return true;
+  }
+  return !collidingPoints.empty();
+}
+
+//Splits the triangle abc (in the local frame of the grid) until it is pruned
+//by the grid's value range or a point within margin is found.  Pieces
+//smaller than minRadius are accepted if the field at their centroid is within
+//margin plus their radius.
+static bool TriangleWithin(const NarrowBandVolumeGrid& grid,const Vector3& a,const Vector3& b,const Vector3& c,Real margin,Real minRadius,Vector3& pt)
+{
+  AABB3D bb;
+  bb.setPoint(a);
+  bb.expand(b);
+  bb.expand(c);
+  Real vmin,vmax;
+  grid.ValueRange(bb,vmin,vmax);
+  if(vmin + bb.distance(grid.bb) > margin) return false;
+  Vector3 centroid = (a+b+c)/3.0;
+  Real d = DistanceLocal(grid,centroid);
+  Real r = Sqrt(Max(centroid.distanceSquared(a),Max(centroid.distanceSquared(b),centroid.distanceSquared(c))));
+  if(d <= margin || (r <= minRadius && d - r <= margin)) {
+    pt = centroid;
+    return true;
+  }
+  if(r <= minRadius) return false;
+  Vector3 ab=(a+b)*0.5,bc=(b+c)*0.5,ca=(c+a)*0.5;
+  return TriangleWithin(grid,a,ab,ca,margin,minRadius,pt) ||
+    TriangleWithin(grid,ab,b,bc,margin,minRadius,pt) ||
+    TriangleWithin(grid,ca,bc,c,margin,minRadius,pt) ||
+    TriangleWithin(grid,ab,bc,ca,margin,minRadius,pt);
+}
+
+bool Collides(const CollisionSparseImplicitSurface& s,const CollisionMesh& mesh,Real margin,vector<int>& collidingTris,vector<Vector3>& collidingPoints,size_t maxContacts)
+{
+  if(s.grid.IsEmpty() || mesh.tris.empty()) return false;
+  RigidTransform Tm_s;
+  Tm_s.mulInverseA(s.currentTransform,mesh.currentTransform);
+  Vector3 h = s.grid.GetCellSize();
+  Real minRadius = 0.25*Min(h.x,Min(h.y,h.z));
+  vector<Vector3> vlocal(mesh.verts.size());
+  for(size_t i=0;i<mesh.verts.size();i++)
+    Tm_s.mul(mesh.verts[i],vlocal[i]);
+  Vector3 pt;
+  for(size_t i=0;i<mesh.tris.size();i++) {
+    const IntTriple& t = mesh.tris[i];
+    if(TriangleWithin(s.grid,vlocal[t.a],vlocal[t.b],vlocal[t.c],margin,minRadius,pt)) {
+      collidingTris.push_back((int)i);
+      collidingPoints.push_back(s.currentTransform*pt);
+      if(collidingTris.size() >= maxContacts) return true;
+    }
+  }
+  return !collidingTris.empty();
+}
+
+Real Distance(const CollisionSparseImplicitSurface& s,const CollisionPointCloud& pc,int& closestPoint,Real upperBound)
+{
+  closestPoint = -1;
+  if(s.grid.IsEmpty() || pc.points.empty()) return upperBound;
+  RigidTransform Tpc_s;
+  Tpc_s.mulInverseA(s.currentTransform,pc.currentTransform);
+  Matrix4 Mpc_s(Tpc_s);
+  AABB3D bblocal;
+  Real dmin,dmax;
+  Real mindist = upperBound;
+  //Heap keeps the highest priority on top, so lower bounds are negated
+  Heap<int,Real> heap;
+  if(DistanceRange(s.grid,pc.octree->Node(0),Mpc_s,bblocal,dmin,dmax) && dmin < mindist)
+    heap.push(0,-dmin);
+  vector<int> pointids;
+  while(!heap.empty()) {
+    int index = heap.top();
+    Real lb = -heap.topPriority();
+    heap.pop();
+    if(lb >= mindist) break;
+    const OctreeNode& n = pc.octree->Node(index);
+    if(pc.octree->IsLeaf(n)) {
+      pc.octree->GetPointIDs(index,pointids);
+      for(size_t i=0;i<pointids.size();i++) {
+        Vector3 ptlocal;
+        Tpc_s.mul(pc.points[pointids[i]],ptlocal);
+        Real d = DistanceLocal(s.grid,ptlocal);
+        if(d < mindist) {
+          mindist = d;
+          closestPoint = pointids[i];
+        }
+      }
+    }
+    else {
+      for(int c=0;c<8;c++) {
+        if(DistanceRange(s.grid,pc.octree->Node(n.childIndices[c]),Mpc_s,bblocal,dmin,dmax) && dmin < mindist)
+          heap.push(n.childIndices[c],-dmin);
+      }
+    }
+  }
+  return mindist;
+}
+
+struct SparseRayCaster
+{
+  const NarrowBandVolumeGrid& grid;
+  const Ray3D& r;
+  Real margin;
+  Real dirnorm,minStep;
+
+  SparseRayCaster(const NarrowBandVolumeGrid& _grid,const Ray3D& _r,Real _margin)
+    :grid(_grid),r(_r),margin(_margin)
+  {
+    dirnorm = r.direction.norm();
+    Vector3 h = grid.GetCellSize();
+    minStep = 0.25*Min(h.x,h.y,h.z)/dirnorm;
+  }
+
+  Real Eval(Real t) const
+  {
+    Vector3 x;
+    r.eval(t,x);
+    return grid.TrilinearInterpolate(x)-margin;
+  }
+
+  //Sphere traces the segment [ta,tb] of a leaf.  Steps are the (conservative)
+  //field value, with a minimum step of a quarter cell, and the crossing is
+  //refined by bisection.
+  bool March(Real ta,Real tb,Real& thit) const
+  {
+    Real t = ta;
+    Real f = Eval(t);
+    if(f <= 0) { thit = t; return true; }
+    while(t < tb) {
+      Real tprev = t;
+      t = Min(t + Max(f/dirnorm,minStep),tb);
+      f = Eval(t);
+      if(f <= 0) {
+        Real lo = tprev, hi = t;
+        for(int iters=0;iters<20;iters++) {
+          Real mid = 0.5*(lo+hi);
+          if(Eval(mid) <= 0) hi = mid;
+          else lo = mid;
+        }
+        thit = hi;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  //Visits nodes front to back, skipping those whose range is above the margin
+  bool Cast(int index,const IntTriple& origin,int extent,Real tmin,Real tmax,Real& thit) const
+  {
+    const NarrowBandVolumeGrid::Node& n = grid.nodes[index];
+    if(n.brick == NarrowBandVolumeGrid::Empty) return false;
+    if(n.vmin > margin) return false;
+    AABB3D box;
+    grid.GetNodeBox(origin,extent,box);
+    box.setIntersection(grid.bb);
+    Real ta=tmin,tb=tmax;
+    if(!ClipLine(r.source,r.direction,box,ta,tb)) return false;
+    if(n.vmax <= margin) { thit = ta; return true; }
+    if(n.child < 0) return March(ta,tb,thit);
+    int half = extent/2;
+    Real tentry[8];
+    int order[8];
+    IntTriple corigin[8];
+    int num = 0;
+    for(int c=0;c<8;c++) {
+      corigin[c].set(origin.a+((c>>2)&1)*half,origin.b+((c>>1)&1)*half,origin.c+(c&1)*half);
+      AABB3D cbox;
+      grid.GetNodeBox(corigin[c],half,cbox);
+      cbox.setIntersection(grid.bb);
+      Real ca=ta,cb=tb;
+      if(!ClipLine(r.source,r.direction,cbox,ca,cb)) continue;
+      tentry[c] = ca;
+      order[num++] = c;
+    }
+    //insertion sort by entry parameter; children are disjoint so the first
+    //hit in this order is the closest
+    for(int i=1;i<num;i++)
+      for(int j=i;j>0 && tentry[order[j]] < tentry[order[j-1]];j--)
+        std::swap(order[j],order[j-1]);
+    for(int i=0;i<num;i++)
+      if(Cast(n.child+order[i],corigin[order[i]],half,ta,tb,thit)) return true;
+    return false;
+  }
+};
+
+bool RayCastLocal(const CollisionSparseImplicitSurface& s,const Ray3D& r,Real margin,Vector3& pt)
+{
+  if(s.grid.IsEmpty()) return false;
+  SparseRayCaster caster(s.grid,r,margin);
+  Real thit;
+  if(!caster.Cast(0,IntTriple(0,0,0),s.grid.rootExtent,0,Inf,thit)) return false;
+  r.eval(thit,pt);
+  return true;
+}
+
+bool RayCast(const CollisionSparseImplicitSurface& s,const Ray3D& r,Real margin,Vector3& pt)
+{
+  RigidTransform Tinv;
+  Tinv.setInverse(s.currentTransform);
+  Ray3D rlocal;
+  rlocal.setTransformed(r,Tinv);
+  if(!RayCastLocal(s,rlocal,margin,pt)) return false;
+  pt = s.currentTransform*pt;
+  return true;
+}
+
+} //namespace Geometry
@@ -0,0 +1,78 @@
+#ifndef COLLISION_SPARSE_IMPLICIT_SURFACE_H
+#define COLLISION_SPARSE_IMPLICIT_SURFACE_H
+
+#include "NarrowBandVolumeGrid.h"
+#include <KrisLibrary/math3d/geometry3d.h>
+
+namespace Geometry {
+
+  class CollisionPointCloud;
+  class CollisionMesh;
+
+  using namespace Math3D;
+
+/** @brief A narrow-band signed distance field with a transform, used for
+ * collision detection.
+ *
+ * The octree of the NarrowBandVolumeGrid doubles as the bounding volume
+ * hierarchy: each node's value range bounds the field inside it, so
+ * queries skip whole nodes that are farther than the query margin (or are
+ * entirely inside).  Queries are exact for margins smaller than the grid's
+ * bandWidth.
+ */
+class CollisionSparseImplicitSurface
+{
+ public:
+  CollisionSparseImplicitSurface();
+  CollisionSparseImplicitSurface(const NarrowBandVolumeGrid& grid);
+
+  ///The underlying sparse signed distance field
+  NarrowBandVolumeGrid grid;
+  ///The transformation of the implicit surface in space
+  RigidTransform currentTransform;
+};
+
+///Returns the signed distance between s and pt.  Negative values indicate
+///interior points.  Input is in world coordinates.
+Real Distance(const CollisionSparseImplicitSurface& s,const Vector3& pt);
+
+///Returns the signed distance between s and pt, as well as the closest point
+///on the surface and the unit direction of decreasing distance (same
+///conventions as the CollisionImplicitSurface version).  Inputs and outputs
+///are all in world coordinates.
+Real Distance(const CollisionSparseImplicitSurface& s,const Vector3& pt,Vector3& surfacePt,Vector3& direction);
+
+///Same as above, for points and spheres
+Real Distance(const CollisionSparseImplicitSurface& s,const GeometricPrimitive3D& geom,Vector3& surfacePt,Vector3& geomPt,Vector3& direction);
+
+///Returns true if the point cloud is within margin distance of s.  Point
+///cloud octree nodes are pruned (or accepted wholesale) using the value range
+///of the surface's octree.  Colliding points are returned in collidingPoints.
+bool Collides(const CollisionSparseImplicitSurface& s,const CollisionPointCloud& pc,Real margin,std::vector<int>& collidingPoints,size_t maxContacts=1);
+
+///Returns the distance and closest point to a CollisionPointCloud, using a
+///best-first traversal of the point cloud octree
+Real Distance(const CollisionSparseImplicitSurface& s,const CollisionPointCloud& pc,int& closestPoint,Real upperBound=Inf);
+
+///Returns true if the triangle mesh is within margin distance of s.
+///Triangles are pruned using the value range of the surface's octree, and
+///the rest are split until a point within margin is found or they are
+///smaller than a quarter of a cell.  Those small pieces are accepted if the
+///field at their centroid is within margin plus their radius, so contacts
+///are conservative to within a quarter of a cell.  Colliding triangles are
+///returned in collidingTris, and a point of each (in world coordinates) in
+///collidingPoints.
+bool Collides(const CollisionSparseImplicitSurface& s,const CollisionMesh& mesh,Real margin,std::vector<int>& collidingTris,std::vector<Vector3>& collidingPoints,size_t maxContacts=1);
+
+///Casts a ray at the surface inflated by margin.  Octree nodes whose range
+///is above margin are skipped, and the remaining leaves are sphere traced.
+///Returns true if the ray hits, and the hit point in pt.  In world
+///coordinates.
+bool RayCast(const CollisionSparseImplicitSurface& s,const Ray3D& r,Real margin,Vector3& pt);
+
+///Same as RayCast, but the ray (and hit point) are in the local frame
+bool RayCastLocal(const CollisionSparseImplicitSurface& s,const Ray3D& r,Real margin,Vector3& pt);
+
+} //namespace Geometry
+
+#endif
@@ -10,6 +10,7 @@
 #include <KrisLibrary/math3d/random.h>
 #include <KrisLibrary/math3d/basis.h>
 #include <KrisLibrary/Timer.h>
+#include <KrisLibrary/utils/threadutils.h>
 
 namespace Geometry {
 	
@@ -448,6 +449,215 @@ void MeshToImplicitSurface_SpaceCarving(const CollisionMesh& mesh,Meshing::Volum
 	LOG4CXX_INFO(KrisLibrary::logger(),"Volume grid has "<<inside<<" / "<<grid.value.m*grid.value.n*grid.value.p);
 }
 
+//Solves the Godunov discretization of |grad u| = 1 given the smallest
+//neighbor value a[d] and the spacing h[d] on each axis.
+static Real EikonalUpdate(Real a[3],Real h[3])
+{
+	//sort by neighbor value
+	for(int i=0;i<2;i++)
+		for(int j=0;j+1<3-i;j++)
+			if(a[j+1] < a[j]) { std::swap(a[j],a[j+1]); std::swap(h[j],h[j+1]); }
+	Real u = a[0]+h[0];
+	if(u <= a[1]) return u;
+	Real A=0,B=0,C=-1;
+	for(int d=0;d<3;d++) {
+		Real w = 1.0/Sqr(h[d]);
+		A += w;
+		B -= 2.0*a[d]*w;
+		C += Sqr(a[d])*w;
+		Real disc = B*B-4.0*A*C;
+		if(disc < 0) return u;
+		u = (-B+Sqrt(disc))/(2.0*A);
+		if(d == 2 || u <= a[d+1]) return u;
+	}
+	return u;
+}
+
+struct FastSweepingSlab
+{
+	//inputs
+	const CollisionMesh* mesh;
+	const CollisionMeshWindingNumber* winding;
+	const Meshing::VolumeGrid* grid;
+	Real bandWidth;
+	int i0,i1;
+	//shared output arrays, only written in planes [i0,i1)
+	Real* dist;
+	signed char* sign;
+	char* fixed;
+	//values of the planes i0-1 and i1 at the start of a sweeping pass
+	std::vector<Real> ghostDist[2];
+	std::vector<signed char> ghostSign[2];
+	bool changed;
+};
+
+//marks the cells in the slab near the mesh surface and computes their exact
+//signed distance
+static void* FastSweepingInitThread(void* vdata)
+{
+	FastSweepingSlab* s = reinterpret_cast<FastSweepingSlab*>(vdata);
+	const Meshing::VolumeGrid& grid = *s->grid;
+	int m=grid.value.m,n=grid.value.n,p=grid.value.p;
+	Vector3 h = grid.GetCellSize();
+	Real band = s->bandWidth*Max(h.x,h.y,h.z);
+	Triangle3D tri;
+	AABB3D tribb;
+	for(size_t t=0;t<s->mesh->tris.size();t++) {
+		s->mesh->GetTriangle(t,tri);
+		tribb.setPoint(tri.a);
+		tribb.expand(tri.b);
+		tribb.expand(tri.c);
+		//range of cell centers within the expanded box
+		int lo[3],hi[3];
+		int dims[3]={m,n,p};
+		for(int d=0;d<3;d++) {
+			lo[d] = (int)Ceil((tribb.bmin[d]-band-grid.bb.bmin[d])/h[d]-0.5);
+			hi[d] = (int)Floor((tribb.bmax[d]+band-grid.bb.bmin[d])/h[d]-0.5);
+			if(lo[d] < 0) lo[d] = 0;
+			if(hi[d] >= dims[d]) hi[d] = dims[d]-1;
+		}
+		if(lo[0] < s->i0) lo[0] = s->i0;
+		if(hi[0] >= s->i1) hi[0] = s->i1-1;
+		for(int i=lo[0];i<=hi[0];i++)
+			for(int j=lo[1];j<=hi[1];j++)
+				for(int k=lo[2];k<=hi[2];k++)
+					s->fixed[(i*n+j)*p+k] = 1;
+	}
+	Vector3 c,cp;
+	for(int i=s->i0;i<s->i1;i++)
+		for(int j=0;j<n;j++)
+			for(int k=0;k<p;k++) {
+				int index = (i*n+j)*p+k;
+				if(!s->fixed[index]) continue;
+				grid.GetCellCenter(i,j,k,c);
+				ClosestPointLocal(*s->mesh,c,cp);
+				s->dist[index] = c.distance(cp);
+				s->sign[index] = (s->winding->EvalLocal(c) > 0.5 ? -1 : 1);
+			}
+	return NULL;
+}
+
+//runs the 8 Gauss-Seidel sweeps over the slab.  Values outside of the slab
+//are read from the ghost planes
+static void* FastSweepingThread(void* vdata)
+{
+	FastSweepingSlab* s = reinterpret_cast<FastSweepingSlab*>(vdata);
+	const Meshing::VolumeGrid& grid = *s->grid;
+	int m=grid.value.m,n=grid.value.n,p=grid.value.p;
+	Vector3 hv = grid.GetCellSize();
+	Real tol = 1e-9*Min(hv.x,hv.y,hv.z);
+	s->changed = false;
+	for(int dir=0;dir<8;dir++) {
+		int di = (dir&1 ? -1 : 1), dj = (dir&2 ? -1 : 1), dk = (dir&4 ? -1 : 1);
+		int istart = (di>0 ? s->i0 : s->i1-1);
+		for(int i=istart;i>=s->i0 && i<s->i1;i+=di)
+			for(int j=(dj>0?0:n-1);j>=0 && j<n;j+=dj)
+				for(int k=(dk>0?0:p-1);k>=0 && k<p;k+=dk) {
+					int index = (i*n+j)*p+k;
+					if(s->fixed[index]) continue;
+					Real a[3],h[3]={hv.x,hv.y,hv.z};
+					Real amin = Inf;
+					signed char asign = 0;
+					int plane = j*p+k;
+					//x neighbors
+					a[0] = Inf;
+					if(i > 0) {
+						Real v; signed char sg;
+						if(i-1 < s->i0) { v = s->ghostDist[0][plane]; sg = s->ghostSign[0][plane]; }
+						else { v = s->dist[index-n*p]; sg = s->sign[index-n*p]; }
+						if(v < a[0]) { a[0] = v; if(v < amin) { amin = v; asign = sg; } }
+					}
+					if(i+1 < m) {
+						Real v; signed char sg;
+						if(i+1 >= s->i1) { v = s->ghostDist[1][plane]; sg = s->ghostSign[1][plane]; }
+						else { v = s->dist[index+n*p]; sg = s->sign[index+n*p]; }
+						if(v < a[0]) { a[0] = v; if(v < amin) { amin = v; asign = sg; } }
+					}
+					//y and z neighbors
+					int strides[2] = {p,1};
+					int coords[2] = {j,k};
+					int dims[2] = {n,p};
+					for(int d=0;d<2;d++) {
+						a[d+1] = Inf;
+						if(coords[d] > 0) {
+							Real v = s->dist[index-strides[d]];
+							if(v < a[d+1]) { a[d+1] = v; if(v < amin) { amin = v; asign = s->sign[index-strides[d]]; } }
+						}
+						if(coords[d]+1 < dims[d]) {
+							Real v = s->dist[index+strides[d]];
+							if(v < a[d+1]) { a[d+1] = v; if(v < amin) { amin = v; asign = s->sign[index+strides[d]]; } }
+						}
+					}
+					if(IsInf(amin)) continue;
+					Real u = EikonalUpdate(a,h);
+					if(u < s->dist[index]-tol) {
+						s->dist[index] = u;
+						s->sign[index] = asign;
+						s->changed = true;
+					}
+				}
+	}
+	return NULL;
+}
+
+void MeshToImplicitSurface_FastSweeping(const CollisionMesh& mesh,Meshing::VolumeGrid& grid,Real resolution,Real bandWidth,int numThreads)
+{
+	if(mesh.tris.empty()) {
+		//no surface to measure the distance to
+		grid.bb.bmin.setZero();
+		grid.bb.bmax.setZero();
+		grid.Resize(0,0,0);
+		return;
+	}
+	AABB3D aabb;
+	mesh.GetAABB(aabb.bmin,aabb.bmax);
+	FitGridToBB(aabb,grid,resolution);
+	int m=grid.value.m,n=grid.value.n,p=grid.value.p;
+	std::vector<Real> dist(m*n*p,Inf);
+	std::vector<signed char> sign(m*n*p,1);
+	std::vector<char> fixed(m*n*p,0);
+	CollisionMeshWindingNumber winding(mesh);
+
+	int numSlabs = Min(ThreadCount(numThreads),m);
+	std::vector<FastSweepingSlab> slabs(numSlabs);
+	for(int i=0;i<numSlabs;i++) {
+		slabs[i].mesh = &mesh;
+		slabs[i].winding = &winding;
+		slabs[i].grid = &grid;
+		slabs[i].bandWidth = bandWidth;
+		slabs[i].i0 = (i*m)/numSlabs;
+		slabs[i].i1 = ((i+1)*m)/numSlabs;
+		slabs[i].dist = &dist[0];
+		slabs[i].sign = &sign[0];
+		slabs[i].fixed = &fixed[0];
+	}
+	ThreadRunAll(FastSweepingInitThread,slabs);
+
+	//sweep until no slab changes.  Information crosses slab boundaries
+	//through the ghost planes, which are refreshed between passes
+	int np = n*p;
+	while(true) {
+		for(int i=0;i<numSlabs;i++) {
+			FastSweepingSlab& s = slabs[i];
+			for(int g=0;g<2;g++) {
+				int plane = (g==0 ? s.i0-1 : s.i1);
+				if(plane < 0 || plane >= m) continue;
+				s.ghostDist[g].assign(dist.begin()+plane*np,dist.begin()+(plane+1)*np);
+				s.ghostSign[g].assign(sign.begin()+plane*np,sign.begin()+(plane+1)*np);
+			}
+		}
+		ThreadRunAll(FastSweepingThread,slabs);
+		bool changed = false;
+		for(int i=0;i<numSlabs;i++)
+			if(slabs[i].changed) changed = true;
+		if(!changed) break;
+	}
+
+	Real* v = &grid.value(0,0,0);
+	for(int i=0;i<m*n*p;i++)
+		v[i] = sign[i]*dist[i];
+}
+
 void ImplicitSurfaceToMesh(const Meshing::VolumeGrid& grid,Meshing::TriMesh& mesh)
 {
 	AABB3D center_bb = grid.bb;
@@ -65,6 +65,20 @@ void MeshToImplicitSurface_FMM(const CollisionMesh& mesh,Meshing::VolumeGrid& gr
  */
 void MeshToImplicitSurface_SpaceCarving(const CollisionMesh& mesh,Meshing::VolumeGrid& grid,Real resolution,int numViews=20);
 
+/** @ingroup Geometry
+ * @brief Creates a signed distance field for a mesh.  Distances of cells within
+ * bandWidth cells of the surface are computed exactly using the PQP hierarchy, and
+ * the rest of the grid is filled in with the fast sweeping method.  Inside/outside
+ * is determined by the generalized winding number, so the mesh need not be closed.
+ *
+ * The grid is split into slabs that are processed by numThreads threads (<= 0 uses
+ * the hardware concurrency).  A mesh without triangles gives an empty grid.
+ *
+ * Note: the mesh's current transform is NOT taken into account (i.e., the resulting grid
+ * is in local coordinates)
+ */
+void MeshToImplicitSurface_FastSweeping(const CollisionMesh& mesh,Meshing::VolumeGrid& grid,Real resolution,Real bandWidth=2,int numThreads=0);
+
 /** @ingroup Geometry
  * @brief Creates a mesh from an implicit surface via Marching Cubes.  This assumes
  * the values of the grid are defined at the cell centers, unlike the methods in
@@ -7,7 +7,9 @@
 #include <math3d/Plane3D.h>
 #include <math/matrix.h>
 #include <math/vector.h>
+#include <math/infnan.h>
 #include <math/SVDecomposition.h>
+#include <math/BatchedDecomposition.h>
 using namespace Math;
 using namespace std;
 
@@ -178,6 +180,53 @@ bool FitPlane(const vector<Vector3>& pts,Plane3D& p)
   return true;
 }
 
+int FitPlanes(const vector<vector<Vector3> >& pts,vector<Plane3D>& planes,vector<int>& valid)
+{
+  //the normal is the eigenvector of the covariance with the smallest
+  //eigenvalue, i.e., the last right singular vector in FitPlane
+  int size = (int)pts.size();
+  BatchedMatrixTemplate<Real> C(size,3,3);
+  vector<Vector3> means(size);
+  Matrix3 Ci;
+  valid.resize(size);
+  for(int k=0;k<size;k++) {
+    valid[k] = !pts[k].empty();
+    if(valid[k]) {
+      means[k] = GetMean(pts[k]);
+      GetCovariance(pts[k],Ci);
+    }
+    else {
+      means[k].setZero();
+      Ci.setZero();
+    }
+    for(int i=0;i<3;i++)
+      for(int j=0;j<3;j++)
+        C(k,i,j) = Ci(i,j);
+  }
+  BatchedSymmetricEigenDecomposition<Real> eig;
+  eig.set(C);
+  planes.resize(size);
+  int numValid = 0;
+  for(int k=0;k<size;k++) {
+    Plane3D& p = planes[k];
+    int imin = eig.minEigenvalueIndex(k);
+    p.normal.set(eig.V(k,0,imin),eig.V(k,1,imin),eig.V(k,2,imin));
+    Real len = p.normal.norm();
+    if(valid[k] && len > 0 && IsFinite(len)) {
+      p.normal /= len;
+      p.offset = dot(p.normal,means[k]);
+      valid[k] = IsFinite(p.offset);
+    }
+    else valid[k] = 0;
+    if(valid[k]) numValid++;
+    else {
+      p.normal.setZero();
+      p.offset = 0;
+    }
+  }
+  return numValid;
+}
+
 //circle equation |(x,y)-(a,b)|^2 = c^2
 //f(a,b,c) = x^2+y^2-2ax-2yb+a^2+b^2-c^2 = 0
 //let u=-2a, v=-2b, w = a^2+b^2-c^2
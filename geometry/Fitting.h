@@ -28,6 +28,11 @@ bool FitGaussian(const std::vector<Vector3>& pts,Vector3& center,Matrix3& R,Vect
 bool FitLine(const std::vector<Vector2>& pts,Line2D& l);
 bool FitLine(const std::vector<Vector3>& pts,Line3D& l);
 bool FitPlane(const std::vector<Vector3>& pts,Plane3D& p);
+///Fits a plane to each point set, solving all of the small eigenproblems
+///in one batch.  Faster than calling FitPlane for many small sets.
+///Returns the number of planes that were fit.  Empty or non-finite point
+///sets have valid[k] = 0 and a zero plane.
+int FitPlanes(const std::vector<std::vector<Vector3> >& pts,std::vector<Plane3D>& planes,std::vector<int>& valid);
 
 bool FitCircle(const std::vector<Vector2>& pts,Circle2D& c);
 //bool FitEllipse(const std::vector<Vector2>& pts,Ellipse2D& c);
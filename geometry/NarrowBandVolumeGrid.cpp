@@ -0,0 +1,403 @@
+#include "NarrowBandVolumeGrid.h"
+#include <KrisLibrary/errors.h>
+#include <iostream>
+
+using namespace std;
+using namespace Geometry;
+
+inline IntTriple ChildOrigin(const IntTriple& origin,int half,int c)
+{
+  return IntTriple(origin.a+((c>>2)&1)*half,origin.b+((c>>1)&1)*half,origin.c+(c&1)*half);
+}
+
+inline int ClampIndex(int i,int n) { return (i < 0 ? 0 : (i >= n ? n-1 : i)); }
+
+NarrowBandVolumeGrid::NarrowBandVolumeGrid()
+  :size(0,0,0),brickSize(8),rootExtent(0),bandWidth(0)
+{}
+
+void NarrowBandVolumeGrid::Build(const Meshing::VolumeGrid& grid,Real _bandWidth,int _brickSize)
+{
+  Assert(_brickSize > 0);
+  bb = grid.bb;
+  size = grid.value.size();
+  brickSize = _brickSize;
+  bandWidth = _bandWidth;
+  nodes.resize(0);
+  brickValues.resize(0);
+  if(size.a == 0 || size.b == 0 || size.c == 0) {
+    rootExtent = 0;
+    return;
+  }
+  rootExtent = brickSize;
+  while(rootExtent < size.a || rootExtent < size.b || rootExtent < size.c)
+    rootExtent *= 2;
+  nodes.resize(1);
+  //the structure and stored values are determined first, then the ranges
+  //are computed from the stored values so that they bound the interpolant
+  //exactly as it is evaluated
+  BuildNode(0,IntTriple(0,0,0),rootExtent,grid);
+  ComputeRanges(0,IntTriple(0,0,0),rootExtent);
+}
+
+void NarrowBandVolumeGrid::ComputeRanges(int index,const IntTriple& o,int ext)
+{
+  if(nodes[index].brick == Empty) return;
+  Real vmin = Inf, vmax = -Inf;
+  if(nodes[index].child >= 0) {
+    int first = nodes[index].child;
+    for(int c=0;c<8;c++) {
+      ComputeRanges(first+c,ChildOrigin(o,ext/2,c),ext/2);
+      const Node& nc = nodes[first+c];
+      if(nc.brick == Empty) continue;
+      vmin = Min(vmin,(Real)nc.vmin);
+      vmax = Max(vmax,(Real)nc.vmax);
+    }
+  }
+  else {
+    const Node& n = nodes[index];
+    IntTriple lo(Max(o.a-1,0),Max(o.b-1,0),Max(o.c-1,0));
+    IntTriple hi(Min(o.a+ext,size.a-1),Min(o.b+ext,size.b-1),Min(o.c+ext,size.c-1));
+    bool uniform = (n.brick == Uniform);
+    if(uniform) vmin = vmax = n.value;
+    for(int i=lo.a;i<=hi.a;i++)
+      for(int j=lo.b;j<=hi.b;j++)
+        for(int k=lo.c;k<=hi.c;k++) {
+          //cells of a uniform leaf all have its value, so only the one-cell
+          //shell around it needs to be visited
+          if(uniform && i>=o.a && i<o.a+ext && j>=o.b && j<o.b+ext && k>=o.c && k<o.c+ext) {
+            k = o.c+ext-1;
+            continue;
+          }
+          Real val = GetValue(i,j,k);
+          if(val < vmin) vmin = val;
+          if(val > vmax) vmax = val;
+        }
+  }
+  nodes[index].vmin = (float)vmin;
+  nodes[index].vmax = (float)vmax;
+}
+
+void NarrowBandVolumeGrid::BuildNode(int index,const IntTriple& origin,int extent,const Meshing::VolumeGrid& grid)
+{
+  nodes[index].vmin = nodes[index].vmax = nodes[index].value = 0;
+  nodes[index].child = -1;
+  nodes[index].brick = Empty;
+  if(origin.a >= size.a || origin.b >= size.b || origin.c >= size.c) return;
+  if(extent == brickSize) {
+    IntTriple hi(Min(origin.a+extent,size.a),Min(origin.b+extent,size.b),Min(origin.c+extent,size.c));
+    Real vmin = Inf, vmax = -Inf;
+    bool inBand = false;
+    for(int i=origin.a;i<hi.a;i++)
+      for(int j=origin.b;j<hi.b;j++)
+        for(int k=origin.c;k<hi.c;k++) {
+          Real v = grid.value(i,j,k);
+          if(Abs(v) < bandWidth) inBand = true;
+          if(v < vmin) vmin = v;
+          if(v > vmax) vmax = v;
+        }
+    if(inBand || (vmin < 0 && vmax > 0)) {
+      nodes[index].brick = (int)NumBricks();
+      size_t base = brickValues.size();
+      brickValues.resize(base+brickSize*brickSize*brickSize);
+      float* v = &brickValues[base];
+      for(int i=0;i<brickSize;i++)
+        for(int j=0;j<brickSize;j++)
+          for(int k=0;k<brickSize;k++,v++)
+            *v = (float)grid.value(ClampIndex(origin.a+i,size.a),ClampIndex(origin.b+j,size.b),ClampIndex(origin.c+k,size.c));
+    }
+    else {
+      nodes[index].brick = Uniform;
+      nodes[index].value = (float)(vmin >= 0 ? vmin : vmax);
+    }
+    return;
+  }
+  int first = (int)nodes.size();
+  nodes.resize(first+8);
+  nodes[index].child = first;
+  nodes[index].brick = Uniform;
+  int half = extent/2;
+  for(int c=0;c<8;c++)
+    BuildNode(first+c,ChildOrigin(origin,half,c),half,grid);
+  //collapse children that are uniform and of the same sign
+  bool anyInside = false, anyOutside = false;
+  Real outsideValue = Inf, insideValue = -Inf;
+  for(int c=0;c<8;c++) {
+    const Node& n = nodes[first+c];
+    if(n.brick == Empty) continue;
+    if(n.child >= 0 || n.brick != Uniform) return;
+    if(n.value >= 0) { anyOutside = true; outsideValue = Min(outsideValue,(Real)n.value); }
+    else { anyInside = true; insideValue = Max(insideValue,(Real)n.value); }
+  }
+  if(anyInside && anyOutside) return;
+  //the first child shares this node's origin, so it's never empty
+  Assert(anyInside || anyOutside);
+  //children are leaves, so they're at the end of the array
+  Assert((int)nodes.size() == first+8);
+  nodes.resize(first);
+  nodes[index].child = -1;
+  nodes[index].brick = Uniform;
+  nodes[index].value = (float)(anyOutside ? outsideValue : insideValue);
+}
+
+void NarrowBandVolumeGrid::GetDense(Meshing::VolumeGrid& grid) const
+{
+  grid.bb = bb;
+  grid.value.resize(size.a,size.b,size.c);
+  for(int i=0;i<size.a;i++)
+    for(int j=0;j<size.b;j++)
+      for(int k=0;k<size.c;k++)
+        grid.value(i,j,k) = GetValue(i,j,k);
+}
+
+Vector3 NarrowBandVolumeGrid::GetCellSize() const
+{
+  Vector3 h=bb.bmax-bb.bmin;
+  h.x /= Real(size.a);
+  h.y /= Real(size.b);
+  h.z /= Real(size.c);
+  return h;
+}
+
+void NarrowBandVolumeGrid::GetIndex(const Vector3& pt,IntTriple& index) const
+{
+  index.a = (int)Floor((pt.x - bb.bmin.x)/(bb.bmax.x-bb.bmin.x)*size.a);
+  index.b = (int)Floor((pt.y - bb.bmin.y)/(bb.bmax.y-bb.bmin.y)*size.b);
+  index.c = (int)Floor((pt.z - bb.bmin.z)/(bb.bmax.z-bb.bmin.z)*size.c);
+}
+
+void NarrowBandVolumeGrid::GetCell(const IntTriple& index,AABB3D& cell) const
+{
+  GetNodeBox(index,1,cell);
+}
+
+void NarrowBandVolumeGrid::GetNodeBox(const IntTriple& origin,int extent,AABB3D& box) const
+{
+  Vector3 h = GetCellSize();
+  box.bmin.x = bb.bmin.x + origin.a*h.x;
+  box.bmin.y = bb.bmin.y + origin.b*h.y;
+  box.bmin.z = bb.bmin.z + origin.c*h.z;
+  box.bmax.x = box.bmin.x + extent*h.x;
+  box.bmax.y = box.bmin.y + extent*h.y;
+  box.bmax.z = box.bmin.z + extent*h.z;
+}
+
+int NarrowBandVolumeGrid::GetLeaf(const IntTriple& index,IntTriple& origin,int& extent) const
+{
+  int n = 0;
+  origin.set(0,0,0);
+  extent = rootExtent;
+  while(nodes[n].child >= 0) {
+    extent /= 2;
+    int c = 0;
+    if(index.a >= origin.a+extent) { origin.a += extent; c |= 4; }
+    if(index.b >= origin.b+extent) { origin.b += extent; c |= 2; }
+    if(index.c >= origin.c+extent) { origin.c += extent; c |= 1; }
+    n = nodes[n].child+c;
+  }
+  return n;
+}
+
+Real NarrowBandVolumeGrid::GetValue(int i,int j,int k) const
+{
+  Assert(!nodes.empty());
+  IntTriple index(ClampIndex(i,size.a),ClampIndex(j,size.b),ClampIndex(k,size.c));
+  IntTriple o;
+  int ext;
+  const Node& n = nodes[GetLeaf(index,o,ext)];
+  if(n.brick < 0) return n.value;
+  return brickValues[((size_t(n.brick)*brickSize + index.a-o.a)*brickSize + index.b-o.b)*brickSize + index.c-o.c];
+}
+
+//Gets the 8 cell values of the trilinear interpolation stencil.  Usually
+//the whole stencil is in one leaf, which takes a single octree descent.
+static void GetStencil(const NarrowBandVolumeGrid& g,int i1,int j1,int k1,int i2,int j2,int k2,Real v[8])
+{
+  IntTriple o;
+  int ext;
+  const NarrowBandVolumeGrid::Node& n = g.nodes[g.GetLeaf(IntTriple(i1,j1,k1),o,ext)];
+  if(i2 < o.a+ext && j2 < o.b+ext && k2 < o.c+ext) {
+    if(n.brick < 0) {
+      for(int c=0;c<8;c++) v[c] = n.value;
+      return;
+    }
+    int B = g.brickSize;
+    const float* b = &g.brickValues[size_t(n.brick)*B*B*B];
+    int ii[2]={i1-o.a,i2-o.a},jj[2]={j1-o.b,j2-o.b},kk[2]={k1-o.c,k2-o.c};
+    for(int c=0;c<8;c++)
+      v[c] = b[(ii[(c>>2)&1]*B + jj[(c>>1)&1])*B + kk[c&1]];
+    return;
+  }
+  for(int c=0;c<8;c++)
+    v[c] = g.GetValue(((c>>2)&1 ? i2 : i1),((c>>1)&1 ? j2 : j1),(c&1 ? k2 : k1));
+}
+
+//Computes the stencil cells and interpolation parameters, as in
+//VolumeGrid::TrilinearInterpolate
+static void GetStencilParams(const NarrowBandVolumeGrid& g,const Vector3& pt,IntTriple& i1,IntTriple& i2,Vector3& params)
+{
+  Real u=(pt.x - g.bb.bmin.x)/(g.bb.bmax.x-g.bb.bmin.x)*g.size.a;
+  Real v=(pt.y - g.bb.bmin.y)/(g.bb.bmax.y-g.bb.bmin.y)*g.size.b;
+  Real w=(pt.z - g.bb.bmin.z)/(g.bb.bmax.z-g.bb.bmin.z)*g.size.c;
+  Real ri = Floor(u), rj = Floor(v), rk = Floor(w);
+  u -= ri; v -= rj; w -= rk;
+  i1.set((int)ri,(int)rj,(int)rk);
+  if(u > 0.5) { i2.a=i1.a+1; u = u-0.5; }
+  else { i2.a=i1.a; i1.a--; u = 0.5+u; }
+  if(v > 0.5) { i2.b=i1.b+1; v = v-0.5; }
+  else { i2.b=i1.b; i1.b--; v = 0.5+v; }
+  if(w > 0.5) { i2.c=i1.c+1; w = w-0.5; }
+  else { i2.c=i1.c; i1.c--; w = 0.5+w; }
+  i1.a = ClampIndex(i1.a,g.size.a); i2.a = ClampIndex(i2.a,g.size.a);
+  i1.b = ClampIndex(i1.b,g.size.b); i2.b = ClampIndex(i2.b,g.size.b);
+  i1.c = ClampIndex(i1.c,g.size.c); i2.c = ClampIndex(i2.c,g.size.c);
+  params.set(u,v,w);
+}
+
+Real NarrowBandVolumeGrid::TrilinearInterpolate(const Vector3& pt) const
+{
+  IntTriple i1,i2;
+  Vector3 params;
+  GetStencilParams(*this,pt,i1,i2,params);
+  Real val[8];
+  GetStencil(*this,i1.a,i1.b,i1.c,i2.a,i2.b,i2.c,val);
+  Real u=params.x,v=params.y,w=params.z;
+  Real v11 = (1-w)*val[0] + w*val[1];
+  Real v12 = (1-w)*val[2] + w*val[3];
+  Real v21 = (1-w)*val[4] + w*val[5];
+  Real v22 = (1-w)*val[6] + w*val[7];
+  Real w1 = (1-v)*v11+v*v12;
+  Real w2 = (1-v)*v21+v*v22;
+  return (1-u)*w1 + u*w2;
+}
+
+void NarrowBandVolumeGrid::Gradient(const Vector3& pt,Vector3& grad) const
+{
+  IntTriple i1,i2;
+  Vector3 params;
+  GetStencilParams(*this,pt,i1,i2,params);
+  Real val[8];
+  GetStencil(*this,i1.a,i1.b,i1.c,i2.a,i2.b,i2.c,val);
+  Real u=params.x,v=params.y,w=params.z;
+  Vector3 h = GetCellSize();
+  //derivatives of the interpolant along each axis; zero on clamped axes
+  Real v11 = (1-w)*val[0] + w*val[1];
+  Real v12 = (1-w)*val[2] + w*val[3];
+  Real v21 = (1-w)*val[4] + w*val[5];
+  Real v22 = (1-w)*val[6] + w*val[7];
+  Real w1 = (1-v)*v11+v*v12;
+  Real w2 = (1-v)*v21+v*v22;
+  grad.x = (w2-w1)/h.x;
+  grad.y = ((1-u)*(v12-v11) + u*(v22-v21))/h.y;
+  grad.z = ((1-u)*((1-v)*(val[1]-val[0]) + v*(val[3]-val[2])) + u*((1-v)*(val[5]-val[4]) + v*(val[7]-val[6])))/h.z;
+}
+
+void NarrowBandVolumeGrid::ValueRange(const AABB3D& range,Real& vmin,Real& vmax) const
+{
+  vmin = Inf;
+  vmax = -Inf;
+  if(nodes.empty()) return;
+  //cells that contribute to the interpolant anywhere in the range
+  Real u0=(range.bmin.x - bb.bmin.x)/(bb.bmax.x-bb.bmin.x)*size.a;
+  Real v0=(range.bmin.y - bb.bmin.y)/(bb.bmax.y-bb.bmin.y)*size.b;
+  Real w0=(range.bmin.z - bb.bmin.z)/(bb.bmax.z-bb.bmin.z)*size.c;
+  Real u1=(range.bmax.x - bb.bmin.x)/(bb.bmax.x-bb.bmin.x)*size.a;
+  Real v1=(range.bmax.y - bb.bmin.y)/(bb.bmax.y-bb.bmin.y)*size.b;
+  Real w1=(range.bmax.z - bb.bmin.z)/(bb.bmax.z-bb.bmin.z)*size.c;
+  IntTriple imin,imax;
+  imin.a = ClampIndex((int)Floor(Max(u0,-1.0)-0.5),size.a);
+  imin.b = ClampIndex((int)Floor(Max(v0,-1.0)-0.5),size.b);
+  imin.c = ClampIndex((int)Floor(Max(w0,-1.0)-0.5),size.c);
+  imax.a = ClampIndex((int)Floor(Min(u1,Real(size.a+1))-0.5)+1,size.a);
+  imax.b = ClampIndex((int)Floor(Min(v1,Real(size.b+1))-0.5)+1,size.b);
+  imax.c = ClampIndex((int)Floor(Min(w1,Real(size.c+1))-0.5)+1,size.c);
+  ValueRange(0,IntTriple(0,0,0),rootExtent,imin,imax,vmin,vmax);
+}
+
+void NarrowBandVolumeGrid::ValueRange(int index,const IntTriple& o,int extent,const IntTriple& imin,const IntTriple& imax,Real& vmin,Real& vmax) const
+{
+  const Node& n = nodes[index];
+  if(n.brick == Empty) return;
+  if(o.a > imax.a || o.b > imax.b || o.c > imax.c) return;
+  if(o.a+extent <= imin.a || o.b+extent <= imin.b || o.c+extent <= imin.c) return;
+  if(n.vmin >= vmin && n.vmax <= vmax) return;
+  bool contained = (o.a >= imin.a && o.b >= imin.b && o.c >= imin.c &&
+                    o.a+extent-1 <= imax.a && o.b+extent-1 <= imax.b && o.c+extent-1 <= imax.c);
+  if(contained || (n.child < 0 && n.brick == Uniform)) {
+    if(n.vmin < vmin) vmin = n.vmin;
+    if(n.vmax > vmax) vmax = n.vmax;
+    return;
+  }
+  if(n.child >= 0) {
+    int half = extent/2;
+    for(int c=0;c<8;c++)
+      ValueRange(n.child+c,ChildOrigin(o,half,c),half,imin,imax,vmin,vmax);
+    return;
+  }
+  //brick that partially overlaps the range
+  int B = brickSize;
+  const float* b = &brickValues[size_t(n.brick)*B*B*B];
+  int i0=Max(imin.a-o.a,0),i1=Min(imax.a-o.a,B-1);
+  int j0=Max(imin.b-o.b,0),j1=Min(imax.b-o.b,B-1);
+  int k0=Max(imin.c-o.c,0),k1=Min(imax.c-o.c,B-1);
+  for(int i=i0;i<=i1;i++)
+    for(int j=j0;j<=j1;j++)
+      for(int k=k0;k<=k1;k++) {
+        Real v = b[(i*B+j)*B+k];
+        if(v < vmin) vmin = v;
+        if(v > vmax) vmax = v;
+      }
+}
+
+namespace Geometry {
+
+ostream& operator << (ostream& out,const NarrowBandVolumeGrid& grid)
+{
+  //enough digits for floats to round-trip, so the node ranges stay valid
+  streamsize oldPrecision = out.precision(9);
+  out<<grid.bb.bmin<<"    "<<grid.bb.bmax<<endl;
+  out<<grid.size.a<<" "<<grid.size.b<<" "<<grid.size.c<<" "<<grid.brickSize<<" "<<grid.bandWidth<<endl;
+  out<<grid.nodes.size()<<endl;
+  for(size_t i=0;i<grid.nodes.size();i++) {
+    const NarrowBandVolumeGrid::Node& n = grid.nodes[i];
+    out<<n.vmin<<" "<<n.vmax<<" "<<n.value<<" "<<n.child<<" "<<n.brick<<endl;
+  }
+  out<<grid.brickValues.size()<<endl;
+  for(size_t i=0;i<grid.brickValues.size();i++) {
+    out<<grid.brickValues[i];
+    if((i+1)%grid.brickSize == 0) out<<endl;
+    else out<<" ";
+  }
+  out.precision(oldPrecision);
+  return out;
+}
+
+istream& operator >> (istream& in,NarrowBandVolumeGrid& grid)
+{
+  in>>grid.bb.bmin>>grid.bb.bmax;
+  in>>grid.size.a>>grid.size.b>>grid.size.c>>grid.brickSize>>grid.bandWidth;
+  if(!in || grid.brickSize <= 0) {
+    in.setstate(ios::failbit);
+    return in;
+  }
+  size_t n;
+  in>>n;
+  if(!in) return in;
+  grid.nodes.resize(n);
+  for(size_t i=0;i<n;i++) {
+    NarrowBandVolumeGrid::Node& node = grid.nodes[i];
+    in>>node.vmin>>node.vmax>>node.value>>node.child>>node.brick;
+  }
+  in>>n;
+  if(!in) return in;
+  grid.brickValues.resize(n);
+  for(size_t i=0;i<n;i++)
+    in>>grid.brickValues[i];
+  grid.rootExtent = grid.brickSize;
+  while(grid.rootExtent < grid.size.a || grid.rootExtent < grid.size.b || grid.rootExtent < grid.size.c)
+    grid.rootExtent *= 2;
+  if(grid.nodes.empty()) grid.rootExtent = 0;
+  return in;
+}
+
+} //namespace Geometry
@@ -0,0 +1,95 @@
+#ifndef NARROW_BAND_VOLUME_GRID_H
+#define NARROW_BAND_VOLUME_GRID_H
+
+#include <KrisLibrary/meshing/VolumeGrid.h>
+#include <iosfwd>
+#include <vector>
+
+namespace Geometry {
+
+  using namespace Math3D;
+
+/** @ingroup Geometry
+ * @brief A signed distance field that only stores values in a narrow band
+ * around the surface.
+ *
+ * The cell layout is the same as a Meshing::VolumeGrid with the same bb and
+ * size, with values sampled at cell centers.  Cells are grouped into
+ * bricks of brickSize^3 cells, and the bricks are organized in an octree.
+ * Only bricks containing a value with |v| < bandWidth (or a sign change)
+ * store their cells.  The rest of the domain is covered by uniform leaves,
+ * which store only the value of their cells that is closest to zero.  Hence,
+ * values are exact within roughly bandWidth of the surface and are
+ * conservative (never larger in magnitude than the true value) elsewhere.
+ *
+ * Each node stores the min and max of all cell values that contribute to
+ * the trilinear interpolation inside the node's box (i.e., its cells
+ * dilated by one cell), so a node's range bounds the interpolated field
+ * anywhere inside it.
+ */
+class NarrowBandVolumeGrid
+{
+ public:
+  enum { Uniform=-1, Empty=-2 };
+  struct Node
+  {
+    ///Range of the interpolated field within the node's box
+    float vmin,vmax;
+    ///For uniform leaves, the value of all cells
+    float value;
+    ///Index of the first of 8 consecutive children, or -1 for leaves
+    int child;
+    ///Index of the brick for brick leaves, or Uniform / Empty
+    int brick;
+  };
+
+  NarrowBandVolumeGrid();
+  ///Builds the octree from a dense signed distance field
+  void Build(const Meshing::VolumeGrid& grid,Real bandWidth,int brickSize=8);
+  ///Expands back into a dense grid.  Cells outside of the band get their
+  ///uniform leaf's value.
+  void GetDense(Meshing::VolumeGrid& grid) const;
+  inline bool IsEmpty() const { return nodes.empty(); }
+  inline size_t NumBricks() const { return (brickSize > 0 ? brickValues.size()/(brickSize*brickSize*brickSize) : 0); }
+  Vector3 GetCellSize() const;
+  void GetIndex(const Vector3& pt,IntTriple& index) const;
+  void GetCell(const IntTriple& index,AABB3D& cell) const;
+  ///Returns the box of the node whose cells start at origin, with the given
+  ///extent (in cells)
+  void GetNodeBox(const IntTriple& origin,int extent,AABB3D& box) const;
+  ///Finds the leaf containing the given cell, which must be in range.
+  ///Returns the leaf index and its origin / extent.
+  int GetLeaf(const IntTriple& index,IntTriple& origin,int& extent) const;
+  ///Gets the value of the given cell (clamped to the grid)
+  Real GetValue(int i,int j,int k) const;
+  inline Real GetValue(const IntTriple& index) const { return GetValue(index.a,index.b,index.c); }
+  ///Same semantics as VolumeGrid::TrilinearInterpolate
+  Real TrilinearInterpolate(const Vector3& pt) const;
+  ///Returns the gradient of the trilinear interpolant at pt
+  void Gradient(const Vector3& pt,Vector3& grad) const;
+  ///Returns a range containing the interpolated field for all points in bb
+  ///(clamped to the grid).  Descends only into nodes that overlap bb.
+  void ValueRange(const AABB3D& bb,Real& vmin,Real& vmax) const;
+
+  AABB3D bb;
+  IntTriple size;
+  int brickSize;
+  ///Extent of the root node, in cells (a power of 2 multiple of brickSize)
+  int rootExtent;
+  Real bandWidth;
+  std::vector<Node> nodes;
+  ///Cell values of all bricks, brickSize^3 per brick, in i,j,k order
+  std::vector<float> brickValues;
+
+ private:
+  void BuildNode(int index,const IntTriple& origin,int extent,const Meshing::VolumeGrid& grid);
+  void ComputeRanges(int index,const IntTriple& origin,int extent);
+  void ValueRange(int index,const IntTriple& origin,int extent,const IntTriple& imin,const IntTriple& imax,Real& vmin,Real& vmax) const;
+};
+
+std::ostream& operator << (std::ostream& out,const NarrowBandVolumeGrid& grid);
+std::istream& operator >> (std::istream& in,NarrowBandVolumeGrid& grid);
+
+} //namespace Geometry
+
+#endif
@@ -0,0 +1,302 @@
+#include <KrisLibrary/Logger.h>
+#include "AnyGeometry.h"
+#include "NarrowBandVolumeGrid.h"
+#include "CollisionMesh.h"
+#include "CollisionImplicitSurface.h"
+#include "CollisionPointCloud.h"
+#include "Conversions.h"
+#include <meshing/MeshPrimitives.h>
+#include <meshing/VolumeGrid.h>
+#include <math/random.h>
+#include <math3d/Box3D.h>
+#include <math3d/Sphere3D.h>
+#include <math3d/geometry3d.h>
+#include <errors.h>
+#include <algorithm>
+#include <climits>
+#include "SelfTest.h"
+using namespace Geometry;
+using namespace std;
+
+//a box of the given dimensions centered at c, rotated by angle about z
+static void MakeBox(const Vector3& c,const Vector3& dims,Real angle,Box3D& box)
+{
+  Matrix3 R;
+  R.setRotateZ(angle);
+  R.getCol1(box.xbasis);
+  R.getCol2(box.ybasis);
+  R.getCol3(box.zbasis);
+  box.dims = dims;
+  box.setCenter(c);
+}
+
+void Geometry::TestBoxIntersection()
+{
+  //a unit cube at the origin, and thin rods rotated 45 degrees about z.
+  //Intersecting with the transpose of a rod's relative rotation rotates
+  //it by -45 degrees instead, which swaps the answers.
+  Box3D cube,rod;
+  MakeBox(Vector3(0.0),Vector3(1.0),0,cube);
+  MakeBox(Vector3(1.5,1.5,0),Vector3(4,0.1,0.1),Pi/4,rod);
+  if(!cube.intersects(rod)) FatalError("TestBoxIntersection: rod through the corner of the cube is missed");
+  if(!rod.intersects(cube)) FatalError("TestBoxIntersection: rod through the corner of the cube is missed (reversed)");
+  MakeBox(Vector3(1.5,-1.5,0),Vector3(5,0.1,0.1),Pi/4,rod);
+  if(cube.intersects(rod)) FatalError("TestBoxIntersection: rod beside the cube intersects");
+  if(rod.intersects(cube)) FatalError("TestBoxIntersection: rod beside the cube intersects (reversed)");
+
+  //rotating both boxes together doesn't change the answer
+  RigidTransform T;
+  T.R.setRotateX(0.3);
+  T.t.set(0.2,-0.4,1.0);
+  Box3D cube2,rod2;
+  cube2.setTransformed(cube,T);
+  MakeBox(Vector3(1.5,1.5,0),Vector3(4,0.1,0.1),Pi/4,rod);
+  rod2.setTransformed(rod,T);
+  if(!cube2.intersects(rod2)) FatalError("TestBoxIntersection: transformed rod is missed");
+}
+
+void Geometry::TestPrimitiveGeometryCopy()
+{
+  Sphere3D s;
+  s.center.set(1,0,0);
+  s.radius = 0.5;
+  AnyCollisionGeometry3D geom((GeometricPrimitive3D(s)));
+  geom.InitCollisionData();
+  RigidTransform T;
+  T.R.setRotateZ(0.5);
+  T.t.set(0,2,0);
+  geom.SetTransform(T);
+
+  //the copy keeps the primitive's collision data (its transform)
+  AnyCollisionGeometry3D copy(geom);
+  if(!copy.CollisionDataInitialized()) FatalError("TestPrimitiveGeometryCopy: collision data was not copied");
+  const RigidTransform& Tcopy = copy.PrimitiveCollisionData();
+  if(!Tcopy.R.isEqual(T.R) || !Tcopy.t.isEqual(T.t)) FatalError("TestPrimitiveGeometryCopy: transform was not copied");
+  Vector3 pt(0,0,0);
+  if(Abs(copy.Distance(pt)-geom.Distance(pt)) > 1e-8) FatalError("TestPrimitiveGeometryCopy: copied distance differs");
+}
+
+void Geometry::TestSparseImplicitSurface()
+{
+  //signed distance field of a sphere of radius 0.3
+  Meshing::VolumeGrid grid;
+  grid.bb.bmin.set(-0.5,-0.5,-0.5);
+  grid.bb.bmax.set(0.5,0.5,0.5);
+  int res=32;
+  grid.Resize(res,res,res);
+  Vector3 c;
+  for(int i=0;i<res;i++)
+    for(int j=0;j<res;j++)
+      for(int k=0;k<res;k++) {
+        grid.GetCellCenter(i,j,k,c);
+        grid.value(i,j,k) = c.norm()-0.3;
+      }
+  Real band = 0.1;
+  NarrowBandVolumeGrid sparse;
+  sparse.Build(grid,band,4);
+  Assert(!sparse.IsEmpty());
+  if(sparse.NumBricks()*64 >= (size_t)(res*res*res)) {
+    LOG4CXX_ERROR(KrisLibrary::logger(),"NarrowBandVolumeGrid stores "<<sparse.NumBricks()<<" bricks, no better than dense");
+    Abort();
+  }
+  //exact within the band, conservative outside of it
+  for(int i=0;i<res;i++)
+    for(int j=0;j<res;j++)
+      for(int k=0;k<res;k++) {
+        Real v = grid.value(i,j,k), s = sparse.GetValue(i,j,k);
+        bool ok = (Abs(v) < band ? Abs(s-v) < 1e-5 : (s*v > 0 && Abs(s) <= Abs(v)+1e-5));
+        if(!ok) {
+          LOG4CXX_ERROR(KrisLibrary::logger(),"NarrowBandVolumeGrid cell "<<i<<" "<<j<<" "<<k<<" has value "<<s<<", dense value "<<v);
+          Abort();
+        }
+      }
+  //interpolation near the surface only touches cells within the band
+  int numTested=0;
+  for(int iter=0;iter<1000;iter++) {
+    Vector3 pt(Rand(-0.4,0.4),Rand(-0.4,0.4),Rand(-0.4,0.4));
+    Real v = grid.TrilinearInterpolate(pt);
+    if(Abs(v) > 0.03) continue;
+    numTested++;
+    Assert(Abs(sparse.TrilinearInterpolate(pt)-v) < 1e-5);
+  }
+  Assert(numTested > 0);
+
+  //geometry interface: bounds and translation
+  AnyGeometry3D geom(sparse);
+  Assert(geom.type == AnyGeometry3D::SparseImplicitSurface);
+  Assert(!geom.Empty());
+  AABB3D bb = geom.GetAABB();
+  Assert(bb.bmin.isEqual(grid.bb.bmin,1e-8) && bb.bmax.isEqual(grid.bb.bmax,1e-8));
+  RigidTransform T;
+  T.R.setIdentity();
+  T.t.set(1,2,3);
+  geom.Transform(T);
+  bb = geom.GetAABB();
+  Assert(bb.bmin.isEqual(grid.bb.bmin+T.t,1e-8) && bb.bmax.isEqual(grid.bb.bmax+T.t,1e-8));
+
+  //distance queries agree with the dense implicit surface under a rigid
+  //transform
+  AnyCollisionGeometry3D sparseColl(sparse),denseColl(grid);
+  sparseColl.InitCollisionData();
+  denseColl.InitCollisionData();
+  T.R.setRotateZ(0.5);
+  sparseColl.SetTransform(T);
+  denseColl.SetTransform(T);
+  Assert(sparseColl.GetAABB().contains(T*Vector3(0.5,0.5,0.5)));
+  Real dout = sparseColl.Distance(T*Vector3(0.35,0,0));
+  Real ddense = denseColl.Distance(T*Vector3(0.35,0,0));
+  if(Abs(dout-0.05) > 0.01 || Abs(dout-ddense) > 1e-5) {
+    LOG4CXX_ERROR(KrisLibrary::logger(),"SparseImplicitSurface distance "<<dout<<", dense "<<ddense<<", should be 0.05");
+    Abort();
+  }
+  Real din = sparseColl.Distance(T*Vector3(0,0.1,0));
+  if(din >= 0) {
+    LOG4CXX_ERROR(KrisLibrary::logger(),"SparseImplicitSurface distance "<<din<<" inside the sphere");
+    Abort();
+  }
+
+  //triangle mesh collisions: a square through the sphere whose vertices are
+  //all far from the surface, and one just above it
+  Meshing::TriMesh square;
+  square.verts.resize(4);
+  square.verts[0].set(-0.4,-0.4,0.25);
+  square.verts[1].set(0.4,-0.4,0.25);
+  square.verts[2].set(0.4,0.4,0.25);
+  square.verts[3].set(-0.4,0.4,0.25);
+  square.tris.resize(2);
+  square.tris[0].set(0,1,2);
+  square.tris[1].set(0,2,3);
+  AnyCollisionGeometry3D meshColl(square);
+  meshColl.InitCollisionData();
+  meshColl.SetTransform(T);
+  vector<int> sparseElements,meshElements;
+  bool collides = sparseColl.Collides(meshColl,sparseElements,meshElements,2);
+  if(!collides || sparseElements.empty() || sparseElements.size() != meshElements.size()) {
+    LOG4CXX_ERROR(KrisLibrary::logger(),"SparseImplicitSurface misses a triangle mesh through it");
+    Abort();
+  }
+  if(!meshColl.Collides(sparseColl)) {
+    LOG4CXX_ERROR(KrisLibrary::logger(),"Triangle mesh misses a SparseImplicitSurface (reversed)");
+    Abort();
+  }
+  for(size_t i=0;i<square.verts.size();i++) square.verts[i].z = 0.35;
+  AnyCollisionGeometry3D aboveColl(square);
+  aboveColl.InitCollisionData();
+  aboveColl.SetTransform(T);
+  if(sparseColl.Collides(aboveColl) || aboveColl.Collides(sparseColl)) {
+    LOG4CXX_ERROR(KrisLibrary::logger(),"SparseImplicitSurface collides with a triangle mesh 0.05 away");
+    Abort();
+  }
+  aboveColl.margin = 0.1;
+  if(!sparseColl.Collides(aboveColl) || !aboveColl.Collides(sparseColl)) {
+    LOG4CXX_ERROR(KrisLibrary::logger(),"SparseImplicitSurface misses a triangle mesh within the margin");
+    Abort();
+  }
+}
+
+//exact signed distance to a box centered at the origin
+static Real BoxDistance(const Vector3& p,const Vector3& half)
+{
+  Vector3 q(Abs(p.x)-half.x,Abs(p.y)-half.y,Abs(p.z)-half.z);
+  Vector3 qout(Max(q.x,0.0),Max(q.y,0.0),Max(q.z,0.0));
+  return qout.norm() + Min(Max(q.x,Max(q.y,q.z)),0.0);
+}
+
+void Geometry::TestFastSweeping()
+{
+  Meshing::TriMesh box;
+  Meshing::MakeTriCenteredBox(1,1,1,0.6,0.4,0.5,box);
+  CollisionMesh mesh(box);
+  mesh.CalcTriNeighbors();
+  mesh.CalcIncidentTris();
+  mesh.InitCollisions();
+  Real res = 0.02, band = 2;
+  Meshing::VolumeGrid serial,parallel,fmm;
+  MeshToImplicitSurface_FastSweeping(mesh,serial,res,band,1);
+  MeshToImplicitSurface_FastSweeping(mesh,parallel,res,band,4);
+  MeshToImplicitSurface_FMM(mesh,fmm,res);
+  if(serial.value.m != fmm.value.m || serial.value.n != fmm.value.n || serial.value.p != fmm.value.p ||
+     parallel.value.m != fmm.value.m || parallel.value.n != fmm.value.n || parallel.value.p != fmm.value.p)
+    FatalError("TestFastSweeping: grid size differs from the FMM grid");
+  //slabs converge to the serial sweep; cells in the band are exact, and the
+  //swept values are within a cell of the fast marching distance field
+  Vector3 half(0.3,0.2,0.25),c;
+  for(int i=0;i<serial.value.m;i++)
+    for(int j=0;j<serial.value.n;j++)
+      for(int k=0;k<serial.value.p;k++) {
+        Real v = serial.value(i,j,k);
+        serial.GetCellCenter(i,j,k,c);
+        Real exact = BoxDistance(c,half);
+        bool ok = (Abs(parallel.value(i,j,k)-v) < 1e-8 &&
+                   (Abs(exact) >= band*res || Abs(v-exact) < 1e-8) &&
+                   Abs(fmm.value(i,j,k)-v) <= 0.6*res);
+        if(!ok) {
+          LOG4CXX_ERROR(KrisLibrary::logger(),"FastSweeping cell "<<i<<" "<<j<<" "<<k<<": "<<v<<", parallel "<<parallel.value(i,j,k)<<", FMM "<<fmm.value(i,j,k)<<", exact "<<exact);
+          Abort();
+        }
+      }
+
+  CollisionMesh empty;
+  MeshToImplicitSurface_FastSweeping(empty,serial,res,band,4);
+  if(!serial.IsEmpty()) FatalError("TestFastSweeping: empty mesh gives a nonempty grid");
+}
+
+void Geometry::TestImplicitSurfaceBatchDistances()
+{
+  //a random field, so that every corner of the interpolation matters
+  Meshing::VolumeGrid grid;
+  grid.bb.bmin.set(-0.5,-0.3,-0.4);
+  grid.bb.bmax.set(0.5,0.3,0.4);
+  grid.Resize(20,12,16);
+  for(int i=0;i<grid.value.m;i++)
+    for(int j=0;j<grid.value.n;j++)
+      for(int k=0;k<grid.value.p;k++)
+        grid.value(i,j,k) = Rand(-0.2,0.2);
+  CollisionImplicitSurface s(grid);
+  s.currentTransform.R.setRotateZ(0.3);
+  s.currentTransform.t.set(0.1,-0.2,0.3);
+
+  //a number of points that isn't a multiple of the batch size, some of
+  //them outside of the grid
+  Meshing::PointCloud3D pts;
+  pts.points.resize(203);
+  for(size_t i=0;i<pts.points.size();i++)
+    pts.points[i].set(Rand(-0.8,0.8),Rand(-0.6,0.6),Rand(-0.7,0.7));
+  CollisionPointCloud pc(pts);
+  pc.currentTransform.R.setRotateX(-0.4);
+  pc.currentTransform.t.set(0.05,0.1,0.2);
+
+  vector<Real> d;
+  Distances(s,pc.points,pc.currentTransform,d);
+  if(d.size() != pc.points.size()) FatalError("TestImplicitSurfaceBatchDistances: wrong number of distances");
+  for(size_t i=0;i<d.size();i++) {
+    Real di = Distance(s,pc.currentTransform*pc.points[i]);
+    if(Abs(d[i]-di) > 1e-10) {
+      LOG4CXX_ERROR(KrisLibrary::logger(),"Batch distance of point "<<i<<" is "<<d[i]<<", single point distance "<<di);
+      Abort();
+    }
+  }
+
+  //batched collision returns exactly the points that collide one at a time.
+  //Points outside of the grid's box (expanded by the margin) are culled
+  //before sampling, so here they all lie inside of it
+  RigidTransform Ts_pc;
+  Ts_pc.mulInverseA(pc.currentTransform,s.currentTransform);
+  for(size_t i=0;i<pc.points.size();i++) {
+    Vector3 ps(Rand(grid.bb.bmin.x,grid.bb.bmax.x),Rand(grid.bb.bmin.y,grid.bb.bmax.y),Rand(grid.bb.bmin.z,grid.bb.bmax.z));
+    pts.points[i] = Ts_pc*ps;
+  }
+  CollisionPointCloud inside(pts);
+  inside.currentTransform = pc.currentTransform;
+  Real margin = 0.05;
+  vector<int> expected,colliding;
+  for(size_t i=0;i<inside.points.size();i++)
+    if(Distance(s,inside.currentTransform*inside.points[i]) <= margin) expected.push_back((int)i);
+  if(expected.empty() || expected.size() == inside.points.size()) FatalError("TestImplicitSurfaceBatchDistances: degenerate test case");
+  Collides(s,inside,margin,colliding,INT_MAX);
+  sort(colliding.begin(),colliding.end());
+  if(colliding != expected) FatalError("TestImplicitSurfaceBatchDistances: batched collision gives %d points, expected %d",(int)colliding.size(),(int)expected.size());
+  colliding.resize(0);
+  if(!Collides(s,inside,margin,colliding,1) || colliding.size() != 1 || !binary_search(expected.begin(),expected.end(),colliding[0]))
+    FatalError("TestImplicitSurfaceBatchDistances: first contact is wrong");
+}
@@ -0,0 +1,14 @@
+#ifndef GEOMETRY_SELF_TEST_H
+#define GEOMETRY_SELF_TEST_H
+
+namespace Geometry {
+
+void TestBoxIntersection();
+void TestPrimitiveGeometryCopy();
+void TestSparseImplicitSurface();
+void TestFastSweeping();
+void TestImplicitSurfaceBatchDistances();
+
+} //namespace Geometry
+
+#endif
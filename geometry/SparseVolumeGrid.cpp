@@ -1,8 +1,10 @@
 #include "SparseVolumeGrid.h"
 #include <KrisLibrary/meshing/MarchingCubes.h>
+#include <KrisLibrary/utils/threadutils.h>
 #include <algorithm>
 #include <iostream>
 #include <limits>
+#include <map>
 
 using namespace std;
 using namespace Geometry;
@@ -471,109 +473,188 @@ void SparseVolumeGrid::Min(Real val,int channel)
 }
 
 
-void SparseVolumeGrid::ExtractMesh(float isosurface,Meshing::TriMesh& mesh)
+///Copies a block's values and the first layer of its +x, +y, +z neighbors
+///into expandedBlock, so that marching cubes covers the seams between
+///blocks.  Missing neighbors are filled with NaN.
+static void GetExpandedBlock(const SparseVolumeGrid& grid,const IntTriple& index,const Array3D<float>& value,Array3D<float>& expandedBlock)
 {
-  mesh.tris.resize(0);
-  mesh.verts.resize(0);
-  const static int m=8,n=8,p=8;
+  const int m=grid.blockSize.a,n=grid.blockSize.b,p=grid.blockSize.c;
   const static float NaN = std::numeric_limits<float>::quiet_NaN();
-  TriMesh tempMesh;
-  Array3D<float> expandedBlock(m+1,n+1,p+1);
-  for(auto b=hash.buckets.begin();b!=hash.buckets.end();b++) {
-    VolumeGridTemplate<float>& depth = reinterpret_cast<Block*>(b->second)->grid.channels[0];
-    AABB3D center_bb = depth.bb;
-    Vector3 celldims = depth.GetCellSize();
-    center_bb.bmin += celldims*0.5;
-    center_bb.bmax += celldims*0.5;
-
-    //copy 8x8x8 block
-    for(auto i=depth.value.begin(),j=expandedBlock.begin(Range3Indices(0,m,0,n,0,p));i!=depth.value.end();++i,++j) 
-      *j = *i;
-
-    //now work on the seams:
-    IntTriple c;
-    void* ptr;
-    c = b->first;
-    c[0] += 1;
-    if((ptr=hash.Get(c))) {
-      Array3D<float> &xnext = reinterpret_cast<Block*>(ptr)->grid.channels[0].value;
-      for(int j=0;j<n;j++) 
-        for(int k=0;k<p;k++) 
-          expandedBlock(m,j,k) = xnext(0,j,k);
-      c[1] += 1;
-      if((ptr=hash.Get(c))) {
-        Array3D<float> &xynext = reinterpret_cast<Block*>(ptr)->grid.channels[0].value;
-        for(int k=0;k<p;k++) 
-          expandedBlock(m,n,k) = xynext(0,0,k);
-        c[2] += 1;
-        if((ptr=hash.Get(c))) {
-          Array3D<float> &xyznext = reinterpret_cast<Block*>(ptr)->grid.channels[0].value;
-          expandedBlock(m,n,p) = xyznext(0,0,0);
-        }
-        else
-          expandedBlock(m,n,p) = NaN;
-        c[2] -= 1;
-      }
-      else {
-        for(int k=0;k<=p;k++) 
-          expandedBlock(m,n,k) = NaN;
-      }
-      c[1] -= 1;
-      c[2] += 1;
-      if((ptr=hash.Get(c))) {
-        Array3D<float> &xznext = reinterpret_cast<Block*>(ptr)->grid.channels[0].value;
-        for(int j=0;j<n;j++) 
-          expandedBlock(m,j,p) = xznext(0,j,0);
-      }
-      else {
-        for(int j=0;j<n;j++) 
-          expandedBlock(m,j,p) = NaN;
-      }
-      c[2] -= 1;
-    }
-    else {
-      for(int j=0;j<=n;j++) 
-        for(int k=0;k<=p;k++) 
-          expandedBlock(m,j,k) = NaN;
-    }
-    c[0] -= 1;
+  expandedBlock.resize(m+1,n+1,p+1);
+  for(auto i=value.begin(),j=expandedBlock.begin(Range3Indices(0,m,0,n,0,p));i!=value.end();++i,++j) 
+    *j = *i;
+
+  //now work on the seams:
+  IntTriple c;
+  void* ptr;
+  c = index;
+  c[0] += 1;
+  if((ptr=grid.hash.Get(c))) {
+    Array3D<float> &xnext = reinterpret_cast<SparseVolumeGrid::Block*>(ptr)->grid.channels[0].value;
+    for(int j=0;j<n;j++) 
+      for(int k=0;k<p;k++) 
+        expandedBlock(m,j,k) = xnext(0,j,k);
     c[1] += 1;
-    if((ptr=hash.Get(c))) {
-      Array3D<float> &ynext = reinterpret_cast<Block*>(ptr)->grid.channels[0].value;
-      for(int i=0;i<m;i++)
-        for(int k=0;k<p;k++) 
-          expandedBlock(i,n,k) = ynext(i,0,k);
+    if((ptr=grid.hash.Get(c))) {
+      Array3D<float> &xynext = reinterpret_cast<SparseVolumeGrid::Block*>(ptr)->grid.channels[0].value;
+      for(int k=0;k<p;k++) 
+        expandedBlock(m,n,k) = xynext(0,0,k);
       c[2] += 1;
-      if((ptr=hash.Get(c))) {
-        Array3D<float> &yznext = reinterpret_cast<Block*>(ptr)->grid.channels[0].value;
-        for(int i=0;i<m;i++) 
-          expandedBlock(i,n,p) = yznext(i,0,0);
+      if((ptr=grid.hash.Get(c))) {
+        Array3D<float> &xyznext = reinterpret_cast<SparseVolumeGrid::Block*>(ptr)->grid.channels[0].value;
+        expandedBlock(m,n,p) = xyznext(0,0,0);
       }
       else
-        for(int i=0;i<m;i++) 
-          expandedBlock(i,n,p) = NaN;
+        expandedBlock(m,n,p) = NaN;
       c[2] -= 1;
     }
     else {
-      for(int i=0;i<m;i++)
-        for(int k=0;k<=p;k++) 
-          expandedBlock(i,n,k) = NaN;
+      for(int k=0;k<=p;k++) 
+        expandedBlock(m,n,k) = NaN;
     }
     c[1] -= 1;
     c[2] += 1;
-    if((ptr=hash.Get(c))) {
-      Array3D<float> &znext = reinterpret_cast<Block*>(ptr)->grid.channels[0].value;
-      for(int i=0;i<m;i++)
-        for(int j=0;j<n;j++) 
-          expandedBlock(i,j,p) = znext(i,j,0);
+    if((ptr=grid.hash.Get(c))) {
+      Array3D<float> &xznext = reinterpret_cast<SparseVolumeGrid::Block*>(ptr)->grid.channels[0].value;
+      for(int j=0;j<n;j++) 
+        expandedBlock(m,j,p) = xznext(0,j,0);
     }
     else {
-      for(int i=0;i<m;i++)
-        for(int j=0;j<n;j++) 
-          expandedBlock(i,j,p) = NaN;
+      for(int j=0;j<n;j++) 
+        expandedBlock(m,j,p) = NaN;
     }
+    c[2] -= 1;
+  }
+  else {
+    for(int j=0;j<=n;j++) 
+      for(int k=0;k<=p;k++) 
+        expandedBlock(m,j,k) = NaN;
+  }
+  c[0] -= 1;
+  c[1] += 1;
+  if((ptr=grid.hash.Get(c))) {
+    Array3D<float> &ynext = reinterpret_cast<SparseVolumeGrid::Block*>(ptr)->grid.channels[0].value;
+    for(int i=0;i<m;i++)
+      for(int k=0;k<p;k++) 
+        expandedBlock(i,n,k) = ynext(i,0,k);
+    c[2] += 1;
+    if((ptr=grid.hash.Get(c))) {
+      Array3D<float> &yznext = reinterpret_cast<SparseVolumeGrid::Block*>(ptr)->grid.channels[0].value;
+      for(int i=0;i<m;i++) 
+        expandedBlock(i,n,p) = yznext(i,0,0);
+    }
+    else
+      for(int i=0;i<m;i++) 
+        expandedBlock(i,n,p) = NaN;
+    c[2] -= 1;
+  }
+  else {
+    for(int i=0;i<m;i++)
+      for(int k=0;k<=p;k++) 
+        expandedBlock(i,n,k) = NaN;
+  }
+  c[1] -= 1;
+  c[2] += 1;
+  if((ptr=grid.hash.Get(c))) {
+    Array3D<float> &znext = reinterpret_cast<SparseVolumeGrid::Block*>(ptr)->grid.channels[0].value;
+    for(int i=0;i<m;i++)
+      for(int j=0;j<n;j++) 
+        expandedBlock(i,j,p) = znext(i,j,0);
+  }
+  else {
+    for(int i=0;i<m;i++)
+      for(int j=0;j<n;j++) 
+        expandedBlock(i,j,p) = NaN;
+  }
+}
+
+struct ExtractMeshData
+{
+  const SparseVolumeGrid* grid;
+  float isosurface;
+  const vector<pair<IntTriple,SparseVolumeGrid::Block*> >* blocks;
+  int start,stop;
+  vector<TriMesh>* meshes;
+  vector<vector<size_t> >* vertEdges;
+};
+
+static void* ExtractMeshThread(void* vdata)
+{
+  ExtractMeshData* data = reinterpret_cast<ExtractMeshData*>(vdata);
+  Array3D<float> expandedBlock;
+  for(int b=data->start;b<data->stop;b++) {
+    const IntTriple& index = (*data->blocks)[b].first;
+    VolumeGridTemplate<float>& depth = (*data->blocks)[b].second->grid.channels[0];
+    AABB3D center_bb = depth.bb;
+    Vector3 celldims = depth.GetCellSize();
+    center_bb.bmin += celldims*0.5;
+    center_bb.bmax += celldims*0.5;
+    GetExpandedBlock(*data->grid,index,depth.value,expandedBlock);
+    MarchingCubes(expandedBlock,data->isosurface,center_bb,(*data->meshes)[b],(*data->vertEdges)[b]);
+  }
+  return NULL;
+}
 
-    MarchingCubes(expandedBlock,isosurface,center_bb,tempMesh);
-    mesh.MergeWith(tempMesh);
+void SparseVolumeGrid::ExtractMesh(float isosurface,Meshing::TriMesh& mesh,int numThreads)
+{
+  mesh.tris.resize(0);
+  mesh.verts.resize(0);
+  //sort the blocks so the output doesn't depend on the hash order
+  vector<pair<IntTriple,Block*> > blocks;
+  blocks.reserve(hash.buckets.size());
+  for(auto b=hash.buckets.begin();b!=hash.buckets.end();b++) 
+    blocks.push_back(pair<IntTriple,Block*>(b->first,reinterpret_cast<Block*>(b->second)));
+  sort(blocks.begin(),blocks.end());
+  if(blocks.empty()) return;
+
+  vector<TriMesh> meshes(blocks.size());
+  vector<vector<size_t> > vertEdges(blocks.size());
+  int nt = std::min(ThreadCount(numThreads),(int)blocks.size());
+  vector<ExtractMeshData> data(nt);
+  for(int t=0;t<nt;t++) {
+    data[t].grid = this;
+    data[t].isosurface = isosurface;
+    data[t].blocks = &blocks;
+    data[t].start = (t*(int)blocks.size())/nt;
+    data[t].stop = ((t+1)*(int)blocks.size())/nt;
+    data[t].meshes = &meshes;
+    data[t].vertEdges = &vertEdges;
+  }
+  ThreadRunAll(ExtractMeshThread,data);
+
+  //merge the block meshes, sharing the vertices that lie on block faces
+  const int m=blockSize.a,n=blockSize.b,p=blockSize.c;
+  const int dims[3] = {m+1,n+1,p+1};
+  map<pair<IntTriple,int>,int> faceVerts;
+  vector<int> vmap;
+  for(size_t b=0;b<blocks.size();b++) {
+    const TriMesh& bm = meshes[b];
+    const vector<size_t>& edges = vertEdges[b];
+    vmap.resize(bm.verts.size());
+    for(size_t v=0;v<bm.verts.size();v++) {
+      size_t code = edges[v];
+      int axis = (int)(code % 3); code /= 3;
+      int local[3];
+      local[2] = (int)(code % dims[2]); code /= dims[2];
+      local[1] = (int)(code % dims[1]); code /= dims[1];
+      local[0] = (int)code;
+      bool onFace = false;
+      for(int d=0;d<3;d++)
+        if(d != axis && (local[d] == 0 || local[d] == dims[d]-1)) onFace = true;
+      if(onFace) {
+        IntTriple global(blocks[b].first.a*m+local[0],blocks[b].first.b*n+local[1],blocks[b].first.c*p+local[2]);
+        pair<IntTriple,int> key(global,axis);
+        auto it = faceVerts.find(key);
+        if(it != faceVerts.end()) {
+          vmap[v] = it->second;
+          continue;
+        }
+        faceVerts[key] = (int)mesh.verts.size();
+      }
+      vmap[v] = (int)mesh.verts.size();
+      mesh.verts.push_back(bm.verts[v]);
+    }
+    for(size_t t=0;t<bm.tris.size();t++)
+      mesh.tris.push_back(IntTriple(vmap[bm.tris[t].a],vmap[bm.tris[t].b],vmap[bm.tris[t].c]));
   }
-}
\ No newline at end of file
+}
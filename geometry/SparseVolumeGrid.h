@@ -126,8 +126,10 @@ class SparseVolumeGrid
   void Max(Real val,int channel=0);
   void Min(Real val,int channel=0);
 
-  ///Generates a mesh for the level set at the given level set (usually 0), using the marching cubes algorithm
-  void ExtractMesh(float isosurface,Meshing::TriMesh& mesh);
+  ///Generates a mesh for the level set at the given level set (usually 0), using the marching cubes algorithm.
+  ///Blocks may be meshed in parallel by passing numThreads > 1 (<= 0 uses the hardware concurrency), and vertices
+  ///on the seams between blocks are shared.
+  void ExtractMesh(float isosurface,Meshing::TriMesh& mesh,int numThreads=1);
 
   GridHash3D hash;
   int blockIDCounter;
@@ -76,6 +76,22 @@ bool UnboundedPolytope2D::Contains(const Vector2& x) const
   return true;
 }
 
+bool UnboundedPolytope2D::ContainsBounded(const Vector2& x) const
+{
+  int n=(int)vertices.size();
+  if(n < 3) return Contains(x);
+  //find the wedge (v0,vi,vi+1) containing x
+  if(Orient2D(vertices[0],vertices[1],x) < 0) return false;
+  if(Orient2D(vertices[0],vertices[n-1],x) > 0) return false;
+  int lo=1,hi=n-1;
+  while(hi-lo > 1) {
+    int mid=(lo+hi)/2;
+    if(Orient2D(vertices[0],vertices[mid],x) >= 0) lo=mid;
+    else hi=mid;
+  }
+  return Orient2D(vertices[lo],vertices[lo+1],x) >= 0;
+}
+
 Real UnboundedPolytope2D::Margin(const Vector2& x) const
 {
   Real margin=-Inf;
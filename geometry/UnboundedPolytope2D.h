@@ -22,6 +22,10 @@ struct UnboundedPolytope2D
   void CalcVertices();
   /// Returns true if the point is within the polytope
   bool Contains(const Vector2& x) const;
+  /// Same as Contains(), but binary searches the vertex representation in
+  /// O(log n) time.  The vertices must form a bounded convex polygon in CCW
+  /// order, with no rays (as produced by ConvexHull2D_Chain).
+  bool ContainsBounded(const Vector2& x) const;
   /// Returns the orthogonal distance to the nearest plane (<0 means outside)
   Real Margin(const Vector2& x) const;
   /// Returns the closest point inside the polytope if one exists (<0 means
@@ -0,0 +1,413 @@
+#include "BatchedDecomposition.h"
+#include <errors.h>
+#include <algorithm>
+#include <limits>
+
+/* All loops over the batch index are innermost and run over contiguous
+ * arrays, with data-dependent choices written as selects, so that they
+ * vectorize.  Large batches are processed in blocks of kBatchBlock items
+ * so that a block's elements stay in cache for the whole factorization.
+ */
+
+namespace Math {
+
+static const int kBatchBlock = 64;
+
+template <class T>
+BatchedMatrixTemplate<T>::BatchedMatrixTemplate()
+  :size(0),m(0),n(0)
+{}
+
+template <class T>
+BatchedMatrixTemplate<T>::BatchedMatrixTemplate(int _size,int _m,int _n)
+  :size(0),m(0),n(0)
+{
+  resize(_size,_m,_n);
+}
+
+template <class T>
+void BatchedMatrixTemplate<T>::resize(int _size,int _m,int _n)
+{
+  size = _size;
+  m = _m;
+  n = _n;
+  data.resize(size*m*n);
+}
+
+template <class T>
+void BatchedMatrixTemplate<T>::setZero()
+{
+  std::fill(data.begin(),data.end(),T(0));
+}
+
+template <class T>
+void BatchedMatrixTemplate<T>::set(int k,const MatrixT& A)
+{
+  Assert(A.m == m && A.n == n);
+  for(int i=0;i<m;i++)
+    for(int j=0;j<n;j++)
+      (*this)(k,i,j) = A(i,j);
+}
+
+template <class T>
+void BatchedMatrixTemplate<T>::set(int k,const VectorT& v)
+{
+  Assert(v.n == m && n == 1);
+  for(int i=0;i<m;i++)
+    (*this)(k,i,0) = v(i);
+}
+
+template <class T>
+void BatchedMatrixTemplate<T>::get(int k,MatrixT& A) const
+{
+  A.resize(m,n);
+  for(int i=0;i<m;i++)
+    for(int j=0;j<n;j++)
+      A(i,j) = (*this)(k,i,j);
+}
+
+template <class T>
+void BatchedMatrixTemplate<T>::get(int k,VectorT& v) const
+{
+  Assert(n == 1);
+  v.resize(m);
+  for(int i=0;i<m;i++)
+    v(i) = (*this)(k,i,0);
+}
+
+
+
+template <class T>
+BatchedCholeskyDecomposition<T>::BatchedCholeskyDecomposition()
+  :zeroTolerance(0)
+{}
+
+template <class T>
+int BatchedCholeskyDecomposition<T>::set(const BatchedMatrixT& A)
+{
+  if(A.m != A.n)
+    FatalError("Non-square matrices in batched Cholesky decomposition");
+  int n=A.n,size=A.size;
+  L.resize(size,n,n);
+  L.setZero();
+  invDiag.resize(n*size);
+  valid.assign(size,1);
+  for(int b0=0;b0<size;b0+=kBatchBlock) {
+    int b1=Min(b0+kBatchBlock,size);
+    for(int j=0;j<n;j++) {
+      T* Ljj = L.element(j,j);
+      const T* Ajj = A.element(j,j);
+      for(int b=b0;b<b1;b++) Ljj[b] = Ajj[b];
+      for(int k=0;k<j;k++) {
+        const T* Ljk = L.element(j,k);
+        for(int b=b0;b<b1;b++) Ljj[b] -= Ljk[b]*Ljk[b];
+      }
+      T* inv = &invDiag[j*size];
+      for(int b=b0;b<b1;b++) {
+        int ok = (Ljj[b] > zeroTolerance);
+        valid[b] &= ok;
+        Ljj[b] = Sqrt(ok ? Ljj[b] : T(1));
+        inv[b] = T(1)/Ljj[b];
+      }
+      for(int i=j+1;i<n;i++) {
+        T* Lij = L.element(i,j);
+        const T* Aij = A.element(i,j);
+        for(int b=b0;b<b1;b++) Lij[b] = Aij[b];
+        for(int k=0;k<j;k++) {
+          const T* Lik = L.element(i,k);
+          const T* Ljk = L.element(j,k);
+          for(int b=b0;b<b1;b++) Lij[b] -= Lik[b]*Ljk[b];
+        }
+        for(int b=b0;b<b1;b++) Lij[b] *= inv[b];
+      }
+    }
+  }
+  return (int)std::count(valid.begin(),valid.end(),1);
+}
+
+template <class T>
+void BatchedCholeskyDecomposition<T>::backSub(const BatchedMatrixT& bvec,BatchedMatrixT& x) const
+{
+  int n=L.n,size=L.size;
+  Assert(bvec.size == size && bvec.m == n && bvec.n == 1);
+  x = bvec;
+  for(int b0=0;b0<size;b0+=kBatchBlock) {
+    int b1=Min(b0+kBatchBlock,size);
+    //L y = b
+    for(int i=0;i<n;i++) {
+      T* xi = x.element(i,0);
+      for(int k=0;k<i;k++) {
+        const T* Lik = L.element(i,k);
+        const T* xk = x.element(k,0);
+        for(int b=b0;b<b1;b++) xi[b] -= Lik[b]*xk[b];
+      }
+      const T* inv = &invDiag[i*size];
+      for(int b=b0;b<b1;b++) xi[b] *= inv[b];
+    }
+    //L^t x = y
+    for(int i=n-1;i>=0;i--) {
+      T* xi = x.element(i,0);
+      for(int k=i+1;k<n;k++) {
+        const T* Lki = L.element(k,i);
+        const T* xk = x.element(k,0);
+        for(int b=b0;b<b1;b++) xi[b] -= Lki[b]*xk[b];
+      }
+      const T* inv = &invDiag[i*size];
+      for(int b=b0;b<b1;b++) xi[b] *= inv[b];
+    }
+  }
+}
+
+
+
+template <class T>
+BatchedQRDecomposition<T>::BatchedQRDecomposition()
+  :zeroTolerance(0)
+{}
+
+template <class T>
+int BatchedQRDecomposition<T>::set(const BatchedMatrixT& A)
+{
+  if(A.m < A.n)
+    FatalError("Batched QR decomposition requires m >= n");
+  int m=A.m,n=A.n,size=A.size;
+  QR = A;
+  vdiag.resize(n*size);
+  rdiag.resize(n*size);
+  beta.resize(n*size);
+  valid.assign(size,1);
+  std::vector<T> norm2(size),s(size);
+  for(int b0=0;b0<size;b0+=kBatchBlock) {
+    int b1=Min(b0+kBatchBlock,size);
+    for(int k=0;k<n;k++) {
+      //Householder vector v = a - alpha e_k, alpha = -sign(a_k)|a|
+      T* akk = QR.element(k,k);
+      for(int b=b0;b<b1;b++) norm2[b] = akk[b]*akk[b];
+      for(int i=k+1;i<m;i++) {
+        const T* aik = QR.element(i,k);
+        for(int b=b0;b<b1;b++) norm2[b] += aik[b]*aik[b];
+      }
+      T* vk = &vdiag[k*size];
+      T* rk = &rdiag[k*size];
+      T* bk = &beta[k*size];
+      for(int b=b0;b<b1;b++) {
+        T nrm = Sqrt(norm2[b]);
+        T alpha = (akk[b] > 0 ? -nrm : nrm);
+        vk[b] = akk[b]-alpha;
+        T vnorm2 = norm2[b] - akk[b]*akk[b] + vk[b]*vk[b];
+        bk[b] = (vnorm2 > 0 ? T(2)/vnorm2 : T(0));
+        rk[b] = alpha;
+        akk[b] = alpha;
+        valid[b] &= (Abs(alpha) > zeroTolerance);
+      }
+      //apply I - beta v v^t to the remaining columns
+      for(int j=k+1;j<n;j++) {
+        T* akj = QR.element(k,j);
+        for(int b=b0;b<b1;b++) s[b] = vk[b]*akj[b];
+        for(int i=k+1;i<m;i++) {
+          const T* aik = QR.element(i,k);
+          const T* aij = QR.element(i,j);
+          for(int b=b0;b<b1;b++) s[b] += aik[b]*aij[b];
+        }
+        for(int b=b0;b<b1;b++) {
+          s[b] *= bk[b];
+          akj[b] -= s[b]*vk[b];
+        }
+        for(int i=k+1;i<m;i++) {
+          const T* aik = QR.element(i,k);
+          T* aij = QR.element(i,j);
+          for(int b=b0;b<b1;b++) aij[b] -= s[b]*aik[b];
+        }
+      }
+    }
+  }
+  return (int)std::count(valid.begin(),valid.end(),1);
+}
+
+template <class T>
+void BatchedQRDecomposition<T>::QtMul(const BatchedMatrixT& bvec,BatchedMatrixT& x) const
+{
+  int m=QR.m,n=QR.n,size=QR.size;
+  Assert(bvec.size == size && bvec.m == m && bvec.n == 1);
+  x = bvec;
+  std::vector<T> s(size);
+  for(int b0=0;b0<size;b0+=kBatchBlock) {
+    int b1=Min(b0+kBatchBlock,size);
+    for(int k=0;k<n;k++) {
+      const T* vk = &vdiag[k*size];
+      const T* bk = &beta[k*size];
+      T* xk = x.element(k,0);
+      for(int b=b0;b<b1;b++) s[b] = vk[b]*xk[b];
+      for(int i=k+1;i<m;i++) {
+        const T* aik = QR.element(i,k);
+        const T* xi = x.element(i,0);
+        for(int b=b0;b<b1;b++) s[b] += aik[b]*xi[b];
+      }
+      for(int b=b0;b<b1;b++) {
+        s[b] *= bk[b];
+        xk[b] -= s[b]*vk[b];
+      }
+      for(int i=k+1;i<m;i++) {
+        const T* aik = QR.element(i,k);
+        T* xi = x.element(i,0);
+        for(int b=b0;b<b1;b++) xi[b] -= s[b]*aik[b];
+      }
+    }
+  }
+}
+
+template <class T>
+void BatchedQRDecomposition<T>::leastSquares(const BatchedMatrixT& bvec,BatchedMatrixT& x) const
+{
+  int n=QR.n,size=QR.size;
+  BatchedMatrixT y;
+  QtMul(bvec,y);
+  x.resize(size,n,1);
+  for(int b0=0;b0<size;b0+=kBatchBlock) {
+    int b1=Min(b0+kBatchBlock,size);
+    for(int i=n-1;i>=0;i--) {
+      T* xi = x.element(i,0);
+      const T* yi = y.element(i,0);
+      for(int b=b0;b<b1;b++) xi[b] = yi[b];
+      for(int j=i+1;j<n;j++) {
+        const T* aij = QR.element(i,j);
+        const T* xj = x.element(j,0);
+        for(int b=b0;b<b1;b++) xi[b] -= aij[b]*xj[b];
+      }
+      const T* ri = &rdiag[i*size];
+      for(int b=b0;b<b1;b++) xi[b] /= (ri[b] != 0 ? ri[b] : T(1));
+    }
+  }
+}
+
+
+
+template <class T>
+BatchedSymmetricEigenDecomposition<T>::BatchedSymmetricEigenDecomposition()
+  :maxSweeps(12),tolerance(std::numeric_limits<T>::epsilon())
+{}
+
+template <class T>
+int BatchedSymmetricEigenDecomposition<T>::set(const BatchedMatrixT& A)
+{
+  if(A.m != A.n)
+    FatalError("Non-square matrices in batched eigendecomposition");
+  int n=A.n,size=A.size;
+  D.resize(size,n,n);
+  V.resize(size,n,n);
+  V.setZero();
+  for(int i=0;i<n;i++) {
+    for(int j=0;j<=i;j++) {
+      const T* aij = A.element(i,j);
+      std::copy(aij,aij+size,D.element(i,j));
+      std::copy(aij,aij+size,D.element(j,i));
+    }
+    T* vii = V.element(i,i);
+    std::fill(vii,vii+size,T(1));
+  }
+  std::vector<T> c(size),s(size),off(size),diag(size);
+  T tol2 = Sqr(tolerance);
+  int maxSweepsTaken = 0;
+  for(int b0=0;b0<size;b0+=kBatchBlock) {
+    int b1=Min(b0+kBatchBlock,size);
+    int sweep;
+    for(sweep=0;sweep<maxSweeps;sweep++) {
+      //converged when the off-diagonal mass is negligible for all items
+      //in the block
+      std::fill(off.begin()+b0,off.begin()+b1,T(0));
+      std::fill(diag.begin()+b0,diag.begin()+b1,T(0));
+      for(int i=0;i<n;i++) {
+        const T* dii = D.element(i,i);
+        for(int b=b0;b<b1;b++) diag[b] += dii[b]*dii[b];
+        for(int j=i+1;j<n;j++) {
+          const T* dij = D.element(i,j);
+          for(int b=b0;b<b1;b++) off[b] += dij[b]*dij[b];
+        }
+      }
+      bool converged = true;
+      for(int b=b0;b<b1;b++)
+        if(off[b] > tol2*diag[b]) { converged = false; break; }
+      if(converged) break;
+
+      for(int p=0;p<n;p++) {
+        for(int q=p+1;q<n;q++) {
+          //rotation J (c at pp and qq, s at pq, -s at qp) that zeros D(p,q)
+          const T* app = D.element(p,p);
+          const T* aqq = D.element(q,q);
+          const T* apq = D.element(p,q);
+          for(int b=b0;b<b1;b++) {
+            int zero = (apq[b] == 0);
+            T theta = (aqq[b]-app[b])/(2*(zero ? T(1) : apq[b]));
+            T t = T(1)/(Abs(theta)+Sqrt(theta*theta+1));
+            t = (theta < 0 ? -t : t);
+            T cb = T(1)/Sqrt(t*t+1);
+            c[b] = (zero ? T(1) : cb);
+            s[b] = (zero ? T(0) : t*cb);
+          }
+          //D = J^t D J, V = V J
+          for(int k=0;k<n;k++) {
+            T* dkp = D.element(k,p);
+            T* dkq = D.element(k,q);
+            for(int b=b0;b<b1;b++) {
+              T x=dkp[b],y=dkq[b];
+              dkp[b] = c[b]*x - s[b]*y;
+              dkq[b] = s[b]*x + c[b]*y;
+            }
+          }
+          for(int k=0;k<n;k++) {
+            T* dpk = D.element(p,k);
+            T* dqk = D.element(q,k);
+            for(int b=b0;b<b1;b++) {
+              T x=dpk[b],y=dqk[b];
+              dpk[b] = c[b]*x - s[b]*y;
+              dqk[b] = s[b]*x + c[b]*y;
+            }
+          }
+          for(int k=0;k<n;k++) {
+            T* vkp = V.element(k,p);
+            T* vkq = V.element(k,q);
+            for(int b=b0;b<b1;b++) {
+              T x=vkp[b],y=vkq[b];
+              vkp[b] = c[b]*x - s[b]*y;
+              vkq[b] = s[b]*x + c[b]*y;
+            }
+          }
+          T* dpq = D.element(p,q);
+          T* dqp = D.element(q,p);
+          std::fill(dpq+b0,dpq+b1,T(0));
+          std::fill(dqp+b0,dqp+b1,T(0));
+        }
+      }
+    }
+    maxSweepsTaken = Max(maxSweepsTaken,sweep);
+  }
+  return maxSweepsTaken;
+}
+
+template <class T>
+void BatchedSymmetricEigenDecomposition<T>::get(int k,VectorT& eigenvalues,MatrixT& eigenvectors) const
+{
+  eigenvalues.resize(D.n);
+  for(int i=0;i<D.n;i++) eigenvalues(i) = D(k,i,i);
+  V.get(k,eigenvectors);
+}
+
+template <class T>
+int BatchedSymmetricEigenDecomposition<T>::minEigenvalueIndex(int k) const
+{
+  int imin=0;
+  for(int i=1;i<D.n;i++)
+    if(D(k,i,i) < D(k,imin,imin)) imin=i;
+  return imin;
+}
+
+template class BatchedMatrixTemplate<float>;
+template class BatchedMatrixTemplate<double>;
+template class BatchedCholeskyDecomposition<float>;
+template class BatchedCholeskyDecomposition<double>;
+template class BatchedQRDecomposition<float>;
+template class BatchedQRDecomposition<double>;
+template class BatchedSymmetricEigenDecomposition<float>;
+template class BatchedSymmetricEigenDecomposition<double>;
+
+} //namespace Math
@@ -0,0 +1,146 @@
+#ifndef MATH_BATCHED_DECOMPOSITION_H
+#define MATH_BATCHED_DECOMPOSITION_H
+
+#include "MatrixTemplate.h"
+#include <vector>
+
+/** @file math/BatchedDecomposition.h
+ * @brief Factorizations of many small, same-sized matrices at once.
+ *
+ * The matrices are packed in structure-of-arrays order: element (i,j) of
+ * every matrix in the batch is stored contiguously, so each step of the
+ * factorization is a loop over the batch that the compiler can vectorize.
+ * No pivoting is done, and items that fail (e.g., a matrix that is not
+ * positive definite) are flagged rather than stopping the rest of the batch.
+ *
+ * These are meant for thousands of 2x2 to 12x12 problems per call, where
+ * the per-matrix overhead of the unbatched decompositions dominates.
+ */
+
+namespace Math {
+
+/** @ingroup Math
+ * @brief A batch of m x n matrices stored in structure-of-arrays order.
+ *
+ * Element (i,j) of matrix k is data[(i*n+j)*size+k].  A batch of vectors
+ * is a batch of n x 1 matrices.
+ */
+template <class T>
+class BatchedMatrixTemplate
+{
+public:
+  typedef MatrixTemplate<T> MatrixT;
+  typedef VectorTemplate<T> VectorT;
+
+  BatchedMatrixTemplate();
+  BatchedMatrixTemplate(int size,int m,int n);
+  void resize(int size,int m,int n);
+  void setZero();
+  ///Sets matrix k of the batch
+  void set(int k,const MatrixT& A);
+  void set(int k,const VectorT& v);
+  ///Gets matrix k of the batch
+  void get(int k,MatrixT& A) const;
+  void get(int k,VectorT& v) const;
+
+  ///Returns the array of element (i,j) across the batch
+  inline T* element(int i,int j) { return &data[(i*n+j)*size]; }
+  inline const T* element(int i,int j) const { return &data[(i*n+j)*size]; }
+  inline T& operator()(int k,int i,int j) { return data[(i*n+j)*size+k]; }
+  inline const T& operator()(int k,int i,int j) const { return data[(i*n+j)*size+k]; }
+
+  int size,m,n;
+  std::vector<T> data;
+};
+
+/** @ingroup Math
+ * @brief Cholesky decompositions A = LL^t of a batch of symmetric n x n
+ * matrices.
+ *
+ * Only the lower triangle of each matrix is read.  Items that are not
+ * positive definite have valid[k] = 0, and their solutions are undefined.
+ */
+template <class T>
+class BatchedCholeskyDecomposition
+{
+public:
+  typedef BatchedMatrixTemplate<T> BatchedMatrixT;
+
+  BatchedCholeskyDecomposition();
+  ///Returns the number of items that were factored successfully
+  int set(const BatchedMatrixT& A);
+  ///Solves A x = b for each item, where b and x are batches of n-vectors
+  void backSub(const BatchedMatrixT& b,BatchedMatrixT& x) const;
+
+  BatchedMatrixT L;         ///<lower triangle holds L
+  std::vector<T> invDiag;   ///<element (i,k) is 1/L(i,i) for item k
+  std::vector<int> valid;
+  T zeroTolerance;          ///<pivots <= this fail (default 0)
+};
+
+/** @ingroup Math
+ * @brief Householder QR decompositions A = QR of a batch of m x n
+ * matrices, m >= n.
+ *
+ * Q is stored as the Householder vectors in the lower triangle of QR (with
+ * their leading elements in vdiag), and R in the upper triangle (with its
+ * diagonal in rdiag).  Items with |R(i,i)| <= zeroTolerance for some i have
+ * valid[k] = 0.
+ */
+template <class T>
+class BatchedQRDecomposition
+{
+public:
+  typedef BatchedMatrixTemplate<T> BatchedMatrixT;
+
+  BatchedQRDecomposition();
+  ///Returns the number of items with full column rank
+  int set(const BatchedMatrixT& A);
+  ///Least-squares solution of A x = b for each item, where b is a batch of
+  ///m-vectors and x is a batch of n-vectors
+  void leastSquares(const BatchedMatrixT& b,BatchedMatrixT& x) const;
+  ///Computes Q^t b for a batch of m-vectors
+  void QtMul(const BatchedMatrixT& b,BatchedMatrixT& x) const;
+
+  BatchedMatrixT QR;
+  std::vector<T> vdiag,rdiag,beta;  ///<element (i,k) is for column i of item k
+  std::vector<int> valid;
+  T zeroTolerance;
+};
+
+/** @ingroup Math
+ * @brief Eigendecompositions A = V D V^t of a batch of symmetric n x n
+ * matrices, computed by cyclic Jacobi rotations.
+ *
+ * This also gives singular value decompositions through the normal
+ * matrices A^t A, e.g., for fitting lines and planes to point sets via
+ * their covariance matrices.  The eigenvalues are not sorted.
+ */
+template <class T>
+class BatchedSymmetricEigenDecomposition
+{
+public:
+  typedef MatrixTemplate<T> MatrixT;
+  typedef VectorTemplate<T> VectorT;
+  typedef BatchedMatrixTemplate<T> BatchedMatrixT;
+
+  BatchedSymmetricEigenDecomposition();
+  ///Returns the largest number of sweeps taken by any block of the batch
+  int set(const BatchedMatrixT& A);
+  ///Gets the eigenvalues and eigenvectors (the columns of V) of item k
+  void get(int k,VectorT& eigenvalues,MatrixT& eigenvectors) const;
+  ///Returns the index of the smallest eigenvalue of item k
+  int minEigenvalueIndex(int k) const;
+
+  BatchedMatrixT D;      ///<diagonal holds the eigenvalues (the rest is ~0)
+  BatchedMatrixT V;      ///<columns are the eigenvectors
+  int maxSweeps;         ///<default 12
+  T tolerance;           ///<stop when all off-diagonals are below this, relative to the diagonal
+};
+
+typedef BatchedMatrixTemplate<float> fBatchedMatrix;
+typedef BatchedMatrixTemplate<double> dBatchedMatrix;
+
+} //namespace Math
+
+#endif
@@ -0,0 +1,236 @@
+#include "BlockedMultiply.h"
+#include <vector>
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BLOCKED_MULTIPLY_AVX2 1
+#include <immintrin.h>
+#endif
+
+namespace Math {
+
+/* Blocking follows the usual GotoBLAS / BLIS layout:
+ *  - B is split into kc x nc panels, packed into slivers of NR columns,
+ *  - A is split into mc x kc blocks, packed into slivers of MR rows,
+ *  - the micro-kernel multiplies one A sliver by one B sliver, keeping the
+ *    MR x NR result in registers.
+ * The packed A block is sized to stay in L2 and the B panel in L3.
+ */
+template <class T> struct MultiplyBlocking;
+template <> struct MultiplyBlocking<double> { enum { MR=6, NR=8, KC=256, MC=96, NC=2048 }; };
+template <> struct MultiplyBlocking<float> { enum { MR=6, NR=16, KC=256, MC=144, NC=2048 }; };
+
+//Packs rows [0,mc) and columns [0,kc) of A into slivers of MR rows.  Sliver
+//s holds A(s*MR+i,k) at a[s*MR*kc+k*MR+i], padded with zeros.
+template <class T,int MR>
+static void PackA(const T* A,int ais,int ajs,int mc,int kc,T* a)
+{
+  for(int ir=0;ir<mc;ir+=MR) {
+    int mr = std::min(MR,mc-ir);
+    const T* Ai = A+ir*ais;
+    for(int k=0;k<kc;k++,a+=MR) {
+      const T* Aik = Ai+k*ajs;
+      int i=0;
+      for(;i<mr;i++) a[i] = Aik[i*ais];
+      for(;i<MR;i++) a[i] = 0;
+    }
+  }
+}
+
+//Packs rows [0,kc) and columns [0,nc) of B into slivers of NR columns.
+//Sliver s holds B(k,s*NR+j) at b[s*NR*kc+k*NR+j], padded with zeros.
+template <class T,int NR>
+static void PackB(const T* B,int bis,int bjs,int kc,int nc,T* b)
+{
+  for(int jr=0;jr<nc;jr+=NR) {
+    int nr = std::min(NR,nc-jr);
+    const T* Bj = B+jr*bjs;
+    for(int k=0;k<kc;k++,b+=NR) {
+      const T* Bkj = Bj+k*bis;
+      int j=0;
+      if(bjs == 1)
+        for(;j<nr;j++) b[j] = Bkj[j];
+      else
+        for(;j<nr;j++) b[j] = Bkj[j*bjs];
+      for(;j<NR;j++) b[j] = 0;
+    }
+  }
+}
+
+//c = a*b for an MR x kc sliver a and a kc x NR sliver b.  c is MR x NR,
+//row major.
+template <class T,int MR,int NR>
+static void MicroKernel_Generic(int kc,const T* a,const T* b,T* c)
+{
+  for(int i=0;i<MR*NR;i++) c[i] = 0;
+  for(int k=0;k<kc;k++,a+=MR,b+=NR) {
+    for(int i=0;i<MR;i++) {
+      T ai = a[i];
+      for(int j=0;j<NR;j++)
+        c[i*NR+j] += ai*b[j];
+    }
+  }
+}
+
+#if BLOCKED_MULTIPLY_AVX2
+
+__attribute__((target("avx2,fma")))
+static void MicroKernel_AVX2(int kc,const double* a,const double* b,double* c)
+{
+  __m256d c00=_mm256_setzero_pd(),c01=_mm256_setzero_pd();
+  __m256d c10=_mm256_setzero_pd(),c11=_mm256_setzero_pd();
+  __m256d c20=_mm256_setzero_pd(),c21=_mm256_setzero_pd();
+  __m256d c30=_mm256_setzero_pd(),c31=_mm256_setzero_pd();
+  __m256d c40=_mm256_setzero_pd(),c41=_mm256_setzero_pd();
+  __m256d c50=_mm256_setzero_pd(),c51=_mm256_setzero_pd();
+  for(int k=0;k<kc;k++,a+=6,b+=8) {
+    __m256d b0 = _mm256_loadu_pd(b);
+    __m256d b1 = _mm256_loadu_pd(b+4);
+    __m256d ai;
+    ai = _mm256_broadcast_sd(a);   c00 = _mm256_fmadd_pd(ai,b0,c00); c01 = _mm256_fmadd_pd(ai,b1,c01);
+    ai = _mm256_broadcast_sd(a+1); c10 = _mm256_fmadd_pd(ai,b0,c10); c11 = _mm256_fmadd_pd(ai,b1,c11);
+    ai = _mm256_broadcast_sd(a+2); c20 = _mm256_fmadd_pd(ai,b0,c20); c21 = _mm256_fmadd_pd(ai,b1,c21);
+    ai = _mm256_broadcast_sd(a+3); c30 = _mm256_fmadd_pd(ai,b0,c30); c31 = _mm256_fmadd_pd(ai,b1,c31);
+    ai = _mm256_broadcast_sd(a+4); c40 = _mm256_fmadd_pd(ai,b0,c40); c41 = _mm256_fmadd_pd(ai,b1,c41);
+    ai = _mm256_broadcast_sd(a+5); c50 = _mm256_fmadd_pd(ai,b0,c50); c51 = _mm256_fmadd_pd(ai,b1,c51);
+  }
+  _mm256_storeu_pd(c,c00);    _mm256_storeu_pd(c+4,c01);
+  _mm256_storeu_pd(c+8,c10);  _mm256_storeu_pd(c+12,c11);
+  _mm256_storeu_pd(c+16,c20); _mm256_storeu_pd(c+20,c21);
+  _mm256_storeu_pd(c+24,c30); _mm256_storeu_pd(c+28,c31);
+  _mm256_storeu_pd(c+32,c40); _mm256_storeu_pd(c+36,c41);
+  _mm256_storeu_pd(c+40,c50); _mm256_storeu_pd(c+44,c51);
+}
+
+__attribute__((target("avx2,fma")))
+static void MicroKernel_AVX2(int kc,const float* a,const float* b,float* c)
+{
+  __m256 c00=_mm256_setzero_ps(),c01=_mm256_setzero_ps();
+  __m256 c10=_mm256_setzero_ps(),c11=_mm256_setzero_ps();
+  __m256 c20=_mm256_setzero_ps(),c21=_mm256_setzero_ps();
+  __m256 c30=_mm256_setzero_ps(),c31=_mm256_setzero_ps();
+  __m256 c40=_mm256_setzero_ps(),c41=_mm256_setzero_ps();
+  __m256 c50=_mm256_setzero_ps(),c51=_mm256_setzero_ps();
+  for(int k=0;k<kc;k++,a+=6,b+=16) {
+    __m256 b0 = _mm256_loadu_ps(b);
+    __m256 b1 = _mm256_loadu_ps(b+8);
+    __m256 ai;
+    ai = _mm256_broadcast_ss(a);   c00 = _mm256_fmadd_ps(ai,b0,c00); c01 = _mm256_fmadd_ps(ai,b1,c01);
+    ai = _mm256_broadcast_ss(a+1); c10 = _mm256_fmadd_ps(ai,b0,c10); c11 = _mm256_fmadd_ps(ai,b1,c11);
+    ai = _mm256_broadcast_ss(a+2); c20 = _mm256_fmadd_ps(ai,b0,c20); c21 = _mm256_fmadd_ps(ai,b1,c21);
+    ai = _mm256_broadcast_ss(a+3); c30 = _mm256_fmadd_ps(ai,b0,c30); c31 = _mm256_fmadd_ps(ai,b1,c31);
+    ai = _mm256_broadcast_ss(a+4); c40 = _mm256_fmadd_ps(ai,b0,c40); c41 = _mm256_fmadd_ps(ai,b1,c41);
+    ai = _mm256_broadcast_ss(a+5); c50 = _mm256_fmadd_ps(ai,b0,c50); c51 = _mm256_fmadd_ps(ai,b1,c51);
+  }
+  _mm256_storeu_ps(c,c00);    _mm256_storeu_ps(c+8,c01);
+  _mm256_storeu_ps(c+16,c10); _mm256_storeu_ps(c+24,c11);
+  _mm256_storeu_ps(c+32,c20); _mm256_storeu_ps(c+40,c21);
+  _mm256_storeu_ps(c+48,c30); _mm256_storeu_ps(c+56,c31);
+  _mm256_storeu_ps(c+64,c40); _mm256_storeu_ps(c+72,c41);
+  _mm256_storeu_ps(c+80,c50); _mm256_storeu_ps(c+88,c51);
+}
+
+static bool CPUHasAVX2FMA()
+{
+  static const bool res = (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"));
+  return res;
+}
+
+#endif //BLOCKED_MULTIPLY_AVX2
+
+bool BlockedMultiplyUsesAVX2()
+{
+#if BLOCKED_MULTIPLY_AVX2
+  return CPUHasAVX2FMA();
+#else
+  return false;
+#endif
+}
+
+//Writes (or adds, if accumulate is true) the upper-left mr x nr part of the
+//MR x NR tile c to X
+template <class T,int NR>
+static void StoreTile(const T* c,int mr,int nr,T* X,int xis,int xjs,bool accumulate)
+{
+  for(int i=0;i<mr;i++,X+=xis,c+=NR) {
+    T* Xij = X;
+    if(accumulate)
+      for(int j=0;j<nr;j++,Xij+=xjs) *Xij += c[j];
+    else
+      for(int j=0;j<nr;j++,Xij+=xjs) *Xij = c[j];
+  }
+}
+
+//Packing buffers are kept per thread and only grow, so repeated products
+//don't allocate.  The B panel is too large for the workspace arena.
+template <class T>
+static T* PackBuffer(std::vector<T>& buf,size_t n)
+{
+  if(buf.size() < n) buf.resize(n);
+  return &buf[0];
+}
+
+template <class T>
+static void BlockedMultiplyT(T* X,int xis,int xjs,
+                             const T* A,int ais,int ajs,
+                             const T* B,int bis,int bjs,
+                             int m,int n,int p)
+{
+  typedef MultiplyBlocking<T> Blocking;
+  const int MR=Blocking::MR, NR=Blocking::NR;
+  if(m <= 0 || p <= 0) return;
+  if(n <= 0) {
+    for(int i=0;i<m;i++)
+      for(int j=0;j<p;j++) X[i*xis+j*xjs] = 0;
+    return;
+  }
+  int kcmax = std::min((int)Blocking::KC,n);
+  int mcmax = std::min((int)Blocking::MC,(m+MR-1)/MR*MR);
+  int ncmax = std::min((int)Blocking::NC,(p+NR-1)/NR*NR);
+  static thread_local std::vector<T> apackBuffer,bpackBuffer;
+  T* apack = PackBuffer(apackBuffer,size_t(mcmax)*kcmax);
+  T* bpack = PackBuffer(bpackBuffer,size_t(kcmax)*ncmax);
+  T c[MR*NR];
+  void (*kernel)(int,const T*,const T*,T*) = MicroKernel_Generic<T,MR,NR>;
+#if BLOCKED_MULTIPLY_AVX2
+  if(CPUHasAVX2FMA()) kernel = MicroKernel_AVX2;
+#endif
+  for(int jc=0;jc<p;jc+=Blocking::NC) {
+    int nc = std::min((int)Blocking::NC,p-jc);
+    for(int pc=0;pc<n;pc+=Blocking::KC) {
+      int kc = std::min((int)Blocking::KC,n-pc);
+      PackB<T,NR>(B+pc*bis+jc*bjs,bis,bjs,kc,nc,bpack);
+      for(int ic=0;ic<m;ic+=Blocking::MC) {
+        int mc = std::min((int)Blocking::MC,m-ic);
+        PackA<T,MR>(A+ic*ais+pc*ajs,ais,ajs,mc,kc,apack);
+        for(int jr=0;jr<nc;jr+=NR) {
+          int nr = std::min(NR,nc-jr);
+          const T* b = bpack+jr*kc;
+          for(int ir=0;ir<mc;ir+=MR) {
+            int mr = std::min(MR,mc-ir);
+            kernel(kc,apack+ir*kc,b,c);
+            StoreTile<T,NR>(c,mr,nr,X+(ic+ir)*xis+(jc+jr)*xjs,xis,xjs,pc>0);
+          }
+        }
+      }
+    }
+  }
+}
+
+void BlockedMultiply(float* X,int xis,int xjs,
+                     const float* A,int ais,int ajs,
+                     const float* B,int bis,int bjs,
+                     int m,int n,int p)
+{
+  BlockedMultiplyT(X,xis,xjs,A,ais,ajs,B,bis,bjs,m,n,p);
+}
+
+void BlockedMultiply(double* X,int xis,int xjs,
+                     const double* A,int ais,int ajs,
+                     const double* B,int bis,int bjs,
+                     int m,int n,int p)
+{
+  BlockedMultiplyT(X,xis,xjs,A,ais,ajs,B,bis,bjs,m,n,p);
+}
+
+} //namespace Math
@@ -0,0 +1,41 @@
+#ifndef MATH_BLOCKED_MULTIPLY_H
+#define MATH_BLOCKED_MULTIPLY_H
+
+namespace Math {
+
+/** @ingroup Math
+ * @brief Computes X = A*B for strided arrays using a packed, cache-blocked
+ * kernel.  X is mxp, A is mxn, and B is nxp.
+ *
+ * Strides follow the conventions of gen_array2d_multiply: element (i,j) of
+ * A is A[i*ais+j*ajs], and so on.  Transposed products are computed by
+ * swapping the strides of the transposed argument.  X must not overlap A or
+ * B.
+ *
+ * Blocks of A and B are packed into contiguous panels and multiplied by a
+ * register-tiled micro-kernel.  On x86 processors with AVX2 and FMA, an
+ * AVX2 micro-kernel is selected at runtime.
+ */
+void BlockedMultiply(float* X,int xis,int xjs,
+                     const float* A,int ais,int ajs,
+                     const float* B,int bis,int bjs,
+                     int m,int n,int p);
+void BlockedMultiply(double* X,int xis,int xjs,
+                     const double* A,int ais,int ajs,
+                     const double* B,int bis,int bjs,
+                     int m,int n,int p);
+
+///Returns true if the blocked kernel is faster than the naive triple loop
+///for a product of the given dimensions.  Packing dominates for tiny
+///matrices.
+inline bool UseBlockedMultiply(int m,int n,int p)
+{
+  return m >= 8 && p >= 8 && n >= 8;
+}
+
+///Returns true if the AVX2/FMA micro-kernel is used
+bool BlockedMultiplyUsesAVX2();
+
+} //namespace Math
+
+#endif
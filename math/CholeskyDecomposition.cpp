@@ -4,6 +4,7 @@
 #include "complex.h"
 #include <iostream>
 #include <errors.h>
+#include <float.h>
 
 namespace Math {
 
@@ -273,6 +274,96 @@ bool CholeskyDecomposition<Complex>::setPerturbed(const MatrixT& A,Complex& lamb
 
 */
 
+MixedPrecisionCholeskyDecomposition::MixedPrecisionCholeskyDecomposition()
+:usingDouble(false),maxIters(10),tolerance(DBL_EPSILON),numIters(0),Anorm(0),factored(false)
+{}
+
+bool MixedPrecisionCholeskyDecomposition::set(const MatrixTemplate<double>& _A)
+{
+  if(_A.m != _A.n) return false;
+  A = _A;
+  Anorm = 0;
+  for(int i=0;i<A.m;i++) {
+    double sum = 0;
+    for(int j=0;j<A.n;j++) sum += Abs(A(i,j));
+    Anorm = Max(Anorm,sum);
+  }
+  usingDouble = false;
+  factored = true;
+  if(Anorm < FLT_MAX && factorFloat()) return true;
+  usingDouble = true;
+  factored = chold.set(A);
+  return factored;
+}
+
+//Right-looking factorization A = U^t U on the upper triangle, so that the
+//updates of the trailing matrix run along contiguous rows and vectorize.
+//L = U^t is then copied to cholf.L.
+bool MixedPrecisionCholeskyDecomposition::factorFloat()
+{
+  int n = A.n;
+  U.resize(n,n);
+  U.copy(A);
+  Assert(U.jstride == 1);
+  for(int k=0;k<n;k++) {
+    float* rk = &U(k,0);
+    if(!(rk[k] > 0)) return false;
+    float ukk = Sqrt(rk[k]);
+    if(ukk < cholf.zeroEpsilon) return false;
+    rk[k] = ukk;
+    float inv = 1.0f/ukk;
+    for(int j=k+1;j<n;j++) rk[j] *= inv;
+    for(int i=k+1;i<n;i++) {
+      float* ri = &U(i,0);
+      float u = rk[i];
+      if(u == 0) continue;
+      for(int j=i;j<n;j++) ri[j] -= u*rk[j];
+    }
+  }
+  cholf.L.resize(n,n);
+  for(int i=0;i<n;i++) {
+    for(int j=0;j<=i;j++) cholf.L(i,j) = U(j,i);
+    for(int j=i+1;j<n;j++) cholf.L(i,j) = 0;
+  }
+  return true;
+}
+
+bool MixedPrecisionCholeskyDecomposition::backSub(const VectorTemplate<double>& b,VectorTemplate<double>& x)
+{
+  numIters = 0;
+  if(!factored) {
+    x.clear();
+    return false;
+  }
+  if(usingDouble) {
+    chold.backSub(b,x);
+    return true;
+  }
+  int n = A.n;
+  VectorTemplate<float> rf,dxf;
+  VectorTemplate<double> r;
+  rf.copy(b);
+  cholf.backSub(rf,dxf);
+  x.copy(dxf);
+  double rnormPrev = dInf;
+  for(numIters=0;numIters<maxIters;numIters++) {
+    A.mul(x,r);
+    r.sub(b,r);
+    double rnorm = r.maxAbsElement();
+    if(rnorm <= tolerance*Sqrt(double(n))*Anorm*x.maxAbsElement()) return true;
+    if(!(rnorm < rnormPrev)) break;  //stagnating or diverging
+    rnormPrev = rnorm;
+    rf.copy(r);
+    cholf.backSub(rf,dxf);
+    for(int i=0;i<n;i++) x(i) += dxf(i);
+  }
+  //refinement failed, fall back to double
+  if(!chold.set(A)) return false;
+  usingDouble = true;
+  chold.backSub(b,x);
+  return true;
+}
+
 template class CholeskyDecomposition<float>;
 template class CholeskyDecomposition<double>;
 //template class CholeskyDecomposition<Complex>;
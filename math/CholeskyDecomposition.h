@@ -39,5 +39,41 @@ public:
   T zeroEpsilon;
 };
 
+/** @ingroup Math
+ * @brief Solves A x = b for positive definite A by factoring A in single
+ * precision and refining the solution in double precision.
+ *
+ * Works like MixedPrecisionLUDecomposition: A is factored in float, and
+ * backSub refines the solution using residuals computed in double.  If A
+ * is not positive definite in float, or refinement fails to converge, A
+ * is factored in double instead.
+ */
+class MixedPrecisionCholeskyDecomposition
+{
+public:
+  MixedPrecisionCholeskyDecomposition();
+  ///Returns false if A is not positive definite (even in double precision)
+  bool set(const MatrixTemplate<double>& A);
+  ///Solves A x = b.  May fall back to a double factorization, so it is
+  ///not const.  Returns false if A couldn't be factored, or if refinement
+  ///failed and A is not positive definite in double precision, in which case x is the
+  ///last refined float solution (or empty, if set() failed).
+  bool backSub(const VectorTemplate<double>& b,VectorTemplate<double>& x);
+
+  MatrixTemplate<double> A;             ///<copy of A, for the residuals
+  CholeskyDecomposition<float> cholf;   ///<the single precision factorization
+  CholeskyDecomposition<double> chold;  ///<the double factorization, if needed
+  bool usingDouble;                     ///<true if chold is in use
+  int maxIters;                         ///<maximum refinement steps (default 10)
+  double tolerance;                     ///<default DBL_EPSILON
+  int numIters;                         ///<refinement steps taken by the last backSub
+
+private:
+  bool factorFloat();
+  double Anorm;
+  bool factored;
+  MatrixTemplate<float> U;
+};
+
 }
 #endif
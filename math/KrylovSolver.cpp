@@ -0,0 +1,488 @@
+#include <KrisLibrary/Logger.h>
+#include "KrylovSolver.h"
+#include "misc.h"
+#include <errors.h>
+#include <float.h>
+
+namespace Math {
+
+MatrixOperator::MatrixOperator(const Matrix& _A)
+  :A(_A)
+{}
+
+SparseMatrixOperator::SparseMatrixOperator(const SparseMatrixTemplate_CR<Real>& _A,int _numThreads)
+  :A(_A),numThreads(_numThreads)
+{}
+
+JacobianVectorOperator::JacobianVectorOperator(VectorFieldFunction* _func,const Vector& _x,const Vector& _fx)
+  :func(_func),x(_x),fx(_fx),useDirectionalDeriv(false),numEvals(0)
+{}
+
+void JacobianVectorOperator::Mul(const Vector& v,Vector& y)
+{
+  if(useDirectionalDeriv) {
+    func->DirectionalDeriv(x,v,y);
+    return;
+  }
+  y.resize(fx.n);
+  Real vnorm = v.norm();
+  if(vnorm == 0) {
+    y.setZero();
+    return;
+  }
+  Real h = Sqrt(DBL_EPSILON)*(One+x.norm())/vnorm;
+  xtemp.resize(x.n);
+  xtemp.copy(x);
+  xtemp.madd(v,h);
+  (*func)(xtemp,y);
+  numEvals++;
+  y -= fx;
+  y.inplaceMul(Inv(h));
+}
+
+bool DiagonalPreconditioner::set(const SparseMatrixTemplate_CR<Real>& A)
+{
+  Assert(A.isSquare());
+  invDiag.resize(A.m);
+  for(int i=0;i<A.m;i++) {
+    const Real* aii = A.getEntry(i,i);
+    if(!aii || *aii == 0) return false;
+    invDiag(i) = Inv(*aii);
+  }
+  return true;
+}
+
+void DiagonalPreconditioner::Solve(const Vector& r,Vector& z)
+{
+  z.resize(r.n);
+  for(int i=0;i<r.n;i++) z(i) = r(i)*invDiag(i);
+}
+
+IncompleteCholeskyPreconditioner::IncompleteCholeskyPreconditioner()
+  :shift(0),maxShift(1)
+{}
+
+bool IncompleteCholeskyPreconditioner::set(const SparseMatrixTemplate_CR<Real>& A)
+{
+  Assert(A.isSquare());
+  int n = A.n;
+  //copy the lower triangle
+  int nnz = 0;
+  for(int i=0;i<n;i++) {
+    const int* cols = A.rowIndices(i);
+    for(int k=0;k<A.numRowEntries(i);k++)
+      if(cols[k] <= i) nnz++;
+  }
+  L.initialize(n,n,nnz);
+  nnz = 0;
+  for(int i=0;i<n;i++) {
+    L.row_offsets[i] = nnz;
+    const int* cols = A.rowIndices(i);
+    const Real* vals = A.rowValues(i);
+    for(int k=0;k<A.numRowEntries(i);k++) {
+      if(cols[k] > i) break;
+      L.col_indices[nnz] = cols[k];
+      L.val_array[nnz] = vals[k];
+      nnz++;
+    }
+    if(nnz == L.row_offsets[i] || L.col_indices[nnz-1] != i) {
+      LOG4CXX_ERROR(KrisLibrary::logger(),"IncompleteCholeskyPreconditioner: diagonal entry "<<i<<" is missing");
+      return false;
+    }
+  }
+  L.row_offsets[n] = nnz;
+  std::vector<Real> Avals(L.val_array,L.val_array+nnz);
+
+  shift = 0;
+  while(true) {
+    bool ok = true;
+    for(int i=0;i<n && ok;i++) {
+      int istart = L.row_offsets[i], idiag = L.row_offsets[i+1]-1;
+      for(int p=istart;p<=idiag;p++) {
+        int k = L.col_indices[p];
+        //sparse dot product of rows i and k over the columns before k
+        Real sum = Avals[p];
+        if(k == i) sum *= One+shift;
+        int pi = istart, pk = L.row_offsets[k], kdiag = L.row_offsets[k+1]-1;
+        while(pi < p && pk < kdiag) {
+          int ci = L.col_indices[pi], ck = L.col_indices[pk];
+          if(ci == ck) { sum -= L.val_array[pi]*L.val_array[pk]; pi++; pk++; }
+          else if(ci < ck) pi++;
+          else pk++;
+        }
+        if(k < i) L.val_array[p] = sum/L.val_array[kdiag];
+        else if(sum > 0) L.val_array[p] = Sqrt(sum);
+        else ok = false;
+      }
+    }
+    if(ok) return true;
+    shift = (shift == 0 ? 1e-3 : shift*10);
+    if(shift > maxShift) return false;
+  }
+  return false;
+}
+
+void IncompleteCholeskyPreconditioner::Solve(const Vector& r,Vector& z)
+{
+  int n = L.n;
+  z.resize(n);
+  //L y = r
+  for(int i=0;i<n;i++) {
+    Real sum = r(i);
+    int idiag = L.row_offsets[i+1]-1;
+    for(int p=L.row_offsets[i];p<idiag;p++)
+      sum -= L.val_array[p]*z(L.col_indices[p]);
+    z(i) = sum/L.val_array[idiag];
+  }
+  //L^t z = y, by columns of L^t
+  for(int i=n-1;i>=0;i--) {
+    int idiag = L.row_offsets[i+1]-1;
+    z(i) /= L.val_array[idiag];
+    Real zi = z(i);
+    for(int p=L.row_offsets[i];p<idiag;p++)
+      z(L.col_indices[p]) -= L.val_array[p]*zi;
+  }
+}
+
+bool ILU0Preconditioner::set(const SparseMatrixTemplate_CR<Real>& A)
+{
+  Assert(A.isSquare());
+  int n = A.n;
+  LU.copy(A);
+  diagIndex.resize(n);
+  for(int i=0;i<n;i++) {
+    diagIndex[i] = -1;
+    for(int p=LU.row_offsets[i];p<LU.row_offsets[i+1];p++)
+      if(LU.col_indices[p] == i) { diagIndex[i] = p; break; }
+    if(diagIndex[i] < 0) {
+      LOG4CXX_ERROR(KrisLibrary::logger(),"ILU0Preconditioner: diagonal entry "<<i<<" is missing");
+      return false;
+    }
+  }
+  std::vector<int> pos(n,-1);
+  for(int i=0;i<n;i++) {
+    for(int p=LU.row_offsets[i];p<LU.row_offsets[i+1];p++)
+      pos[LU.col_indices[p]] = p;
+    for(int p=LU.row_offsets[i];p<diagIndex[i];p++) {
+      int k = LU.col_indices[p];
+      Real lik = LU.val_array[p] / LU.val_array[diagIndex[k]];
+      LU.val_array[p] = lik;
+      for(int pk=diagIndex[k]+1;pk<LU.row_offsets[k+1];pk++) {
+        int j = pos[LU.col_indices[pk]];
+        if(j >= 0) LU.val_array[j] -= lik*LU.val_array[pk];
+      }
+    }
+    for(int p=LU.row_offsets[i];p<LU.row_offsets[i+1];p++)
+      pos[LU.col_indices[p]] = -1;
+    if(LU.val_array[diagIndex[i]] == 0) return false;
+  }
+  return true;
+}
+
+void ILU0Preconditioner::Solve(const Vector& r,Vector& z)
+{
+  int n = LU.n;
+  z.resize(n);
+  for(int i=0;i<n;i++) {
+    Real sum = r(i);
+    for(int p=LU.row_offsets[i];p<diagIndex[i];p++)
+      sum -= LU.val_array[p]*z(LU.col_indices[p]);
+    z(i) = sum;
+  }
+  for(int i=n-1;i>=0;i--) {
+    Real sum = z(i);
+    for(int p=diagIndex[i]+1;p<LU.row_offsets[i+1];p++)
+      sum -= LU.val_array[p]*z(LU.col_indices[p]);
+    z(i) = sum/LU.val_array[diagIndex[i]];
+  }
+}
+
+//sizes a workspace vector, which may have been used for a different size
+static void ResizeWorkspace(Vector& v,int n)
+{
+  if(v.n != n) {
+    v.clear();
+    v.resize(n);
+  }
+}
+
+KrylovSolver::KrylovSolver()
+  :method(GMRES),preconditioner(NULL),tolerance(1e-8),maxIters(0),restart(30),verbose(0),
+   numIters(0),residualNorm(0)
+{}
+
+void KrylovSolver::Precondition(const Vector& r,Vector& z)
+{
+  if(preconditioner) preconditioner->Solve(r,z);
+  else z.copy(r);
+}
+
+bool KrylovSolver::Solve(LinearOperator& A,const Vector& b,Vector& x)
+{
+  int n = A.NumCols();
+  if(A.NumRows() != n || b.n != n)
+    FatalError("KrylovSolver: A must be square, got %d x %d, b has size %d",A.NumRows(),n,b.n);
+  if(x.n != n) {
+    x.clear();
+    x.resize(n,Zero);
+  }
+  Vector* work[8] = {&r,&z,&p,&q,&s,&t,&v,&w};
+  for(int i=0;i<8;i++) ResizeWorkspace(*work[i],n);
+  numIters = 0;
+  iterLimit = (maxIters > 0 ? maxIters : 2*n);
+  Real bnorm = b.norm();
+  if(bnorm == 0) {
+    x.setZero();
+    residualNorm = 0;
+    return true;
+  }
+  target = tolerance*bnorm;
+  bool res = false;
+  switch(method) {
+  case ConjugateGradient: res = SolveCG(A,b,x); break;
+  case MINRES: res = SolveMINRES(A,b,x); break;
+  case GMRES: res = SolveGMRES(A,b,x); break;
+  case BiCGStab: res = SolveBiCGStab(A,b,x); break;
+  }
+  if(verbose) LOG4CXX_INFO(KrisLibrary::logger(),"KrylovSolver: "<<(res?"converged":"did not converge")<<" in "<<numIters<<" iterations, residual "<<residualNorm);
+  return res;
+}
+
+bool KrylovSolver::SolveCG(LinearOperator& A,const Vector& b,Vector& x)
+{
+  A.Mul(x,q);
+  r.sub(b,q);
+  residualNorm = r.norm();
+  if(residualNorm <= target) return true;
+  Real rho,rhoPrev=0;
+  for(numIters=1;numIters<=iterLimit;numIters++) {
+    Precondition(r,z);
+    rho = r.dot(z);
+    if(numIters == 1) p.copy(z);
+    else {
+      p.inplaceMul(rho/rhoPrev);
+      p += z;
+    }
+    A.Mul(p,q);
+    Real pq = p.dot(q);
+    if(pq <= 0) {
+      if(verbose) LOG4CXX_INFO(KrisLibrary::logger(),"KrylovSolver: matrix is not positive definite");
+      return false;
+    }
+    Real alpha = rho/pq;
+    x.madd(p,alpha);
+    r.madd(q,-alpha);
+    residualNorm = r.norm();
+    if(residualNorm <= target) return true;
+    rhoPrev = rho;
+  }
+  numIters = iterLimit;
+  return false;
+}
+
+//Follows the preconditioned MINRES of Paige and Saunders
+bool KrylovSolver::SolveMINRES(LinearOperator& A,const Vector& b,Vector& x)
+{
+  int n = b.n;
+  Vector& r1 = r, &r2 = s, &y = t, &w1 = p, &w2 = q;
+  A.Mul(x,y);
+  r1.sub(b,y);
+  Precondition(r1,y);
+  Real beta1 = r1.dot(y);
+  if(beta1 < 0) {
+    LOG4CXX_ERROR(KrisLibrary::logger(),"KrylovSolver: MINRES preconditioner is not positive definite");
+    return false;
+  }
+  //stop on the residual in the M^-1 norm, relative to that of b
+  Precondition(b,z);
+  Real targetM = tolerance*Sqrt(Max(b.dot(z),Zero));
+  beta1 = Sqrt(beta1);
+  residualNorm = beta1;
+  if(beta1 <= targetM) return true;
+  r2.copy(r1);
+  w.resize(n); w.setZero();
+  w1.resize(n); w1.setZero();
+  w2.resize(n); w2.setZero();
+  Real oldb=0,beta=beta1,dbar=0,epsln=0,phibar=beta1;
+  Real cs=-1,sn=0;
+  for(numIters=1;numIters<=iterLimit;numIters++) {
+    v.mul(y,Inv(beta));
+    A.Mul(v,y);
+    if(numIters >= 2) y.madd(r1,-beta/oldb);
+    Real alpha = v.dot(y);
+    y.madd(r2,-alpha/beta);
+    r1.swap(r2);
+    r2.copy(y);
+    Precondition(r2,y);
+    oldb = beta;
+    beta = r2.dot(y);
+    if(beta < 0) {
+      LOG4CXX_ERROR(KrisLibrary::logger(),"KrylovSolver: MINRES preconditioner is not positive definite");
+      return false;
+    }
+    beta = Sqrt(beta);
+    //apply the previous rotation, then compute the next one
+    Real oldeps = epsln;
+    Real delta = cs*dbar + sn*alpha;
+    Real gbar = sn*dbar - cs*alpha;
+    epsln = sn*beta;
+    dbar = -cs*beta;
+    Real gamma = Max(pythag(gbar,beta),(Real)DBL_EPSILON);
+    cs = gbar/gamma;
+    sn = beta/gamma;
+    Real phi = cs*phibar;
+    phibar = sn*phibar;
+    //update the search directions and x
+    w1.swap(w2);
+    w2.swap(w);
+    for(int i=0;i<n;i++)
+      w(i) = (v(i) - oldeps*w1(i) - delta*w2(i))/gamma;
+    x.madd(w,phi);
+    residualNorm = phibar;
+    if(phibar <= targetM) return true;
+    if(beta == 0) break;   //invariant subspace found, x is exact
+  }
+  if(numIters > iterLimit) numIters = iterLimit;
+  A.Mul(x,y);
+  y -= b;
+  residualNorm = y.norm();
+  return residualNorm <= target;
+}
+
+static inline void GivensRotation(Real a,Real b,Real& c,Real& s)
+{
+  if(b == 0) { c = 1; s = 0; }
+  else {
+    Real h = pythag(a,b);
+    c = a/h;
+    s = b/h;
+  }
+}
+
+//Right-preconditioned GMRES(m): x = x0 + M^-1 V y minimizes |b-Ax| over the
+//Krylov space, and the least-squares problem for y is kept in QR form by
+//Givens rotations
+bool KrylovSolver::SolveGMRES(LinearOperator& A,const Vector& b,Vector& x)
+{
+  int n = b.n;
+  int m = Max(1,Min(restart,n));
+  basis.resize(m+1);
+  for(int i=0;i<=m;i++) ResizeWorkspace(basis[i],n);
+  Matrix H(m+1,m);
+  Vector cs(m),sn(m),g(m+1),y(m);
+  numIters = 0;
+  while(true) {
+    A.Mul(x,q);
+    r.sub(b,q);
+    Real beta = r.norm();
+    residualNorm = beta;
+    if(beta <= target) return true;
+    if(numIters >= iterLimit) return false;
+    basis[0].mul(r,Inv(beta));
+    g.setZero();
+    g(0) = beta;
+    int k = 0;
+    for(int j=0;j<m && numIters<iterLimit;j++) {
+      numIters++;
+      Precondition(basis[j],z);
+      A.Mul(z,w);
+      //modified Gram-Schmidt
+      for(int i=0;i<=j;i++) {
+        H(i,j) = w.dot(basis[i]);
+        w.madd(basis[i],-H(i,j));
+      }
+      H(j+1,j) = w.norm();
+      if(H(j+1,j) != 0) basis[j+1].mul(w,Inv(H(j+1,j)));
+      for(int i=0;i<j;i++) {
+        Real temp = cs(i)*H(i,j) + sn(i)*H(i+1,j);
+        H(i+1,j) = -sn(i)*H(i,j) + cs(i)*H(i+1,j);
+        H(i,j) = temp;
+      }
+      GivensRotation(H(j,j),H(j+1,j),cs(j),sn(j));
+      H(j,j) = cs(j)*H(j,j) + sn(j)*H(j+1,j);
+      H(j+1,j) = 0;
+      g(j+1) = -sn(j)*g(j);
+      g(j) = cs(j)*g(j);
+      k = j+1;
+      residualNorm = Abs(g(j+1));
+      if(residualNorm <= target || H(j,j) == 0) break;
+    }
+    //solve the triangular system and update x
+    for(int i=k-1;i>=0;i--) {
+      Real sum = g(i);
+      for(int l=i+1;l<k;l++) sum -= H(i,l)*y(l);
+      if(H(i,i) == 0) {
+        LOG4CXX_ERROR(KrisLibrary::logger(),"KrylovSolver: GMRES breakdown, A is singular");
+        return false;
+      }
+      y(i) = sum/H(i,i);
+    }
+    v.resize(n);
+    v.setZero();
+    for(int i=0;i<k;i++) v.madd(basis[i],y(i));
+    Precondition(v,z);
+    x += z;
+    if(residualNorm <= target) return true;
+  }
+  return false;
+}
+
+//Right-preconditioned BiCGStab of van der Vorst
+bool KrylovSolver::SolveBiCGStab(LinearOperator& A,const Vector& b,Vector& x)
+{
+  int n = b.n;
+  Vector& rhat = w, &phat = z, &shat = q;
+  A.Mul(x,v);
+  r.sub(b,v);
+  residualNorm = r.norm();
+  if(residualNorm <= target) return true;
+  rhat.copy(r);
+  p.resize(n); p.setZero();
+  v.setZero();
+  Real rho=1,alpha=1,omega=1;
+  for(numIters=1;numIters<=iterLimit;numIters++) {
+    Real rhoNew = rhat.dot(r);
+    if(rhoNew == 0) {
+      if(verbose) LOG4CXX_INFO(KrisLibrary::logger(),"KrylovSolver: BiCGStab breakdown, rho = 0");
+      return false;
+    }
+    if(numIters == 1) p.copy(r);
+    else {
+      Real beta = (rhoNew/rho)*(alpha/omega);
+      p.madd(v,-omega);
+      p.inplaceMul(beta);
+      p += r;
+    }
+    Precondition(p,phat);
+    A.Mul(phat,v);
+    Real rhatv = rhat.dot(v);
+    if(rhatv == 0) {
+      if(verbose) LOG4CXX_INFO(KrisLibrary::logger(),"KrylovSolver: BiCGStab breakdown, r0.v = 0");
+      return false;
+    }
+    alpha = rhoNew/rhatv;
+    s.copy(r);
+    s.madd(v,-alpha);
+    x.madd(phat,alpha);
+    residualNorm = s.norm();
+    if(residualNorm <= target) return true;
+    Precondition(s,shat);
+    A.Mul(shat,t);
+    Real tt = t.dot(t);
+    omega = (tt > 0 ? t.dot(s)/tt : Zero);
+    x.madd(shat,omega);
+    r.copy(s);
+    r.madd(t,-omega);
+    residualNorm = r.norm();
+    if(residualNorm <= target) return true;
+    if(omega == 0) {
+      if(verbose) LOG4CXX_INFO(KrisLibrary::logger(),"KrylovSolver: BiCGStab breakdown, omega = 0");
+      return false;
+    }
+    rho = rhoNew;
+  }
+  numIters = iterLimit;
+  return false;
+}
+
+} //namespace Math
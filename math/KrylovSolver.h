@@ -0,0 +1,198 @@
+#ifndef MATH_KRYLOV_SOLVER_H
+#define MATH_KRYLOV_SOLVER_H
+
+#include "matrix.h"
+#include "SparseMatrixTemplate.h"
+#include "function.h"
+#include <vector>
+
+/** @file math/KrylovSolver.h
+ * @ingroup Math
+ * @brief Iterative solvers for linear systems Ax=b that only need the
+ * products Ax, so A can be a sparse matrix or an implicit operator like
+ * a Jacobian evaluated by finite differences.
+ */
+
+namespace Math {
+
+/** @ingroup Math
+ * @brief An abstract linear operator, given by its product with a vector.
+ */
+class LinearOperator
+{
+public:
+  virtual ~LinearOperator() {}
+  virtual int NumRows() const =0;
+  virtual int NumCols() const =0;
+  ///Computes y = A x
+  virtual void Mul(const Vector& x,Vector& y) =0;
+};
+
+///A dense matrix as a LinearOperator
+class MatrixOperator : public LinearOperator
+{
+public:
+  MatrixOperator(const Matrix& A);
+  virtual int NumRows() const { return A.m; }
+  virtual int NumCols() const { return A.n; }
+  virtual void Mul(const Vector& x,Vector& y) { A.mul(x,y); }
+
+  const Matrix& A;
+};
+
+///A compressed-row sparse matrix as a LinearOperator
+class SparseMatrixOperator : public LinearOperator
+{
+public:
+  SparseMatrixOperator(const SparseMatrixTemplate_CR<Real>& A,int numThreads=0);
+  virtual int NumRows() const { return A.m; }
+  virtual int NumCols() const { return A.n; }
+  virtual void Mul(const Vector& x,Vector& y) { A.mul(x,y,numThreads); }
+
+  const SparseMatrixTemplate_CR<Real>& A;
+  int numThreads;
+};
+
+/** @ingroup Math
+ * @brief The Jacobian of a VectorFieldFunction at x, as a LinearOperator,
+ * without forming the Jacobian.
+ *
+ * By default, J v is estimated by the forward difference
+ * (f(x+hv)-f(x))/h, with h = sqrt(eps)*(1+|x|)/|v|, which costs one
+ * function evaluation per product.  If the function overrides
+ * DirectionalDeriv with an analytic product, set useDirectionalDeriv to
+ * true to use it instead.
+ */
+class JacobianVectorOperator : public LinearOperator
+{
+public:
+  ///fx is f(x), which must stay valid while the operator is used
+  JacobianVectorOperator(VectorFieldFunction* func,const Vector& x,const Vector& fx);
+  virtual int NumRows() const { return fx.n; }
+  virtual int NumCols() const { return x.n; }
+  virtual void Mul(const Vector& v,Vector& y);
+
+  VectorFieldFunction* func;
+  const Vector& x;
+  const Vector& fx;
+  bool useDirectionalDeriv;
+  int numEvals;             ///<number of function evaluations so far
+  Vector xtemp;
+};
+
+/** @ingroup Math
+ * @brief A preconditioner M for a Krylov method, which should be cheap to
+ * invert and approximate A.
+ */
+class LinearPreconditioner
+{
+public:
+  virtual ~LinearPreconditioner() {}
+  ///Computes z = M^-1 r
+  virtual void Solve(const Vector& r,Vector& z) =0;
+};
+
+///Jacobi preconditioning, M = diag(A)
+class DiagonalPreconditioner : public LinearPreconditioner
+{
+public:
+  ///Returns false if a diagonal entry is zero
+  bool set(const SparseMatrixTemplate_CR<Real>& A);
+  virtual void Solve(const Vector& r,Vector& z);
+
+  Vector invDiag;
+};
+
+/** @ingroup Math
+ * @brief Zero fill-in incomplete Cholesky preconditioning, M = LL^t where
+ * L has the sparsity pattern of the lower triangle of A.
+ *
+ * A must be symmetric with both triangles stored.  If the factorization
+ * breaks down, as it can for matrices that are not diagonally dominant,
+ * it is retried on A + shift*diag(A) with increasing shifts.
+ */
+class IncompleteCholeskyPreconditioner : public LinearPreconditioner
+{
+public:
+  IncompleteCholeskyPreconditioner();
+  ///Returns false if no shift up to maxShift gives a factorization
+  bool set(const SparseMatrixTemplate_CR<Real>& A);
+  virtual void Solve(const Vector& r,Vector& z);
+
+  SparseMatrixTemplate_CR<Real> L;  ///<lower triangle, with the diagonal last in each row
+  Real shift;      ///<the diagonal shift that was used
+  Real maxShift;   ///<default 1
+};
+
+/** @ingroup Math
+ * @brief Zero fill-in incomplete LU preconditioning, M = LU where L and U
+ * have the sparsity patterns of the strict lower and upper triangles of A.
+ *
+ * Every diagonal entry of A must be in its sparsity pattern.
+ */
+class ILU0Preconditioner : public LinearPreconditioner
+{
+public:
+  ///Returns false if A is missing a diagonal entry or a pivot is zero
+  bool set(const SparseMatrixTemplate_CR<Real>& A);
+  virtual void Solve(const Vector& r,Vector& z);
+
+  SparseMatrixTemplate_CR<Real> LU;  ///<U on and above the diagonal, L (with unit diagonal) below
+  std::vector<int> diagIndex;        ///<position of the diagonal of row i in LU
+};
+
+/** @ingroup Math
+ * @brief Krylov subspace methods for square systems A x = b.
+ *
+ * - ConjugateGradient: A symmetric positive definite.
+ * - MINRES: A symmetric, possibly indefinite.
+ * - GMRES: general A, restarted every 'restart' iterations.
+ * - BiCGStab: general A, with fixed storage and two products per iteration.
+ *
+ * The preconditioner, if given, must be symmetric positive definite for
+ * CG and MINRES; GMRES and BiCGStab apply it on the right.
+ *
+ * If x has the size of b on input it is used as the initial guess, so
+ * that a sequence of related systems can be warm-started from the last
+ * solution; otherwise x starts at 0.  The iteration stops when
+ * |b-Ax| <= tolerance*|b| (for preconditioned MINRES, the residual is
+ * measured in the M^-1 norm).
+ */
+class KrylovSolver
+{
+public:
+  enum Method { ConjugateGradient, MINRES, GMRES, BiCGStab };
+
+  KrylovSolver();
+  ///Returns true if the tolerance was reached
+  bool Solve(LinearOperator& A,const Vector& b,Vector& x);
+
+  //settings
+  Method method;
+  LinearPreconditioner* preconditioner;  ///<default NULL (none)
+  Real tolerance;   ///<relative residual tolerance (default 1e-8)
+  int maxIters;     ///<maximum number of products with A (default 0: 2*n)
+  int restart;      ///<GMRES restart length (default 30)
+  int verbose;
+
+  //outputs
+  int numIters;
+  Real residualNorm;
+
+private:
+  bool SolveCG(LinearOperator& A,const Vector& b,Vector& x);
+  bool SolveMINRES(LinearOperator& A,const Vector& b,Vector& x);
+  bool SolveGMRES(LinearOperator& A,const Vector& b,Vector& x);
+  bool SolveBiCGStab(LinearOperator& A,const Vector& b,Vector& x);
+  void Precondition(const Vector& r,Vector& z);
+
+  int iterLimit;
+  Real target;
+  //workspace, kept between solves
+  Vector r,z,p,q,s,t,v,w;
+  std::vector<Vector> basis;
+};
+
+} //namespace Math
+
+#endif
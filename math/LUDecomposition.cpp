@@ -3,6 +3,7 @@
 #include "backsubstitute.h"
 #include "complex.h"
 #include <errors.h>
+#include <float.h>
 
 namespace Math {
 
@@ -183,9 +184,313 @@ void LUDecomposition<T>::getU(MatrixT& U) const
   }
 }
 
+template <class T>
+UpdatableLUDecomposition<T>::UpdatableLUDecomposition()
+:zeroTolerance((T)1e-6)
+{}
+
+template <class T>
+void UpdatableLUDecomposition<T>::eliminate(int p,int q,int col,VectorT* w)
+{
+  T xp = (w ? (*w)(p) : U(p,col));
+  T xq = (w ? (*w)(q) : U(q,col));
+  if(xq == T(0)) return;
+  if(Abs(xq) > Abs(xp)) {
+    //swap the rows so the multiplier is bounded by 1
+    for(int j=col;j<U.n;j++) std::swap(U(p,j),U(q,j));
+    for(int j=0;j<F.n;j++) std::swap(F(p,j),F(q,j));
+    if(w) std::swap((*w)(p),(*w)(q));
+    std::swap(xp,xq);
+  }
+  T mult = xq/xp;
+  for(int j=col;j<U.n;j++) U(q,j) -= mult*U(p,j);
+  for(int j=0;j<F.n;j++) F(q,j) -= mult*F(p,j);
+  if(w) (*w)(q) = 0;
+  else U(q,col) = 0;
+}
+
+template <class T>
+bool UpdatableLUDecomposition<T>::set(const MatrixT& A)
+{
+  if(!A.isSquare())
+    FatalError("Non-square matrix in LU decomposition");
+  int n=A.n;
+  U = A;
+  F.resize(n,n);
+  F.setIdentity();
+  //gaussian elimination with partial pivoting, accumulating the row
+  //operations in F
+  for(int k=0;k<n;k++) {
+    int imax=k;
+    for(int i=k+1;i<n;i++)
+      if(Abs(U(i,k)) > Abs(U(imax,k))) imax=i;
+    if(imax != k) {
+      VectorT rowimax,rowk;
+      U.getRowRef(imax,rowimax);
+      U.getRowRef(k,rowk);
+      rowimax.swapCopy(rowk);
+      F.getRowRef(imax,rowimax);
+      F.getRowRef(k,rowk);
+      rowimax.swapCopy(rowk);
+    }
+    if(U(k,k) == T(0)) continue;
+    T inv = Inv(U(k,k));
+    for(int i=k+1;i<n;i++) {
+      if(U(i,k) == T(0)) continue;
+      T mult = U(i,k)*inv;
+      for(int j=k+1;j<n;j++) U(i,j) -= mult*U(k,j);
+      for(int j=0;j<n;j++) F(i,j) -= mult*F(k,j);
+      U(i,k) = 0;
+    }
+  }
+  return isNonsingular();
+}
+
+template <class T>
+bool UpdatableLUDecomposition<T>::isNonsingular() const
+{
+  for(int i=0;i<U.n;i++)
+    if(FuzzyZero(U(i,i),zeroTolerance)) return false;
+  return true;
+}
+
+template <class T>
+void UpdatableLUDecomposition<T>::backSub(const VectorT& b, VectorT& x) const
+{
+  if(!(U.n == b.n))
+    FatalError("Incompatible dimensions");
+  VectorT y;
+  F.mul(b,y);
+  x.resize(U.n);
+  UBackSubstitute(U,y,x);
+}
+
+/* With w = F u, F(A + u v^t) = U + w v^t.  Eliminating w up to its first
+ * entry makes U upper Hessenberg, the rank-one term then only changes the
+ * first row, and a second sweep restores the triangular form.
+ */
+template <class T>
+void UpdatableLUDecomposition<T>::rankOneUpdate(const VectorT& u,const VectorT& v)
+{
+  int n=U.n;
+  Assert(u.n == n);
+  Assert(v.n == n);
+  VectorT w;
+  F.mul(u,w);
+  for(int k=n-1;k>0;k--)
+    eliminate(k-1,k,k-1,&w);
+  for(int j=0;j<n;j++)
+    U(0,j) += w(0)*v(j);
+  for(int k=1;k<n;k++)
+    eliminate(k-1,k,k-1);
+}
+
+/* Column j of U becomes the spike F a.  Eliminating the spike from the
+ * bottom up leaves U upper Hessenberg after column j, which a second sweep
+ * makes triangular.
+ */
+template <class T>
+void UpdatableLUDecomposition<T>::replaceCol(int j,const VectorT& a)
+{
+  int n=U.n;
+  Assert(j >= 0 && j < n);
+  Assert(a.n == n);
+  VectorT w;
+  F.mul(a,w);
+  for(int i=0;i<n;i++) U(i,j) = w(i);
+  for(int k=n-1;k>j;k--)
+    eliminate(k-1,k,j);
+  for(int k=j+1;k<n;k++)
+    eliminate(k-1,k,k-1);
+}
+
+/* The new row is appended to the bottom of U (and F is extended by e_i, so
+ * that F A = U still holds), and the new column is a spike.  The spike is
+ * eliminated from the bottom up, which doesn't fill in below the diagonal
+ * because the later columns shift right, and then the new bottom row is
+ * eliminated against each row above it.
+ */
+template <class T>
+void UpdatableLUDecomposition<T>::insertRowCol(int i,const VectorT& row,const VectorT& col)
+{
+  int n=U.n;
+  Assert(i >= 0 && i <= n);
+  Assert(row.n == n+1 && col.n == n+1);
+  VectorT b(n),w;
+  for(int k=0;k<n;k++) b(k) = col(k < i ? k : k+1);
+  F.mul(b,w);
+  MatrixT Fn(n+1,n+1),Un(n+1,n+1);
+  for(int r=0;r<n;r++) {
+    for(int c=0;c<=n;c++) {
+      if(c == i) {
+        Fn(r,c) = 0;
+        Un(r,c) = w(r);
+      }
+      else {
+        int cold = (c < i ? c : c-1);
+        Fn(r,c) = F(r,cold);
+        Un(r,c) = U(r,cold);
+      }
+    }
+  }
+  for(int c=0;c<=n;c++) {
+    Fn(n,c) = (c == i ? T(1) : T(0));
+    Un(n,c) = row(c);
+  }
+  F.swap(Fn);
+  U.swap(Un);
+  for(int k=n-1;k>i;k--)
+    eliminate(k-1,k,i);
+  for(int k=0;k<n;k++)
+    eliminate(k,n,k);
+}
+
+/* Deleting column i leaves U upper Hessenberg after column i; once that is
+ * reduced, the last row of U is zero.  Then row i of A can be dropped once
+ * column i of F is zero in every other row, which only takes adding
+ * multiples of F's last row, since U's last row is zero.
+ */
+template <class T>
+bool UpdatableLUDecomposition<T>::deleteRowCol(int i)
+{
+  int n=U.n;
+  Assert(i >= 0 && i < n);
+  MatrixT F0(F),U0(U);
+  MatrixT Un(n,n-1);
+  for(int r=0;r<n;r++) {
+    for(int c=0;c<i;c++) Un(r,c) = U(r,c);
+    for(int c=i+1;c<n;c++) Un(r,c-1) = U(r,c);
+  }
+  U.swap(Un);
+  for(int k=i+1;k<n;k++)
+    eliminate(k-1,k,k-1);
+  T pivot = F(n-1,i);
+  if(FuzzyZero(pivot,zeroTolerance)) {
+    F.swap(F0);
+    U.swap(U0);
+    return false;
+  }
+  for(int k=0;k<n-1;k++) {
+    T mult = F(k,i)/pivot;
+    if(mult == T(0)) continue;
+    for(int j=0;j<n;j++) F(k,j) -= mult*F(n-1,j);
+  }
+  MatrixT Fn(n-1,n-1);
+  Un.resize(n-1,n-1);
+  for(int r=0;r<n-1;r++) {
+    for(int c=0;c<n;c++)
+      if(c != i) Fn(r,(c < i ? c : c-1)) = F(r,c);
+    for(int c=0;c<n-1;c++) Un(r,c) = U(r,c);
+  }
+  F.swap(Fn);
+  U.swap(Un);
+  return true;
+}
+
+//infinity norm, the max absolute row sum
+static double NormInf(const MatrixTemplate<double>& A)
+{
+  double res = 0;
+  for(int i=0;i<A.m;i++) {
+    double sum = 0;
+    for(int j=0;j<A.n;j++) sum += Abs(A(i,j));
+    res = Max(res,sum);
+  }
+  return res;
+}
+
+MixedPrecisionLUDecomposition::MixedPrecisionLUDecomposition()
+:usingDouble(false),maxIters(10),tolerance(DBL_EPSILON),numIters(0),Anorm(0),factored(false)
+{}
+
+bool MixedPrecisionLUDecomposition::set(const MatrixTemplate<double>& _A)
+{
+  if(!_A.isSquare())
+    FatalError("Non-square matrix in LU decomposition");
+  A = _A;
+  Anorm = NormInf(A);
+  usingDouble = false;
+  factored = true;
+  if(Anorm < FLT_MAX && factorFloat()) return true;
+  usingDouble = true;
+  factored = LUd.set(A);
+  return factored;
+}
+
+//Gaussian elimination with partial pivoting, storing the result in the
+//same form as LUDecomposition::set, so that LUf.backSub can be used.
+//The inner loops run along contiguous rows so they vectorize.
+bool MixedPrecisionLUDecomposition::factorFloat()
+{
+  int n = A.n;
+  MatrixTemplate<float>& LU = LUf.LU;
+  LU.resize(n,n);
+  LU.copy(A);
+  Assert(LU.jstride == 1);
+  LUf.P.resize(n);
+  for(int j=0;j<n;j++) {
+    int imax = j;
+    float big = Abs(LU(j,j));
+    for(int i=j+1;i<n;i++)
+      if(Abs(LU(i,j)) > big) { big = Abs(LU(i,j)); imax = i; }
+    LUf.P[j] = imax;
+    if(big <= LUf.zeroTolerance) return false;
+    float* rj = &LU(j,0);
+    if(imax != j) std::swap_ranges(rj,rj+n,&LU(imax,0));
+    float pivinv = 1.0f/rj[j];
+    for(int i=j+1;i<n;i++) {
+      float* ri = &LU(i,0);
+      float l = ri[j]*pivinv;
+      ri[j] = l;
+      if(l == 0) continue;
+      for(int k=j+1;k<n;k++) ri[k] -= l*rj[k];
+    }
+  }
+  return true;
+}
+
+bool MixedPrecisionLUDecomposition::backSub(const VectorTemplate<double>& b,VectorTemplate<double>& x)
+{
+  numIters = 0;
+  if(!factored) {
+    x.clear();
+    return false;
+  }
+  if(usingDouble) {
+    LUd.backSub(b,x);
+    return true;
+  }
+  int n = A.n;
+  VectorTemplate<float> rf,dxf;
+  VectorTemplate<double> r;
+  rf.copy(b);
+  LUf.backSub(rf,dxf);
+  x.copy(dxf);
+  double rnormPrev = dInf;
+  for(numIters=0;numIters<maxIters;numIters++) {
+    A.mul(x,r);
+    r.sub(b,r);
+    double rnorm = r.maxAbsElement();
+    if(rnorm <= tolerance*Sqrt(double(n))*Anorm*x.maxAbsElement()) return true;
+    if(!(rnorm < rnormPrev)) break;  //stagnating or diverging
+    rnormPrev = rnorm;
+    rf.copy(r);
+    LUf.backSub(rf,dxf);
+    for(int i=0;i<n;i++) x(i) += dxf(i);
+  }
+  //refinement failed, fall back to double
+  if(!LUd.set(A)) return false;
+  usingDouble = true;
+  LUd.backSub(b,x);
+  return true;
+}
+
 template class LUDecomposition<float>;
 template class LUDecomposition<double>;
 template class LUDecomposition<Complex>;
+template class UpdatableLUDecomposition<float>;
+template class UpdatableLUDecomposition<double>;
+template class UpdatableLUDecomposition<Complex>;
 
 
 } //namespace Math
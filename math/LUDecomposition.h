@@ -39,5 +39,95 @@ public:
   T zeroTolerance;
 };
 
+/** @ingroup Math
+ * @brief An LU decomposition that can be updated when A changes by a
+ * rank-one term, a column replacement, or the insertion or deletion of
+ * a row and column.
+ *
+ * Rather than L and P, the decomposition stores the accumulated
+ * elimination F = (PL)^-1, so that F A = U.  Updates are done in the
+ * style of Bartels and Golub: the change to U is reduced to upper
+ * triangular form by eliminations between pairs of rows, swapping the
+ * rows when needed to keep the multipliers bounded by 1, and the same
+ * operations are applied to F.  Each update costs O(n^2) rather than the
+ * O(n^3) of a new factorization.
+ *
+ * Since A must stay square, rows and columns are inserted and deleted
+ * together, as happens to the KKT matrix of an active-set method.
+ */
+template <class T>
+class UpdatableLUDecomposition
+{
+public:
+  typedef MatrixTemplate<T> MatrixT;
+  typedef VectorTemplate<T> VectorT;
+
+  UpdatableLUDecomposition();
+  bool set(const MatrixT& A);
+  void backSub(const VectorT& b, VectorT& x) const;
+  ///Updates the decomposition to that of A + u v^t
+  void rankOneUpdate(const VectorT& u,const VectorT& v);
+  ///Replaces column j of A with a
+  void replaceCol(int j,const VectorT& a);
+  ///Inserts a row and column at index i, so that row i of the new matrix is
+  ///row and column i is col (both have size n+1, and row(i) = col(i)).
+  void insertRowCol(int i,const VectorT& row,const VectorT& col);
+  ///Deletes row and column i.  Returns false if the resulting matrix is
+  ///singular, in which case the decomposition is left unchanged.
+  bool deleteRowCol(int i);
+  ///Returns false if a diagonal element of U is <= zeroTolerance
+  bool isNonsingular() const;
+
+  MatrixT F,U;
+  T zeroTolerance;
+
+private:
+  //zeros U(q,col) (or w(q), if w is given) by subtracting a multiple of
+  //row p, swapping p and q first if needed.  U's rows are assumed to be
+  //zero before col.
+  void eliminate(int p,int q,int col,VectorT* w=NULL);
+};
+
+/** @ingroup Math
+ * @brief Solves A x = b by factoring A in single precision and refining
+ * the solution in double precision.
+ *
+ * The factorization is done in float with partial pivoting, which roughly
+ * halves its cost for mid-size dense systems.  Each backSub then applies
+ * iterative refinement x += A^-1 (b - A x), with the residual computed in
+ * double, until |b - A x|_inf <= tolerance*sqrt(n)*|A|_inf*|x|_inf.  This
+ * recovers double accuracy as long as A is not too ill-conditioned for
+ * float (roughly cond(A) < 1e6).
+ *
+ * If A cannot be factored in float, or refinement stagnates or does not
+ * converge within maxIters steps, A is factored in double and that
+ * factorization is used from then on.
+ */
+class MixedPrecisionLUDecomposition
+{
+public:
+  MixedPrecisionLUDecomposition();
+  ///Returns false if A is singular (even in double precision)
+  bool set(const MatrixTemplate<double>& A);
+  ///Solves A x = b.  May fall back to a double factorization, so it is
+  ///not const.  Returns false if A couldn't be factored, or if refinement
+  ///failed and A is singular in double precision, in which case x is the
+  ///last refined float solution (or empty, if set() failed).
+  bool backSub(const VectorTemplate<double>& b,VectorTemplate<double>& x);
+
+  MatrixTemplate<double> A;       ///<copy of A, for the residuals
+  LUDecomposition<float> LUf;     ///<the single precision factorization
+  LUDecomposition<double> LUd;    ///<the double factorization, if needed
+  bool usingDouble;               ///<true if LUd is in use
+  int maxIters;                   ///<maximum refinement steps (default 10)
+  double tolerance;               ///<default DBL_EPSILON
+  int numIters;                   ///<refinement steps taken by the last backSub
+
+private:
+  bool factorFloat();
+  double Anorm;
+  bool factored;
+};
+
 }
 #endif
@@ -2,6 +2,8 @@
 #include "MatrixTemplate.h"
 #include "fastarray.h"
 #include "complex.h"
+#include "Workspace.h"
+#include "BlockedMultiply.h"
 #include <KrisLibrary/File.h>
 #include <iostream>
 #include <errors.h>
@@ -32,6 +34,30 @@ const char* MatrixError_InvalidCol = "Matrix column index [%d] out of range";
 #define MYGENARGS getStart(),istride,jstride
 #define GENARGS(a) a.getStart(),a.istride,a.jstride
 
+//X = A*B.  Real types use the cache-blocked kernel when it pays off, other
+//types use the generic strided loop.
+template <class T>
+inline void ArrayMultiply(T* X,int xis,int xjs,const T* A,int ais,int ajs,const T* B,int bis,int bjs,int m,int n,int p)
+{
+  gen_array2d_multiply(X,xis,xjs,A,ais,ajs,B,bis,bjs,m,n,p);
+}
+
+inline void ArrayMultiply(float* X,int xis,int xjs,const float* A,int ais,int ajs,const float* B,int bis,int bjs,int m,int n,int p)
+{
+  if(UseBlockedMultiply(m,n,p))
+    BlockedMultiply(X,xis,xjs,A,ais,ajs,B,bis,bjs,m,n,p);
+  else
+    gen_array2d_multiply(X,xis,xjs,A,ais,ajs,B,bis,bjs,m,n,p);
+}
+
+inline void ArrayMultiply(double* X,int xis,int xjs,const double* A,int ais,int ajs,const double* B,int bis,int bjs,int m,int n,int p)
+{
+  if(UseBlockedMultiply(m,n,p))
+    BlockedMultiply(X,xis,xjs,A,ais,ajs,B,bis,bjs,m,n,p);
+  else
+    gen_array2d_multiply(X,xis,xjs,A,ais,ajs,B,bis,bjs,m,n,p);
+}
+
 template <class T>
 MatrixTemplate<T>::MatrixTemplate()
 :vals(NULL),capacity(0),allocated(false),
@@ -110,7 +136,7 @@ template <class T>
 void MatrixTemplate<T>::clear()
 {
   if(allocated)
-    SafeArrayDelete(vals);
+    WorkspaceDeleteArray(vals);
   vals=NULL;
   capacity=0;
   base=0;
@@ -136,9 +162,9 @@ void MatrixTemplate<T>::resize(int _m, int _n)
       clear();
     }
     if(_m*_n > capacity) {
-      SafeArrayDelete(vals);
+      WorkspaceDeleteArray(vals);
       try {
-	vals = new T[_m*_n];
+	vals = WorkspaceNewArray<T>(_m*_n);
       }
       catch(exception& e) {
 	FatalError("Couldn't allocate matrix of size %d x %d, exception %s",_m,_n,e.what());
@@ -182,7 +208,7 @@ void MatrixTemplate<T>::resizePersist(int _m, int _n)
     if(_m*_n > capacity) {
       T* oldvals=vals;
       try {
-	vals = new T[_m*_n];
+	vals = WorkspaceNewArray<T>(_m*_n);
       }
       catch(exception& e) {
 	FatalError("Couldn't allocate matrix of size %d x %d, exception %s",_m,_n,e.what());
@@ -192,7 +218,7 @@ void MatrixTemplate<T>::resizePersist(int _m, int _n)
       }
       //copy
       gen_array2d_equal(vals,_n,1,oldvals,istride,jstride,m,n);
-      SafeArrayDelete(oldvals);
+      WorkspaceDeleteArray(oldvals);
       capacity = _m*_n;
     }
     else if(_n != istride) {
@@ -413,7 +439,7 @@ void MatrixTemplate<T>::mul(const MyT& a, const MyT& b)
     RaiseErrorFmt(WHERE_AM_I,MatrixError_ArgIncompatibleDimensions);
   CHECKRESIZE(a.m,b.n);
 
-  gen_array2d_multiply(MYGENARGS,GENARGS(a),GENARGS(b),
+  ArrayMultiply(MYGENARGS,GENARGS(a),GENARGS(b),
     m,a.n,n);
 }
 
@@ -424,7 +450,8 @@ void MatrixTemplate<T>::mulTransposeA(const MyT& a, const MyT& b)
     RaiseErrorFmt(WHERE_AM_I,MatrixError_ArgIncompatibleDimensions);
   CHECKRESIZE(a.n,b.n);
 
-  gen_array2d_multiply_transposeA(MYGENARGS,GENARGS(a),GENARGS(b),
+  //A^t has the strides of A swapped
+  ArrayMultiply(MYGENARGS,a.getStart(),a.jstride,a.istride,GENARGS(b),
     m,a.m,n);
 }
 
@@ -435,7 +462,8 @@ void MatrixTemplate<T>::mulTransposeB(const MyT& a, const MyT& b)
     RaiseErrorFmt(WHERE_AM_I,MatrixError_ArgIncompatibleDimensions);
   CHECKRESIZE(a.m,b.m);
 
-  gen_array2d_multiply_transposeB(MYGENARGS,GENARGS(a),GENARGS(b),
+  //B^t has the strides of B swapped
+  ArrayMultiply(MYGENARGS,GENARGS(a),b.getStart(),b.jstride,b.istride,
     m,a.n,n);
 }
 
@@ -340,7 +340,208 @@ void NRQRDecomposition<T>::getQ(MatrixT& Q) const
   }
 }
 
+/* Givens rotations for UpdatableQRDecomposition.  The rotation
+ *   [ c s]
+ *   [-s c]
+ * is applied to rows p and q of R (starting at column j0), and its
+ * transpose to columns p and q of Q, so the product QR is unchanged.
+ */
+template <class T>
+static void GivensCoefficients(T a,T b,T& c,T& s)
+{
+  if(b == 0) { c = 1; s = 0; return; }
+  T scale = Max(Abs(a),Abs(b));
+  T r = scale*Sqrt(Sqr(a/scale)+Sqr(b/scale));
+  c = a/r;
+  s = b/r;
+}
+
+template <class T>
+static void GivensRotate(MatrixTemplate<T>& Q,MatrixTemplate<T>& R,int p,int q,int j0,T c,T s)
+{
+  for(int j=j0;j<R.n;j++) {
+    T a=R(p,j),b=R(q,j);
+    R(p,j) = c*a + s*b;
+    R(q,j) = -s*a + c*b;
+  }
+  for(int i=0;i<Q.m;i++) {
+    T a=Q(i,p),b=Q(i,q);
+    Q(i,p) = c*a + s*b;
+    Q(i,q) = -s*a + c*b;
+  }
+}
+
+template <class T>
+bool UpdatableQRDecomposition<T>::set(const MatrixT& A)
+{
+  QRDecomposition<T> qr;
+  if(!qr.set(A)) return false;
+  qr.getQ(Q);
+  qr.getR(R);
+  return true;
+}
+
+template <class T>
+void UpdatableQRDecomposition<T>::QMul(const VectorT& b,VectorT& x) const
+{
+  Q.mul(b,x);
+}
+
+template <class T>
+void UpdatableQRDecomposition<T>::QtMul(const VectorT& b,VectorT& x) const
+{
+  Q.mulTranspose(b,x);
+}
+
+template <class T>
+void UpdatableQRDecomposition<T>::backSub(const VectorT& b,VectorT& x) const
+{
+  Assert(R.m >= R.n);
+  Assert(b.n == Q.m);
+  if(x.n == 0) x.resize(R.n);
+  VectorT rhs;
+  QtMul(b,rhs);
+  MatrixT R1; R1.setRef(R,0,0,1,1,R.n,R.n);
+  VectorT rhs1; rhs1.setRef(rhs,0,1,R.n);
+  UBackSubstitute(R1,rhs1,x);
+}
+
+/* Golub and Van Loan, "Matrix Computations", Section 12.5.  With w = Q^t u,
+ * rotations that reduce w to a multiple of e_1 make R upper Hessenberg; the
+ * rank-one term then only changes the first row, and a second sweep
+ * restores the triangular form.
+ */
+template <class T>
+void UpdatableQRDecomposition<T>::rankOneUpdate(const VectorT& u,const VectorT& v)
+{
+  Assert(u.n == R.m);
+  Assert(v.n == R.n);
+  VectorT w;
+  QtMul(u,w);
+  T c,s;
+  for(int k=R.m-1;k>0;k--) {
+    GivensCoefficients(w(k-1),w(k),c,s);
+    w(k-1) = c*w(k-1) + s*w(k);
+    w(k) = 0;
+    GivensRotate(Q,R,k-1,k,k-1,c,s);
+  }
+  for(int j=0;j<R.n;j++)
+    R(0,j) += w(0)*v(j);
+  for(int k=1;k<Min(R.m,R.n+1);k++) {
+    GivensCoefficients(R(k-1,k-1),R(k,k-1),c,s);
+    GivensRotate(Q,R,k-1,k,k-1,c,s);
+    R(k,k-1) = 0;
+  }
+}
+
+/* The new row is appended to R, with Q extended by a unit row/column that
+ * puts it in place, and then rotated into the rows above it.
+ */
+template <class T>
+void UpdatableQRDecomposition<T>::insertRow(int i,const VectorT& a)
+{
+  int m=R.m,n=R.n;
+  Assert(i >= 0 && i <= m);
+  Assert(a.n == n);
+  MatrixT Qn(m+1,m+1,T(0)),Rn(m+1,n);
+  for(int r=0;r<m;r++) {
+    int rn = (r < i ? r : r+1);
+    for(int c=0;c<m;c++) Qn(rn,c) = Q(r,c);
+    for(int c=0;c<n;c++) Rn(r,c) = R(r,c);
+  }
+  Qn(i,m) = 1;
+  for(int c=0;c<n;c++) Rn(m,c) = a(c);
+  T c,s;
+  for(int j=0;j<Min(m,n);j++) {
+    GivensCoefficients(Rn(j,j),Rn(m,j),c,s);
+    GivensRotate(Qn,Rn,j,m,j,c,s);
+    Rn(m,j) = 0;
+  }
+  Q.swap(Qn);
+  R.swap(Rn);
+}
+
+/* Rotating row i of Q into +/-e_1 makes column 0 of Q equal to +/-e_i and
+ * the rows of R below the first upper triangular, so both can be dropped.
+ */
+template <class T>
+void UpdatableQRDecomposition<T>::deleteRow(int i)
+{
+  int m=R.m,n=R.n;
+  Assert(i >= 0 && i < m);
+  VectorT q;
+  Q.getRowCopy(i,q);
+  T c,s;
+  for(int k=m-1;k>0;k--) {
+    GivensCoefficients(q(k-1),q(k),c,s);
+    q(k-1) = c*q(k-1) + s*q(k);
+    q(k) = 0;
+    GivensRotate(Q,R,k-1,k,k-1,c,s);
+  }
+  MatrixT Qn(m-1,m-1),Rn(m-1,n);
+  for(int r=0;r<m;r++) {
+    if(r == i) continue;
+    int rn = (r < i ? r : r-1);
+    for(int c=1;c<m;c++) Qn(rn,c-1) = Q(r,c);
+  }
+  for(int r=1;r<m;r++)
+    for(int c=0;c<n;c++) Rn(r-1,c) = R(r,c);
+  Q.swap(Qn);
+  R.swap(Rn);
+}
+
+/* Q^t a is inserted as column j of R, and the part below the diagonal is
+ * rotated away from the bottom up.  Because the columns after j shift
+ * right by one, this does not create any other nonzeros below the diagonal.
+ */
+template <class T>
+void UpdatableQRDecomposition<T>::insertCol(int j,const VectorT& a)
+{
+  int m=R.m,n=R.n;
+  Assert(j >= 0 && j <= n);
+  Assert(a.n == m);
+  VectorT w;
+  QtMul(a,w);
+  MatrixT Rn(m,n+1);
+  for(int r=0;r<m;r++) {
+    for(int c=0;c<j;c++) Rn(r,c) = R(r,c);
+    Rn(r,j) = w(r);
+    for(int c=j;c<n;c++) Rn(r,c+1) = R(r,c);
+  }
+  T c,s;
+  for(int k=m-1;k>j;k--) {
+    GivensCoefficients(Rn(k-1,j),Rn(k,j),c,s);
+    GivensRotate(Q,Rn,k-1,k,j,c,s);
+    Rn(k,j) = 0;
+  }
+  R.swap(Rn);
+}
+
+/* Removing column j leaves R upper Hessenberg from column j on, which is
+ * restored by rotating adjacent rows.
+ */
+template <class T>
+void UpdatableQRDecomposition<T>::deleteCol(int j)
+{
+  int m=R.m,n=R.n;
+  Assert(j >= 0 && j < n);
+  MatrixT Rn(m,n-1);
+  for(int r=0;r<m;r++) {
+    for(int c=0;c<j;c++) Rn(r,c) = R(r,c);
+    for(int c=j+1;c<n;c++) Rn(r,c-1) = R(r,c);
+  }
+  T c,s;
+  for(int k=j;k<n-1 && k+1<m;k++) {
+    GivensCoefficients(Rn(k,k),Rn(k+1,k),c,s);
+    GivensRotate(Q,Rn,k,k+1,k,c,s);
+    Rn(k+1,k) = 0;
+  }
+  R.swap(Rn);
+}
+
 template class QRDecomposition<float>;
 template class QRDecomposition<double>;
+template class UpdatableQRDecomposition<float>;
+template class UpdatableQRDecomposition<double>;
 
 }
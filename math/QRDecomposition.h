@@ -48,6 +48,42 @@ public:
   VectorT tau;
 };
 
+/** @ingroup Math
+ * @brief A QR decomposition A = Q R that can be updated when A changes by
+ * a rank-one term, or by inserting or deleting a row or column.
+ *
+ * Unlike QRDecomposition, Q is stored explicitly (M x M) so that it can be
+ * modified by Givens rotations.  Each update takes O(M^2 + MN) time rather
+ * than the O(MN^2) of a new factorization, which suits active-set methods
+ * that add or remove one constraint at a time.
+ *
+ * Solves with backSub() require M >= N and R to have full rank.
+ */
+template <class T>
+class UpdatableQRDecomposition
+{
+public:
+  typedef MatrixTemplate<T> MatrixT;
+  typedef VectorTemplate<T> VectorT;
+  bool set(const MatrixT& A);
+  ///Least-squares solution of A x = b
+  void backSub(const VectorT& b,VectorT& x) const;
+  void QMul(const VectorT& b,VectorT& x) const;
+  void QtMul(const VectorT& b,VectorT& x) const;
+  ///Updates the decomposition to that of A + u v^t
+  void rankOneUpdate(const VectorT& u,const VectorT& v);
+  ///Inserts a as row i of A
+  void insertRow(int i,const VectorT& a);
+  ///Deletes row i of A
+  void deleteRow(int i);
+  ///Inserts a as column j of A
+  void insertCol(int j,const VectorT& a);
+  ///Deletes column j of A
+  void deleteCol(int j);
+
+  MatrixT Q,R;
+};
+
 /** @ingroup Math
  * @brief The QR decomposition as computed by the algorithm
  * in Numerical Recipes in C.
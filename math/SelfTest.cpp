@@ -8,6 +8,7 @@
 #include "differentiation.h"
 #include "quadrature.h"
 #include "LUDecomposition.h"
+#include "QRDecomposition.h"
 #include "BlockTridiagonalMatrix.h"
 #include "BlockPrinter.h"
 #include "BLASInterface.h"
@@ -15,10 +16,18 @@
 #include "MatrixPrinter.h"
 #include "VectorPrinter.h"
 #include "metric.h"
+#include "SmallMatrix.h"
+#include "Workspace.h"
+#include "SparseLDL.h"
+#include "BatchedDecomposition.h"
+#include "VectorExpression.h"
+#include "KrylovSolver.h"
+#include "CholeskyDecomposition.h"
 #include <errors.h>
 #include <utils/fileutils.h>
 #include <string.h>
 #include <fstream>
+#include <thread>
 #include <iostream>
 using namespace std;
 
@@ -117,15 +126,383 @@ void TestVectorOps()
   LOG4CXX_INFO(KrisLibrary::logger(),"Vector ops test not done");
 }
 
+void TestVectorExpressions()
+{
+  Vector a(7),b(7),c(7),x,y;
+  for(int i=0;i<7;i++) { a(i)=Rand(); b(i)=Rand(); c(i)=Rand(); }
+  Evaluate(x,Expr(a)+Two*Expr(b)-c/Two);
+  y = a+Two*b-c*Half;
+  Assert(x.isEqual(y,1e-12));
+  //in-place, aliased update
+  EvaluateInc(x,-(Expr(a)-b));
+  y -= a-b;
+  Assert(x.isEqual(y,1e-12));
+  Evaluate(x,Expr(x)*Two);
+  y.inplaceMul(Two);
+  Assert(x.isEqual(y,1e-12));
+  Assert(FuzzyEquals(dot(Expr(a),Expr(b)+c),a.dot(b)+a.dot(c),1e-12));
+  Assert(FuzzyEquals(normSquared(Expr(a)-b),a.distanceSquared(b),1e-12));
+  //strided operands and destination
+  Vector s(14),as,xs;
+  s.set(One);
+  as.setRef(s,0,2,7);
+  xs.setRef(s,1,2,7);
+  as.copy(a);
+  Evaluate(xs,Expr(as)+Expr(b));
+  y.add(a,b);
+  Assert(xs.isEqual(y,1e-12));
+}
+
+static void DeleteVector(Vector* v) { delete v; }
+
+static void AllocateInWorkspace(Vector** v)
+{
+  ScopedWorkspace workspace;
+  *v = new Vector(50,Two);
+}
+
+void TestWorkspace()
+{
+  Vector outside;
+  size_t used0 = WorkspaceBytesUsed();
+  {
+    ScopedWorkspace workspace;
+    Vector a(100,One),b(50,Two);
+    Matrix m(10,10,Zero);
+    outside.resize(20,3.0);
+    if(WorkspaceBytesUsed() <= used0) FatalError("ScopedWorkspace did not allocate from the workspace");
+    //out-of-order release, and reuse of the freed space
+    a.clear();
+    Vector c(80,Zero);
+    Assert(b(49) == Two && m(9,9) == Zero);
+    c.clear();
+    b.clear();
+    m.clear();
+  }
+  //storage that outlives the workspace stays valid
+  Assert(outside(19) == 3.0);
+  outside.clear();
+  size_t used1 = WorkspaceBytesUsed();
+  if(used1 != used0) FatalError("Workspace holds %d bytes after release, %d before",(int)used1,(int)used0);
+
+  //storage freed on another thread goes back to this thread's arena
+  {
+    ScopedWorkspace workspace;
+    Vector* a = new Vector(100,One);
+    if(WorkspaceBytesUsed() <= used0) FatalError("ScopedWorkspace did not allocate from the workspace");
+    std::thread worker(DeleteVector,a);
+    worker.join();
+    used1 = WorkspaceBytesUsed();
+    if(used1 != used0) FatalError("Workspace holds %d bytes after a release on another thread, %d before",(int)used1,(int)used0);
+  }
+  //storage from another thread's arena can be freed here, even after that
+  //thread exits
+  Vector* fromWorker = NULL;
+  std::thread worker(AllocateInWorkspace,&fromWorker);
+  worker.join();
+  if((*fromWorker)(49) != Two) FatalError("Vector allocated on another thread has the wrong value");
+  delete fromWorker;
+}
+
 void VectorSelfTest()
 {
   LOG4CXX_INFO(KrisLibrary::logger(),"Self-testing vectors");
   TestVectorBasic();
   TestVectorOps();
+  TestVectorExpressions();
+  TestWorkspace();
   LOG4CXX_INFO(KrisLibrary::logger(),"Done");
   KrisLibrary::loggerWait();
 }
 
+void RandomizeMatrix(Matrix& A)
+{
+  for(int i=0;i<A.m;i++)
+    for(int j=0;j<A.n;j++) A(i,j) = Rand(-One,One);
+}
+
+//checks that Q is orthogonal, R is upper triangular, and QR = A
+bool CheckQRUpdate(const UpdatableQRDecomposition<Real>& qr,const Matrix& A)
+{
+  Matrix QtQ,QR,I(qr.Q.n,qr.Q.n);
+  I.setIdentity();
+  QtQ.mulTransposeA(qr.Q,qr.Q);
+  QR.mul(qr.Q,qr.R);
+  if(!QtQ.isEqual(I,1e-10) || !QR.isEqual(A,1e-10)) return false;
+  for(int i=0;i<qr.R.m;i++)
+    for(int j=0;j<i && j<qr.R.n;j++)
+      if(qr.R(i,j) != 0) return false;
+  return true;
+}
+
+//checks that U is upper triangular, and FA = U
+bool CheckLUUpdate(const UpdatableLUDecomposition<Real>& lu,const Matrix& A)
+{
+  Matrix FA;
+  FA.mul(lu.F,A);
+  if(!FA.isEqual(lu.U,1e-10)) return false;
+  for(int i=0;i<lu.U.m;i++)
+    for(int j=0;j<i;j++)
+      if(lu.U(i,j) != 0) return false;
+  Vector b(A.n),x,Ax;
+  for(int i=0;i<A.n;i++) b(i) = Rand(-One,One);
+  lu.backSub(b,x);
+  A.mul(x,Ax);
+  return Ax.isEqual(b,1e-8);
+}
+
+void TestDecompositionUpdates()
+{
+  Vector u,v,a;
+  //QR updates
+  Matrix A(7,4),An;
+  RandomizeMatrix(A);
+  UpdatableQRDecomposition<Real> qr;
+  qr.set(A);
+  if(!CheckQRUpdate(qr,A)) FatalError("QR decomposition is wrong after set");
+  u.resize(7); v.resize(4);
+  for(int i=0;i<7;i++) u(i) = Rand(-One,One);
+  for(int j=0;j<4;j++) v(j) = Rand(-One,One);
+  qr.rankOneUpdate(u,v);
+  for(int i=0;i<7;i++)
+    for(int j=0;j<4;j++) A(i,j) += u(i)*v(j);
+  if(!CheckQRUpdate(qr,A)) FatalError("QR decomposition is wrong after rankOneUpdate");
+  a.resize(4);
+  for(int j=0;j<4;j++) a(j) = Rand(-One,One);
+  qr.insertRow(2,a);
+  An.resize(8,4);
+  for(int i=0;i<8;i++)
+    for(int j=0;j<4;j++) An(i,j) = (i < 2 ? A(i,j) : (i == 2 ? a(j) : A(i-1,j)));
+  A = An;
+  if(!CheckQRUpdate(qr,A)) FatalError("QR decomposition is wrong after insertRow");
+  qr.deleteRow(5);
+  An.resize(7,4);
+  for(int i=0;i<7;i++)
+    for(int j=0;j<4;j++) An(i,j) = A(i < 5 ? i : i+1,j);
+  A = An;
+  if(!CheckQRUpdate(qr,A)) FatalError("QR decomposition is wrong after deleteRow");
+  a.resize(7);
+  for(int i=0;i<7;i++) a(i) = Rand(-One,One);
+  qr.insertCol(1,a);
+  An.resize(7,5);
+  for(int i=0;i<7;i++)
+    for(int j=0;j<5;j++) An(i,j) = (j < 1 ? A(i,j) : (j == 1 ? a(i) : A(i,j-1)));
+  A = An;
+  if(!CheckQRUpdate(qr,A)) FatalError("QR decomposition is wrong after insertCol");
+  qr.deleteCol(3);
+  An.resize(7,4);
+  for(int i=0;i<7;i++)
+    for(int j=0;j<4;j++) An(i,j) = A(i,j < 3 ? j : j+1);
+  A = An;
+  if(!CheckQRUpdate(qr,A)) FatalError("QR decomposition is wrong after deleteCol");
+
+  //LU updates
+  A.resize(6,6);
+  RandomizeMatrix(A);
+  UpdatableLUDecomposition<Real> lu;
+  if(!lu.set(A)) FatalError("UpdatableLUDecomposition failed on a random matrix");
+  if(!CheckLUUpdate(lu,A)) FatalError("LU decomposition is wrong after set");
+  u.resize(6); v.resize(6);
+  for(int i=0;i<6;i++) { u(i) = Rand(-One,One); v(i) = Rand(-One,One); }
+  lu.rankOneUpdate(u,v);
+  for(int i=0;i<6;i++)
+    for(int j=0;j<6;j++) A(i,j) += u(i)*v(j);
+  if(!CheckLUUpdate(lu,A)) FatalError("LU decomposition is wrong after rankOneUpdate");
+  a.resize(6);
+  for(int i=0;i<6;i++) a(i) = Rand(-One,One);
+  lu.replaceCol(2,a);
+  for(int i=0;i<6;i++) A(i,2) = a(i);
+  if(!CheckLUUpdate(lu,A)) FatalError("LU decomposition is wrong after replaceCol");
+  Vector row(7),col(7);
+  for(int i=0;i<7;i++) { row(i) = Rand(-One,One); col(i) = Rand(-One,One); }
+  col(3) = row(3);
+  lu.insertRowCol(3,row,col);
+  An.resize(7,7);
+  for(int i=0;i<7;i++)
+    for(int j=0;j<7;j++) {
+      if(i == 3) An(i,j) = row(j);
+      else if(j == 3) An(i,j) = col(i);
+      else An(i,j) = A(i < 3 ? i : i-1,j < 3 ? j : j-1);
+    }
+  A = An;
+  if(!CheckLUUpdate(lu,A)) FatalError("LU decomposition is wrong after insertRowCol");
+  if(!lu.deleteRowCol(1)) FatalError("UpdatableLUDecomposition::deleteRowCol failed");
+  An.resize(6,6);
+  for(int i=0;i<6;i++)
+    for(int j=0;j<6;j++) An(i,j) = A(i < 1 ? i : i+1,j < 1 ? j : j+1);
+  A = An;
+  if(!CheckLUUpdate(lu,A)) FatalError("LU decomposition is wrong after deleteRowCol");
+}
+
+void TestKrylovSolvers()
+{
+  //5-point Laplacian on a 12x12 grid, optionally with a convection term
+  //(nonsymmetric) or a negative shift (indefinite)
+  int N=12,n=N*N;
+  for(int problem=0;problem<3;problem++) {
+    Real c = (problem==1 ? 0.5 : 0), sigma = (problem==2 ? -0.5 : 0);
+    SparseMatrixTemplate_RM<Real> Arm(n,n);
+    for(int i=0;i<N;i++)
+      for(int j=0;j<N;j++) {
+        int k=i*N+j;
+        Arm(k,k) = 4+sigma;
+        if(i>0) Arm(k,k-N) = -1-c;
+        if(i+1<N) Arm(k,k+N) = -1+c;
+        if(j>0) Arm(k,k-1) = -1;
+        if(j+1<N) Arm(k,k+1) = -1;
+      }
+    SparseMatrixTemplate_CR<Real> A;
+    A.set(Arm);
+    SparseMatrixOperator op(A);
+    Vector b(n),x,r;
+    for(int i=0;i<n;i++) b(i) = Rand(-One,One);
+    IncompleteCholeskyPreconditioner ic;
+    ILU0Preconditioner ilu;
+    if(!ilu.set(A)) FatalError("ILU0Preconditioner failed on problem %d",problem);
+    if(problem == 0 && !ic.set(A)) FatalError("IncompleteCholeskyPreconditioner failed on problem %d",problem);
+    for(int m=0;m<4;m++) {
+      KrylovSolver::Method method = (KrylovSolver::Method)m;
+      if(problem == 1 && (method == KrylovSolver::ConjugateGradient || method == KrylovSolver::MINRES)) continue;
+      if(problem == 2 && (method == KrylovSolver::ConjugateGradient || method == KrylovSolver::GMRES)) continue;
+      for(int pc=0;pc<2;pc++) {
+        KrylovSolver solver;
+        solver.method = method;
+        solver.maxIters = 1000;
+        if(pc == 1) solver.preconditioner = (problem == 0 ? (LinearPreconditioner*)&ic : (LinearPreconditioner*)&ilu);
+        if(problem == 2 && method == KrylovSolver::MINRES && pc == 1) continue;
+        x.clear();
+        bool solved = solver.Solve(op,b,x);
+        if(!solved) {
+          LOG4CXX_ERROR(KrisLibrary::logger(),"Krylov method "<<m<<" preconditioner "<<pc<<" failed on problem "<<problem<<" after "<<solver.numIters<<" iters");
+          Abort();
+        }
+        A.mul(x,r);
+        r -= b;
+        if(r.norm() > 1e-6*b.norm()) {
+          LOG4CXX_ERROR(KrisLibrary::logger(),"Krylov method "<<m<<" preconditioner "<<pc<<" on problem "<<problem<<" has residual "<<r.norm()<<", |b| = "<<b.norm());
+          Abort();
+        }
+        //warm start from the solution takes no iterations
+        solved = solver.Solve(op,b,x);
+        if(!solved || solver.numIters > 1) {
+          LOG4CXX_ERROR(KrisLibrary::logger(),"Krylov method "<<m<<" preconditioner "<<pc<<" warm start on problem "<<problem<<" took "<<solver.numIters<<" iters, solved "<<(int)solved);
+          Abort();
+        }
+      }
+    }
+  }
+}
+
+void TestMixedPrecision()
+{
+  int n=60;
+  Matrix A(n,n),B(n,n),H(12,12);
+  Vector b(n),x,r;
+  RandomizeMatrix(A);
+  for(int i=0;i<n;i++) { A(i,i) += 4; b(i) = Rand(-One,One); }
+  MixedPrecisionLUDecomposition lu;
+  if(!lu.set(A) || !lu.backSub(b,x)) FatalError("MixedPrecisionLUDecomposition failed on a well-conditioned matrix");
+  A.mul(x,r); r -= b;
+  Assert(!lu.usingDouble && lu.numIters > 0);
+  Assert(r.maxAbsElement() < 1e-12);
+
+  //symmetric positive definite
+  B.mulTransposeA(A,A);
+  MixedPrecisionCholeskyDecomposition chol;
+  if(!chol.set(B) || !chol.backSub(b,x)) FatalError("MixedPrecisionCholeskyDecomposition failed on a positive definite matrix");
+  B.mul(x,r); r -= b;
+  Assert(!chol.usingDouble);
+  Assert(r.maxAbsElement() < 1e-10*B.maxAbsElement());
+
+  //Hilbert matrices are too ill-conditioned for float, so these fall back
+  Vector h(12,One),y;
+  x.clear();
+  for(int i=0;i<12;i++)
+    for(int j=0;j<12;j++) H(i,j) = One/Real(i+j+1);
+  if(!chol.set(H) || !chol.backSub(h,y)) FatalError("MixedPrecisionCholeskyDecomposition failed on a Hilbert matrix");
+  Assert(chol.usingDouble);
+  LUDecomposition<Real> lud;
+  lud.zeroTolerance = 0;
+  lu.LUd.zeroTolerance = 0;
+  if(!lu.set(H) || !lu.backSub(h,x)) FatalError("MixedPrecisionLUDecomposition failed on a Hilbert matrix");
+  Assert(lu.usingDouble);
+  lud.set(H);
+  y.clear();
+  lud.backSub(h,y);
+  Assert(x.isEqual(y,1e-8*y.maxAbsElement()));
+
+  //singular matrices are reported by backSub
+  Matrix S(n,n,Zero);
+  if(lu.set(S)) FatalError("MixedPrecisionLUDecomposition accepted a singular matrix");
+  if(lu.backSub(b,x)) FatalError("MixedPrecisionLUDecomposition solved a singular system");
+}
+
+void TestBatchedDecompositions()
+{
+  int size = 37, n = 5;
+  BatchedMatrixTemplate<Real> A(size,n,n),B(size,8,n),b(size,n,1),b8(size,8,1),x;
+  std::vector<Matrix> As(size),Bs(size);
+  std::vector<Vector> bs(size),b8s(size);
+  for(int k=0;k<size;k++) {
+    Matrix M(n,n);
+    RandomizeMatrix(M);
+    As[k].mulTransposeA(M,M);
+    for(int i=0;i<n;i++) As[k](i,i) += 0.1;
+    A.set(k,As[k]);
+    Bs[k].resize(8,n);
+    RandomizeMatrix(Bs[k]);
+    B.set(k,Bs[k]);
+    bs[k].resize(n);
+    b8s[k].resize(8);
+    for(int i=0;i<n;i++) bs[k](i) = Rand(-One,One);
+    for(int i=0;i<8;i++) b8s[k](i) = Rand(-One,One);
+    b.set(k,bs[k]);
+    b8.set(k,b8s[k]);
+  }
+  //a matrix that isn't positive definite only fails its own item
+  Matrix Mneg(n,n,Zero);
+  Mneg(0,0) = -1;
+  A.set(3,Mneg);
+  BatchedCholeskyDecomposition<Real> chol;
+  int numValid = chol.set(A);
+  if(numValid != size-1 || chol.valid[3]) FatalError("BatchedCholeskyDecomposition factored %d items, expected %d",numValid,size-1);
+  chol.backSub(b,x);
+  for(int k=0;k<size;k++) {
+    if(k == 3) continue;
+    Vector xk,Axk;
+    x.get(k,xk);
+    As[k].mul(xk,Axk);
+    Assert(Axk.isEqual(bs[k],1e-8));
+  }
+  //least squares solutions satisfy the normal equations
+  BatchedQRDecomposition<Real> qr;
+  numValid = qr.set(B);
+  if(numValid != size) FatalError("BatchedQRDecomposition factored %d items, expected %d",numValid,size);
+  qr.leastSquares(b8,x);
+  for(int k=0;k<size;k++) {
+    Vector xk,r,Atr;
+    x.get(k,xk);
+    Bs[k].mul(xk,r);
+    r -= b8s[k];
+    Bs[k].mulTranspose(r,Atr);
+    Assert(Atr.maxAbsElement() < 1e-10);
+  }
+  //A V = V D
+  BatchedSymmetricEigenDecomposition<Real> eig;
+  eig.set(A);
+  for(int k=0;k<size;k++) {
+    if(k == 3) continue;
+    Vector lambda;
+    Matrix V,AV,VD;
+    eig.get(k,lambda,V);
+    AV.mul(As[k],V);
+    VD = V;
+    for(int j=0;j<n;j++)
+      for(int i=0;i<n;i++) VD(i,j) *= lambda(j);
+    Assert(AV.isEqual(VD,1e-10));
+  }
+}
+
 void MatrixSelfTest()
 {
   LOG4CXX_INFO(KrisLibrary::logger(),"Self-testing matrices");
@@ -175,6 +552,113 @@ void MatrixSelfTest()
 
   //LOG4CXX_INFO(KrisLibrary::logger(),"A^-1*A"<<MatrixPrinter(m3)<<"\n");
   Assert(m3.isEqual(m,1e-6));
+
+  //products large enough for the blocked kernel, with odd sizes and
+  //transposed / strided references
+  Matrix A(37,301),B(301,45),C,Cref(37,45),At,Bt,Asub,Csub;
+  for(int i=0;i<A.m;i++)
+    for(int j=0;j<A.n;j++) A(i,j) = Rand(-One,One);
+  for(int i=0;i<B.m;i++)
+    for(int j=0;j<B.n;j++) B(i,j) = Rand(-One,One);
+  for(int i=0;i<Cref.m;i++)
+    for(int j=0;j<Cref.n;j++) {
+      A.getRowRef(i,r1);
+      B.getColRef(j,r2);
+      Cref(i,j) = r1.dot(r2);
+    }
+  C.mul(A,B);
+  Assert(C.isEqual(Cref,1e-10));
+  Matrix AtData,BtData;
+  AtData.setTranspose(A);
+  BtData.setTranspose(B);
+  C.setZero();
+  C.mulTransposeA(AtData,B);
+  Assert(C.isEqual(Cref,1e-10));
+  C.setZero();
+  C.mulTransposeB(A,BtData);
+  Assert(C.isEqual(Cref,1e-10));
+  At.setRefTranspose(AtData);
+  Bt.setRefTranspose(BtData);
+  C.setZero();
+  C.mul(At,Bt);
+  Assert(C.isEqual(Cref,1e-10));
+  Matrix Cbig(50,60,Zero);
+  Asub.setRef(A,3,0,1,1,30,A.n);
+  Csub.setRef(Cbig,5,7,1,1,30,45);
+  Csub.mul(Asub,B);
+  for(int i=0;i<30;i++)
+    for(int j=0;j<45;j++)
+      Assert(FuzzyEquals(Cbig(i+5,j+7),Cref(i+3,j),1e-10));
+  Assert(Cbig(4,7) == 0 && Cbig(5,6) == 0 && Cbig(35,7) == 0 && Cbig(5,52) == 0);
+
+  //fixed-size matrices should agree with the dynamic ones, and references
+  //should see the same storage
+  SmallMatrix<Real,4,6> sA;
+  SmallMatrix<Real,6,5> sB;
+  SmallMatrix<Real,4,5> sC;
+  SmallVector<Real,6> sx;
+  SmallVector<Real,4> sy;
+  for(int i=0;i<4;i++)
+    for(int j=0;j<6;j++) sA(i,j) = Rand(-One,One);
+  for(int i=0;i<6;i++)
+    for(int j=0;j<5;j++) sB(i,j) = Rand(-One,One);
+  for(int i=0;i<6;i++) sx(i) = Rand(-One,One);
+  sC.mul(sA,sB);
+  sA.mul(sx,sy);
+  Matrix sAref,sBref,sCref,sAB;
+  Vector sxref,syref;
+  sA.getRef(sAref);
+  sB.getRef(sBref);
+  sx.getRef(sxref);
+  Assert(sAref.m == 4 && sAref.n == 6 && sAref(2,3) == sA(2,3));
+  sAB.mul(sAref,sBref);
+  sC.getRef(sCref);
+  Assert(sAB.isEqual(sCref,1e-12));
+  sAref.mul(sxref,syref);
+  for(int i=0;i<4;i++) Assert(FuzzyEquals(syref(i),sy(i),1e-12));
+  sCref.resize(4,5);
+  sCref(1,2) = 7;
+  Assert(sC(1,2) == 7);
+
+  //sparse LDL^t of a 2D grid Laplacian, with and without a fill-reducing
+  //ordering, and refactoring with the same pattern
+  int gn = 12, nn = gn*gn;
+  Matrix Lap(nn,nn,Zero);
+  for(int i=0;i<gn;i++)
+    for(int j=0;j<gn;j++) {
+      int a = i*gn+j;
+      Lap(a,a) = 4.5;
+      if(i+1 < gn) Lap(a,a+gn) = Lap(a+gn,a) = -1;
+      if(j+1 < gn) Lap(a,a+1) = Lap(a+1,a) = -1;
+    }
+  SparseMatrixTemplate_CC<Real> sLap;
+  sLap.set(Lap);
+  Assert(sLap.isValid());
+  Vector sb(nn),sxn,sxa,sres;
+  for(int i=0;i<nn;i++) sb(i) = Rand(-One,One);
+  SparseLDLDecomposition<Real> ldlNatural,ldlAMD;
+  ldlNatural.analyze(sLap,SparseLDLDecomposition<Real>::NaturalOrdering);
+  if(!ldlNatural.factor(sLap)) FatalError("SparseLDLDecomposition failed with the natural ordering");
+  if(!ldlAMD.set(sLap)) FatalError("SparseLDLDecomposition failed with the AMD ordering");
+  if(ldlAMD.numNonZerosL() >= ldlNatural.numNonZerosL())
+    FatalError("AMD ordering gave %d nonzeros in L, natural ordering %d",(int)ldlAMD.numNonZerosL(),(int)ldlNatural.numNonZerosL());
+  ldlNatural.backSub(sb,sxn);
+  ldlAMD.backSub(sb,sxa);
+  Lap.mul(sxa,sres);
+  if(!sres.isEqual(sb,1e-10) || !sxa.isEqual(sxn,1e-10)) FatalError("Sparse LDL solutions are wrong");
+  sLap.inplaceMul(2.0);
+  if(!ldlAMD.factor(sLap)) FatalError("SparseLDLDecomposition refactorization failed");
+  ldlAMD.backSub(sb,sxa);
+  sxa.inplaceMul(2.0);
+  if(!sxa.isEqual(sxn,1e-10)) FatalError("Sparse LDL solution is wrong after refactoring");
+
+  //compressed row products, single and multithreaded
+  SparseMatrixTemplate_CR<Real>::self_test();
+
+  TestDecompositionUpdates();
+  TestBatchedDecompositions();
+  TestMixedPrecision();
+  TestKrylovSolvers();
   LOG4CXX_INFO(KrisLibrary::logger(),"Done");
   KrisLibrary::loggerWait();
 }
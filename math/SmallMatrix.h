@@ -0,0 +1,218 @@
+#ifndef MATH_SMALL_MATRIX_H
+#define MATH_SMALL_MATRIX_H
+
+#include "VectorTemplate.h"
+#include "MatrixTemplate.h"
+
+namespace Math {
+
+/** @ingroup Math
+ * @brief A vector whose size N is fixed at compile time.  Elements are
+ * stored in the object itself, so it never allocates.
+ *
+ * The method names and argument conventions match VectorTemplate, so code
+ * written for VectorTemplate usually compiles unchanged.  getRef() makes a
+ * VectorTemplate that refers to the elements, for passing to functions that
+ * take VectorTemplate arguments (no copy, no allocation).
+ *
+ * Like the Math3D types, the default constructor leaves the elements
+ * uninitialized.
+ */
+template <class T,int N>
+class SmallVector
+{
+ public:
+  typedef SmallVector<T,N> MyT;
+  enum { n=N };
+
+  SmallVector() {}
+  explicit SmallVector(T c) { set(c); }
+  explicit SmallVector(const T* vals) { set(vals); }
+
+  inline T& operator () (int i) { return vals[i]; }
+  inline const T& operator () (int i) const { return vals[i]; }
+  inline T& operator [] (int i) { return vals[i]; }
+  inline const T& operator [] (int i) const { return vals[i]; }
+  inline T* getStart() { return vals; }
+  inline const T* getStart() const { return vals; }
+  static inline int size() { return N; }
+  inline void operator += (const MyT& a) { for(int i=0;i<N;i++) vals[i] += a.vals[i]; }
+  inline void operator -= (const MyT& a) { for(int i=0;i<N;i++) vals[i] -= a.vals[i]; }
+  inline void operator *= (T c) { for(int i=0;i<N;i++) vals[i] *= c; }
+  inline bool operator == (const MyT& a) const { for(int i=0;i<N;i++) if(vals[i] != a.vals[i]) return false; return true; }
+  inline bool operator != (const MyT& a) const { return !operator == (a); }
+
+  inline void set(T c) { for(int i=0;i<N;i++) vals[i] = c; }
+  inline void set(const T* v) { for(int i=0;i<N;i++) vals[i] = v[i]; }
+  inline void setZero() { set(T(0)); }
+  inline void setNegative(const MyT& a) { for(int i=0;i<N;i++) vals[i] = -a.vals[i]; }
+  inline void add(const MyT& a,const MyT& b) { for(int i=0;i<N;i++) vals[i] = a.vals[i]+b.vals[i]; }
+  inline void sub(const MyT& a,const MyT& b) { for(int i=0;i<N;i++) vals[i] = a.vals[i]-b.vals[i]; }
+  inline void mul(const MyT& a,T c) { for(int i=0;i<N;i++) vals[i] = a.vals[i]*c; }
+  inline void div(const MyT& a,T c) { mul(a,T(1)/c); }
+  inline void madd(const MyT& a,T c) { for(int i=0;i<N;i++) vals[i] += a.vals[i]*c; }
+  inline void inplaceMul(T c) { operator *= (c); }
+  inline void inplaceNegative() { for(int i=0;i<N;i++) vals[i] = -vals[i]; }
+  inline T dot(const MyT& a) const { T sum(0); for(int i=0;i<N;i++) sum += vals[i]*a.vals[i]; return sum; }
+  inline T normSquared() const { return dot(*this); }
+  inline T norm() const { return Sqrt(normSquared()); }
+
+  ///Copies from a VectorTemplate of size N
+  inline void copy(const VectorTemplate<T>& v) { Assert(v.n == N); for(int i=0;i<N;i++) vals[i] = v(i); }
+  ///Copies into a VectorTemplate, resizing it if it's empty
+  inline void get(VectorTemplate<T>& v) const { if(v.empty()) v.resize(N); Assert(v.n == N); for(int i=0;i<N;i++) v(i) = vals[i]; }
+  ///Sets ref to refer to the elements of this vector.  ref must not outlive
+  ///this object.
+  inline void getRef(VectorTemplate<T>& ref) { ref.setRef(vals,N); }
+  ///Same as above, for read-only access
+  inline void getRef(VectorTemplate<T>& ref) const { ref.setRef(const_cast<T*>(vals),N); }
+
+  T vals[N];
+};
+
+/** @ingroup Math
+ * @brief An M x N matrix whose size is fixed at compile time.  Elements are
+ * stored row-major in the object itself, so it never allocates.
+ *
+ * The method names and argument conventions match MatrixTemplate, e.g.
+ * A.mul(x,y) sets y=A*x and A.madd(x,y) sets y+=A*x.  getRef() makes a
+ * MatrixTemplate that refers to the elements (istride=N, jstride=1), for
+ * passing to functions that take MatrixTemplate arguments.  Such functions
+ * can call resize() on the reference as long as the dimensions match.
+ */
+template <class T,int M,int N>
+class SmallMatrix
+{
+ public:
+  typedef SmallMatrix<T,M,N> MyT;
+  enum { m=M, n=N };
+
+  SmallMatrix() {}
+  explicit SmallMatrix(T c) { set(c); }
+  explicit SmallMatrix(const T* vals) { set(vals); }
+
+  inline T& operator () (int i,int j) { return vals[i*N+j]; }
+  inline const T& operator () (int i,int j) const { return vals[i*N+j]; }
+  inline T* getStart() { return vals; }
+  inline const T* getStart() const { return vals; }
+  static inline int numRows() { return M; }
+  static inline int numCols() { return N; }
+  inline void operator += (const MyT& a) { for(int i=0;i<M*N;i++) vals[i] += a.vals[i]; }
+  inline void operator -= (const MyT& a) { for(int i=0;i<M*N;i++) vals[i] -= a.vals[i]; }
+  inline void operator *= (T c) { for(int i=0;i<M*N;i++) vals[i] *= c; }
+  inline bool operator == (const MyT& a) const { for(int i=0;i<M*N;i++) if(vals[i] != a.vals[i]) return false; return true; }
+  inline bool operator != (const MyT& a) const { return !operator == (a); }
+
+  inline void set(T c) { for(int i=0;i<M*N;i++) vals[i] = c; }
+  inline void set(const T* v) { for(int i=0;i<M*N;i++) vals[i] = v[i]; }
+  inline void setZero() { set(T(0)); }
+  inline void setIdentity() { setZero(); for(int i=0;i<M && i<N;i++) vals[i*N+i] = T(1); }
+  inline void setNegative(const MyT& a) { for(int i=0;i<M*N;i++) vals[i] = -a.vals[i]; }
+  inline void setTranspose(const SmallMatrix<T,N,M>& a) {
+    for(int i=0;i<M;i++)
+      for(int j=0;j<N;j++)
+        vals[i*N+j] = a(j,i);
+  }
+  inline void setOuterProduct(const SmallVector<T,M>& a,const SmallVector<T,N>& b) {
+    for(int i=0;i<M;i++)
+      for(int j=0;j<N;j++)
+        vals[i*N+j] = a(i)*b(j);
+  }
+  inline void add(const MyT& a,const MyT& b) { for(int i=0;i<M*N;i++) vals[i] = a.vals[i]+b.vals[i]; }
+  inline void sub(const MyT& a,const MyT& b) { for(int i=0;i<M*N;i++) vals[i] = a.vals[i]-b.vals[i]; }
+  inline void mul(const MyT& a,T c) { for(int i=0;i<M*N;i++) vals[i] = a.vals[i]*c; }
+  inline void madd(const MyT& a,T c) { for(int i=0;i<M*N;i++) vals[i] += a.vals[i]*c; }
+  inline void inplaceMul(T c) { operator *= (c); }
+  ///this = a*b.  this must not be a or b.
+  template <int K>
+  inline void mul(const SmallMatrix<T,M,K>& a,const SmallMatrix<T,K,N>& b) {
+    for(int i=0;i<M;i++) {
+      T* xi = &vals[i*N];
+      for(int j=0;j<N;j++) xi[j] = 0;
+      for(int k=0;k<K;k++) {
+        T aik = a(i,k);
+        const T* bk = &b.vals[k*N];
+        for(int j=0;j<N;j++) xi[j] += aik*bk[j];
+      }
+    }
+  }
+  ///this = a^T*b.  this must not be a or b.
+  template <int K>
+  inline void mulTransposeA(const SmallMatrix<T,K,M>& a,const SmallMatrix<T,K,N>& b) {
+    setZero();
+    for(int k=0;k<K;k++)
+      for(int i=0;i<M;i++) {
+        T aki = a(k,i);
+        for(int j=0;j<N;j++) vals[i*N+j] += aki*b(k,j);
+      }
+  }
+  ///this = a*b^T.  this must not be a or b.
+  template <int K>
+  inline void mulTransposeB(const SmallMatrix<T,M,K>& a,const SmallMatrix<T,N,K>& b) {
+    for(int i=0;i<M;i++)
+      for(int j=0;j<N;j++) {
+        T sum(0);
+        for(int k=0;k<K;k++) sum += a(i,k)*b(j,k);
+        vals[i*N+j] = sum;
+      }
+  }
+  ///y = this*x
+  inline void mul(const SmallVector<T,N>& x,SmallVector<T,M>& y) const {
+    for(int i=0;i<M;i++) {
+      T sum(0);
+      for(int j=0;j<N;j++) sum += vals[i*N+j]*x(j);
+      y(i) = sum;
+    }
+  }
+  ///y += this*x
+  inline void madd(const SmallVector<T,N>& x,SmallVector<T,M>& y) const {
+    for(int i=0;i<M;i++) {
+      T sum(0);
+      for(int j=0;j<N;j++) sum += vals[i*N+j]*x(j);
+      y(i) += sum;
+    }
+  }
+  ///y = this^T*x
+  inline void mulTranspose(const SmallVector<T,M>& x,SmallVector<T,N>& y) const {
+    y.setZero();
+    maddTranspose(x,y);
+  }
+  ///y += this^T*x
+  inline void maddTranspose(const SmallVector<T,M>& x,SmallVector<T,N>& y) const {
+    for(int i=0;i<M;i++) {
+      T xi = x(i);
+      for(int j=0;j<N;j++) y(j) += vals[i*N+j]*xi;
+    }
+  }
+  inline void getRow(int i,SmallVector<T,N>& v) const { for(int j=0;j<N;j++) v(j) = vals[i*N+j]; }
+  inline void getCol(int j,SmallVector<T,M>& v) const { for(int i=0;i<M;i++) v(i) = vals[i*N+j]; }
+  inline void setRow(int i,const SmallVector<T,N>& v) { for(int j=0;j<N;j++) vals[i*N+j] = v(j); }
+  inline void setCol(int j,const SmallVector<T,M>& v) { for(int i=0;i<M;i++) vals[i*N+j] = v(i); }
+
+  ///Copies from an M x N MatrixTemplate
+  inline void copy(const MatrixTemplate<T>& a) {
+    Assert(a.m == M && a.n == N);
+    for(int i=0;i<M;i++)
+      for(int j=0;j<N;j++)
+        vals[i*N+j] = a(i,j);
+  }
+  ///Copies into a MatrixTemplate, resizing it if it's empty
+  inline void get(MatrixTemplate<T>& a) const {
+    if(a.isEmpty()) a.resize(M,N);
+    Assert(a.m == M && a.n == N);
+    for(int i=0;i<M;i++)
+      for(int j=0;j<N;j++)
+        a(i,j) = vals[i*N+j];
+  }
+  ///Sets ref to refer to the elements of this matrix.  ref must not outlive
+  ///this object.
+  inline void getRef(MatrixTemplate<T>& ref) { ref.setRef(vals,M*N,0,N,1,M,N); }
+  ///Same as above, for read-only access
+  inline void getRef(MatrixTemplate<T>& ref) const { ref.setRef(const_cast<T*>(vals),M*N,0,N,1,M,N); }
+
+  T vals[M*N];
+};
+
+} //namespace Math
+
+#endif
@@ -0,0 +1,456 @@
+#include "SparseLDL.h"
+#include <KrisLibrary/errors.h>
+#include <algorithm>
+using namespace std;
+
+namespace Math {
+
+/* Minimum degree on the quotient graph, following Amestoy, Davis and Duff,
+ * "An approximate minimum degree ordering algorithm" (1996).
+ *
+ * Each node is a variable, an element (an eliminated pivot, representing
+ * the clique it formed), or dead (absorbed into another node).  Variable i
+ * keeps lists of adjacent variables A[i] and elements E[i]; element e keeps
+ * the list of variables L[e].  Indistinguishable variables are merged into
+ * supervariables of weight nv, and the degree of a variable is an upper
+ * bound on its external degree.
+ */
+namespace {
+
+enum { AMDVariable, AMDElement, AMDDead };
+
+struct DegreeLists
+{
+  DegreeLists(int n) :head(n,-1),next(n,-1),prev(n,-1),mindeg(0) {}
+  void insert(int i,int d) {
+    next[i] = head[d];
+    prev[i] = -1;
+    if(head[d] >= 0) prev[head[d]] = i;
+    head[d] = i;
+    if(d < mindeg) mindeg = d;
+  }
+  void remove(int i,int d) {
+    if(prev[i] >= 0) next[prev[i]] = next[i];
+    else head[d] = next[i];
+    if(next[i] >= 0) prev[next[i]] = prev[i];
+  }
+  int popMin() {
+    while(head[mindeg] < 0) mindeg++;
+    int i = head[mindeg];
+    remove(i,mindeg);
+    return i;
+  }
+  vector<int> head,next,prev;
+  int mindeg;
+};
+
+} //namespace
+
+void ApproximateMinimumDegree(int n,const vector<int>& col_offsets,const vector<int>& row_indices,vector<int>& perm)
+{
+  perm.resize(0);
+  perm.reserve(n);
+  if(n == 0) return;
+
+  //adjacency of A+A^t, without the diagonal
+  vector<vector<int> > A(n);
+  for(int j=0;j<n;j++)
+    for(int k=col_offsets[j];k<col_offsets[j+1];k++) {
+      int i=row_indices[k];
+      if(i == j) continue;
+      A[i].push_back(j);
+      A[j].push_back(i);
+    }
+  for(int i=0;i<n;i++) {
+    sort(A[i].begin(),A[i].end());
+    A[i].erase(unique(A[i].begin(),A[i].end()),A[i].end());
+  }
+
+  //dense rows are removed from the graph and ordered last
+  int denseThreshold = Max(16,(int)(10.0*Sqrt(Real(n))));
+  vector<char> status(n,AMDVariable);
+  vector<int> denseRows;
+  for(int i=0;i<n;i++)
+    if((int)A[i].size() > denseThreshold) {
+      status[i] = AMDDead;
+      denseRows.push_back(i);
+    }
+  vector<int> nv(n,1),degree(n,0),elemSize(n,0);
+  vector<vector<int> > E(n),L(n),members(n);
+  DegreeLists lists(n);
+  for(int i=0;i<n;i++) {
+    if(status[i] != AMDVariable) continue;
+    if(!denseRows.empty()) {
+      size_t k=0;
+      for(size_t a=0;a<A[i].size();a++)
+        if(status[A[i][a]] == AMDVariable) A[i][k++] = A[i][a];
+      A[i].resize(k);
+    }
+    degree[i] = (int)A[i].size();
+    lists.insert(i,degree[i]);
+  }
+
+  vector<int> mark(n,0),wmark(n,0),w(n,0),tempDegree(n,0);
+  vector<size_t> hash(n,0);
+  vector<pair<size_t,int> > hashOrder;
+  int stamp=0,wstamp=0;
+  int nel = (int)denseRows.size();
+  while(nel < n) {
+    //pick the pivot of minimum degree and make it an element
+    int p = lists.popMin();
+    perm.push_back(p);
+    perm.insert(perm.end(),members[p].begin(),members[p].end());
+    vector<int>().swap(members[p]);
+    nel += nv[p];
+
+    //L[p] = union of the elements adjacent to p, and of A[p]; those
+    //elements are absorbed into p
+    stamp++;
+    mark[p] = stamp;
+    vector<int>& Lp = L[p];
+    for(size_t a=0;a<E[p].size();a++) {
+      int e = E[p][a];
+      if(status[e] != AMDElement) continue;
+      for(size_t b=0;b<L[e].size();b++) {
+        int i = L[e][b];
+        if(status[i] == AMDVariable && mark[i] != stamp) {
+          mark[i] = stamp;
+          Lp.push_back(i);
+        }
+      }
+      status[e] = AMDDead;
+      vector<int>().swap(L[e]);
+    }
+    for(size_t a=0;a<A[p].size();a++) {
+      int i = A[p][a];
+      if(status[i] == AMDVariable && mark[i] != stamp) {
+        mark[i] = stamp;
+        Lp.push_back(i);
+      }
+    }
+    vector<int>().swap(E[p]);
+    vector<int>().swap(A[p]);
+    status[p] = AMDElement;
+    for(size_t a=0;a<Lp.size();a++)
+      lists.remove(Lp[a],degree[Lp[a]]);
+
+    //w[e] = |L[e] \ L[p]| for every element e adjacent to L[p]
+    wstamp++;
+    for(size_t a=0;a<Lp.size();a++) {
+      int i = Lp[a];
+      for(size_t b=0;b<E[i].size();b++) {
+        int e = E[i][b];
+        if(status[e] != AMDElement) continue;
+        if(wmark[e] != wstamp) {
+          wmark[e] = wstamp;
+          w[e] = elemSize[e];
+        }
+        w[e] -= nv[i];
+      }
+    }
+
+    //prune the adjacency of each variable in L[p], and sum the external
+    //degree not due to p
+    for(size_t a=0;a<Lp.size();a++) {
+      int i = Lp[a];
+      int d = 0;
+      size_t h = p;
+      size_t k = 0;
+      for(size_t b=0;b<E[i].size();b++) {
+        int e = E[i][b];
+        if(status[e] != AMDElement) continue;
+        if(w[e] == 0) {
+          //L[e] is a subset of L[p]: absorb e into p
+          status[e] = AMDDead;
+          vector<int>().swap(L[e]);
+          continue;
+        }
+        d += w[e];
+        h += e;
+        E[i][k++] = e;
+      }
+      E[i].resize(k);
+      E[i].push_back(p);
+      k = 0;
+      for(size_t b=0;b<A[i].size();b++) {
+        int j = A[i][b];
+        if(status[j] != AMDVariable || mark[j] == stamp) continue;
+        d += nv[j];
+        h += j;
+        A[i][k++] = j;
+      }
+      A[i].resize(k);
+      tempDegree[i] = d;
+      hash[i] = h;
+    }
+
+    //mass elimination: variables adjacent only to p are eliminated with it
+    size_t k = 0;
+    for(size_t a=0;a<Lp.size();a++) {
+      int i = Lp[a];
+      if(tempDegree[i] == 0 && E[i].size() == 1) {
+        perm.push_back(i);
+        perm.insert(perm.end(),members[i].begin(),members[i].end());
+        vector<int>().swap(members[i]);
+        nel += nv[i];
+        nv[i] = 0;
+        status[i] = AMDDead;
+        vector<int>().swap(E[i]);
+        vector<int>().swap(A[i]);
+      }
+      else Lp[k++] = i;
+    }
+    Lp.resize(k);
+
+    //merge indistinguishable variables into supervariables
+    hashOrder.resize(Lp.size());
+    for(size_t a=0;a<Lp.size();a++)
+      hashOrder[a] = pair<size_t,int>(hash[Lp[a]],Lp[a]);
+    sort(hashOrder.begin(),hashOrder.end());
+    for(size_t a=0;a<hashOrder.size();a++) {
+      int i = hashOrder[a].second;
+      if(nv[i] == 0) continue;
+      bool marked = false;
+      for(size_t b=a+1;b<hashOrder.size() && hashOrder[b].first == hashOrder[a].first;b++) {
+        int j = hashOrder[b].second;
+        if(nv[j] == 0) continue;
+        if(A[i].size() != A[j].size() || E[i].size() != E[j].size()) continue;
+        if(!marked) {
+          wstamp++;
+          for(size_t c=0;c<A[i].size();c++) wmark[A[i][c]] = wstamp;
+          for(size_t c=0;c<E[i].size();c++) wmark[E[i][c]] = wstamp;
+          marked = true;
+        }
+        bool same = true;
+        for(size_t c=0;c<A[j].size() && same;c++) same = (wmark[A[j][c]] == wstamp);
+        for(size_t c=0;c<E[j].size() && same;c++) same = (wmark[E[j][c]] == wstamp);
+        if(!same) continue;
+        nv[i] += nv[j];
+        nv[j] = 0;
+        status[j] = AMDDead;
+        members[i].push_back(j);
+        members[i].insert(members[i].end(),members[j].begin(),members[j].end());
+        vector<int>().swap(members[j]);
+        vector<int>().swap(E[j]);
+        vector<int>().swap(A[j]);
+      }
+    }
+
+    //update the degrees of the remaining variables in L[p]
+    k = 0;
+    int size = 0;
+    for(size_t a=0;a<Lp.size();a++) {
+      if(nv[Lp[a]] == 0) continue;
+      size += nv[Lp[a]];
+      Lp[k++] = Lp[a];
+    }
+    Lp.resize(k);
+    elemSize[p] = size;
+    for(size_t a=0;a<Lp.size();a++) {
+      int i = Lp[a];
+      int ext = size - nv[i];
+      int d = Min(tempDegree[i],degree[i]) + ext;
+      d = Min(d,n-nel-nv[i]);
+      degree[i] = Max(d,0);
+      lists.insert(i,degree[i]);
+    }
+  }
+  perm.insert(perm.end(),denseRows.begin(),denseRows.end());
+  Assert((int)perm.size() == n);
+}
+
+
+
+template <class T>
+SparseLDLDecomposition<T>::SparseLDLDecomposition()
+  :zeroTolerance(0),n(0),failedPivot(-1)
+{}
+
+template <class T>
+void SparseLDLDecomposition<T>::analyze(const SparseMatrixT& A,Ordering ordering)
+{
+  if(!A.isSquare()) FatalError("SparseLDLDecomposition: matrix is not square");
+  vector<int> p;
+  if(ordering == AMDOrdering)
+    ApproximateMinimumDegree(A.n,A.col_offsets,A.row_indices,p);
+  else {
+    p.resize(A.n);
+    for(int i=0;i<A.n;i++) p[i] = i;
+  }
+  analyze(A,p);
+}
+
+template <class T>
+void SparseLDLDecomposition<T>::analyze(const SparseMatrixT& A,const vector<int>& _perm)
+{
+  if(!A.isSquare()) FatalError("SparseLDLDecomposition: matrix is not square");
+  Assert((int)_perm.size() == A.n);
+  n = A.n;
+  perm = _perm;
+  pinv.resize(n);
+  for(int k=0;k<n;k++) pinv[perm[k]] = k;
+  Acol_offsets = A.col_offsets;
+  Arow_indices = A.row_indices;
+
+  //C = upper triangle of PAP^t
+  int nnz = A.numNonZeros();
+  Cp.resize(n+1);
+  fill(Cp.begin(),Cp.end(),0);
+  Cmap.resize(nnz);
+  for(int j=0;j<n;j++)
+    for(int k=A.col_offsets[j];k<A.col_offsets[j+1];k++) {
+      int i = A.row_indices[k];
+      if(i > j) continue;
+      Cp[Max(pinv[i],pinv[j])+1]++;
+    }
+  for(int j=0;j<n;j++) Cp[j+1] += Cp[j];
+  Ci.resize(Cp[n]);
+  Cx.resize(Cp[n]);
+  vector<int> next(Cp.begin(),Cp.end()-1);
+  for(int j=0;j<n;j++)
+    for(int k=A.col_offsets[j];k<A.col_offsets[j+1];k++) {
+      int i = A.row_indices[k];
+      if(i > j) {
+        Cmap[k] = -1;
+        continue;
+      }
+      int pi = pinv[i], pj = pinv[j];
+      int c = Max(pi,pj);
+      Cmap[k] = next[c];
+      Ci[next[c]++] = Min(pi,pj);
+    }
+
+  //elimination tree and column counts of L
+  parent.resize(n);
+  flag.resize(n);
+  lnz.resize(n);
+  for(int k=0;k<n;k++) {
+    parent[k] = -1;
+    flag[k] = k;
+    lnz[k] = 0;
+    for(int p=Cp[k];p<Cp[k+1];p++) {
+      for(int i=Ci[p];flag[i]!=k;i=parent[i]) {
+        if(parent[i] == -1) parent[i] = k;
+        lnz[i]++;
+        flag[i] = k;
+      }
+    }
+  }
+  Lp.resize(n+1);
+  Lp[0] = 0;
+  for(int k=0;k<n;k++) Lp[k+1] = Lp[k] + lnz[k];
+  Li.resize(Lp[n]);
+  Lx.resize(Lp[n]);
+  D.resize(n);
+  y.resize(n);
+  pattern.resize(n);
+  work.resize(n);
+}
+
+template <class T>
+bool SparseLDLDecomposition<T>::factor(const SparseMatrixT& A)
+{
+  Assert(isAnalyzed());
+  Assert(A.n == n && A.numNonZeros() == (int)Cmap.size());
+  fill(Cx.begin(),Cx.end(),T(0));
+  for(size_t k=0;k<Cmap.size();k++)
+    if(Cmap[k] >= 0) Cx[Cmap[k]] = A.val_array[k];
+
+  //up-looking factorization: row k of L is found by a sparse triangular
+  //solve whose pattern is the reach of C(:,k) in the elimination tree
+  failedPivot = -1;
+  for(int k=0;k<n;k++) {
+    y[k] = 0;
+    int top = n;
+    flag[k] = k;
+    lnz[k] = 0;
+    for(int p=Cp[k];p<Cp[k+1];p++) {
+      int i = Ci[p];
+      y[i] += Cx[p];
+      int len = 0;
+      for(;flag[i]!=k;i=parent[i]) {
+        pattern[len++] = i;
+        flag[i] = k;
+      }
+      while(len > 0) pattern[--top] = pattern[--len];
+    }
+    D[k] = y[k];
+    y[k] = 0;
+    for(;top<n;top++) {
+      int i = pattern[top];
+      T yi = y[i];
+      y[i] = 0;
+      int p2 = Lp[i]+lnz[i];
+      for(int p=Lp[i];p<p2;p++)
+        y[Li[p]] -= Lx[p]*yi;
+      T lki = yi/D[i];
+      D[k] -= lki*yi;
+      Li[p2] = k;
+      Lx[p2] = lki;
+      lnz[i]++;
+    }
+    if(Abs(D[k]) <= zeroTolerance) {
+      failedPivot = k;
+      return false;
+    }
+  }
+  return true;
+}
+
+template <class T>
+bool SparseLDLDecomposition<T>::set(const SparseMatrixT& A,Ordering ordering)
+{
+  if(!isAnalyzed() || A.n != n || A.col_offsets != Acol_offsets || A.row_indices != Arow_indices)
+    analyze(A,ordering);
+  return factor(A);
+}
+
+template <class T>
+void SparseLDLDecomposition<T>::backSub(const VectorT& b,VectorT& x) const
+{
+  Assert(b.n == n);
+  for(int k=0;k<n;k++) work[k] = b(perm[k]);
+  for(int j=0;j<n;j++) {
+    T xj = work[j];
+    for(int p=Lp[j];p<Lp[j+1];p++)
+      work[Li[p]] -= Lx[p]*xj;
+  }
+  for(int j=0;j<n;j++) work[j] /= D[j];
+  for(int j=n-1;j>=0;j--) {
+    T xj = work[j];
+    for(int p=Lp[j];p<Lp[j+1];p++)
+      xj -= Lx[p]*work[Li[p]];
+    work[j] = xj;
+  }
+  x.resize(n);
+  for(int k=0;k<n;k++) x(perm[k]) = work[k];
+}
+
+template <class T>
+int SparseLDLDecomposition<T>::numNegativePivots() const
+{
+  int num=0;
+  for(int k=0;k<n;k++)
+    if(D[k] < 0) num++;
+  return num;
+}
+
+template <class T>
+void SparseLDLDecomposition<T>::getL(SparseMatrixT& L) const
+{
+  L.initialize(n,n,numNonZerosL());
+  for(int j=0;j<n;j++) {
+    L.col_offsets[j] = Lp[j];
+    //rows are produced in increasing order
+    for(int p=Lp[j];p<Lp[j+1];p++) {
+      L.row_indices[p] = Li[p];
+      L.val_array[p] = Lx[p];
+    }
+  }
+  L.col_offsets[n] = numNonZerosL();
+}
+
+template class SparseLDLDecomposition<float>;
+template class SparseLDLDecomposition<double>;
+
+} //namespace Math
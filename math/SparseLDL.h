@@ -0,0 +1,92 @@
+#ifndef MATH_SPARSE_LDL_H
+#define MATH_SPARSE_LDL_H
+
+#include "SparseMatrixTemplate.h"
+#include <vector>
+
+namespace Math {
+
+/** @ingroup Math
+ * @brief Computes a fill-reducing ordering for the symmetric matrix with
+ * the sparsity pattern of A+A^t, using the approximate minimum degree (AMD)
+ * heuristic.
+ *
+ * A is n x n and given in compressed column form.  Values and the diagonal
+ * are ignored.  On output, perm[k] is the index of the row/column of A that
+ * is eliminated k'th.  Rows that are much denser than the rest are ordered
+ * last.
+ */
+void ApproximateMinimumDegree(int n,const std::vector<int>& col_offsets,const std::vector<int>& row_indices,std::vector<int>& perm);
+
+/** @ingroup Math
+ * @brief Sparse LDL^t factorization P A P^t = L D L^t of a symmetric
+ * matrix A.
+ *
+ * Only the diagonal and upper triangle of A are read.  No pivoting is
+ * done during the numeric factorization, so A should be positive definite,
+ * or quasi-definite (like the regularized KKT matrix of a QP).  When A is
+ * positive definite, L*sqrt(D) is its Cholesky factor.
+ *
+ * The work is split into two phases:
+ * - analyze() picks the ordering P and computes the elimination tree and
+ *   the structure of L from the sparsity pattern of A.
+ * - factor() computes the values of L and D.
+ * Matrices with the same pattern (e.g., from one Newton step to the next)
+ * only need factor().  set() does both, skipping analyze() if the pattern
+ * matches the last one analyzed.
+ */
+template <class T>
+class SparseLDLDecomposition
+{
+ public:
+  typedef SparseMatrixTemplate_CC<T> SparseMatrixT;
+  typedef VectorTemplate<T> VectorT;
+  enum Ordering { NaturalOrdering, AMDOrdering };
+
+  SparseLDLDecomposition();
+  ///Symbolic factorization, with the given fill-reducing ordering
+  void analyze(const SparseMatrixT& A,Ordering ordering=AMDOrdering);
+  ///Symbolic factorization, with a user-supplied ordering (perm[k] is the
+  ///k'th row/column to eliminate)
+  void analyze(const SparseMatrixT& A,const std::vector<int>& perm);
+  ///Numeric factorization.  A must have the same pattern as the matrix
+  ///given to analyze().  Returns false if a pivot has absolute value
+  ///<= zeroTolerance; its index in the permuted matrix is failedPivot.
+  bool factor(const SparseMatrixT& A);
+  ///Re-analyzes A if its pattern has changed, then factors it
+  bool set(const SparseMatrixT& A,Ordering ordering=AMDOrdering);
+  ///Solves A x = b
+  void backSub(const VectorT& b,VectorT& x) const;
+
+  inline bool isAnalyzed() const { return (int)Lp.size() == n+1; }
+  ///Returns the number of entries in L, not counting the unit diagonal
+  inline int numNonZerosL() const { return isAnalyzed() ? Lp[n] : 0; }
+  ///Returns the number of negative entries of D (the number of negative
+  ///eigenvalues of A)
+  int numNegativePivots() const;
+  ///Returns the strictly lower part of L, in the permuted order
+  void getL(SparseMatrixT& L) const;
+
+  T zeroTolerance;        ///<pivots with absolute value <= this fail (default 0)
+  int n;
+  std::vector<int> perm,pinv;  ///<row/col k of PAP^t is row/col perm[k] of A
+  std::vector<int> parent;     ///<elimination tree of PAP^t
+  std::vector<int> Lp,Li;      ///<structure of L, compressed column
+  std::vector<T> Lx,D;         ///<values of L and D
+  int failedPivot;
+
+ private:
+  //pattern of the analyzed matrix, and where each of its entries maps to in
+  //the upper triangle of PAP^t (or -1 for entries below the diagonal)
+  std::vector<int> Acol_offsets,Arow_indices;
+  std::vector<int> Cp,Ci,Cmap;
+  std::vector<T> Cx;
+  //workspace for factor() and backSub()
+  std::vector<int> flag,lnz,pattern;
+  std::vector<T> y;
+  mutable std::vector<T> work;
+};
+
+} //namespace Math
+
+#endif
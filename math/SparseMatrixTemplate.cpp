@@ -2,6 +2,9 @@
 #include "SparseMatrixTemplate.h"
 #include "complex.h"
 #include <iostream>
+#include <algorithm>
+#include "random.h"
+#include <KrisLibrary/utils/threadutils.h>
 using namespace std;
 
 namespace Math {
@@ -545,12 +548,872 @@ template <> void SparseMatrixTemplate_RM<Complex>::setAdjoint(const MyT& A)
       j->second.inplaceConjugate();
 }
 
+/* Products of compressed-row matrices are split over threads by ranges of
+ * rows (or, for the transposed products, of columns) with roughly equal
+ * numbers of entries.  The same kernels are used for both: offsets/indices
+ * give the entries of each row of the operand, and valIndex, if non-NULL,
+ * maps those entries to positions in vals.
+ */
+static const int kSparseParallelMinEntries = 32768;
+static const int kSparseProductBlockSize = 8;
+
+//returns the number of threads to use for a product with nnz entries over
+//count rows.  Explicit thread counts are always honored.
+static int SparseProductThreads(int nnz,int count,int numThreads)
+{
+  int p = ThreadCount(numThreads);
+  if(numThreads <= 0) p = Min(p,nnz/kSparseParallelMinEntries);
+  p = Min(p,count);
+  return Max(p,1);
+}
+
+//splits [0,count) into p ranges [splits[k],splits[k+1]) with about the same
+//number of entries each
+static void PartitionByEntries(const int* offsets,int count,int p,std::vector<int>& splits)
+{
+  splits.resize(p+1);
+  splits[0] = 0;
+  splits[p] = count;
+  long long nnz = offsets[count];
+  for(int k=1;k<p;k++) {
+    int target = (int)(nnz*k/p);
+    int r = int(std::lower_bound(offsets,offsets+count+1,target)-offsets);
+    splits[k] = Min(Max(r,splits[k-1]),count);
+  }
+}
+
+template <class T>
+struct SparseProductTask
+{
+  const int* offsets;
+  const int* indices;
+  const T* vals;
+  const int* valIndex;
+  //vector product: x = (x+)A*y
+  const T* y; int ystride;
+  T* x; int xstride;
+  //matrix product: v = A*w
+  const MatrixTemplate<T>* w;
+  MatrixTemplate<T>* v;
+  int start,end;
+  bool add;
+};
+
+template <class T>
+static void SparseVectorProductRange(const SparseProductTask<T>& t)
+{
+  for(int i=t.start;i<t.end;i++) {
+    T sum=0;
+    if(t.valIndex) {
+      for(int k=t.offsets[i];k<t.offsets[i+1];k++)
+        sum += t.vals[t.valIndex[k]]*t.y[t.indices[k]*t.ystride];
+    }
+    else {
+      for(int k=t.offsets[i];k<t.offsets[i+1];k++)
+        sum += t.vals[k]*t.y[t.indices[k]*t.ystride];
+    }
+    if(t.add) t.x[i*t.xstride] += sum;
+    else t.x[i*t.xstride] = sum;
+  }
+}
+
+//accumulates blocks of columns of v at a time, so each entry of the sparse
+//matrix is loaded once per block rather than once per column
+template <class T>
+static void SparseMatrixProductRange(const SparseProductTask<T>& t)
+{
+  const MatrixTemplate<T>& w = *t.w;
+  MatrixTemplate<T>& v = *t.v;
+  const T* wstart = w.getStart();
+  T* vstart = v.getStart();
+  T acc[kSparseProductBlockSize];
+  for(int cb=0;cb<w.n;cb+=kSparseProductBlockSize) {
+    int nb = Min(kSparseProductBlockSize,w.n-cb);
+    for(int i=t.start;i<t.end;i++) {
+      for(int c=0;c<nb;c++) acc[c]=0;
+      for(int k=t.offsets[i];k<t.offsets[i+1];k++) {
+        T a = (t.valIndex ? t.vals[t.valIndex[k]] : t.vals[k]);
+        const T* wrow = wstart + t.indices[k]*w.istride + cb*w.jstride;
+        for(int c=0;c<nb;c++) acc[c] += a*wrow[c*w.jstride];
+      }
+      T* vrow = vstart + i*v.istride + cb*v.jstride;
+      for(int c=0;c<nb;c++) vrow[c*v.jstride] = acc[c];
+    }
+  }
+}
+
+template <class T>
+static void* SparseProductThread(void* vdata)
+{
+  SparseProductTask<T>* t = reinterpret_cast<SparseProductTask<T>*>(vdata);
+  if(t->w) SparseMatrixProductRange(*t);
+  else SparseVectorProductRange(*t);
+  return NULL;
+}
+
+template <class T>
+static void RunSparseProduct(const SparseProductTask<T>& task,int count,int numThreads)
+{
+  int p = SparseProductThreads(task.offsets[count],count,numThreads);
+  if(p == 1) {
+    SparseProductTask<T> t = task;
+    t.start = 0;
+    t.end = count;
+    SparseProductThread<T>(&t);
+    return;
+  }
+  std::vector<int> splits;
+  PartitionByEntries(task.offsets,count,p,splits);
+  std::vector<SparseProductTask<T> > tasks(p,task);
+  for(int k=0;k<p;k++) {
+    tasks[k].start = splits[k];
+    tasks[k].end = splits[k+1];
+  }
+  ThreadRunAll(SparseProductThread<T>,tasks);
+}
+
+template <class T>
+SparseMatrixTemplate_CR<T>::SparseMatrixTemplate_CR()
+  :row_offsets(NULL),col_indices(NULL),val_array(NULL),m(0),n(0),num_entries(0),transposeIndexValid(false)
+{}
+
+template <class T>
+SparseMatrixTemplate_CR<T>::SparseMatrixTemplate_CR(const MyT& A)
+  :row_offsets(NULL),col_indices(NULL),val_array(NULL),m(0),n(0),num_entries(0),transposeIndexValid(false)
+{
+  copy(A);
+}
+
+template <class T>
+SparseMatrixTemplate_CR<T>::~SparseMatrixTemplate_CR()
+{
+  clear();
+}
+
+template <class T>
+const SparseMatrixTemplate_CR<T>& SparseMatrixTemplate_CR<T>::operator = (const MyT& A)
+{
+  copy(A);
+  return *this;
+}
+
+template <class T>
+void SparseMatrixTemplate_CR<T>::initialize(int _m,int _n,int _num_entries)
+{
+  if(row_offsets == NULL || m != _m || num_entries != _num_entries) {
+    clear();
+    row_offsets = new int[_m+1];
+    col_indices = new int[_num_entries];
+    val_array = new T[_num_entries];
+  }
+  clearTransposeIndex();
+  m = _m;
+  n = _n;
+  num_entries = _num_entries;
+  std::fill(row_offsets,row_offsets+m+1,0);
+  std::fill(col_indices,col_indices+num_entries,0);
+  std::fill(val_array,val_array+num_entries,T(0));
+}
+
+template <class T>
+void SparseMatrixTemplate_CR<T>::resize(int _m,int _n,int _num_entries)
+{
+  if(m == _m && n == _n && num_entries == _num_entries) return;
+  int* new_offsets = new int[_m+1];
+  int* new_indices = new int[_num_entries];
+  T* new_vals = new T[_num_entries];
+  //keep the entries that fit into the new structure
+  int mcopy = (row_offsets ? Min(m,_m) : 0);
+  for(int i=0;i<=mcopy;i++) new_offsets[i] = Min(row_offsets[i],_num_entries);
+  for(int i=mcopy+1;i<=_m;i++) new_offsets[i] = new_offsets[mcopy];
+  int ncopy = new_offsets[_m];
+  std::copy(col_indices,col_indices+ncopy,new_indices);
+  std::copy(val_array,val_array+ncopy,new_vals);
+  std::fill(new_indices+ncopy,new_indices+_num_entries,0);
+  std::fill(new_vals+ncopy,new_vals+_num_entries,T(0));
+  clear();
+  row_offsets = new_offsets;
+  col_indices = new_indices;
+  val_array = new_vals;
+  m = _m;
+  n = _n;
+  num_entries = _num_entries;
+  clearTransposeIndex();
+}
+
+template <class T>
+void SparseMatrixTemplate_CR<T>::clear()
+{
+  SafeArrayDelete(row_offsets);
+  SafeArrayDelete(col_indices);
+  SafeArrayDelete(val_array);
+  m = n = num_entries = 0;
+  clearTransposeIndex();
+}
+
+template <class T>
+void SparseMatrixTemplate_CR<T>::clearTransposeIndex() const
+{
+  std::lock_guard<std::mutex> guard(transposeIndexLock);
+  tcol_offsets.clear();
+  trow_indices.clear();
+  tval_index.clear();
+  transposeIndexValid.store(false,std::memory_order_release);
+}
+
+template <class T>
+void SparseMatrixTemplate_CR<T>::buildTransposeIndex() const
+{
+  //double-checked so that threads sharing a const matrix build it once
+  if(transposeIndexValid.load(std::memory_order_acquire)) return;
+  std::lock_guard<std::mutex> guard(transposeIndexLock);
+  if(transposeIndexValid.load(std::memory_order_relaxed)) return;
+  tcol_offsets.assign(n+1,0);
+  trow_indices.resize(num_entries);
+  tval_index.resize(num_entries);
+  for(int k=0;k<num_entries;k++)
+    tcol_offsets[col_indices[k]+1]++;
+  for(int j=0;j<n;j++) tcol_offsets[j+1] += tcol_offsets[j];
+  std::vector<int> next(tcol_offsets.begin(),tcol_offsets.end()-1);
+  for(int i=0;i<m;i++)
+    for(int k=row_offsets[i];k<row_offsets[i+1];k++) {
+      int p = next[col_indices[k]]++;
+      trow_indices[p] = i;
+      tval_index[p] = k;
+    }
+  transposeIndexValid.store(true,std::memory_order_release);
+}
+
+template <class T>
+T* SparseMatrixTemplate_CR<T>::getEntry(int i,int j)
+{
+  const int* begin = col_indices+row_offsets[i];
+  const int* end = col_indices+row_offsets[i+1];
+  const int* it = std::lower_bound(begin,end,j);
+  if(it == end || *it != j) return NULL;
+  return &val_array[it-col_indices];
+}
+
+template <class T>
+const T* SparseMatrixTemplate_CR<T>::getEntry(int i,int j) const
+{
+  return const_cast<MyT*>(this)->getEntry(i,j);
+}
+
+template <class T>
+void SparseMatrixTemplate_CR<T>::copy(const MyT& A)
+{
+  if(this == &A) return;
+  initialize(A.m,A.n,A.num_entries);
+  std::copy(A.row_offsets,A.row_offsets+m+1,row_offsets);
+  std::copy(A.col_indices,A.col_indices+num_entries,col_indices);
+  std::copy(A.val_array,A.val_array+num_entries,val_array);
+}
+
+template <class T>
+template <class T2>
+void SparseMatrixTemplate_CR<T>::copy(const SparseMatrixTemplate_CR<T2>& A)
+{
+  initialize(A.m,A.n,A.num_entries);
+  std::copy(A.row_offsets,A.row_offsets+m+1,row_offsets);
+  std::copy(A.col_indices,A.col_indices+num_entries,col_indices);
+  for(int k=0;k<num_entries;k++) val_array[k] = T(A.val_array[k]);
+}
+
+template <class T>
+void SparseMatrixTemplate_CR<T>::set(const MatrixT& A,T zeroTol)
+{
+  int nnz=0;
+  for(int i=0;i<A.m;i++)
+    for(int j=0;j<A.n;j++)
+      if(!FuzzyZero(A(i,j),zeroTol)) nnz++;
+  initialize(A.m,A.n,nnz);
+  int k=0;
+  for(int i=0;i<m;i++) {
+    row_offsets[i] = k;
+    for(int j=0;j<n;j++)
+      if(!FuzzyZero(A(i,j),zeroTol)) {
+        col_indices[k] = j;
+        val_array[k] = A(i,j);
+        k++;
+      }
+  }
+  row_offsets[m] = k;
+}
+
+template <class T>
+void SparseMatrixTemplate_CR<T>::set(const SparseMatrixTemplate_RM<T>& A)
+{
+  initialize(A.m,A.n,(int)A.numNonZeros());
+  int k=0;
+  for(int i=0;i<m;i++) {
+    row_offsets[i] = k;
+    for(typename SparseMatrixTemplate_RM<T>::ConstRowIterator it=A.rows[i].begin();it!=A.rows[i].end();it++) {
+      col_indices[k] = it->first;
+      val_array[k] = it->second;
+      k++;
+    }
+  }
+  row_offsets[m] = k;
+}
+
+template <class T>
+void SparseMatrixTemplate_CR<T>::get(MatrixT& A) const
+{
+  A.resize(m,n,Zero);
+  for(int i=0;i<m;i++)
+    for(int k=row_offsets[i];k<row_offsets[i+1];k++)
+      A(i,col_indices[k]) = val_array[k];
+}
+
+template <class T>
+void SparseMatrixTemplate_CR<T>::mul(const MyT& A,T s)
+{
+  copy(A);
+  inplaceMul(s);
+}
+
+template <class T>
+void SparseMatrixTemplate_CR<T>::mul(const VectorT& y,VectorT& x,int numThreads) const
+{
+  if(x.n == 0) x.resize(m);
+  if(x.n != m) {
+    FatalError("Destination vector has incorrect dimensions");
+  }
+  if(y.n != n) {
+    FatalError("Source vector has incorrect dimensions");
+  }
+  SparseProductTask<T> task = {row_offsets,col_indices,val_array,NULL,y.getStart(),y.stride,x.getStart(),x.stride,NULL,NULL,0,0,false};
+  RunSparseProduct(task,m,numThreads);
+}
+
+template <class T>
+void SparseMatrixTemplate_CR<T>::madd(const VectorT& y,VectorT& x,int numThreads) const
+{
+  if(x.n != m) {
+    FatalError("Destination vector has incorrect dimensions");
+  }
+  if(y.n != n) {
+    FatalError("Source vector has incorrect dimensions");
+  }
+  SparseProductTask<T> task = {row_offsets,col_indices,val_array,NULL,y.getStart(),y.stride,x.getStart(),x.stride,NULL,NULL,0,0,true};
+  RunSparseProduct(task,m,numThreads);
+}
+
+template <class T>
+void SparseMatrixTemplate_CR<T>::mulTranspose(const VectorT& y,VectorT& x,int numThreads) const
+{
+  if(x.n == 0) x.resize(n);
+  if(x.n != n) {
+    FatalError("Destination vector has incorrect dimensions");
+  }
+  if(y.n != m) {
+    FatalError("Source vector has incorrect dimensions");
+  }
+  buildTransposeIndex();
+  SparseProductTask<T> task = {tcol_offsets.data(),trow_indices.data(),val_array,tval_index.data(),y.getStart(),y.stride,x.getStart(),x.stride,NULL,NULL,0,0,false};
+  RunSparseProduct(task,n,numThreads);
+}
+
+template <class T>
+void SparseMatrixTemplate_CR<T>::maddTranspose(const VectorT& y,VectorT& x,int numThreads) const
+{
+  if(x.n != n) {
+    FatalError("Destination vector has incorrect dimensions");
+  }
+  if(y.n != m) {
+    FatalError("Source vector has incorrect dimensions");
+  }
+  buildTransposeIndex();
+  SparseProductTask<T> task = {tcol_offsets.data(),trow_indices.data(),val_array,tval_index.data(),y.getStart(),y.stride,x.getStart(),x.stride,NULL,NULL,0,0,true};
+  RunSparseProduct(task,n,numThreads);
+}
+
+template <class T>
+void SparseMatrixTemplate_CR<T>::mul(const MatrixT& w,MatrixT& v,int numThreads) const
+{
+  if(w.m != n) {
+    FatalError("W matrix has incorrect # of rows");
+  }
+  if(v.isEmpty()) v.resize(m,w.n);
+  if(v.m != m) {
+    FatalError("V matrix has incorrect # of rows");
+  }
+  if(v.n != w.n) {
+    FatalError("V matrix has incorrect # of columns");
+  }
+  SparseProductTask<T> task = {row_offsets,col_indices,val_array,NULL,NULL,0,NULL,0,&w,&v,0,0,false};
+  RunSparseProduct(task,m,numThreads);
+}
+
+template <class T>
+void SparseMatrixTemplate_CR<T>::mulTranspose(const MatrixT& w,MatrixT& v,int numThreads) const
+{
+  if(w.m != m) {
+    FatalError("W matrix has incorrect # of rows");
+  }
+  if(v.isEmpty()) v.resize(n,w.n);
+  if(v.m != n) {
+    FatalError("V matrix has incorrect # of rows");
+  }
+  if(v.n != w.n) {
+    FatalError("V matrix has incorrect # of columns");
+  }
+  buildTransposeIndex();
+  SparseProductTask<T> task = {tcol_offsets.data(),trow_indices.data(),val_array,tval_index.data(),NULL,0,NULL,0,&w,&v,0,0,false};
+  RunSparseProduct(task,n,numThreads);
+}
+
+template <class T>
+T SparseMatrixTemplate_CR<T>::dotRow(int i,const VectorT& v) const
+{
+  Assert(v.n == n);
+  T sum=0;
+  for(int k=row_offsets[i];k<row_offsets[i+1];k++)
+    sum += val_array[k]*v(col_indices[k]);
+  return sum;
+}
+
+template <class T>
+T SparseMatrixTemplate_CR<T>::dotCol(int j,const VectorT& v) const
+{
+  Assert(v.n == m);
+  buildTransposeIndex();
+  T sum=0;
+  for(int k=tcol_offsets[j];k<tcol_offsets[j+1];k++)
+    sum += val_array[tval_index[k]]*v(trow_indices[k]);
+  return sum;
+}
+
+template <class T>
+T SparseMatrixTemplate_CR<T>::dotSymmL(int i,const VectorT& v) const
+{
+  Assert(isSquare());
+  Assert(v.n == n);
+  //row i up to the diagonal, then column i below it
+  T sum=0;
+  for(int k=row_offsets[i];k<row_offsets[i+1] && col_indices[k]<=i;k++)
+    sum += val_array[k]*v(col_indices[k]);
+  buildTransposeIndex();
+  for(int k=tcol_offsets[i];k<tcol_offsets[i+1];k++)
+    if(trow_indices[k] > i)
+      sum += val_array[tval_index[k]]*v(trow_indices[k]);
+  return sum;
+}
+
+template <class T>
+void SparseMatrixTemplate_CR<T>::inplaceMul(T c)
+{
+  for(int k=0;k<num_entries;k++) val_array[k] *= c;
+}
+
+template <class T>
+void SparseMatrixTemplate_CR<T>::inplaceDiv(T c)
+{
+  for(int k=0;k<num_entries;k++) val_array[k] /= c;
+}
+
+template <class T>
+void SparseMatrixTemplate_CR<T>::inplaceMulRow(int i,T c)
+{
+  for(int k=row_offsets[i];k<row_offsets[i+1];k++) val_array[k] *= c;
+}
+
+template <class T>
+void SparseMatrixTemplate_CR<T>::inplaceMulCol(int j,T c)
+{
+  buildTransposeIndex();
+  for(int k=tcol_offsets[j];k<tcol_offsets[j+1];k++) val_array[tval_index[k]] *= c;
+}
+
+template <class T>
+bool SparseMatrixTemplate_CR<T>::isValid() const
+{
+  if(m < 0 || n < 0 || num_entries < 0) return false;
+  if(!row_offsets) return (m == 0 && num_entries == 0);
+  if(row_offsets[0] != 0 || row_offsets[m] != num_entries) return false;
+  for(int i=0;i<m;i++) {
+    if(row_offsets[i+1] < row_offsets[i]) return false;
+    for(int k=row_offsets[i];k<row_offsets[i+1];k++) {
+      if(col_indices[k] < 0 || col_indices[k] >= n) return false;
+      if(k > row_offsets[i] && col_indices[k] <= col_indices[k-1]) return false;
+    }
+  }
+  return true;
+}
+
+//one reader of a shared const matrix, for the concurrent self test
+template <class T>
+struct SparseTransposeReader
+{
+  const SparseMatrixTemplate_CR<T>* A;
+  const VectorTemplate<T>* y;
+  VectorTemplate<T> x;
+  T dot;
+};
+
+template <class T>
+static void* SparseTransposeReaderThread(void* vdata)
+{
+  SparseTransposeReader<T>* r = reinterpret_cast<SparseTransposeReader<T>*>(vdata);
+  r->A->mulTranspose(*r->y,r->x,1);
+  r->dot = r->A->dotCol(r->A->n-1,*r->y);
+  return NULL;
+}
+
+template <class T>
+void SparseMatrixTemplate_CR<T>::self_test()
+{
+  self_test(1,1,1);
+  self_test(10,7,20);
+  self_test(7,10,0);
+  self_test(200,150,3000);
+
+  //empty and cleared matrices
+  MyT S;
+  S.set(MatrixT(0,5));
+  if(!S.isValid() || S.m != 0 || S.n != 5) FatalError("SparseMatrixTemplate_CR: empty set error");
+  VectorT y(5,One),x;
+  S.mul(y,x);
+  if(x.n != 0) FatalError("SparseMatrixTemplate_CR: empty mul error");
+  S.clear();
+  S.initialize(0,3,0);
+  if(!S.isValid()) FatalError("SparseMatrixTemplate_CR: cleared initialize error");
+  MatrixT A(3,3,Zero);
+  A(0,0) = 1; A(1,2) = 2; A(2,1) = 3;
+  S.clear();
+  S.set(A);
+  if(!S.isValid() || S.num_entries != 3) FatalError("SparseMatrixTemplate_CR: cleared set error");
+
+  //resizing keeps the entries; new storage is filled in by the caller
+  S.resize(4,3,5);
+  if(S.row_offsets[S.m] != 3) FatalError("SparseMatrixTemplate_CR: resize offsets error");
+  S.col_indices[3] = 0; S.val_array[3] = 4;
+  S.col_indices[4] = 2; S.val_array[4] = 5;
+  S.row_offsets[4] = 5;
+  if(!S.isValid()) FatalError("SparseMatrixTemplate_CR: resize error");
+  VectorT y3(4),x3,x3ref(3);
+  y3(0) = 1; y3(1) = 2; y3(2) = 3; y3(3) = 4;
+  S.mulTranspose(y3,x3);
+  x3ref(0) = 1+16; x3ref(1) = 9; x3ref(2) = 4+20;
+  if(!x3.isEqual(x3ref,T(1e-8))) FatalError("SparseMatrixTemplate_CR: resize mulTranspose error");
+
+  //editing the structure in place requires invalidating the transpose index
+  S.col_indices[3] = 1;
+  S.clearTransposeIndex();
+  S.mulTranspose(y3,x3);
+  x3ref(0) = 1; x3ref(1) = 9+16;
+  if(!x3.isEqual(x3ref,T(1e-8))) FatalError("SparseMatrixTemplate_CR: clearTransposeIndex error");
+
+  //threads sharing a const matrix build the transpose index once
+  MatrixT B(300,200,Zero);
+  for(int k=0;k<4000;k++)
+    B(RandInt(B.m),RandInt(B.n)) = T(Rand(-1,1));
+  MyT SB;
+  SB.set(B);
+  VectorT yb(B.m),xbref;
+  for(int i=0;i<B.m;i++) yb(i) = T(Rand(-1,1));
+  B.mulTranspose(yb,xbref);
+  std::vector<SparseTransposeReader<T> > readers(4);
+  for(size_t i=0;i<readers.size();i++) {
+    readers[i].A = &SB;
+    readers[i].y = &yb;
+  }
+  ThreadRunAll(SparseTransposeReaderThread<T>,readers);
+  Real tol = 1e-4;
+  for(size_t i=0;i<readers.size();i++) {
+    if(!readers[i].x.isEqual(xbref,tol)) FatalError("SparseMatrixTemplate_CR: concurrent mulTranspose error");
+    if(Abs(readers[i].dot-xbref(B.n-1)) > tol) FatalError("SparseMatrixTemplate_CR: concurrent dotCol error");
+  }
+}
+
+template <class T>
+void SparseMatrixTemplate_CR<T>::self_test(int m,int n,int nnz)
+{
+  //random matrix with about nnz entries
+  MatrixT A(m,n,Zero);
+  for(int k=0;k<nnz;k++)
+    A(RandInt(m),RandInt(n)) = T(Rand(-1,1));
+  MyT S;
+  S.set(A);
+  if(!S.isValid()) FatalError("SparseMatrixTemplate_CR: invalid structure");
+  MatrixT Scopy;
+  S.get(Scopy);
+  if(!Scopy.isEqual(A,0)) FatalError("SparseMatrixTemplate_CR: set/get mismatch");
+
+  VectorT y(n),yt(m);
+  for(int j=0;j<n;j++) y(j) = T(Rand(-1,1));
+  for(int i=0;i<m;i++) yt(i) = T(Rand(-1,1));
+  MatrixT W(n,5),Wt(m,11);
+  for(int i=0;i<W.m;i++) for(int j=0;j<W.n;j++) W(i,j) = T(Rand(-1,1));
+  for(int i=0;i<Wt.m;i++) for(int j=0;j<Wt.n;j++) Wt(i,j) = T(Rand(-1,1));
+  VectorT x,xt,xref,xtref;
+  MatrixT V,Vt,Vref,Vtref;
+  A.mul(y,xref);
+  A.mulTranspose(yt,xtref);
+  Vref.mul(A,W);
+  Vtref.mulTransposeA(A,Wt);
+  Real tol = 1e-4;
+  //single threaded, and split over more threads than there are cores
+  for(int numThreads=1;numThreads<=4;numThreads+=3) {
+    x.clear(); xt.clear(); V.clear(); Vt.clear();
+    S.mul(y,x,numThreads);
+    S.mulTranspose(yt,xt,numThreads);
+    S.mul(W,V,numThreads);
+    S.mulTranspose(Wt,Vt,numThreads);
+    if(!x.isEqual(xref,tol)) FatalError("SparseMatrixTemplate_CR: mul error");
+    if(!xt.isEqual(xtref,tol)) FatalError("SparseMatrixTemplate_CR: mulTranspose error");
+    if(!V.isEqual(Vref,tol)) FatalError("SparseMatrixTemplate_CR: matrix mul error");
+    if(!Vt.isEqual(Vtref,tol)) FatalError("SparseMatrixTemplate_CR: matrix mulTranspose error");
+    S.madd(y,x,numThreads);
+    S.maddTranspose(yt,xt,numThreads);
+    xref.inplaceMul(2);
+    xtref.inplaceMul(2);
+    if(!x.isEqual(xref,tol)) FatalError("SparseMatrixTemplate_CR: madd error");
+    if(!xt.isEqual(xtref,tol)) FatalError("SparseMatrixTemplate_CR: maddTranspose error");
+    xref.inplaceDiv(2);
+    xtref.inplaceDiv(2);
+  }
+  for(int i=0;i<m;i++) {
+    VectorT Ai;
+    A.getRowRef(i,Ai);
+    if(Abs(S.dotRow(i,y)-Ai.dot(y)) > tol) FatalError("SparseMatrixTemplate_CR: dotRow error");
+  }
+  for(int j=0;j<n;j++) {
+    VectorT Aj;
+    A.getColRef(j,Aj);
+    if(Abs(S.dotCol(j,yt)-Aj.dot(yt)) > tol) FatalError("SparseMatrixTemplate_CR: dotCol error");
+  }
+  //the transpose index stays valid when values change
+  if(m > 0 && n > 0) {
+    S.inplaceMulCol(n-1,3);
+    S.inplaceMulRow(0,2);
+    for(int i=0;i<m;i++) A(i,n-1) *= 3;
+    for(int j=0;j<n;j++) A(0,j) *= 2;
+    S.mulTranspose(yt,xt);
+    A.mulTranspose(yt,xtref);
+    if(!xt.isEqual(xtref,tol)) FatalError("SparseMatrixTemplate_CR: inplaceMulCol/Row error");
+  }
+  MyT S2(S);
+  S2.resize(m+2,n,S.num_entries/2);
+  if(!S2.isValid()) FatalError("SparseMatrixTemplate_CR: resize error");
+}
+
+template <class T>
+std::ostream& operator << (std::ostream& out, const SparseMatrixTemplate_CR<T>& A)
+{
+  out<<A.m<<" "<<A.n<<" "<<A.num_entries<<endl;
+  for(int i=0;i<A.m;i++) {
+    for(int k=A.row_offsets[i];k<A.row_offsets[i+1];k++)
+      out<<i<<" "<<A.col_indices[k]<<"   "<<A.val_array[k]<<endl;
+  }
+  return out;
+}
+
+template <class T>
+SparseMatrixTemplate_CC<T>::SparseMatrixTemplate_CC()
+  :m(0),n(0)
+{}
+
+template <class T>
+void SparseMatrixTemplate_CC<T>::initialize(int _m,int _n,int num_entries)
+{
+  m = _m;
+  n = _n;
+  col_offsets.resize(n+1);
+  std::fill(col_offsets.begin(),col_offsets.end(),0);
+  row_indices.resize(num_entries);
+  val_array.resize(num_entries);
+}
+
+template <class T>
+void SparseMatrixTemplate_CC<T>::clear()
+{
+  m = n = 0;
+  col_offsets.clear();
+  row_indices.clear();
+  val_array.clear();
+}
+
+template <class T>
+T* SparseMatrixTemplate_CC<T>::getEntry(int i,int j)
+{
+  const int* begin = row_indices.data()+col_offsets[j];
+  const int* end = row_indices.data()+col_offsets[j+1];
+  const int* it = std::lower_bound(begin,end,i);
+  if(it == end || *it != i) return NULL;
+  return &val_array[it-row_indices.data()];
+}
+
+template <class T>
+const T* SparseMatrixTemplate_CC<T>::getEntry(int i,int j) const
+{
+  return const_cast<MyT*>(this)->getEntry(i,j);
+}
+
+template <class T>
+void SparseMatrixTemplate_CC<T>::set(const MatrixT& A,T zeroTol)
+{
+  int nnz=0;
+  for(int i=0;i<A.m;i++)
+    for(int j=0;j<A.n;j++)
+      if(!FuzzyZero(A(i,j),zeroTol)) nnz++;
+  initialize(A.m,A.n,nnz);
+  int k=0;
+  for(int j=0;j<n;j++) {
+    col_offsets[j] = k;
+    for(int i=0;i<m;i++)
+      if(!FuzzyZero(A(i,j),zeroTol)) {
+        row_indices[k] = i;
+        val_array[k] = A(i,j);
+        k++;
+      }
+  }
+  col_offsets[n] = k;
+}
+
+template <class T>
+void SparseMatrixTemplate_CC<T>::set(const SparseMatrixTemplate_RM<T>& A)
+{
+  initialize(A.m,A.n,(int)A.numNonZeros());
+  //count the entries in each column, then fill the columns in row order
+  for(int i=0;i<A.m;i++)
+    for(typename SparseMatrixTemplate_RM<T>::ConstRowIterator it=A.rows[i].begin();it!=A.rows[i].end();it++)
+      col_offsets[it->first+1]++;
+  for(int j=0;j<n;j++) col_offsets[j+1] += col_offsets[j];
+  std::vector<int> next(col_offsets.begin(),col_offsets.end()-1);
+  for(int i=0;i<A.m;i++)
+    for(typename SparseMatrixTemplate_RM<T>::ConstRowIterator it=A.rows[i].begin();it!=A.rows[i].end();it++) {
+      int k = next[it->first]++;
+      row_indices[k] = i;
+      val_array[k] = it->second;
+    }
+}
+
+template <class T>
+void SparseMatrixTemplate_CC<T>::get(MatrixT& A) const
+{
+  A.resize(m,n,Zero);
+  for(int j=0;j<n;j++)
+    for(int k=col_offsets[j];k<col_offsets[j+1];k++)
+      A(row_indices[k],j) = val_array[k];
+}
+
+template <class T>
+void SparseMatrixTemplate_CC<T>::setTranspose(const MyT& A)
+{
+  Assert(this != &A);
+  initialize(A.n,A.m,A.numNonZeros());
+  for(int k=0;k<A.numNonZeros();k++)
+    col_offsets[A.row_indices[k]+1]++;
+  for(int j=0;j<n;j++) col_offsets[j+1] += col_offsets[j];
+  std::vector<int> next(col_offsets.begin(),col_offsets.end()-1);
+  for(int j=0;j<A.n;j++)
+    for(int k=A.col_offsets[j];k<A.col_offsets[j+1];k++) {
+      int p = next[A.row_indices[k]]++;
+      row_indices[p] = j;
+      val_array[p] = A.val_array[k];
+    }
+}
+
+template <class T>
+bool SparseMatrixTemplate_CC<T>::samePattern(const MyT& A) const
+{
+  return m == A.m && n == A.n && col_offsets == A.col_offsets && row_indices == A.row_indices;
+}
+
+template <class T>
+void SparseMatrixTemplate_CC<T>::mul(const VectorT& y,VectorT& x) const
+{
+  if(x.n == 0) x.resize(m);
+  if(x.n != m) {
+    FatalError("Destination vector has incorrect dimensions");
+  }
+  x.setZero();
+  madd(y,x);
+}
+
+template <class T>
+void SparseMatrixTemplate_CC<T>::madd(const VectorT& y,VectorT& x) const
+{
+  if(x.n != m) {
+    FatalError("Destination vector has incorrect dimensions");
+  }
+  if(y.n != n) {
+    FatalError("Source vector has incorrect dimensions");
+  }
+  for(int j=0;j<n;j++) {
+    T yj = y(j);
+    for(int k=col_offsets[j];k<col_offsets[j+1];k++)
+      x(row_indices[k]) += val_array[k]*yj;
+  }
+}
+
+template <class T>
+void SparseMatrixTemplate_CC<T>::mulTranspose(const VectorT& y,VectorT& x) const
+{
+  if(x.n == 0) x.resize(n);
+  if(x.n != n) {
+    FatalError("Destination vector has incorrect dimensions");
+  }
+  x.setZero();
+  maddTranspose(y,x);
+}
+
+template <class T>
+void SparseMatrixTemplate_CC<T>::maddTranspose(const VectorT& y,VectorT& x) const
+{
+  if(x.n != n) {
+    FatalError("Destination vector has incorrect dimensions");
+  }
+  if(y.n != m) {
+    FatalError("Source vector has incorrect dimensions");
+  }
+  for(int j=0;j<n;j++) {
+    T sum=0;
+    for(int k=col_offsets[j];k<col_offsets[j+1];k++)
+      sum += val_array[k]*y(row_indices[k]);
+    x(j) += sum;
+  }
+}
+
+template <class T>
+void SparseMatrixTemplate_CC<T>::inplaceMul(T c)
+{
+  for(size_t k=0;k<val_array.size();k++) val_array[k] *= c;
+}
+
+template <class T>
+bool SparseMatrixTemplate_CC<T>::isValid() const
+{
+  if((int)col_offsets.size() != n+1) return false;
+  if(col_offsets[0] != 0 || col_offsets[n] != (int)row_indices.size()) return false;
+  if(row_indices.size() != val_array.size()) return false;
+  for(int j=0;j<n;j++) {
+    if(col_offsets[j+1] < col_offsets[j]) return false;
+    for(int k=col_offsets[j];k<col_offsets[j+1];k++) {
+      if(row_indices[k] < 0 || row_indices[k] >= m) return false;
+      if(k > col_offsets[j] && row_indices[k] <= row_indices[k-1]) return false;
+    }
+  }
+  return true;
+}
+
 template class SparseMatrixTemplate_RM<float>;
 template class SparseMatrixTemplate_RM<double>;
 template class SparseMatrixTemplate_RM<Complex>;
+template class SparseMatrixTemplate_CR<float>;
+template class SparseMatrixTemplate_CR<double>;
+template class SparseMatrixTemplate_CR<Complex>;
+template class SparseMatrixTemplate_CC<float>;
+template class SparseMatrixTemplate_CC<double>;
+template class SparseMatrixTemplate_CC<Complex>;
 template ostream& operator << (ostream& out, const SparseMatrixTemplate_RM<float>& v);
 template ostream& operator << (ostream& out, const SparseMatrixTemplate_RM<double>& v);
 template ostream& operator << (ostream& out, const SparseMatrixTemplate_RM<Complex>& v);
+template ostream& operator << (ostream& out, const SparseMatrixTemplate_CR<float>& v);
+template ostream& operator << (ostream& out, const SparseMatrixTemplate_CR<double>& v);
+template ostream& operator << (ostream& out, const SparseMatrixTemplate_CR<Complex>& v);
 template istream& operator >> (istream& in, SparseMatrixTemplate_RM<float>& v);
 template istream& operator >> (istream& in, SparseMatrixTemplate_RM<double>& v);
 template istream& operator >> (istream& in, SparseMatrixTemplate_RM<Complex>& v);
@@ -559,5 +1422,9 @@ template void SparseMatrixTemplate_RM<float>::copy(const SparseMatrixTemplate_RM
 template void SparseMatrixTemplate_RM<double>::copy(const SparseMatrixTemplate_RM<float>& a);
 template void SparseMatrixTemplate_RM<Complex>::copy(const SparseMatrixTemplate_RM<float>& a);
 template void SparseMatrixTemplate_RM<Complex>::copy(const SparseMatrixTemplate_RM<double>& a);
+template void SparseMatrixTemplate_CR<float>::copy(const SparseMatrixTemplate_CR<double>& a);
+template void SparseMatrixTemplate_CR<double>::copy(const SparseMatrixTemplate_CR<float>& a);
+template void SparseMatrixTemplate_CR<Complex>::copy(const SparseMatrixTemplate_CR<float>& a);
+template void SparseMatrixTemplate_CR<Complex>::copy(const SparseMatrixTemplate_CR<double>& a);
 
 } // namespace Math
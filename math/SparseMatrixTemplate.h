@@ -5,6 +5,8 @@
 #include "VectorTemplate.h"
 #include "SparseVectorTemplate.h"
 #include <vector>
+#include <atomic>
+#include <mutex>
 
 /** @file math/SparseMatrixTemplate.h
  * @brief Several sparse matrix classes.
@@ -120,6 +122,14 @@ class SparseMatrixTemplate_RM
  * Like the above, except the rows are all fixed in a compressed,
  * contiguous block of index/value pairs.  The number of nonzero
  * entries (and their locations) must be known in advance.
+ *
+ * The matrix-vector and matrix-matrix products are multithreaded for
+ * large matrices.  numThreads gives the number of threads to use (<= 0
+ * uses the hardware concurrency); rows are split into ranges with roughly
+ * equal numbers of entries, and matrices with too few entries to benefit
+ * are multiplied on the calling thread.  Transposed products go through a
+ * column index of the entries that is built on first use (by one thread,
+ * if several share a const matrix) and kept until the structure changes.
  */
 template <class T>
 class SparseMatrixTemplate_CR
@@ -130,8 +140,13 @@ class SparseMatrixTemplate_CR
   typedef MatrixTemplate<T> MatrixT;
 
   SparseMatrixTemplate_CR();
+  SparseMatrixTemplate_CR(const MyT&);
   ~SparseMatrixTemplate_CR();
+  const MyT& operator = (const MyT&);
   void initialize(int m, int n, int num_entries);
+  ///Keeps the entries that fit in the new size.  If num_entries grows, the
+  ///new entries are not yet assigned to rows (row_offsets[m] is the number
+  ///of kept entries), so the caller must fill them in and set the offsets.
   void resize(int m, int n, int num_entries);
   void clear();
 
@@ -142,16 +157,17 @@ class SparseMatrixTemplate_CR
   template <class T2>
   void copy(const SparseMatrixTemplate_CR<T2>&);
   void set(const MatrixT&,T zeroTol=Zero);
+  void set(const SparseMatrixTemplate_RM<T>&);
   void getCopy(MyT& m) const { m.copy(*this); }
   void get(MatrixT&) const;
 
   void mul(const MyT&, T s);
-  void mul(const VectorT& y, VectorT& x) const;		 //x = this*y;
-  void mulTranspose(const VectorT& y, VectorT& x) const; //x = this^t*y
-  void madd(const VectorT& y,VectorT& x) const;          //x = x+this*y
-  void maddTranspose(const VectorT& y,VectorT& x) const; //x = x+this^t*y
-  void mul(const MatrixT& w, MatrixT& v) const;            //dense matrix multiply v = this*w
-  void mulTranspose(const MatrixT& w, MatrixT& v) const; //w = this^t*w
+  void mul(const VectorT& y, VectorT& x,int numThreads=0) const;		 //x = this*y;
+  void mulTranspose(const VectorT& y, VectorT& x,int numThreads=0) const; //x = this^t*y
+  void madd(const VectorT& y,VectorT& x,int numThreads=0) const;          //x = x+this*y
+  void maddTranspose(const VectorT& y,VectorT& x,int numThreads=0) const; //x = x+this^t*y
+  void mul(const MatrixT& w, MatrixT& v,int numThreads=0) const;            //dense matrix multiply v = this*w
+  void mulTranspose(const MatrixT& w, MatrixT& v,int numThreads=0) const; //v = this^t*w
   T dotRow(int i, const VectorT&) const;
   T dotCol(int j, const VectorT&) const;
   //assumes lower triangle is filled, upper is transpose
@@ -160,6 +176,8 @@ class SparseMatrixTemplate_CR
   void inplaceDiv(T c);
   void inplaceMulRow(int i,T c);
   void inplaceMulCol(int i,T c);
+  ///Builds the column index used by the transposed products and dotCol
+  void buildTransposeIndex() const;
 
   bool isValid() const;
   inline bool isEmpty() const { return m == 0 && n == 0; }
@@ -181,6 +199,8 @@ class SparseMatrixTemplate_CR
    * The col_indices array marks the column of the corresponding
    *   element in the value array, and each column is sorted in
    *   increasing order.
+   * If the structure is modified directly, call clearTransposeIndex();
+   * the transpose index is otherwise kept regardless of its contents.
    ****************************************************************/
   int* row_offsets;
   int* col_indices;
@@ -189,8 +209,77 @@ class SparseMatrixTemplate_CR
   int m,n;
   int num_entries;
 
+  void clearTransposeIndex() const;
+
   static void self_test();
   static void self_test(int m, int n, int nnz);
+
+ private:
+  //column index: the entries of column j are val_array[tval_index[k]] for
+  //k in [tcol_offsets[j],tcol_offsets[j+1]), in rows trow_indices[k]
+  mutable std::vector<int> tcol_offsets,trow_indices,tval_index;
+  mutable std::atomic<bool> transposeIndexValid;
+  mutable std::mutex transposeIndexLock;
+};
+
+/** @ingroup Math
+ * @brief Column-major compressed sparse matrix (CSC format).
+ *
+ * The columns are stored in a compressed, contiguous block of row
+ * index/value pairs.  This is the format used by the sparse direct
+ * factorizations (e.g., SparseLDLDecomposition).
+ */
+template <class T>
+class SparseMatrixTemplate_CC
+{
+ public:
+  typedef SparseMatrixTemplate_CC<T> MyT;
+  typedef VectorTemplate<T> VectorT;
+  typedef MatrixTemplate<T> MatrixT;
+
+  SparseMatrixTemplate_CC();
+  void initialize(int m, int n, int num_entries);
+  void clear();
+
+  T* getEntry(int i,int j);
+  const T* getEntry(int i,int j) const;
+
+  void set(const MatrixT&,T zeroTol=Zero);
+  void set(const SparseMatrixTemplate_RM<T>&);
+  void get(MatrixT&) const;
+  void setTranspose(const MyT&);
+  ///Returns true if the sparsity pattern matches that of A
+  bool samePattern(const MyT& A) const;
+
+  void mul(const VectorT& y, VectorT& x) const;		 //x = this*y;
+  void mulTranspose(const VectorT& y, VectorT& x) const; //x = this^t*y
+  void madd(const VectorT& y,VectorT& x) const;          //x = x+this*y
+  void maddTranspose(const VectorT& y,VectorT& x) const; //x = x+this^t*y
+  void inplaceMul(T c);
+
+  bool isValid() const;
+  inline bool isEmpty() const { return m == 0 && n == 0; }
+  inline bool hasDims(int M, int N) const { return m == M && n == N; }
+  inline bool isSquare() const { return m == n; }
+  inline int numNonZeros() const { return (int)row_indices.size(); }
+
+  inline const int* colIndices(int j) const { return row_indices.data() + col_offsets[j]; }
+  inline T* colValues(int j) { return val_array.data() + col_offsets[j]; }
+  inline const T* colValues(int j) const { return val_array.data() + col_offsets[j]; }
+  inline int numColEntries(int j) const { return col_offsets[j+1]-col_offsets[j]; }
+
+  /***************************************************************
+   * Compressed column format:
+   * col_offsets indexes into the row index array, by column, and is size
+   *   n+1 (the last value is the number of entries).
+   * The row_indices array marks the row of the corresponding element in
+   *   the value array, and each column is sorted in increasing order.
+   ****************************************************************/
+  std::vector<int> col_offsets;
+  std::vector<int> row_indices;
+  std::vector<T> val_array;
+
+  int m,n;
 };
 
 ///returns true if all elements of x are finite
@@ -213,6 +302,9 @@ typedef SparseMatrixTemplate_RM<Complex> cSparseMatrix_RM;
 typedef SparseMatrixTemplate_CR<float> fSparseMatrix_CR;
 typedef SparseMatrixTemplate_CR<double> dSparseMatrix_CR;
 typedef SparseMatrixTemplate_CR<Complex> cSparseMatrix_CR;
+typedef SparseMatrixTemplate_CC<float> fSparseMatrix_CC;
+typedef SparseMatrixTemplate_CC<double> dSparseMatrix_CC;
+typedef SparseMatrixTemplate_CC<Complex> cSparseMatrix_CC;
 
 template <class T>
 std::ostream& operator << (std::ostream&, const SparseMatrixTemplate_RM<T>&);
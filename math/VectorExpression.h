@@ -0,0 +1,241 @@
+#ifndef MATH_VECTOR_EXPRESSION_H
+#define MATH_VECTOR_EXPRESSION_H
+
+#include "VectorTemplate.h"
+#include <KrisLibrary/errors.h>
+
+/** @file math/VectorExpression.h
+ * @brief Opt-in expression templates that fuse element-wise vector
+ * arithmetic into a single loop.
+ *
+ * Wrapping a vector in Expr() makes the usual operators build an
+ * expression rather than a temporary vector.  The expression is evaluated
+ * element-by-element, with no intermediate storage, by Evaluate(),
+ * EvaluateInc(), dot(), or normSquared().  For example,
+ *
+ * @code
+ * //x = x0 + t*dx + t*bias, in one pass
+ * Evaluate(x,Expr(x0) + t*Expr(dx) + t*Expr(bias));
+ * //g.(g+h) without forming g+h
+ * Real gdot = dot(Expr(g),Expr(g)+h);
+ * @endcode
+ *
+ * At least one operand of each operator must be an expression: a+b on
+ * two plain vectors still uses the operators in VectorTemplate.h, which
+ * return a new vector.  Expressions refer to their vector operands, so
+ * they should be evaluated before the operands change or go out of scope.
+ * The destination may be one of the operands.
+ */
+
+namespace Math {
+
+///Base class of all vector expressions (a CRTP wrapper around E)
+template <class E>
+struct VectorExpression
+{
+  inline const E& self() const { return static_cast<const E&>(*this); }
+};
+
+///A vector operand
+template <class T>
+struct VectorLeafExpression : public VectorExpression<VectorLeafExpression<T> >
+{
+  typedef T value_type;
+  explicit VectorLeafExpression(const VectorTemplate<T>& v) :vals(v.getStart()),stride(v.stride),n(v.n) {}
+  inline int size() const { return n; }
+  inline bool isCompact() const { return stride==1; }
+  inline T at(int i) const { return vals[i*stride]; }
+  inline T atCompact(int i) const { return vals[i]; }
+
+  const T* vals;
+  int stride,n;
+};
+
+template <class A,class B>
+struct VectorSumExpression : public VectorExpression<VectorSumExpression<A,B> >
+{
+  typedef typename A::value_type value_type;
+  VectorSumExpression(const A& _a,const B& _b) :a(_a),b(_b) { Assert(a.size()==b.size()); }
+  inline int size() const { return a.size(); }
+  inline bool isCompact() const { return a.isCompact() && b.isCompact(); }
+  inline value_type at(int i) const { return a.at(i)+b.at(i); }
+  inline value_type atCompact(int i) const { return a.atCompact(i)+b.atCompact(i); }
+
+  A a;
+  B b;
+};
+
+template <class A,class B>
+struct VectorDifferenceExpression : public VectorExpression<VectorDifferenceExpression<A,B> >
+{
+  typedef typename A::value_type value_type;
+  VectorDifferenceExpression(const A& _a,const B& _b) :a(_a),b(_b) { Assert(a.size()==b.size()); }
+  inline int size() const { return a.size(); }
+  inline bool isCompact() const { return a.isCompact() && b.isCompact(); }
+  inline value_type at(int i) const { return a.at(i)-b.at(i); }
+  inline value_type atCompact(int i) const { return a.atCompact(i)-b.atCompact(i); }
+
+  A a;
+  B b;
+};
+
+template <class A>
+struct VectorScaleExpression : public VectorExpression<VectorScaleExpression<A> >
+{
+  typedef typename A::value_type value_type;
+  VectorScaleExpression(const A& _a,value_type _c) :a(_a),c(_c) {}
+  inline int size() const { return a.size(); }
+  inline bool isCompact() const { return a.isCompact(); }
+  inline value_type at(int i) const { return c*a.at(i); }
+  inline value_type atCompact(int i) const { return c*a.atCompact(i); }
+
+  A a;
+  value_type c;
+};
+
+template <class A>
+struct VectorNegateExpression : public VectorExpression<VectorNegateExpression<A> >
+{
+  typedef typename A::value_type value_type;
+  explicit VectorNegateExpression(const A& _a) :a(_a) {}
+  inline int size() const { return a.size(); }
+  inline bool isCompact() const { return a.isCompact(); }
+  inline value_type at(int i) const { return -a.at(i); }
+  inline value_type atCompact(int i) const { return -a.atCompact(i); }
+
+  A a;
+};
+
+///Wraps a vector so that arithmetic on it builds an expression
+template <class T>
+inline VectorLeafExpression<T> Expr(const VectorTemplate<T>& v)
+{
+  return VectorLeafExpression<T>(v);
+}
+
+template <class A,class B>
+inline VectorSumExpression<A,B> operator + (const VectorExpression<A>& a,const VectorExpression<B>& b)
+{
+  return VectorSumExpression<A,B>(a.self(),b.self());
+}
+
+template <class A,class T>
+inline VectorSumExpression<A,VectorLeafExpression<T> > operator + (const VectorExpression<A>& a,const VectorTemplate<T>& b)
+{
+  return VectorSumExpression<A,VectorLeafExpression<T> >(a.self(),Expr(b));
+}
+
+template <class T,class B>
+inline VectorSumExpression<VectorLeafExpression<T>,B> operator + (const VectorTemplate<T>& a,const VectorExpression<B>& b)
+{
+  return VectorSumExpression<VectorLeafExpression<T>,B>(Expr(a),b.self());
+}
+
+template <class A,class B>
+inline VectorDifferenceExpression<A,B> operator - (const VectorExpression<A>& a,const VectorExpression<B>& b)
+{
+  return VectorDifferenceExpression<A,B>(a.self(),b.self());
+}
+
+template <class A,class T>
+inline VectorDifferenceExpression<A,VectorLeafExpression<T> > operator - (const VectorExpression<A>& a,const VectorTemplate<T>& b)
+{
+  return VectorDifferenceExpression<A,VectorLeafExpression<T> >(a.self(),Expr(b));
+}
+
+template <class T,class B>
+inline VectorDifferenceExpression<VectorLeafExpression<T>,B> operator - (const VectorTemplate<T>& a,const VectorExpression<B>& b)
+{
+  return VectorDifferenceExpression<VectorLeafExpression<T>,B>(Expr(a),b.self());
+}
+
+template <class A>
+inline VectorScaleExpression<A> operator * (const VectorExpression<A>& a,typename A::value_type c)
+{
+  return VectorScaleExpression<A>(a.self(),c);
+}
+
+template <class A>
+inline VectorScaleExpression<A> operator * (typename A::value_type c,const VectorExpression<A>& a)
+{
+  return VectorScaleExpression<A>(a.self(),c);
+}
+
+template <class A>
+inline VectorScaleExpression<A> operator / (const VectorExpression<A>& a,typename A::value_type c)
+{
+  return VectorScaleExpression<A>(a.self(),typename A::value_type(1)/c);
+}
+
+template <class A>
+inline VectorNegateExpression<A> operator - (const VectorExpression<A>& a)
+{
+  return VectorNegateExpression<A>(a.self());
+}
+
+///Sets x = e.  If x is empty, it is resized to the size of e.
+template <class T,class E>
+void Evaluate(VectorTemplate<T>& x,const VectorExpression<E>& expr)
+{
+  const E& e = expr.self();
+  if(x.empty()) x.resize(e.size());
+  else Assert(x.n == e.size());
+  T* v = x.getStart();
+  if(x.stride == 1 && e.isCompact()) {
+    for(int i=0;i<x.n;i++) v[i] = e.atCompact(i);
+  }
+  else {
+    for(int i=0;i<x.n;i++) v[i*x.stride] = e.at(i);
+  }
+}
+
+///Sets x += e
+template <class T,class E>
+void EvaluateInc(VectorTemplate<T>& x,const VectorExpression<E>& expr)
+{
+  const E& e = expr.self();
+  Assert(x.n == e.size());
+  T* v = x.getStart();
+  if(x.stride == 1 && e.isCompact()) {
+    for(int i=0;i<x.n;i++) v[i] += e.atCompact(i);
+  }
+  else {
+    for(int i=0;i<x.n;i++) v[i*x.stride] += e.at(i);
+  }
+}
+
+///Returns the dot product of two expressions, in one pass
+template <class A,class B>
+typename A::value_type dot(const VectorExpression<A>& aexpr,const VectorExpression<B>& bexpr)
+{
+  const A& a = aexpr.self();
+  const B& b = bexpr.self();
+  Assert(a.size() == b.size());
+  typename A::value_type sum(0);
+  if(a.isCompact() && b.isCompact()) {
+    for(int i=0;i<a.size();i++) sum += a.atCompact(i)*b.atCompact(i);
+  }
+  else {
+    for(int i=0;i<a.size();i++) sum += a.at(i)*b.at(i);
+  }
+  return sum;
+}
+
+///Returns the squared norm of an expression, in one pass
+template <class A>
+typename A::value_type normSquared(const VectorExpression<A>& aexpr)
+{
+  const A& a = aexpr.self();
+  typename A::value_type sum(0);
+  if(a.isCompact()) {
+    for(int i=0;i<a.size();i++) sum += Sqr(a.atCompact(i));
+  }
+  else {
+    for(int i=0;i<a.size();i++) sum += Sqr(a.at(i));
+  }
+  return sum;
+}
+
+} //namespace Math
+
+#endif
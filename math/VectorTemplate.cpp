@@ -2,6 +2,7 @@
 #include "VectorTemplate.h"
 #include "fastarray.h"
 #include "complex.h"
+#include "Workspace.h"
 #include <KrisLibrary/File.h>
 #include <KrisLibrary/errors.h>
 #include <iostream>
@@ -102,8 +103,8 @@ void VectorTemplate<T>::resize(int _n)
       clear();
     }
     if(_n > capacity) {
-      SafeArrayDelete(vals);
-      vals = new T[_n];
+      WorkspaceDeleteArray(vals);
+      vals = WorkspaceNewArray<T>(_n);
       capacity = _n;
       if(!vals) {
 	FatalError("Not enough memory to allocate vector of size %d",_n);
@@ -142,14 +143,14 @@ void VectorTemplate<T>::resizePersist(int _n)
     }
     if(_n > capacity) {
       T* oldvals = vals;
-      vals = new T[_n];
+      vals = WorkspaceNewArray<T>(_n);
       capacity = _n;
       if(!vals) {
 	FatalError("Not enough memory to allocate vector of size %d",_n);
       }
       //copy n values 
       gen_array_equal(vals, 1, oldvals, stride, n);
-      SafeArrayDelete(oldvals);
+      WorkspaceDeleteArray(oldvals);
     }
     base = 0;
     stride = 1;
@@ -173,7 +174,7 @@ template <class T>
 void VectorTemplate<T>::clear()
 {
   if(allocated) {
-    SafeArrayDelete(vals);
+    WorkspaceDeleteArray(vals);
   }
   else {
     vals=NULL;
@@ -0,0 +1,229 @@
+#include "Workspace.h"
+#include <stdlib.h>
+#include <atomic>
+#include <mutex>
+#include <KrisLibrary/errors.h>
+
+namespace Math {
+
+const size_t ScopedWorkspace::kDefaultSize;
+
+/* Each block is preceded by a header that links it to the block below it.
+ * Freeing the top block pops it along with any freed blocks directly
+ * beneath; freeing any other block just marks it.
+ *
+ * A block freed by another thread is only marked.  The owning thread pops
+ * it on its next allocation or free, so only the owner touches top/last.
+ * Arena buffers are listed in a global registry so that other threads can
+ * tell arena blocks from heap arrays.
+ */
+struct WorkspaceBlockHeader
+{
+  size_t prev;  //offset of the previous block's header, or kWorkspaceNone
+  std::atomic<int> freed;
+};
+
+static const size_t kWorkspaceAlign = 32;
+static const size_t kWorkspaceNone = (size_t)-1;
+static const size_t kWorkspaceHeaderSize = (sizeof(WorkspaceBlockHeader)+kWorkspaceAlign-1)/kWorkspaceAlign*kWorkspaceAlign;
+static const int kMaxWorkspaceArenas = 256;
+
+static inline WorkspaceBlockHeader* BlockHeader(void* ptr)
+{
+  return (WorkspaceBlockHeader*)((char*)ptr - kWorkspaceHeaderSize);
+}
+
+//number of arena blocks in use on all threads.  While it's zero, frees
+//skip the arena lookups entirely.
+static std::atomic<size_t> gWorkspaceLiveBlocks(0);
+//number of ScopedWorkspaces alive on all threads.  While it's zero,
+//allocations skip the thread-local lookup.
+static std::atomic<int> gWorkspaceGuards(0);
+
+/* Buffers of all arenas.  Writers hold the mutex; readers are lock-free and
+ * retry if the version changed (or is odd, i.e., mid-write) during a scan.
+ */
+struct WorkspaceRegistry
+{
+  std::mutex writeLock;
+  std::atomic<unsigned> version;
+  std::atomic<char*> begin[kMaxWorkspaceArenas];
+  std::atomic<size_t> size[kMaxWorkspaceArenas];
+
+  int Add(char* buffer,size_t capacity) {
+    std::lock_guard<std::mutex> guard(writeLock);
+    for(int i=0;i<kMaxWorkspaceArenas;i++) {
+      if(begin[i].load(std::memory_order_relaxed) != NULL) continue;
+      version.fetch_add(1,std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      size[i].store(capacity,std::memory_order_relaxed);
+      begin[i].store(buffer,std::memory_order_relaxed);
+      version.fetch_add(1,std::memory_order_release);
+      return i;
+    }
+    return -1;
+  }
+
+  void Remove(int slot) {
+    std::lock_guard<std::mutex> guard(writeLock);
+    version.fetch_add(1,std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    begin[slot].store(NULL,std::memory_order_relaxed);
+    size[slot].store(0,std::memory_order_relaxed);
+    version.fetch_add(1,std::memory_order_release);
+  }
+
+  bool Contains(void* ptr) {
+    while(true) {
+      unsigned v1 = version.load(std::memory_order_acquire);
+      if(v1 & 1) continue;
+      bool found = false;
+      for(int i=0;i<kMaxWorkspaceArenas;i++) {
+        char* b = begin[i].load(std::memory_order_relaxed);
+        if(b && (char*)ptr >= b && (char*)ptr < b+size[i].load(std::memory_order_relaxed)) {
+          found = true;
+          break;
+        }
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if(version.load(std::memory_order_relaxed) == v1) return found;
+    }
+  }
+};
+
+static WorkspaceRegistry gWorkspaceRegistry;
+
+struct WorkspaceArena
+{
+  WorkspaceArena() :data(NULL),buffer(NULL),capacity(0),top(0),last(kWorkspaceNone),depth(0),heapFallbacks(0),slot(-1) {}
+  ~WorkspaceArena() {
+    //blocks still in use (e.g., held by objects with static storage or
+    //by other threads) keep the buffer alive
+    Collect();
+    if(top == 0) Release();
+  }
+
+  void Release() {
+    if(slot >= 0) gWorkspaceRegistry.Remove(slot);
+    slot = -1;
+    free(data);
+    data = buffer = NULL;
+    capacity = 0;
+  }
+
+  void Reserve(size_t bytes) {
+    Collect();
+    if(bytes <= capacity || top != 0) return;
+    Release();
+    data = (char*)malloc(bytes+kWorkspaceAlign);
+    if(!data) return;
+    buffer = data + (kWorkspaceAlign - (size_t)data%kWorkspaceAlign)%kWorkspaceAlign;
+    slot = gWorkspaceRegistry.Add(buffer,bytes);
+    if(slot < 0) {
+      //too many arenas; this thread uses the heap
+      free(data);
+      data = buffer = NULL;
+      return;
+    }
+    capacity = bytes;
+  }
+
+  WorkspaceBlockHeader* Header(size_t offset) const { return (WorkspaceBlockHeader*)(buffer+offset); }
+
+  void* Allocate(size_t bytes) {
+    Collect();
+    size_t size = kWorkspaceHeaderSize + (bytes+kWorkspaceAlign-1)/kWorkspaceAlign*kWorkspaceAlign;
+    if(size > capacity - top) {
+      heapFallbacks++;
+      return NULL;
+    }
+    WorkspaceBlockHeader* h = new (Header(top)) WorkspaceBlockHeader;
+    h->prev = last;
+    h->freed.store(0,std::memory_order_relaxed);
+    last = top;
+    top += size;
+    gWorkspaceLiveBlocks.fetch_add(1,std::memory_order_relaxed);
+    return buffer+last+kWorkspaceHeaderSize;
+  }
+
+  bool Owns(void* ptr) const {
+    return buffer && (char*)ptr >= buffer && (char*)ptr < buffer+capacity;
+  }
+
+  void Free(void* ptr) {
+    BlockHeader(ptr)->freed.store(1,std::memory_order_relaxed);
+    gWorkspaceLiveBlocks.fetch_sub(1,std::memory_order_relaxed);
+    Collect();
+  }
+
+  //pops freed blocks off the top, including ones freed by other threads
+  void Collect() {
+    while(last != kWorkspaceNone && Header(last)->freed.load(std::memory_order_acquire)) {
+      top = last;
+      last = Header(last)->prev;
+    }
+  }
+
+  char* data;    //the allocated memory
+  char* buffer;  //data, aligned
+  size_t capacity;
+  size_t top,last;
+  int depth;
+  size_t heapFallbacks;
+  int slot;      //index in gWorkspaceRegistry, or -1
+};
+
+static thread_local WorkspaceArena gWorkspaceArena;
+
+ScopedWorkspace::ScopedWorkspace(size_t bytes)
+{
+  WorkspaceArena& arena = gWorkspaceArena;
+  if(arena.depth == 0) arena.Reserve(bytes);
+  arena.depth++;
+  gWorkspaceGuards.fetch_add(1,std::memory_order_relaxed);
+}
+
+ScopedWorkspace::~ScopedWorkspace()
+{
+  gWorkspaceGuards.fetch_sub(1,std::memory_order_relaxed);
+  gWorkspaceArena.depth--;
+  Assert(gWorkspaceArena.depth >= 0);
+}
+
+size_t WorkspaceBytesUsed()
+{
+  WorkspaceArena& arena = gWorkspaceArena;
+  arena.Collect();
+  return arena.top;
+}
+
+size_t WorkspaceHeapFallbacks()
+{
+  return gWorkspaceArena.heapFallbacks;
+}
+
+void* WorkspaceAllocate(size_t bytes)
+{
+  if(gWorkspaceGuards.load(std::memory_order_relaxed) == 0) return NULL;
+  WorkspaceArena& arena = gWorkspaceArena;
+  if(arena.depth == 0) return NULL;
+  return arena.Allocate(bytes);
+}
+
+bool WorkspaceFree(void* ptr)
+{
+  //no arena blocks anywhere, so ptr must be from the heap
+  if(gWorkspaceLiveBlocks.load(std::memory_order_relaxed) == 0) return false;
+  WorkspaceArena& arena = gWorkspaceArena;
+  if(arena.Owns(ptr)) {
+    arena.Free(ptr);
+    return true;
+  }
+  if(!gWorkspaceRegistry.Contains(ptr)) return false;
+  //a block of another thread's arena; the owner reclaims it
+  BlockHeader(ptr)->freed.store(1,std::memory_order_release);
+  gWorkspaceLiveBlocks.fetch_sub(1,std::memory_order_relaxed);
+  return true;
+}
+
+} //namespace Math
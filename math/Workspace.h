@@ -0,0 +1,85 @@
+#ifndef MATH_WORKSPACE_H
+#define MATH_WORKSPACE_H
+
+#include <stddef.h>
+#include <new>
+#include <type_traits>
+
+namespace Math {
+
+/** @ingroup Math
+ * @brief While one of these is in scope, VectorTemplate and MatrixTemplate
+ * storage allocated on the current thread comes from a thread-local stack
+ * arena rather than the heap.
+ *
+ * The arena is allocated by the first guard on a thread and kept for the
+ * life of the thread, so after a warm-up call, code that creates and
+ * destroys temporary vectors and matrices does not touch malloc.  This is
+ * meant for solvers that are called repeatedly from real-time loops, e.g.
+ *
+ * @code
+ * void ControlLoop() {
+ *   ScopedWorkspace workspace;
+ *   solver.Solve(iters);
+ * }
+ * @endcode
+ *
+ * Storage is released in stack order.  Arrays that are freed out of order
+ * (or that outlive the guard, like a solver's output) stay valid; their
+ * space is reclaimed once everything above them is freed.  If the arena is
+ * full, allocations fall back to the heap.
+ *
+ * Arrays may be freed on any thread.  Space freed by another thread is
+ * reclaimed by the owning thread on its next workspace allocation or free.
+ * Guards may be nested; the arena size is set by the first one.
+ */
+class ScopedWorkspace
+{
+ public:
+  ///Default arena size, in bytes
+  static const size_t kDefaultSize = (1<<20);
+
+  explicit ScopedWorkspace(size_t bytes=kDefaultSize);
+  ~ScopedWorkspace();
+};
+
+///Returns the number of arena bytes in use on this thread
+size_t WorkspaceBytesUsed();
+///Returns the number of allocations on this thread that fell back to the
+///heap because the arena was full
+size_t WorkspaceHeapFallbacks();
+
+///Returns bytes of storage from this thread's arena, or NULL if no
+///ScopedWorkspace is active or the arena is full
+void* WorkspaceAllocate(size_t bytes);
+///If ptr was returned by WorkspaceAllocate on any thread, releases it and
+///returns true.  Otherwise returns false.
+bool WorkspaceFree(void* ptr);
+
+///Allocates an array of n T's, from the workspace if one is active
+template <class T>
+T* WorkspaceNewArray(int n)
+{
+  if(std::is_trivially_destructible<T>::value) {
+    void* ptr = WorkspaceAllocate(sizeof(T)*n);
+    if(ptr) {
+      T* vals = static_cast<T*>(ptr);
+      for(int i=0;i<n;i++) new (vals+i) T;
+      return vals;
+    }
+  }
+  return new T[n];
+}
+
+///Frees an array from WorkspaceNewArray and sets vals to NULL
+template <class T>
+void WorkspaceDeleteArray(T*& vals)
+{
+  if(!vals) return;
+  if(!WorkspaceFree(vals)) delete [] vals;
+  vals = NULL;
+}
+
+} //namespace Math
+
+#endif
@@ -102,9 +102,12 @@ bool Box3D::intersects(const Box3D& b) const
   Vector3 halfdims = dims*0.5;
   Vector3 bhalfdims = b.dims*0.5;
   PQP_REAL B[3][3],T[3],AD[3],BD[3];
-  bxlocal.get(B[0]);
-  bylocal.get(B[1]);
-  bzlocal.get(B[2]);
+  //B is the rotation of b relative to this box; its columns are b's axes
+  for(int i=0;i<3;i++) {
+    B[i][0] = bxlocal[i];
+    B[i][1] = bylocal[i];
+    B[i][2] = bzlocal[i];
+  }
   bclocal.get(T);
   halfdims.get(AD);
   bhalfdims.get(BD);
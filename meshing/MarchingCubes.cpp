@@ -6,6 +6,8 @@
 #include "MarchingCubes.h"
 #include <math3d/interpolate.h>
 #include <math/function.h>
+#include <KrisLibrary/utils/threadutils.h>
+#include <algorithm>
 
 namespace Meshing {
 
@@ -328,32 +330,6 @@ inline Vector3 MulCubeOffset(const Vector3& dx,int v)
 		 (cube[v][2]?dx.z:Zero));
 }
 
-void EvaluateCube(ScalarFieldFunction& f,const Vector3& x,const Vector3& dx,Real vals[8])
-{
-  Vector v(3);
-  v.copy(x + MulCubeOffset(dx,0));  vals[0] = f(v);
-  v.copy(x + MulCubeOffset(dx,1));  vals[1] = f(v);
-  v.copy(x + MulCubeOffset(dx,2));  vals[2] = f(v);
-  v.copy(x + MulCubeOffset(dx,3));  vals[3] = f(v);
-  v.copy(x + MulCubeOffset(dx,4));  vals[4] = f(v);
-  v.copy(x + MulCubeOffset(dx,5));  vals[5] = f(v);
-  v.copy(x + MulCubeOffset(dx,6));  vals[6] = f(v);
-  v.copy(x + MulCubeOffset(dx,7));  vals[7] = f(v);
-}
-
-void EvaluateCube(Real (*f)(Real,Real,Real),const Vector3& x,const Vector3& dx,Real vals[8])
-{
-  Vector3 v;
-  v = x + MulCubeOffset(dx,0);  vals[0] = f(v.x,v.y,v.z);
-  v = x + MulCubeOffset(dx,1);  vals[1] = f(v.x,v.y,v.z);
-  v = x + MulCubeOffset(dx,2);  vals[2] = f(v.x,v.y,v.z);
-  v = x + MulCubeOffset(dx,3);  vals[3] = f(v.x,v.y,v.z);
-  v = x + MulCubeOffset(dx,4);  vals[4] = f(v.x,v.y,v.z);
-  v = x + MulCubeOffset(dx,5);  vals[5] = f(v.x,v.y,v.z);
-  v = x + MulCubeOffset(dx,6);  vals[6] = f(v.x,v.y,v.z);
-  v = x + MulCubeOffset(dx,7);  vals[7] = f(v.x,v.y,v.z);
-}
-
 template <class T>
 void EvaluateCube(const Array3D<T>& a,int i,int j,int k,T vals[8])
 {
@@ -374,344 +350,287 @@ Vector3 EvalCubeEdge(const Vector3& x0,const Vector3& dx,Real u,int v1,int v2)
   return x0+d;
 }
 
-void MarchingCubes(ScalarFieldFunction& input,Real isoLevel,const AABB3D& bb,const int dims[3],TriMesh& m)
+///Edges of the MC cube, described by the cube-relative coordinates of the
+///lower endpoint and the axis along which the edge runs
+const static int mcEdgeOrigin[12][3] = {
+  {0,0,0},{1,0,0},{0,0,1},{0,0,0},
+  {0,1,0},{1,1,0},{0,1,1},{0,1,0},
+  {0,0,0},{1,0,0},{1,0,1},{0,0,1}
+};
+const static int mcEdgeAxis[12] = {0,2,0,2,0,2,0,2,1,1,1,1};
+
+/** @brief Samples plane i of an Array3D into a contiguous n x p buffer */
+template <class T>
+struct ArrayPlaneSampler
 {
-  m.verts.resize(0);
-  m.tris.resize(0);
-  m.verts.reserve(dims[0]*dims[1]);
-  m.tris.reserve(dims[0]*dims[1]);
-  Real vals[8];
-  Vector3 verts[12];
-  int vertMap[12];
-  Vector3 x;
-  Vector3 dh(bb.bmax-bb.bmin);
-  dh.x /= Real(dims[0]-1);
-  dh.y /= Real(dims[1]-1);
-  dh.z /= Real(dims[2]-1);
+  ArrayPlaneSampler(const Array3D<T>& _a) :a(_a) {}
+  void operator () (int i,T* vals) const {
+    std::copy(&a(i,0,0),&a(i,0,0)+a.n*a.p,vals);
+  }
+  const Array3D<T>& a;
+};
 
-  IntTriple tri;
-  x = bb.bmin;
-  for (int i=0;i<dims[0]-1;i++,x.x += dh.x) {
-    x.y = bb.bmin.y;
-    for (int j=0;j<dims[1]-1;j++,x.y += dh.y) {
-      x.z = bb.bmin.z;
-      for (int k=0;k<dims[2]-1;k++,x.z += dh.z) {
-	EvaluateCube(input,x,dh,vals);
-	
-	int cubeIndex = 0;
-	if (vals[0] < isoLevel) cubeIndex |= 1;
-	if (vals[1] < isoLevel) cubeIndex |= 2;
-	if (vals[2] < isoLevel) cubeIndex |= 4;
-	if (vals[3] < isoLevel) cubeIndex |= 8;
-	if (vals[4] < isoLevel) cubeIndex |= 16;
-	if (vals[5] < isoLevel) cubeIndex |= 32;
-	if (vals[6] < isoLevel) cubeIndex |= 64;
-	if (vals[7] < isoLevel) cubeIndex |= 128;
-
-	if (MCEdgeTable[cubeIndex] == 0) {
-	  continue;
-	}
-
-	int vertoffset = (int)m.verts.size();
-	if (MCEdgeTable[cubeIndex] & 1) {
-	  Real u=SegmentCrossing(vals[0], vals[1], isoLevel);
-	  verts[0] = EvalCubeEdge(x,dh,u,0,1);
-	}
-	if (MCEdgeTable[cubeIndex] & 2) {
-	  Real u=SegmentCrossing(vals[1], vals[2], isoLevel);
-	  verts[1] = EvalCubeEdge(x,dh,u,1,2);
-	}
-	if (MCEdgeTable[cubeIndex] & 4) {
-	  Real u=SegmentCrossing(vals[2], vals[3], isoLevel);
-	  verts[2] = EvalCubeEdge(x,dh,u,2,3);
-	}
-	if (MCEdgeTable[cubeIndex] & 8) {
-	  Real u=SegmentCrossing(vals[3], vals[0], isoLevel);
-	  verts[3] = EvalCubeEdge(x,dh,u,3,0);
-	}
-	if (MCEdgeTable[cubeIndex] & 16) {
-	  Real u=SegmentCrossing(vals[4], vals[5], isoLevel);
-	  verts[4] = EvalCubeEdge(x,dh,u,4,5);
-	}
-	if (MCEdgeTable[cubeIndex] & 32) {
-	  Real u=SegmentCrossing(vals[5], vals[6], isoLevel);
-	  verts[5] = EvalCubeEdge(x,dh,u,5,6);
-	}
-	if (MCEdgeTable[cubeIndex] & 64) {
-	  Real u=SegmentCrossing(vals[6], vals[7], isoLevel);
-	  verts[6] = EvalCubeEdge(x,dh,u,6,7);
-	}
-	if (MCEdgeTable[cubeIndex] & 128) {
-	  Real u=SegmentCrossing(vals[7], vals[4], isoLevel);
-	  verts[7] = EvalCubeEdge(x,dh,u,7,4);
-	}
-	if (MCEdgeTable[cubeIndex] & 256) {
-	  Real u=SegmentCrossing(vals[0], vals[4], isoLevel);
-	  verts[8] = EvalCubeEdge(x,dh,u,0,4);
-	}
-	if (MCEdgeTable[cubeIndex] & 512) {
-	  Real u=SegmentCrossing(vals[1], vals[5], isoLevel);
-	  verts[9] = EvalCubeEdge(x,dh,u,1,5);
-	}
-	if (MCEdgeTable[cubeIndex] & 1024) {
-	  Real u=SegmentCrossing(vals[2], vals[6], isoLevel);
-	  verts[10] = EvalCubeEdge(x,dh,u,2,6);
-	}
-	if (MCEdgeTable[cubeIndex] & 2048) {
-	  Real u=SegmentCrossing(vals[3], vals[7], isoLevel);
-	  verts[11] = EvalCubeEdge(x,dh,u,3,7);
-	}
-
-	//get the mapping from tri vertices to mesh vertices
-	for(const int* t=MCTriTable[cubeIndex];*t!=-1; t++) {
-	  vertMap[*t] = (int)m.verts.size();
-	  m.verts.push_back(verts[*t]);
-	}
-	for(const int* t=MCTriTable[cubeIndex];*t!=-1; t+=3) {
-	  tri.a = vertMap[*t];
-	  tri.b = vertMap[*(t+1)];
-	  tri.c = vertMap[*(t+2)];
-	  if(tri.a < vertoffset || tri.a >= (int)m.verts.size() ||
-	     tri.b < vertoffset || tri.b >= (int)m.verts.size() ||
-	     tri.c < vertoffset || tri.c >= (int)m.verts.size())
-	    {
-	      	      LOG4CXX_ERROR(KrisLibrary::logger(),"Internal Marching cubes error!\n");
-	      	      LOG4CXX_ERROR(KrisLibrary::logger(),"Triangle "<<tri.a<<" "<<tri.b<<" "<<tri.c);
-	      	      LOG4CXX_ERROR(KrisLibrary::logger(),"Starting vertex size: "<<vertoffset<<" ending vertex size "<<m.verts.size());
-	      	      LOG4CXX_ERROR(KrisLibrary::logger(),"cube index "<<cubeIndex);
-	      abort();
-	    }
-	  m.tris.push_back(tri);
-	}
+/** @brief Samples plane i of a function on a regular grid */
+template <class F>
+struct FunctionPlaneSampler
+{
+  FunctionPlaneSampler(F& _f,const Vector3& _x0,const Vector3& _dh,int _n,int _p)
+    :f(_f),x0(_x0),dh(_dh),n(_n),p(_p) {}
+  void operator () (int i,Real* vals) const {
+    Vector3 x;
+    x.x = x0.x + dh.x*i;
+    for(int j=0;j<n;j++) {
+      x.y = x0.y + dh.y*j;
+      for(int k=0;k<p;k++,vals++) {
+        x.z = x0.z + dh.z*k;
+        *vals = Eval(x);
       }
     }
   }
-  assert(m.IsValid());
+  Real Eval(const Vector3& x) const { return f(x.x,x.y,x.z); }
+  F& f;
+  Vector3 x0,dh;
+  int n,p;
+};
 
-  //TODO: merge vertices
+template <>
+Real FunctionPlaneSampler<ScalarFieldFunction>::Eval(const Vector3& x) const
+{
+  Vector v(3);
+  v.copy(x);
+  return f(v);
 }
 
-void MarchingCubes(Real (*input)(Real,Real,Real),Real isoLevel,const AABB3D& bb,const int dims[3],TriMesh& m)
+/** @brief Marches the cube layers [i0,i1) of an m x n x p grid.
+ *
+ * Vertices are cached on the edges of the two planes bounding the current
+ * layer and on the x-edges spanning it, so each vertex is emitted once per
+ * slab.  The y/z edge vertex indices on the planes i0 and i1 are retained
+ * in firstPlane and lastPlane so that adjacent slabs can be stitched.
+ * If vertEdges is given, it receives an edge code ((i*n+j)*p+k)*3+axis for
+ * each emitted vertex.
+ */
+template <class T,class Sampler>
+void MarchSlab(const Sampler& sampler,int i0,int i1,int n,int p,T isoLevel,
+               const Vector3& x0,const Vector3& dh,TriMesh& m,
+               vector<int>& firstPlane,vector<int>& lastPlane,
+               vector<size_t>* vertEdges=NULL)
 {
   m.verts.resize(0);
   m.tris.resize(0);
-  m.verts.reserve(dims[0]*dims[1]);
-  m.tris.reserve(dims[0]*dims[1]);
-  Real vals[8];
-  Vector3 verts[12];
-  int vertMap[12];
-  Vector3 x;
+  int np = n*p;
+  vector<T> vals0(np),vals1(np);
+  vector<int> plane0(np*2,-1),plane1(np*2,-1),xedges(np,-1);
+  if(vertEdges) vertEdges->resize(0);
+
+  T vals[8];
+  int edgeVerts[12];
+  sampler(i0,&vals0[0]);
+  for(int i=i0;i<i1;i++) {
+    sampler(i+1,&vals1[0]);
+    std::fill(plane1.begin(),plane1.end(),-1);
+    std::fill(xedges.begin(),xedges.end(),-1);
+    const T* planeVals[2] = {&vals0[0],&vals1[0]};
+    int* planeCache[2] = {&plane0[0],&plane1[0]};
+    for(int j=0;j+1<n;j++) {
+      for(int k=0;k+1<p;k++) {
+        int c = j*p+k;
+        vals[0] = vals0[c];
+        vals[1] = vals1[c];
+        vals[2] = vals1[c+1];
+        vals[3] = vals0[c+1];
+        vals[4] = vals0[c+p];
+        vals[5] = vals1[c+p];
+        vals[6] = vals1[c+p+1];
+        vals[7] = vals0[c+p+1];
+
+        int cubeIndex = 0;
+        if (vals[0] < isoLevel) cubeIndex |= 1;
+        if (vals[1] < isoLevel) cubeIndex |= 2;
+        if (vals[2] < isoLevel) cubeIndex |= 4;
+        if (vals[3] < isoLevel) cubeIndex |= 8;
+        if (vals[4] < isoLevel) cubeIndex |= 16;
+        if (vals[5] < isoLevel) cubeIndex |= 32;
+        if (vals[6] < isoLevel) cubeIndex |= 64;
+        if (vals[7] < isoLevel) cubeIndex |= 128;
+
+        int edges = MCEdgeTable[cubeIndex];
+        if (edges == 0) continue;
+
+        for(int e=0;e<12;e++) {
+          if(!(edges & (1<<e))) continue;
+          const int* o = mcEdgeOrigin[e];
+          int axis = mcEdgeAxis[e];
+          int oc = (j+o[1])*p + k+o[2];
+          int* cache;
+          if(axis == 0) cache = &xedges[oc];
+          else cache = &planeCache[o[0]][oc*2+axis-1];
+          if(*cache < 0) {
+            //interpolate from the lower to the upper endpoint, so that the
+            //vertex doesn't depend on which cube created it
+            T va = planeVals[o[0]][oc], vb;
+            if(axis == 0) vb = vals1[oc];
+            else if(axis == 1) vb = planeVals[o[0]][oc+p];
+            else vb = planeVals[o[0]][oc+1];
+            Real u = SegmentCrossing(va,vb,isoLevel);
+            Vector3 v(x0.x+dh.x*(i+o[0]),x0.y+dh.y*(j+o[1]),x0.z+dh.z*(k+o[2]));
+            v[axis] += u*dh[axis];
+            *cache = (int)m.verts.size();
+            m.verts.push_back(v);
+            if(vertEdges)
+              vertEdges->push_back((((size_t)(i+o[0])*n+j+o[1])*p+k+o[2])*3+axis);
+          }
+          edgeVerts[e] = *cache;
+        }
+        for(const int* t=MCTriTable[cubeIndex];*t!=-1; t+=3)
+          m.tris.push_back(IntTriple(edgeVerts[*t],edgeVerts[*(t+1)],edgeVerts[*(t+2)]));
+      }
+    }
+    if(i == i0) firstPlane = plane0;
+    swap(vals0,vals1);
+    swap(plane0,plane1);
+  }
+  if(i1 == i0) firstPlane = plane0;
+  lastPlane = plane0;
+}
+
+template <class T,class Sampler>
+struct MarchSlabData
+{
+  const Sampler* sampler;
+  int i0,i1,n,p;
+  T isoLevel;
+  Vector3 x0,dh;
+  TriMesh mesh;
+  vector<int> firstPlane,lastPlane;
+};
+
+template <class T,class Sampler>
+void* MarchSlabThread(void* vdata)
+{
+  MarchSlabData<T,Sampler>* data = reinterpret_cast<MarchSlabData<T,Sampler>*>(vdata);
+  MarchSlab(*data->sampler,data->i0,data->i1,data->n,data->p,data->isoLevel,data->x0,data->dh,data->mesh,data->firstPlane,data->lastPlane);
+  return NULL;
+}
+
+//minimum number of cube layers per slab
+const static int kMinSlabLayers = 8;
+
+/** @brief Runs marching cubes over an m x n x p grid of samples in parallel
+ * slabs along the x axis, and stitches the slabs into a single indexed mesh.
+ *
+ * Slabs are merged in order, and vertices shared between slabs are
+ * emitted by the lower slab, so the result is the same as a serial march
+ * regardless of numThreads.
+ */
+template <class T,class Sampler>
+void MarchSlabs(const Sampler& sampler,int m,int n,int p,T isoLevel,const AABB3D& bb,int numThreads,TriMesh& mesh)
+{
+  mesh.verts.resize(0);
+  mesh.tris.resize(0);
+  if(m < 2 || n < 2 || p < 2) return;
+  Vector3 dh(bb.bmax-bb.bmin);
+  dh.x /= Real(m-1);
+  dh.y /= Real(n-1);
+  dh.z /= Real(p-1);
+
+  int numSlabs = Min(ThreadCount(numThreads),(m-1+kMinSlabLayers-1)/kMinSlabLayers);
+  if(numSlabs < 1) numSlabs = 1;
+  vector<MarchSlabData<T,Sampler> > slabs(numSlabs);
+  for(int s=0;s<numSlabs;s++) {
+    slabs[s].sampler = &sampler;
+    slabs[s].i0 = (s*(m-1))/numSlabs;
+    slabs[s].i1 = ((s+1)*(m-1))/numSlabs;
+    slabs[s].n = n;
+    slabs[s].p = p;
+    slabs[s].isoLevel = isoLevel;
+    slabs[s].x0 = bb.bmin;
+    slabs[s].dh = dh;
+  }
+  if(numSlabs == 1) {
+    MarchSlab(sampler,0,m-1,n,p,isoLevel,bb.bmin,dh,mesh,slabs[0].firstPlane,slabs[0].lastPlane);
+    return;
+  }
+  ThreadRunAll(MarchSlabThread<T,Sampler>,slabs);
+
+  //stitch: vertices on a slab's first plane were also emitted by the
+  //previous slab's last plane
+  size_t nv=0,nt=0;
+  for(int s=0;s<numSlabs;s++) {
+    nv += slabs[s].mesh.verts.size();
+    nt += slabs[s].mesh.tris.size();
+  }
+  mesh.verts.reserve(nv);
+  mesh.tris.reserve(nt);
+  vector<int> prevMap,vmap;
+  for(int s=0;s<numSlabs;s++) {
+    TriMesh& sm = slabs[s].mesh;
+    vmap.resize(sm.verts.size());
+    std::fill(vmap.begin(),vmap.end(),-1);
+    if(s > 0) {
+      const vector<int>& first = slabs[s].firstPlane;
+      const vector<int>& prevLast = slabs[s-1].lastPlane;
+      for(size_t e=0;e<first.size();e++)
+        if(first[e] >= 0 && prevLast[e] >= 0)
+          vmap[first[e]] = prevMap[prevLast[e]];
+    }
+    for(size_t v=0;v<sm.verts.size();v++) {
+      if(vmap[v] >= 0) continue;
+      vmap[v] = (int)mesh.verts.size();
+      mesh.verts.push_back(sm.verts[v]);
+    }
+    for(size_t t=0;t<sm.tris.size();t++)
+      mesh.tris.push_back(IntTriple(vmap[sm.tris[t].a],vmap[sm.tris[t].b],vmap[sm.tris[t].c]));
+    swap(prevMap,vmap);
+    sm.verts.clear();
+    sm.tris.clear();
+  }
+}
+
+void MarchingCubes(ScalarFieldFunction& input,Real isoLevel,const AABB3D& bb,const int dims[3],TriMesh& m,int numThreads)
+{
   Vector3 dh(bb.bmax-bb.bmin);
   dh.x /= Real(dims[0]-1);
   dh.y /= Real(dims[1]-1);
   dh.z /= Real(dims[2]-1);
+  FunctionPlaneSampler<ScalarFieldFunction> sampler(input,bb.bmin,dh,dims[1],dims[2]);
+  MarchSlabs(sampler,dims[0],dims[1],dims[2],isoLevel,bb,numThreads,m);
+  assert(m.IsValid());
+}
 
-  IntTriple tri;
-  x = bb.bmin;
-  for (int i=0;i<dims[0]-1;i++,x.x += dh.x) {
-    x.y = bb.bmin.y;
-    for (int j=0;j<dims[1]-1;j++,x.y += dh.y) {
-      x.z = bb.bmin.z;
-      for (int k=0;k<dims[2]-1;k++,x.z += dh.z) {
-	EvaluateCube(input,x,dh,vals);
-	
-	int cubeIndex = 0;
-	if (vals[0] < isoLevel) cubeIndex |= 1;
-	if (vals[1] < isoLevel) cubeIndex |= 2;
-	if (vals[2] < isoLevel) cubeIndex |= 4;
-	if (vals[3] < isoLevel) cubeIndex |= 8;
-	if (vals[4] < isoLevel) cubeIndex |= 16;
-	if (vals[5] < isoLevel) cubeIndex |= 32;
-	if (vals[6] < isoLevel) cubeIndex |= 64;
-	if (vals[7] < isoLevel) cubeIndex |= 128;
-
-	if (MCEdgeTable[cubeIndex] == 0) {
-	  continue;
-	}
-
-	int vertoffset = (int)m.verts.size();
-	if (MCEdgeTable[cubeIndex] & 1) {
-	  Real u=SegmentCrossing(vals[0], vals[1], isoLevel);
-	  verts[0] = EvalCubeEdge(x,dh,u,0,1);
-	}
-	if (MCEdgeTable[cubeIndex] & 2) {
-	  Real u=SegmentCrossing(vals[1], vals[2], isoLevel);
-	  verts[1] = EvalCubeEdge(x,dh,u,1,2);
-	}
-	if (MCEdgeTable[cubeIndex] & 4) {
-	  Real u=SegmentCrossing(vals[2], vals[3], isoLevel);
-	  verts[2] = EvalCubeEdge(x,dh,u,2,3);
-	}
-	if (MCEdgeTable[cubeIndex] & 8) {
-	  Real u=SegmentCrossing(vals[3], vals[0], isoLevel);
-	  verts[3] = EvalCubeEdge(x,dh,u,3,0);
-	}
-	if (MCEdgeTable[cubeIndex] & 16) {
-	  Real u=SegmentCrossing(vals[4], vals[5], isoLevel);
-	  verts[4] = EvalCubeEdge(x,dh,u,4,5);
-	}
-	if (MCEdgeTable[cubeIndex] & 32) {
-	  Real u=SegmentCrossing(vals[5], vals[6], isoLevel);
-	  verts[5] = EvalCubeEdge(x,dh,u,5,6);
-	}
-	if (MCEdgeTable[cubeIndex] & 64) {
-	  Real u=SegmentCrossing(vals[6], vals[7], isoLevel);
-	  verts[6] = EvalCubeEdge(x,dh,u,6,7);
-	}
-	if (MCEdgeTable[cubeIndex] & 128) {
-	  Real u=SegmentCrossing(vals[7], vals[4], isoLevel);
-	  verts[7] = EvalCubeEdge(x,dh,u,7,4);
-	}
-	if (MCEdgeTable[cubeIndex] & 256) {
-	  Real u=SegmentCrossing(vals[0], vals[4], isoLevel);
-	  verts[8] = EvalCubeEdge(x,dh,u,0,4);
-	}
-	if (MCEdgeTable[cubeIndex] & 512) {
-	  Real u=SegmentCrossing(vals[1], vals[5], isoLevel);
-	  verts[9] = EvalCubeEdge(x,dh,u,1,5);
-	}
-	if (MCEdgeTable[cubeIndex] & 1024) {
-	  Real u=SegmentCrossing(vals[2], vals[6], isoLevel);
-	  verts[10] = EvalCubeEdge(x,dh,u,2,6);
-	}
-	if (MCEdgeTable[cubeIndex] & 2048) {
-	  Real u=SegmentCrossing(vals[3], vals[7], isoLevel);
-	  verts[11] = EvalCubeEdge(x,dh,u,3,7);
-	}
-
-	//get the mapping from tri vertices to mesh vertices
-	for(const int* t=MCTriTable[cubeIndex];*t!=-1; t++) {
-	  vertMap[*t] = (int)m.verts.size();
-	  m.verts.push_back(verts[*t]);
-	}
-	for(const int* t=MCTriTable[cubeIndex];*t!=-1; t+=3) {
-	  tri.a = vertMap[*t];
-	  tri.b = vertMap[*(t+1)];
-	  tri.c = vertMap[*(t+2)];
-	  if(tri.a < vertoffset || tri.a >= (int)m.verts.size() ||
-	     tri.b < vertoffset || tri.b >= (int)m.verts.size() ||
-	     tri.c < vertoffset || tri.c >= (int)m.verts.size())
-	    {
-	      	      LOG4CXX_ERROR(KrisLibrary::logger(),"Internal Marching cubes error!\n");
-	      	      LOG4CXX_ERROR(KrisLibrary::logger(),"Triangle "<<tri.a<<" "<<tri.b<<" "<<tri.c);
-	      	      LOG4CXX_ERROR(KrisLibrary::logger(),"Starting vertex size: "<<vertoffset<<" ending vertex size "<<m.verts.size());
-	      	      LOG4CXX_ERROR(KrisLibrary::logger(),"cube index "<<cubeIndex);
-	      abort();
-	    }
-	  m.tris.push_back(tri);
-	}
-      }
-    }
-  }
+void MarchingCubes(Real (*input)(Real,Real,Real),Real isoLevel,const AABB3D& bb,const int dims[3],TriMesh& m,int numThreads)
+{
+  typedef Real (*Fn)(Real,Real,Real);
+  Vector3 dh(bb.bmax-bb.bmin);
+  dh.x /= Real(dims[0]-1);
+  dh.y /= Real(dims[1]-1);
+  dh.z /= Real(dims[2]-1);
+  FunctionPlaneSampler<Fn> sampler(input,bb.bmin,dh,dims[1],dims[2]);
+  MarchSlabs(sampler,dims[0],dims[1],dims[2],isoLevel,bb,numThreads,m);
   assert(m.IsValid());
+}
 
-  //TODO: merge vertices
+template <class T>
+void MarchingCubes(const Array3D<T>& input,T isoLevel,const AABB3D& bb,TriMesh& m,int numThreads)
+{
+  ArrayPlaneSampler<T> sampler(input);
+  MarchSlabs(sampler,input.m,input.n,input.p,isoLevel,bb,numThreads,m);
 }
 
 template <class T>
-void MarchingCubes(const Array3D<T>& input,T isoLevel,const AABB3D& bb,TriMesh& m)
+void MarchingCubes(const Array3D<T>& input,T isoLevel,const AABB3D& bb,TriMesh& m,vector<size_t>& vertEdges)
 {
   m.verts.resize(0);
   m.tris.resize(0);
-  m.verts.reserve(input.m*input.n);
-  m.tris.reserve(input.m*input.n);
-  T vals[8];
-  Vector3 verts[12];
-  int vertMap[12];
-  Vector3 x;
+  vertEdges.resize(0);
+  if(input.m < 2 || input.n < 2 || input.p < 2) return;
   Vector3 dh(bb.bmax-bb.bmin);
   dh.x /= Real(input.m-1);
   dh.y /= Real(input.n-1);
   dh.z /= Real(input.p-1);
-
-  IntTriple tri;
-  x = bb.bmin;
-  for (int i=0;i<input.m-1;i++,x.x += dh.x) {
-    x.y = bb.bmin.y;
-    for (int j=0;j<input.n-1;j++,x.y += dh.y) {
-      x.z = bb.bmin.z;
-      for (int k=0;k<input.p-1;k++,x.z += dh.z) {
-	EvaluateCube(input,i,j,k,vals);
-	
-	int cubeIndex = 0;
-	if (vals[0] < isoLevel) cubeIndex |= 1;
-	if (vals[1] < isoLevel) cubeIndex |= 2;
-	if (vals[2] < isoLevel) cubeIndex |= 4;
-	if (vals[3] < isoLevel) cubeIndex |= 8;
-	if (vals[4] < isoLevel) cubeIndex |= 16;
-	if (vals[5] < isoLevel) cubeIndex |= 32;
-	if (vals[6] < isoLevel) cubeIndex |= 64;
-	if (vals[7] < isoLevel) cubeIndex |= 128;
-
-	if (MCEdgeTable[cubeIndex] == 0) {
-	  continue;
-	}
-
-	if (MCEdgeTable[cubeIndex] & 1) {
-	  Real u=SegmentCrossing(vals[0], vals[1], isoLevel);
-	  verts[0] = EvalCubeEdge(x,dh,u,0,1);
-	}
-	if (MCEdgeTable[cubeIndex] & 2) {
-	  Real u=SegmentCrossing(vals[1], vals[2], isoLevel);
-	  verts[1] = EvalCubeEdge(x,dh,u,1,2);
-	}
-	if (MCEdgeTable[cubeIndex] & 4) {
-	  Real u=SegmentCrossing(vals[2], vals[3], isoLevel);
-	  verts[2] = EvalCubeEdge(x,dh,u,2,3);
-	}
-	if (MCEdgeTable[cubeIndex] & 8) {
-	  Real u=SegmentCrossing(vals[3], vals[0], isoLevel);
-	  verts[3] = EvalCubeEdge(x,dh,u,3,0);
-	}
-	if (MCEdgeTable[cubeIndex] & 16) {
-	  Real u=SegmentCrossing(vals[4], vals[5], isoLevel);
-	  verts[4] = EvalCubeEdge(x,dh,u,4,5);
-	}
-	if (MCEdgeTable[cubeIndex] & 32) {
-	  Real u=SegmentCrossing(vals[5], vals[6], isoLevel);
-	  verts[5] = EvalCubeEdge(x,dh,u,5,6);
-	}
-	if (MCEdgeTable[cubeIndex] & 64) {
-	  Real u=SegmentCrossing(vals[6], vals[7], isoLevel);
-	  verts[6] = EvalCubeEdge(x,dh,u,6,7);
-	}
-	if (MCEdgeTable[cubeIndex] & 128) {
-	  Real u=SegmentCrossing(vals[7], vals[4], isoLevel);
-	  verts[7] = EvalCubeEdge(x,dh,u,7,4);
-	}
-	if (MCEdgeTable[cubeIndex] & 256) {
-	  Real u=SegmentCrossing(vals[0], vals[4], isoLevel);
-	  verts[8] = EvalCubeEdge(x,dh,u,0,4);
-	}
-	if (MCEdgeTable[cubeIndex] & 512) {
-	  Real u=SegmentCrossing(vals[1], vals[5], isoLevel);
-	  verts[9] = EvalCubeEdge(x,dh,u,1,5);
-	}
-	if (MCEdgeTable[cubeIndex] & 1024) {
-	  Real u=SegmentCrossing(vals[2], vals[6], isoLevel);
-	  verts[10] = EvalCubeEdge(x,dh,u,2,6);
-	}
-	if (MCEdgeTable[cubeIndex] & 2048) {
-	  Real u=SegmentCrossing(vals[3], vals[7], isoLevel);
-	  verts[11] = EvalCubeEdge(x,dh,u,3,7);
-	}
-
-	//get the mapping from tri vertices to mesh vertices
-	for(const int* t=MCTriTable[cubeIndex];*t!=-1; t++) {
-	  vertMap[*t] = (int)m.verts.size();
-	  m.verts.push_back(verts[*t]);
-	}
-	for(const int* t=MCTriTable[cubeIndex];*t!=-1; t+=3) {
-	  tri.a = vertMap[*t];
-	  tri.b = vertMap[*(t+1)];
-	  tri.c = vertMap[*(t+2)];
-	  m.tris.push_back(tri);
-	}
-      }
-    }
-  }
-
-  //TODO: merge vertices
+  ArrayPlaneSampler<T> sampler(input);
+  vector<int> firstPlane,lastPlane;
+  MarchSlab(sampler,0,input.m-1,input.n,input.p,isoLevel,bb.bmin,dh,m,firstPlane,lastPlane,&vertEdges);
 }
 
 template <class T>
@@ -937,10 +856,15 @@ void CubeToMesh(const Real origvals[8],Real isoLevel,const AABB3D& bb,TriMesh& m
 }
 
 //forward evaluations
-template void MarchingCubes<char>(const Array3D<char>& input,char isoLevel,const AABB3D& bb,TriMesh& m);
-template void MarchingCubes<int>(const Array3D<int>& input,int isoLevel,const AABB3D& bb,TriMesh& m);
-template void MarchingCubes<float>(const Array3D<float>& input,float isoLevel,const AABB3D& bb,TriMesh& m);
-template void MarchingCubes<double>(const Array3D<double>& input,double isoLevel,const AABB3D& bb,TriMesh& m);
+template void MarchingCubes<char>(const Array3D<char>& input,char isoLevel,const AABB3D& bb,TriMesh& m,int numThreads);
+template void MarchingCubes<int>(const Array3D<int>& input,int isoLevel,const AABB3D& bb,TriMesh& m,int numThreads);
+template void MarchingCubes<float>(const Array3D<float>& input,float isoLevel,const AABB3D& bb,TriMesh& m,int numThreads);
+template void MarchingCubes<double>(const Array3D<double>& input,double isoLevel,const AABB3D& bb,TriMesh& m,int numThreads);
+
+template void MarchingCubes<char>(const Array3D<char>& input,char isoLevel,const AABB3D& bb,TriMesh& m,vector<size_t>& vertEdges);
+template void MarchingCubes<int>(const Array3D<int>& input,int isoLevel,const AABB3D& bb,TriMesh& m,vector<size_t>& vertEdges);
+template void MarchingCubes<float>(const Array3D<float>& input,float isoLevel,const AABB3D& bb,TriMesh& m,vector<size_t>& vertEdges);
+template void MarchingCubes<double>(const Array3D<double>& input,double isoLevel,const AABB3D& bb,TriMesh& m,vector<size_t>& vertEdges);
 
 template void TSDFMarchingCubes<char>(const Array3D<char>& input,char isoLevel,char truncationValue,const AABB3D& bb,TriMesh& m);
 template void TSDFMarchingCubes<int>(const Array3D<int>& input,int isoLevel,int truncationValue,const AABB3D& bb,TriMesh& m);
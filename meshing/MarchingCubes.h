@@ -19,19 +19,38 @@ namespace Meshing {
   /** @addtogroup Meshing */
   /*@{*/
 
-/// Takes a 3D function as input, meshes the isosurface at f(x)=isoval
-void MarchingCubes(ScalarFieldFunction& f,Real isoval,const AABB3D& bb,const int dims[3],TriMesh& m);
+/// Takes a 3D function as input, meshes the isosurface at f(x)=isoval.
+/// The output is an indexed mesh in which vertices are shared between
+/// adjacent cubes.
+///
+/// The grid is split into slabs along x, which are processed by numThreads
+/// threads (<= 0 uses the hardware concurrency).  f must then be safe to call
+/// concurrently.  The result does not depend on the number of threads.
+void MarchingCubes(ScalarFieldFunction& f,Real isoval,const AABB3D& bb,const int dims[3],TriMesh& m,int numThreads=1);
 
-/// Takes a 3D function as input, meshes the isosurface at f(x)=isoval
-void MarchingCubes(Real (*f)(Real,Real,Real),Real isoval,const AABB3D& bb,const int dims[3],TriMesh& m);
+/// Takes a 3D function as input, meshes the isosurface at f(x)=isoval.
+/// Threading is the same as for the ScalarFieldFunction version.
+void MarchingCubes(Real (*f)(Real,Real,Real),Real isoval,const AABB3D& bb,const int dims[3],TriMesh& m,int numThreads=1);
 
 /// Takes a 3D grid as input, meshes the isosurface at f(x)=isoval.
 /// Assumes the input values are defined at the vertices of a grid with
-/// m-1 x n-1 x p-1 cells
+/// m-1 x n-1 x p-1 cells.  The output is an indexed mesh in which vertices
+/// are shared between adjacent cubes.
+///
+/// Large grids may be processed in parallel slabs by passing numThreads > 1
+/// (<= 0 uses the hardware concurrency).  The result does not depend on
+/// the number of threads.
 ///
 /// Defined for T = char, int, float, and double
 template <class T>
-void MarchingCubes(const Array3D<T>& input,T isoval,const AABB3D& bb,TriMesh& m);
+void MarchingCubes(const Array3D<T>& input,T isoval,const AABB3D& bb,TriMesh& m,int numThreads=1);
+
+/// Same as above, but single-threaded, and also returns the grid edge on
+/// which each vertex lies, encoded as ((i*n+j)*p+k)*3+axis where (i,j,k)
+/// is the lower endpoint of the edge.  Useful for stitching meshes
+/// extracted from adjacent blocks.
+template <class T>
+void MarchingCubes(const Array3D<T>& input,T isoval,const AABB3D& bb,TriMesh& m,std::vector<size_t>& vertEdges);
 
 /// Takes values of a function f at a cube's vertices as input,
 /// meshes the isosurface at f(x)=isoval
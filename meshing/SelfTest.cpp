@@ -0,0 +1,169 @@
+#include <KrisLibrary/Logger.h>
+#include "MarchingCubes.h"
+#include "Voxelize.h"
+#include "VolumeGrid.h"
+#include "MeshPrimitives.h"
+#include <math3d/Triangle3D.h>
+#include <structs/array3d.h>
+#include <math3d/AABB3D.h>
+#include <errors.h>
+#include "SelfTest.h"
+using namespace Meshing;
+using namespace std;
+
+static Real WavySphere(Real x,Real y,Real z)
+{
+  return x*x+y*y+z*z - 0.5 - 0.1*Sin(5*x)*Cos(3*y);
+}
+
+static bool SameMesh(const TriMesh& a,const TriMesh& b)
+{
+  if(a.verts.size() != b.verts.size() || a.tris.size() != b.tris.size()) return false;
+  for(size_t i=0;i<a.verts.size();i++)
+    if(a.verts[i] != b.verts[i]) return false;
+  for(size_t i=0;i<a.tris.size();i++)
+    if(a.tris[i] != b.tris[i]) return false;
+  return true;
+}
+
+//slab-parallel marching cubes must give exactly the serial mesh
+void Meshing::TestMarchingCubes()
+{
+  AABB3D bb(Vector3(-1.0),Vector3(1.0));
+  int dims[3] = {61,37,29};
+  Array3D<Real> grid(dims[0],dims[1],dims[2]);
+  for(int i=0;i<dims[0];i++)
+    for(int j=0;j<dims[1];j++)
+      for(int k=0;k<dims[2];k++)
+        grid(i,j,k) = WavySphere(-1.0+2.0*i/(dims[0]-1),-1.0+2.0*j/(dims[1]-1),-1.0+2.0*k/(dims[2]-1));
+
+  TriMesh serial,parallel;
+  MarchingCubes(grid,Real(0),bb,serial);
+  if(serial.tris.empty()) FatalError("TestMarchingCubes: empty serial mesh");
+  if(!serial.IsValid()) FatalError("TestMarchingCubes: invalid serial mesh");
+  for(int numThreads=2;numThreads<=7;numThreads+=5) {
+    MarchingCubes(grid,Real(0),bb,parallel,numThreads);
+    if(!SameMesh(serial,parallel)) FatalError("TestMarchingCubes: grid mesh differs with %d threads",numThreads);
+  }
+
+  TriMesh fserial;
+  MarchingCubes(WavySphere,0,bb,dims,fserial);
+  if(fserial.tris.empty()) FatalError("TestMarchingCubes: empty function mesh");
+  MarchingCubes(WavySphere,0,bb,dims,parallel,4);
+  if(!SameMesh(fserial,parallel)) FatalError("TestMarchingCubes: function mesh differs with 4 threads");
+
+  //the edge codes give the lower grid vertex of each mesh vertex's edge
+  vector<size_t> vertEdges;
+  MarchingCubes(grid,Real(0),bb,parallel,vertEdges);
+  if(!SameMesh(serial,parallel) || vertEdges.size() != serial.verts.size()) FatalError("TestMarchingCubes: edge-coded mesh differs");
+  Vector3 h((bb.bmax.x-bb.bmin.x)/(dims[0]-1),(bb.bmax.y-bb.bmin.y)/(dims[1]-1),(bb.bmax.z-bb.bmin.z)/(dims[2]-1));
+  for(size_t v=0;v<vertEdges.size();v++) {
+    size_t code = vertEdges[v];
+    int axis = (int)(code%3); code /= 3;
+    int k = (int)(code%dims[2]); code /= dims[2];
+    int j = (int)(code%dims[1]); code /= dims[1];
+    int i = (int)code;
+    Vector3 lo(bb.bmin.x+h.x*i,bb.bmin.y+h.y*j,bb.bmin.z+h.z*k);
+    Vector3 d = serial.verts[v]-lo;
+    for(int a=0;a<3;a++) {
+      if(a == axis) {
+        if(d[a] < -Epsilon || d[a] > h[a]+Epsilon) FatalError("TestMarchingCubes: vertex %d is off its edge",(int)v);
+      }
+      else if(Abs(d[a]) > Epsilon) FatalError("TestMarchingCubes: vertex %d is off its edge",(int)v);
+    }
+  }
+}
+
+//the surface voxelizer before tiling: each triangle is tested against the
+//cells of its bounding box, stepping through them with VolumeGridIterator
+static void ReferenceSurfaceOccupancy(const TriMesh& mesh,Array3D<bool>& occupied,const AABB3D& bb)
+{
+  occupied.set(false);
+  Vector3 h((bb.bmax.x-bb.bmin.x)/occupied.m,(bb.bmax.y-bb.bmin.y)/occupied.n,(bb.bmax.z-bb.bmin.z)/occupied.p);
+  int dims[3] = {occupied.m,occupied.n,occupied.p};
+  Triangle3D tri;
+  AABB3D query,cell;
+  for(size_t t=0;t<mesh.tris.size();t++) {
+    mesh.GetTriangle(t,tri);
+    query.setPoint(tri.a);
+    query.expand(tri.b);
+    query.expand(tri.c);
+    IntTriple lo,hi;
+    for(int d=0;d<3;d++) {
+      lo[d] = Max((int)Floor((query.bmin[d]-bb.bmin[d])/h[d]),0);
+      hi[d] = Min((int)Floor((query.bmax[d]-bb.bmin[d])/h[d]),dims[d]-1);
+    }
+    VolumeGridIterator<bool> it(occupied,bb);
+    it.setRange(lo,hi);
+    for(;!it.isDone();++it) {
+      it.getCell(cell);
+      if(tri.intersects(cell)) *it = true;
+    }
+  }
+}
+
+//true if some cell within one index of (i,j,k) is set in both a and b
+static bool NearCommonCell(const Array3D<bool>& a,const Array3D<bool>& b,int i,int j,int k)
+{
+  for(int di=-1;di<=1;di++)
+    for(int dj=-1;dj<=1;dj++)
+      for(int dk=-1;dk<=1;dk++) {
+        int u=i+di,v=j+dj,w=k+dk;
+        if(u < 0 || u >= a.m || v < 0 || v >= a.n || w < 0 || w >= a.p) continue;
+        if(a(u,v,w) && b(u,v,w)) return true;
+      }
+  return false;
+}
+
+//the tiled voxelizers stay close to the single-sweep results: surface cells
+//differ from the old rasterizer only next to cells that both mark, and the
+//volume fills agree with the true interior away from the surface
+void Meshing::TestVoxelize()
+{
+  TriMesh mesh;
+  Real r = 0.8;
+  MakeTriSphere(24,32,r,mesh);
+  RigidTransform T;
+  T.R.setRotateY(0.3);
+  T.t.set(0.03,-0.05,0.02);
+  mesh.Transform(Matrix4(T));
+  int m=70,n=75,p=80;
+  AABB3D bb(Vector3(-1.0),Vector3(1.0));
+  Vector3 h(2.0/m,2.0/n,2.0/p);
+
+  Array3D<bool> ref(m,n,p),surface(m,n,p),surface1(m,n,p);
+  ReferenceSurfaceOccupancy(mesh,ref,bb);
+  SurfaceOccupancyGrid(mesh,surface,bb,4);
+  SurfaceOccupancyGrid(mesh,surface1,bb,1);
+  int numRef=0,numDiff=0;
+  for(int i=0;i<m;i++)
+    for(int j=0;j<n;j++)
+      for(int k=0;k<p;k++) {
+        if(surface(i,j,k) != surface1(i,j,k)) FatalError("TestVoxelize: surface cells depend on the number of threads");
+        if(ref(i,j,k)) numRef++;
+        if(ref(i,j,k) == surface(i,j,k)) continue;
+        numDiff++;
+        if(!NearCommonCell(ref,surface,i,j,k)) FatalError("TestVoxelize: surface cell %d %d %d is far from the old surface",i,j,k);
+      }
+  if(numRef == 0) FatalError("TestVoxelize: empty reference surface");
+  if(numDiff*100 > numRef) FatalError("TestVoxelize: %d of %d surface cells differ from the old rasterizer",numDiff,numRef);
+
+  Array3D<bool> shoot(m,n,p),shoot1(m,n,p),fill(m,n,p);
+  VolumeOccupancyGrid_CenterShooting(mesh,shoot,bb,0,4);
+  VolumeOccupancyGrid_CenterShooting(mesh,shoot1,bb,0,1);
+  VolumeOccupancyGrid_FloodFill(mesh,fill,bb,IntTriple(0,0,0),false,4);
+  //the mesh is inscribed in the sphere, so it may cut inside by r(1-cos(pi/24))
+  Real slack = 2.0*h.maxAbsElement() + r*(1.0-Cos(Pi/24));
+  Vector3 c,center=T.t;
+  for(int i=0;i<m;i++)
+    for(int j=0;j<n;j++)
+      for(int k=0;k<p;k++) {
+        if(shoot(i,j,k) != shoot1(i,j,k)) FatalError("TestVoxelize: center shooting depends on the number of threads");
+        c.set(bb.bmin.x+h.x*(i+0.5),bb.bmin.y+h.y*(j+0.5),bb.bmin.z+h.z*(k+0.5));
+        Real d = c.distance(center)-r;
+        if(Abs(d) < slack) continue;
+        bool inside = (d < 0);
+        if(shoot(i,j,k) != inside) FatalError("TestVoxelize: center shooting is wrong at %d %d %d",i,j,k);
+        if(fill(i,j,k) != inside) FatalError("TestVoxelize: flood fill is wrong at %d %d %d",i,j,k);
+      }
+}
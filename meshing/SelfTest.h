@@ -0,0 +1,11 @@
+#ifndef MESHING_SELF_TEST_H
+#define MESHING_SELF_TEST_H
+
+namespace Meshing {
+
+void TestMarchingCubes();
+void TestVoxelize();
+
+} //namespace Meshing
+
+#endif
@@ -11,6 +11,7 @@
 #include <geometry/primitives.h>
 #include <math/random.h>
 #include <Timer.h>
+#include <utils/threadutils.h>
 #include <list>
 #include <set>
 using namespace Geometry;
@@ -445,6 +446,43 @@ void GetTriangleCells(const Triangle3D& tri,int m,int n,int p,const AABB3D& bb,v
 
 }
 
+void GetTriangleCells(const Triangle3D& tri,int m,int n,int p,const AABB3D& bb,const IntTriple& rlo,const IntTriple& rhi,vector<IntTriple>& cells)
+{
+  cells.resize(0);
+  AABB3D query;
+  query.setPoint(tri.a);
+  query.expand(tri.b);
+  query.expand(tri.c);
+  IntTriple lo,hi;
+  bool q=QueryGrid(m,n,p,bb,query,lo,hi);
+  if(!q) return;
+  lo.a = Max(lo.a,rlo.a); lo.b = Max(lo.b,rlo.b); lo.c = Max(lo.c,rlo.c);
+  hi.a = Min(hi.a,rhi.a); hi.b = Min(hi.b,rhi.b); hi.c = Min(hi.c,rhi.c);
+  if(lo.a > hi.a || lo.b > hi.b || lo.c > hi.c) return;
+
+  //cell corners are computed from the index so that they don't depend on
+  //the range
+  AABB3D cell;
+  Vector3 cellSize = bb.bmax-bb.bmin;
+  cellSize.x /= m;
+  cellSize.y /= n;
+  cellSize.z /= p;
+  IntTriple index;
+  for(index.a=lo.a;index.a<=hi.a;index.a++) {
+    cell.bmin.x = bb.bmin.x + Real(index.a)*cellSize.x;
+    cell.bmax.x = cell.bmin.x + cellSize.x;
+    for(index.b=lo.b;index.b<=hi.b;index.b++) {
+      cell.bmin.y = bb.bmin.y + Real(index.b)*cellSize.y;
+      cell.bmax.y = cell.bmin.y + cellSize.y;
+      for(index.c=lo.c;index.c<=hi.c;index.c++) {
+        cell.bmin.z = bb.bmin.z + Real(index.c)*cellSize.z;
+        cell.bmax.z = cell.bmin.z + cellSize.z;
+        if(tri.intersects(cell)) cells.push_back(index);
+      }
+    }
+  }
+}
+
 template <class T>
 void RasterizeXYSegment(const Segment3D& s,int i,int j,const Array3D<T>& grid,const AABB3D& bb,vector<IntTriple>& cells)
 {
@@ -669,157 +707,469 @@ void GetTriangleCells2(const Triangle3D& torig,const Array3D<T>& grid,const AABB
   GetTriangleCells2(torig,grid.m,grid.n,grid.p,bb,cells);
 }
 
-void SurfaceOccupancyGrid(const TriMesh& m,Array3D<bool>& occupied,AABB3D& bb)
+//Side length (in cells) of the tiles used by the parallel voxelization
+//routines
+static const int kVoxelTileSize = 32;
+
+//Hands out task indices to worker threads one at a time, so that tiles
+//with many triangles don't hold up the others
+template <class Task>
+struct TaskQueue
 {
-  if(bb.bmin.x > bb.bmax.x || bb.bmin.y > bb.bmax.y || bb.bmin.z > bb.bmax.z)
-    FitGridToMesh(occupied,bb,m);
-  occupied.set(false);
+  TaskQueue(Task& _task,int _count) :task(_task),count(_count),next(0) {}
+  bool Pop(int& index)
+  {
+    ScopedLock lock(mutex);
+    if(next >= count) return false;
+    index = next++;
+    return true;
+  }
+
+  Task& task;
+  int count,next;
+  Mutex mutex;
+};
+
+template <class Task>
+void* TaskQueueThread(void* vdata)
+{
+  TaskQueue<Task>* queue = *reinterpret_cast<TaskQueue<Task>**>(vdata);
+  int index;
+  while(queue->Pop(index))
+    queue->task(index);
+  return NULL;
+}
+
+//Runs task(i) for all i in [0,count) on numThreads threads.  Tasks must only
+//write to disjoint parts of the output.
+template <class Task>
+void RunTasks(Task& task,int count,int numThreads)
+{
+  numThreads = Min(ThreadCount(numThreads),count);
+  if(numThreads <= 1) {
+    for(int i=0;i<count;i++) task(i);
+    return;
+  }
+  TaskQueue<Task> queue(task,count);
+  vector<TaskQueue<Task>*> data(numThreads,&queue);
+  ThreadRunAll(TaskQueueThread<Task>,data);
+}
+
+//Partition of an m x n x p grid into tiles of kVoxelTileSize^3 cells
+struct VoxelTiling
+{
+  void Init(int _m,int _n,int _p)
+  {
+    m=_m; n=_n; p=_p;
+    numTiles.set((m+kVoxelTileSize-1)/kVoxelTileSize,(n+kVoxelTileSize-1)/kVoxelTileSize,(p+kVoxelTileSize-1)/kVoxelTileSize);
+  }
+  inline int NumTiles() const { return numTiles.a*numTiles.b*numTiles.c; }
+  inline int TileIndex(int a,int b,int c) const { return (a*numTiles.b+b)*numTiles.c+c; }
+  inline int TileOf(int i,int j,int k) const { return TileIndex(i/kVoxelTileSize,j/kVoxelTileSize,k/kVoxelTileSize); }
+  //Returns the inclusive range of cells in the tile
+  void GetRange(int tile,IntTriple& lo,IntTriple& hi) const
+  {
+    lo.a = (tile/(numTiles.b*numTiles.c))*kVoxelTileSize;
+    lo.b = ((tile/numTiles.c)%numTiles.b)*kVoxelTileSize;
+    lo.c = (tile%numTiles.c)*kVoxelTileSize;
+    hi.a = Min(lo.a+kVoxelTileSize,m)-1;
+    hi.b = Min(lo.b+kVoxelTileSize,n)-1;
+    hi.c = Min(lo.c+kVoxelTileSize,p)-1;
+  }
+
+  int m,n,p;
+  IntTriple numTiles;
+};
+
+//Tiling along with the triangles whose bounding boxes overlap each tile.
+//The triangles of tile t are triangles[start[t]] ... triangles[start[t+1]-1],
+//in increasing order.
+struct TriangleTiles : public VoxelTiling
+{
+  void Build(const TriMesh& mesh,int m,int n,int p,const AABB3D& bb,int numThreads);
+
+  vector<int> start,triangles;
+  ///The tiles that overlap at least one triangle
+  vector<int> occupiedTiles;
+};
+
+struct TileBinningData
+{
+  const TriMesh* mesh;
+  const TriangleTiles* tiles;
+  const AABB3D* bb;
+  int triStart,triEnd;
+  vector<int> tileIds,triIds;
+};
+
+void* TileBinningThread(void* vdata)
+{
+  TileBinningData* data = reinterpret_cast<TileBinningData*>(vdata);
+  const TriangleTiles& tiles = *data->tiles;
   Triangle3D tri;
-  AABB3D query,cell;
-  IntTriple hi,lo;
-  for(size_t i=0;i<m.tris.size();i++) {
-    m.GetTriangle(i,tri);
+  AABB3D query;
+  IntTriple lo,hi;
+  for(int i=data->triStart;i<data->triEnd;i++) {
+    data->mesh->GetTriangle(i,tri);
     query.setPoint(tri.a);
     query.expand(tri.b);
     query.expand(tri.c);
-    bool q=QueryGrid(occupied,bb,query,lo,hi);
-    if(!q) continue;
-    //KrisLibrary::loggerWait();
-    VolumeGridIterator<bool> it(occupied,bb);
-    it.setRange(lo,hi);
-    for(;!it.isDone();++it) {
-      it.getCell(cell);
-      if(tri.intersects(cell))
-        occupied(it.index)=true;
-    }
-    /*
-    IntTriple index=lo;
-    while(index.a <= hi.a) {
-      while(index.b <= hi.b) {
-        while(index.c <= hi.c) {
-          if(!occupied(index)) {
-            GetGridCell(occupied,bb,index,cell);
-            if(tri.intersects(cell)) {
-              occupied(index)=true;
-            }
-          }
-          index.c++;
+    if(!QueryGrid(tiles.m,tiles.n,tiles.p,*data->bb,query,lo,hi)) continue;
+    for(int a=lo.a/kVoxelTileSize;a<=hi.a/kVoxelTileSize;a++)
+      for(int b=lo.b/kVoxelTileSize;b<=hi.b/kVoxelTileSize;b++)
+        for(int c=lo.c/kVoxelTileSize;c<=hi.c/kVoxelTileSize;c++) {
+          data->tileIds.push_back(tiles.TileIndex(a,b,c));
+          data->triIds.push_back(i);
         }
-        index.b++;
-        index.c = lo.c;
-      }
-      index.a++;
-      index.b = lo.b;
-    }
-    */
   }
+  return NULL;
 }
 
-void VolumeOccupancyGrid_FloodFill(const TriMesh& m,Array3D<bool>& occupied,AABB3D& bb,const IntTriple& seed,bool seedOccupied)
+void TriangleTiles::Build(const TriMesh& mesh,int _m,int _n,int _p,const AABB3D& bb,int numThreads)
+{
+  Init(_m,_n,_p);
+  //bin contiguous ranges of triangles in parallel
+  int numTris = (int)mesh.tris.size();
+  int numChunks = Max(1,Min(ThreadCount(numThreads),numTris/1024));
+  vector<TileBinningData> data(numChunks);
+  for(int i=0;i<numChunks;i++) {
+    data[i].mesh = &mesh;
+    data[i].tiles = this;
+    data[i].bb = &bb;
+    data[i].triStart = int((long long)numTris*i/numChunks);
+    data[i].triEnd = int((long long)numTris*(i+1)/numChunks);
+  }
+  ThreadRunAll(TileBinningThread,data);
+  //counting sort by tile.  The chunks are merged in order, so each tile's
+  //triangles stay sorted.
+  start.resize(0);
+  start.resize(NumTiles()+1,0);
+  for(int i=0;i<numChunks;i++)
+    for(size_t j=0;j<data[i].tileIds.size();j++)
+      start[data[i].tileIds[j]+1]++;
+  for(int t=0;t<NumTiles();t++)
+    start[t+1] += start[t];
+  triangles.resize(start.back());
+  vector<int> pos(start.begin(),start.end()-1);
+  for(int i=0;i<numChunks;i++) {
+    for(size_t j=0;j<data[i].tileIds.size();j++)
+      triangles[pos[data[i].tileIds[j]]++] = data[i].triIds[j];
+    vector<int>().swap(data[i].tileIds);
+    vector<int>().swap(data[i].triIds);
+  }
+  occupiedTiles.resize(0);
+  for(int t=0;t<NumTiles();t++)
+    if(start[t+1] > start[t]) occupiedTiles.push_back(t);
+}
+
+struct SurfaceTileTask
+{
+  void operator()(int index)
+  {
+    int tile = tiles.occupiedTiles[index];
+    IntTriple lo,hi;
+    tiles.GetRange(tile,lo,hi);
+    Triangle3D tri;
+    vector<IntTriple> cells;
+    for(int i=tiles.start[tile];i<tiles.start[tile+1];i++) {
+      mesh.GetTriangle(tiles.triangles[i],tri);
+      GetTriangleCells(tri,tiles.m,tiles.n,tiles.p,bb,lo,hi,cells);
+      for(size_t j=0;j<cells.size();j++)
+        occupied(cells[j]) = true;
+    }
+  }
+
+  const TriMesh& mesh;
+  const TriangleTiles& tiles;
+  const AABB3D& bb;
+  Array3D<bool>& occupied;
+};
+
+void SurfaceOccupancyGrid(const TriMesh& m,Array3D<bool>& occupied,AABB3D& bb,int numThreads)
 {
   if(bb.bmin.x > bb.bmax.x || bb.bmin.y > bb.bmax.y || bb.bmin.z > bb.bmax.z)
     FitGridToMesh(occupied,bb,m);
+  occupied.set(false);
+  TriangleTiles tiles;
+  tiles.Build(m,occupied.m,occupied.n,occupied.p,bb,numThreads);
+  SurfaceTileTask task = {m,tiles,bb,occupied};
+  RunTasks(task,(int)tiles.occupiedTiles.size(),numThreads);
+}
 
-  Array3D<bool> surface(occupied.m,occupied.n,occupied.p);
-  SurfaceOccupancyGrid(m,surface,bb);
-
-  occupied.set(!seedOccupied);
-  //set the surface cells to seedOccupied
-  for(int i=0;i<surface.m;i++) 
-    for(int j=0;j<surface.n;j++) 
-      for(int k=0;k<surface.p;k++) 
-        if(surface(i,j,k)) occupied(i,j,k) = seedOccupied;
-
-  bool grow = true;
-  Array3D<bool> buffer;
-  if(grow) {
-    //try to grow to fill some gaps
-    for(int i=0;i<surface.m;i++) 
-      for(int j=0;j<surface.n;j++) 
-        for(int k=0;k<surface.p;k++)
-          if(surface(i,j,k)) {
-            if(i > 1) occupied(i-1,j,k) = seedOccupied;
-            if(i+2<surface.m) occupied(i+1,j,k) = seedOccupied;
-            if(j > 1) occupied(i,j-1,k) = seedOccupied;
-            if(j+2<surface.n) occupied(i,j+1,k) = seedOccupied;
-            if(k > 1) occupied(i,j,k-1) = seedOccupied;
-            if(k+2<surface.p) occupied(i,j,k+1) = seedOccupied;
-          }
-    buffer = occupied;
+struct SurfaceCellsTask
+{
+  void operator()(int index)
+  {
+    int tile = tiles.occupiedTiles[index];
+    IntTriple lo,hi;
+    tiles.GetRange(tile,lo,hi);
+    IntTriple w(hi.a-lo.a+1,hi.b-lo.b+1,hi.c-lo.c+1);
+    vector<bool> mark(w.a*w.b*w.c,false);
+    Triangle3D tri;
+    vector<IntTriple> cells;
+    for(int i=tiles.start[tile];i<tiles.start[tile+1];i++) {
+      mesh.GetTriangle(tiles.triangles[i],tri);
+      GetTriangleCells(tri,tiles.m,tiles.n,tiles.p,bb,lo,hi,cells);
+      for(size_t j=0;j<cells.size();j++)
+        mark[((cells[j].a-lo.a)*w.b+cells[j].b-lo.b)*w.c+cells[j].c-lo.c] = true;
+    }
+    vector<IntTriple>& out = tileCells[index];
+    int l=0;
+    for(int i=lo.a;i<=hi.a;i++)
+      for(int j=lo.b;j<=hi.b;j++)
+        for(int k=lo.c;k<=hi.c;k++,l++)
+          if(mark[l]) out.push_back(IntTriple(i,j,k));
   }
 
-  list<IntTriple> queue;
-  queue.push_back(seed);
-  while(!queue.empty()) {
-    IntTriple index=queue.front();
-    queue.pop_front();
-    
-    //go to neighbors
-    index.a++;
-    if(index.a < occupied.m && occupied(index.a,index.b,index.c) != seedOccupied) {
-      occupied(index.a,index.b,index.c) = seedOccupied;
-      queue.push_back(index);
-    }
-    index.a-=2;
-    if(index.a >= 0 && occupied(index.a,index.b,index.c) != seedOccupied) {
-      occupied(index.a,index.b,index.c) = seedOccupied;
-      queue.push_back(index);
-    }
-    index.a++;
+  const TriMesh& mesh;
+  const TriangleTiles& tiles;
+  const AABB3D& bb;
+  vector<vector<IntTriple> >& tileCells;
+};
 
-    index.b++;
-    if(index.b < occupied.n && occupied(index.a,index.b,index.c) != seedOccupied) {
-      occupied(index.a,index.b,index.c) = seedOccupied;
-      queue.push_back(index);
-    }
-    index.b-=2;
-    if(index.b >= 0 && occupied(index.a,index.b,index.c) != seedOccupied) {
-      occupied(index.a,index.b,index.c) = seedOccupied;
-      queue.push_back(index);
-    }
-    index.b++;
+void SurfaceOccupancyCells(const TriMesh& mesh,int m,int n,int p,AABB3D& bb,vector<IntTriple>& cells,int numThreads)
+{
+  if(bb.bmin.x > bb.bmax.x || bb.bmin.y > bb.bmax.y || bb.bmin.z > bb.bmax.z)
+    FitGridToMesh(m,n,p,bb,mesh);
+  TriangleTiles tiles;
+  tiles.Build(mesh,m,n,p,bb,numThreads);
+  vector<vector<IntTriple> > tileCells(tiles.occupiedTiles.size());
+  SurfaceCellsTask task = {mesh,tiles,bb,tileCells};
+  RunTasks(task,(int)tiles.occupiedTiles.size(),numThreads);
+  size_t num = 0;
+  for(size_t i=0;i<tileCells.size();i++) num += tileCells[i].size();
+  cells.resize(0);
+  cells.reserve(num);
+  for(size_t i=0;i<tileCells.size();i++)
+    cells.insert(cells.end(),tileCells[i].begin(),tileCells[i].end());
+}
 
-    index.c++;
-    if(index.c < occupied.p && occupied(index.a,index.b,index.c) != seedOccupied) {
-      occupied(index.a,index.b,index.c) = seedOccupied;
-      queue.push_back(index);
-    }
-    index.c-=2;
-    if(index.c >= 0 && occupied(index.a,index.b,index.c) != seedOccupied) {
-      occupied(index.a,index.b,index.c) = seedOccupied;
-      queue.push_back(index);
+//Sets the surface cells and their non-border neighbors to seedOccupied, and
+//the rest to !seedOccupied.  Processes one x layer.
+struct GrowLayerTask
+{
+  void operator()(int i)
+  {
+    int m=surface.m,n=surface.n,p=surface.p;
+    bool xinterior = (i >= 1 && i+1 < m);
+    for(int j=0;j<n;j++) {
+      bool yinterior = (j >= 1 && j+1 < n);
+      for(int k=0;k<p;k++) {
+        bool zinterior = (k >= 1 && k+1 < p);
+        bool grown = surface(i,j,k) ||
+          (xinterior && (surface(i-1,j,k) || surface(i+1,j,k))) ||
+          (yinterior && (surface(i,j-1,k) || surface(i,j+1,k))) ||
+          (zinterior && (surface(i,j,k-1) || surface(i,j,k+1)));
+        occupied(i,j,k) = (grown ? seedOccupied : !seedOccupied);
+      }
     }
-    index.c++;
   }
 
-  if(grow) { //erode
-    if(!seedOccupied) {
-      for(int i=0;i<surface.m;i++) 
-        for(int j=0;j<surface.n;j++) 
-          for(int k=0;k<surface.p;k++)
-            if(buffer(i,j,k) == seedOccupied) occupied(i,j,k) = true;
-    }
-    surface = occupied;
-    for(int i=0;i<surface.m;i++) 
-      for(int j=0;j<surface.n;j++) 
-        for(int k=0;k<surface.p;k++) 
-          if(surface(i,j,k) == seedOccupied) {
-            if(i > 0) occupied(i-1,j,k) = seedOccupied;
-            if(i+1<surface.m) occupied(i+1,j,k) = seedOccupied;
-            if(j > 0) occupied(i,j-1,k) = seedOccupied;
-            if(j+1<surface.n) occupied(i,j+1,k) = seedOccupied;
-            if(k > 0) occupied(i,j,k-1) = seedOccupied;
-            if(k+1<surface.p) occupied(i,j,k+1) = seedOccupied;
+  const Array3D<bool>& surface;
+  Array3D<bool>& occupied;
+  bool seedOccupied;
+};
+
+//Sets the cells of one x layer that are adjacent to a seedOccupied cell of
+//src to seedOccupied
+struct DilateLayerTask
+{
+  void operator()(int i)
+  {
+    int m=src.m,n=src.n,p=src.p;
+    for(int j=0;j<n;j++)
+      for(int k=0;k<p;k++) {
+        if(src(i,j,k) == value) continue;
+        if((i > 0 && src(i-1,j,k) == value) || (i+1 < m && src(i+1,j,k) == value) ||
+           (j > 0 && src(i,j-1,k) == value) || (j+1 < n && src(i,j+1,k) == value) ||
+           (k > 0 && src(i,j,k-1) == value) || (k+1 < p && src(i,j,k+1) == value))
+          dest(i,j,k) = value;
+      }
+  }
+
+  const Array3D<bool>& src;
+  Array3D<bool>& dest;
+  bool value;
+};
+
+//Labels the connected regions of cells with occupied != value within each
+//tile.  Labels are local to the tile.
+struct LabelTileTask
+{
+  void operator()(int tile)
+  {
+    IntTriple lo,hi;
+    tiling.GetRange(tile,lo,hi);
+    const bool* occ = occupied.getData();
+    int* lab = labels.getData();
+    const int stride[3] = {occupied.n*occupied.p,occupied.p,1};
+    int count = 0;
+    vector<IntTriple> queue;
+    IntTriple index;
+    for(index.a=lo.a;index.a<=hi.a;index.a++)
+      for(index.b=lo.b;index.b<=hi.b;index.b++)
+        for(index.c=lo.c;index.c<=hi.c;index.c++) {
+          int start = index.a*stride[0]+index.b*stride[1]+index.c;
+          if(occ[start] == value || lab[start] >= 0) continue;
+          lab[start] = count;
+          queue.resize(0);
+          queue.push_back(index);
+          while(!queue.empty()) {
+            IntTriple c = queue.back();
+            queue.pop_back();
+            int cindex = c.a*stride[0]+c.b*stride[1]+c.c;
+            for(int axis=0;axis<3;axis++) {
+              if(c[axis] > lo[axis]) {
+                int nindex = cindex-stride[axis];
+                if(occ[nindex] != value && lab[nindex] < 0) {
+                  lab[nindex] = count;
+                  queue.push_back(c);
+                  queue.back()[axis]--;
+                }
+              }
+              if(c[axis] < hi[axis]) {
+                int nindex = cindex+stride[axis];
+                if(occ[nindex] != value && lab[nindex] < 0) {
+                  lab[nindex] = count;
+                  queue.push_back(c);
+                  queue.back()[axis]++;
+                }
+              }
+            }
           }
+          count++;
+        }
+    labelCounts[tile] = count;
   }
-  else {
-    if(!seedOccupied) {  //need to set surface cells
-      for(int i=0;i<surface.m;i++) 
-        for(int j=0;j<surface.n;j++) 
-          for(int k=0;k<surface.p;k++) 
-            if(surface(i,j,k)) occupied(i,j,k) = true;
+
+  const VoxelTiling& tiling;
+  const Array3D<bool>& occupied;
+  Array3D<int>& labels;
+  bool value;
+  vector<int>& labelCounts;
+};
+
+struct FillLabelsTask
+{
+  void operator()(int tile)
+  {
+    IntTriple lo,hi;
+    tiling.GetRange(tile,lo,hi);
+    const char* tileFill = &fill[labelOffsets[tile]];
+    for(int i=lo.a;i<=hi.a;i++)
+      for(int j=lo.b;j<=hi.b;j++)
+        for(int k=lo.c;k<=hi.c;k++) {
+          int l = labels(i,j,k);
+          if(l >= 0 && tileFill[l]) occupied(i,j,k) = value;
+        }
+  }
+
+  const VoxelTiling& tiling;
+  const Array3D<int>& labels;
+  const vector<int>& labelOffsets;
+  const vector<char>& fill;
+  Array3D<bool>& occupied;
+  bool value;
+};
+
+static int FindRoot(vector<int>& parent,int i)
+{
+  while(parent[i] != i) {
+    parent[i] = parent[parent[i]];
+    i = parent[i];
+  }
+  return i;
+}
+
+static void MergeLabels(vector<int>& parent,int i,int j)
+{
+  i = FindRoot(parent,i);
+  j = FindRoot(parent,j);
+  if(i < j) parent[j] = i;
+  else if(j < i) parent[i] = j;
+}
+
+//Sets all cells with occupied != value that are connected to the seed
+//through such cells to value.  Gives the same result as a breadth-first fill
+//from the seed, but regions are labeled per tile in parallel and the labels
+//are then merged across tile faces.
+static void FloodFillTiled(Array3D<bool>& occupied,const IntTriple& seed,bool value,int numThreads)
+{
+  VoxelTiling tiling;
+  tiling.Init(occupied.m,occupied.n,occupied.p);
+  Array3D<int> labels(occupied.m,occupied.n,occupied.p,-1);
+  vector<int> labelCounts(tiling.NumTiles());
+  LabelTileTask labelTask = {tiling,occupied,labels,value,labelCounts};
+  RunTasks(labelTask,tiling.NumTiles(),numThreads);
+
+  vector<int> labelOffsets(tiling.NumTiles()+1,0);
+  for(int t=0;t<tiling.NumTiles();t++)
+    labelOffsets[t+1] = labelOffsets[t]+labelCounts[t];
+  vector<int> parent(labelOffsets.back());
+  for(size_t i=0;i<parent.size();i++) parent[i] = (int)i;
+
+  //merge labels of adjacent cells on the +x,+y,+z faces of each tile
+  IntTriple lo,hi;
+  for(int t=0;t<tiling.NumTiles();t++) {
+    tiling.GetRange(t,lo,hi);
+    for(int axis=0;axis<3;axis++) {
+      if(hi[axis]+1 >= occupied.size()[axis]) continue;
+      IntTriple flo=lo,fhi=hi;
+      flo[axis] = fhi[axis] = hi[axis];
+      int nbtile = t + (axis==0 ? tiling.numTiles.b*tiling.numTiles.c : (axis==1 ? tiling.numTiles.c : 1));
+      IntTriple c,nb;
+      for(c.a=flo.a;c.a<=fhi.a;c.a++)
+        for(c.b=flo.b;c.b<=fhi.b;c.b++)
+          for(c.c=flo.c;c.c<=fhi.c;c.c++) {
+            nb = c;
+            nb[axis]++;
+            if(labels(c) < 0 || labels(nb) < 0) continue;
+            MergeLabels(parent,labelOffsets[t]+labels(c),labelOffsets[nbtile]+labels(nb));
+          }
     }
   }
+
+  //the fill starts from the neighbors of the seed
+  vector<char> fill(parent.size()+1,0);
+  vector<char> rootFilled(parent.size(),0);
+  for(int d=0;d<6;d++) {
+    IntTriple nb = seed;
+    nb[d/2] += ((d&1) ? 1 : -1);
+    if(nb.a < 0 || nb.a >= occupied.m || nb.b < 0 || nb.b >= occupied.n || nb.c < 0 || nb.c >= occupied.p) continue;
+    if(labels(nb) < 0) continue;
+    rootFilled[FindRoot(parent,labelOffsets[tiling.TileOf(nb.a,nb.b,nb.c)]+labels(nb))] = 1;
+  }
+  for(size_t i=0;i<parent.size();i++)
+    fill[i] = rootFilled[FindRoot(parent,(int)i)];
+  FillLabelsTask fillTask = {tiling,labels,labelOffsets,fill,occupied,value};
+  RunTasks(fillTask,tiling.NumTiles(),numThreads);
+}
+
+void VolumeOccupancyGrid_FloodFill(const TriMesh& m,Array3D<bool>& occupied,AABB3D& bb,const IntTriple& seed,bool seedOccupied,int numThreads)
+{
+  if(bb.bmin.x > bb.bmax.x || bb.bmin.y > bb.bmax.y || bb.bmin.z > bb.bmax.z)
+    FitGridToMesh(occupied,bb,m);
+
+  Array3D<bool> surface(occupied.m,occupied.n,occupied.p);
+  SurfaceOccupancyGrid(m,surface,bb,numThreads);
+
+  //set the surface cells to seedOccupied, and grow them to fill some gaps
+  GrowLayerTask growTask = {surface,occupied,seedOccupied};
+  RunTasks(growTask,occupied.m,numThreads);
+  Array3D<bool> buffer = occupied;
+
+  FloodFillTiled(occupied,seed,seedOccupied,numThreads);
+
+  //erode
+  if(!seedOccupied) {
+    for(int i=0;i<surface.m;i++) 
+      for(int j=0;j<surface.n;j++) 
+        for(int k=0;k<surface.p;k++)
+          if(buffer(i,j,k) == seedOccupied) occupied(i,j,k) = true;
+  }
+  surface = occupied;
+  DilateLayerTask erodeTask = {surface,occupied,seedOccupied};
+  RunTasks(erodeTask,occupied.m,numThreads);
 }
 
 void DensityEstimate_FloodFill(const TriMeshWithTopology& m,Array3D<Real>& density,AABB3D& bb,const IntTriple& seed)
@@ -915,89 +1265,168 @@ void DensityEstimate_FloodFill(const TriMeshWithTopology& m,Array3D<Real>& densi
 
 }
 
-void VolumeOccupancyGrid_CenterShooting(const TriMesh& m,Array3D<bool>& occupied,AABB3D& bb,int shootDirection)
+//Summary of the center shooting sweep of one ray across one tile.  Cells
+//before firstDetermined (relative to the tile) haven't seen a hit that
+//decides their state yet, so they take the state the ray enters the tile
+//with.
+struct ShootingSpan
 {
-  if(bb.bmin.x > bb.bmax.x || bb.bmin.y > bb.bmax.y || bb.bmin.z > bb.bmax.z)
-    FitGridToMesh(occupied,bb,m);
-
-  if(shootDirection != 0) FatalError("VolumeOccupancyGrid: can only do x direction now");
+  enum { Unknown=0, Outside=1, Inside=2 };
+  enum { NoHit=0, ExitHit=1, OtherHit=2 };
+  int firstDetermined;
+  ///State after the tile, or Unknown if no hit in the tile decides it
+  char exitState;
+  ///The kind of the first triangle hit in the tile
+  char firstHit;
+};
 
-  Ray3D ray;
-  ray.direction.setZero();
-  ray.direction[shootDirection] = 1;
+inline void ShootingHit(const Vector3& normal,int shootDirection,ShootingSpan& span,char& state)
+{
+  if(span.firstHit == ShootingSpan::NoHit)
+    span.firstHit = (normal[shootDirection] > 0 ? ShootingSpan::ExitHit : ShootingSpan::OtherHit);
+  if(normal[shootDirection] < 0)  //entering into the triangle
+    state = ShootingSpan::Inside;
+  else if(normal[shootDirection] > 0)  //exiting the triangle
+    state = ShootingSpan::Outside;
+}
 
-  Array3D<list<int> > triangleLists(occupied.m,occupied.n,occupied.p);
-  GetTriangleBuckets(m,bb,triangleLists);
-  
-  Real xscale = (bb.bmax.x-bb.bmin.x)/Real(occupied.m);
-  Triangle3D tri;
-  for(int j=0;j<occupied.n;j++) {
-    for(int k=0;k<occupied.p;k++) {
-      GetGridCellCenter(occupied,bb,IntTriple(0,j,k),ray.source);
-      ray.source.x = bb.bmin.x;
-      //parity is 1 if it's outside, -1 if inside
-      int parity = 1;
-      int numHits = 0;
-      //sweep a ray across x axis
-      for(int i=0;i<occupied.m;i++) {
-        Real startdistance = (Real(i))*xscale;
-        Real enddistance = (Real(i+1))*xscale;
-        Real centerdistance = (Real(i)+0.5)*xscale;
-        const list<int>& triangles = triangleLists(i,j,k);
-        Heap<Triangle3D,Real> entering,exiting;
-        for(list<int>::const_iterator a=triangles.begin();a!=triangles.end();a++) {
-          m.GetTriangle(*a,tri);
-          Real t,u,v;
-          if(tri.rayIntersects(ray,&t,&u,&v)) {
-            if(t >= startdistance && t < enddistance) {
-              if(t > centerdistance) exiting.push(tri,-t);
-              else entering.push(tri,-t);
+//Sweeps the rays of one tile.  Determined cells are written directly, and
+//the spans record the rest for ReconcileShootingTask.
+struct ShootTileTask
+{
+  void operator()(int index)
+  {
+    int tile = tiles.occupiedTiles[index];
+    IntTriple lo,hi;
+    tiles.GetRange(tile,lo,hi);
+    IntTriple w(hi.a-lo.a+1,hi.b-lo.b+1,hi.c-lo.c+1);
+    //bucket the triangles by (tile-local) cell
+    vector<int> cellIds,triIds,cellStart(w.a*w.b*w.c+1,0);
+    Triangle3D tri;
+    vector<IntTriple> cells;
+    for(int i=tiles.start[tile];i<tiles.start[tile+1];i++) {
+      mesh.GetTriangle(tiles.triangles[i],tri);
+      GetTriangleCells(tri,tiles.m,tiles.n,tiles.p,bb,lo,hi,cells);
+      for(size_t j=0;j<cells.size();j++) {
+        int l = ((cells[j].a-lo.a)*w.b+cells[j].b-lo.b)*w.c+cells[j].c-lo.c;
+        cellIds.push_back(l);
+        triIds.push_back(tiles.triangles[i]);
+        cellStart[l+1]++;
+      }
+    }
+    for(size_t l=0;l+1<cellStart.size();l++)
+      cellStart[l+1] += cellStart[l];
+    vector<int> cellTris(cellIds.size()),pos(cellStart.begin(),cellStart.end()-1);
+    for(size_t i=0;i<cellIds.size();i++)
+      cellTris[pos[cellIds[i]]++] = triIds[i];
+
+    Real xscale = (bb.bmax.x-bb.bmin.x)/Real(occupied.m);
+    int tilex = lo.a/kVoxelTileSize;
+    Ray3D ray;
+    ray.direction.setZero();
+    ray.direction[shootDirection] = 1;
+    for(int j=lo.b;j<=hi.b;j++) {
+      for(int k=lo.c;k<=hi.c;k++) {
+        GetGridCellCenter(occupied,bb,IntTriple(0,j,k),ray.source);
+        ray.source.x = bb.bmin.x;
+        ShootingSpan& span = spans[(tilex*occupied.n+j)*occupied.p+k];
+        char state = ShootingSpan::Unknown;
+        for(int i=lo.a;i<=hi.a;i++) {
+          Real startdistance = (Real(i))*xscale;
+          Real enddistance = (Real(i+1))*xscale;
+          Real centerdistance = (Real(i)+0.5)*xscale;
+          int l = ((i-lo.a)*w.b+j-lo.b)*w.c+k-lo.c;
+          Heap<Triangle3D,Real> entering,exiting;
+          for(int a=cellStart[l];a<cellStart[l+1];a++) {
+            mesh.GetTriangle(cellTris[a],tri);
+            Real t,u,v;
+            if(tri.rayIntersects(ray,&t,&u,&v)) {
+              if(t >= startdistance && t < enddistance) {
+                if(t > centerdistance) exiting.push(tri,-t);
+                else entering.push(tri,-t);
+              }
             }
           }
-        }
-        //take all the triangles from the entering cell face to the center
-        while(!entering.empty()) {
-          tri = entering.top(); entering.pop();
-          Vector3 n=tri.normal();
-          if(n[shootDirection] < 0) { //entering into the triangle
-            if(parity > 0)   //on outside
-              parity = -parity;
+          //take all the triangles from the entering cell face to the center
+          while(!entering.empty()) {
+            ShootingHit(entering.top().normal(),shootDirection,span,state);
+            entering.pop();
           }
-          else if(n[shootDirection] > 0) {  //exiting the triangle
-            if(parity < 0)   //on inside
-              parity = -parity;
-            else if(numHits==0) {  //first hit is on inside of triangle
-              for(int i2=0;i2<i;i2++)
-                occupied(i2,j,k) = true;
-            }
+          //set the occupation grid
+          if(state != ShootingSpan::Unknown) {
+            occupied(i,j,k) = (state == ShootingSpan::Inside);
+            if(span.firstDetermined > i-lo.a) span.firstDetermined = i-lo.a;
+          }
+          //take all the triangles from the cell center to the exiting face
+          while(!exiting.empty()) {
+            ShootingHit(exiting.top().normal(),shootDirection,span,state);
+            exiting.pop();
           }
-          numHits++;
         }
+        span.exitState = state;
+      }
+    }
+  }
 
-        //set the occupation grid
-        occupied(i,j,k) = (parity < 0);
+  const TriMesh& mesh;
+  const TriangleTiles& tiles;
+  const AABB3D& bb;
+  int shootDirection;
+  vector<ShootingSpan>& spans;
+  Array3D<bool>& occupied;
+};
 
-        //take all the triangles from the cell center to the exiting face
-        while(!exiting.empty()) {
-          tri = exiting.top(); exiting.pop();
-          Vector3 n=tri.normal();
-          if(n[shootDirection] < 0) { //entering into the triangle
-            if(parity > 0)   //on outside
-              parity = -parity;
-          }
-          else if(n[shootDirection] > 0) {  //exiting the triangle
-            if(parity < 0)   //on inside
-              parity = -parity;
-            else if(numHits==0) {  //first hit is on inside of triangle
-              for(int i2=0;i2<=i;i2++)
-                occupied(i2,j,k) = true;
-            }
-          }
-          numHits++;
+//Propagates the inside/outside state along the rays of one y layer through
+//the tiles, and fills in the undetermined cells
+struct ReconcileShootingTask
+{
+  void operator()(int j)
+  {
+    int m=occupied.m,n=occupied.n,p=occupied.p;
+    for(int k=0;k<p;k++) {
+      //if the first triangle hit by the ray is exited, the ray starts inside
+      char state = ShootingSpan::Outside;
+      for(int a=0;a<numTilesX;a++) {
+        const ShootingSpan& span = spans[(a*n+j)*p+k];
+        if(span.firstHit != ShootingSpan::NoHit) {
+          if(span.firstHit == ShootingSpan::ExitHit) state = ShootingSpan::Inside;
+          break;
         }
       }
+      for(int a=0;a<numTilesX;a++) {
+        const ShootingSpan& span = spans[(a*n+j)*p+k];
+        int start = a*kVoxelTileSize;
+        int end = Min(start+span.firstDetermined,m);
+        for(int i=start;i<end;i++)
+          occupied(i,j,k) = (state == ShootingSpan::Inside);
+        if(span.exitState != ShootingSpan::Unknown) state = span.exitState;
+      }
     }
   }
+
+  const vector<ShootingSpan>& spans;
+  int numTilesX;
+  Array3D<bool>& occupied;
+};
+
+void VolumeOccupancyGrid_CenterShooting(const TriMesh& m,Array3D<bool>& occupied,AABB3D& bb,int shootDirection,int numThreads)
+{
+  if(bb.bmin.x > bb.bmax.x || bb.bmin.y > bb.bmax.y || bb.bmin.z > bb.bmax.z)
+    FitGridToMesh(occupied,bb,m);
+
+  if(shootDirection != 0) FatalError("VolumeOccupancyGrid: can only do x direction now");
+
+  TriangleTiles tiles;
+  tiles.Build(m,occupied.m,occupied.n,occupied.p,bb,numThreads);
+  ShootingSpan empty;
+  empty.firstDetermined = kVoxelTileSize;
+  empty.exitState = ShootingSpan::Unknown;
+  empty.firstHit = ShootingSpan::NoHit;
+  vector<ShootingSpan> spans(tiles.numTiles.a*occupied.n*occupied.p,empty);
+  ShootTileTask shootTask = {m,tiles,bb,shootDirection,spans,occupied};
+  RunTasks(shootTask,(int)tiles.occupiedTiles.size(),numThreads);
+  ReconcileShootingTask reconcileTask = {spans,tiles.numTiles.a,occupied};
+  RunTasks(reconcileTask,occupied.n,numThreads);
 }
 
 void DensityEstimate_CenterShooting(const TriMesh& m,Array3D<Real>& density,AABB3D& bb,int shootDirection)
@@ -37,29 +37,57 @@ void GetTriangleCells(const Triangle3D& tri,vector<IntTriple>& cells);
  */
 void GetTriangleCells(const Triangle3D& tri,int m,int n,int p,const AABB3D& bb,vector<IntTriple>& cells);
 
+/** @ingroup Meshing
+ * @brief Same as above, but only returns the cells in the index range
+ * [lo,hi] (inclusive).  Used to rasterize a triangle into one tile of a
+ * larger grid.
+ */
+void GetTriangleCells(const Triangle3D& tri,int m,int n,int p,const AABB3D& bb,const IntTriple& lo,const IntTriple& hi,vector<IntTriple>& cells);
+
 /** @ingroup Meshing
  * @brief Sets cells of a boolean 3D grid (occupied,bb) that overlap the
  * surface of m to true.
  *
  * If bb is empty, automatically fits the bounding box to contain the mesh
  * in the non-border cells of the grid.
+ *
+ * The grid is split into tiles of 32^3 cells.  Triangles are binned into
+ * tiles and the tiles are rasterized by numThreads threads (<= 0 uses the
+ * hardware concurrency).
+ */
+void SurfaceOccupancyGrid(const TriMesh& m,Array3D<bool>& occupied,AABB3D& bb,int numThreads=0);
+
+/** @ingroup Meshing
+ * @brief Sparse version of SurfaceOccupancyGrid: returns the cells of an
+ * m x n x p grid over bb that overlap the surface of mesh, without
+ * allocating the dense grid.
+ *
+ * Cells are grouped by tile, and are in i,j,k order within each tile.  The
+ * output is the same for any number of threads.
  */
-void SurfaceOccupancyGrid(const TriMesh& m,Array3D<bool>& occupied,AABB3D& bb);
+void SurfaceOccupancyCells(const TriMesh& mesh,int m,int n,int p,AABB3D& bb,vector<IntTriple>& cells,int numThreads=0);
 
 /** @ingroup Meshing
  * @brief Sets cells of a boolean 3D grid (occupied,bb) to true
  * if the cell's center is in the interior of the mesh, and false otherwise.
  * Occupancy is determined by a flood-fill algorithm starting from the seed
  * point.
+ *
+ * The flood fill labels connected regions within each tile in parallel,
+ * then merges labels across tile boundaries.
  */
-void VolumeOccupancyGrid_FloodFill(const TriMesh& m,Array3D<bool>& occupied,AABB3D& bb,const IntTriple& seed,bool seedOccupied);
+void VolumeOccupancyGrid_FloodFill(const TriMesh& m,Array3D<bool>& occupied,AABB3D& bb,const IntTriple& seed,bool seedOccupied,int numThreads=0);
 
 /** @ingroup Meshing
  * @brief Sets cells of a boolean 3D grid (occupied,bb) to true
  * if the cell's center is in the interior of the mesh, and false otherwise. 
  * Occupancy is determined by sweeping a ray through the mesh.
+ *
+ * Rays are swept through each tile independently, in parallel, and the
+ * inside/outside state at tile boundaries is reconciled afterwards.  The
+ * result is the same as a single sweep over the whole grid.
  */
-void VolumeOccupancyGrid_CenterShooting(const TriMesh& m,Array3D<bool>& occupied,AABB3D& bb,int shootDirection=0);
+void VolumeOccupancyGrid_CenterShooting(const TriMesh& m,Array3D<bool>& occupied,AABB3D& bb,int shootDirection=0,int numThreads=0);
 
 /** @ingroup Meshing
  * @brief From one "visible" side of the grid, sweeps the visibility across
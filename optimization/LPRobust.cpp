@@ -48,6 +48,30 @@ LinearProgram::Result RobustLPSolver::Solve_NewObjective(const LinearProgram_Spa
   return SolveGLPK();
 }
 
+LinearProgram::Result RobustLPSolver::Solve_NewBounds(const LinearProgram& lp)
+{
+  if(!initialized) UpdateGLPK(lp);
+  else UpdateGLPKBounds(lp.q,lp.p,lp.l,lp.u);
+  return SolveGLPK();
+}
+
+LinearProgram::Result RobustLPSolver::Solve_NewBounds(const LinearProgram_Sparse& lp)
+{
+  if(!initialized) {
+    glpk.Set(lp);
+    initialized = true;
+  }
+  else UpdateGLPKBounds(lp.q,lp.p,lp.l,lp.u);
+  return SolveGLPK();
+}
+
+void RobustLPSolver::UpdateGLPKBounds(const Vector& q,const Vector& p,const Vector& l,const Vector& u)
+{
+  for(int i=0;i<q.n;i++)
+    glpk.SetRowBounds(i,q(i),p(i));
+  for(int j=0;j<l.n;j++)
+    glpk.SetVariableBounds(j,l(j),u(j));
+}
 
 void RobustLPSolver::UpdateGLPK(const LinearProgram& lp)
 {
@@ -18,7 +18,13 @@ struct RobustLPSolver
   LinearProgram::Result Solve(const LinearProgram_Sparse& lp);
   LinearProgram::Result Solve_NewObjective(const LinearProgram& lp);
   LinearProgram::Result Solve_NewObjective(const LinearProgram_Sparse& lp);
+  ///Solves an LP that differs from the last one solved only in its
+  ///constraint and variable bounds.  The solver's current basis (and its
+  ///factorization) is kept as a warm start.
+  LinearProgram::Result Solve_NewBounds(const LinearProgram& lp);
+  LinearProgram::Result Solve_NewBounds(const LinearProgram_Sparse& lp);
   void UpdateGLPK(const LinearProgram& lp);
+  void UpdateGLPKBounds(const Vector& q,const Vector& p,const Vector& l,const Vector& u);
   LinearProgram::Result SolveGLPK();
 
   GLPKInterface glpk;
@@ -5,14 +5,20 @@
 #include <math/SVDecomposition.h>
 #include <math/VectorPrinter.h>
 #include <math/MatrixPrinter.h>
+#include <math/SparseLDL.h>
 #include <errors.h>
 #include <iostream>
+#include <algorithm>
 using namespace Optimization;
 using namespace std;
 using namespace Math;
 
 #define kMaxIters_Outer   30
 #define kMaxIters_Inner   10
+//the Newton system is solved with a sparse factorization if A has at least
+//this many columns, and H=A^t*D*A has at most this fraction of nonzeros
+#define kSparseMinVariables 100
+#define kSparseMaxDensity 0.1
 
 struct HConditioner : public Conditioner_SymmDiag
 {
@@ -30,8 +36,106 @@ void ConditionMatrix(Matrix& A,Real relZeroTolerance=1e-8)
       if(Abs(A(i,j)) <= relZero) A(i,j)=Zero;
 }
 
+//Assembles H = A^t*diag(d)^2*A in compressed column form for a sparse A.
+//Only the upper triangle of H is stored.  Each pair of entries in a row of
+//A contributes to one entry of H, whose index is computed once in Init().
+struct SparseNormalEquations
+{
+  //returns false if H would be too dense to be worth it
+  bool Init(const Matrix& A,Real maxDensity)
+  {
+    rowStart.resize(A.m+1);
+    cols.resize(0);
+    vals.resize(0);
+    size_t numPairs = 0;
+    for(int i=0;i<A.m;i++) {
+      rowStart[i] = (int)cols.size();
+      for(int j=0;j<A.n;j++)
+        if(A(i,j) != 0) {
+          cols.push_back(j);
+          vals.push_back(A(i,j));
+        }
+      size_t k = cols.size()-rowStart[i];
+      numPairs += k*(k+1)/2;
+    }
+    rowStart[A.m] = (int)cols.size();
+    if(Real(numPairs) > maxDensity*Real(A.n)*Real(A.n+1)*0.5) return false;
+
+    //pattern of H: (row,col) pairs with row <= col, sorted by column
+    vector<pair<int,int> > entries;
+    entries.reserve(numPairs);
+    for(int i=0;i<A.m;i++)
+      for(int a=rowStart[i];a<rowStart[i+1];a++)
+        for(int b=a;b<rowStart[i+1];b++)
+          entries.push_back(pair<int,int>(cols[b],cols[a]));
+    sort(entries.begin(),entries.end());
+    entries.erase(unique(entries.begin(),entries.end()),entries.end());
+    if(Real(entries.size()) > maxDensity*Real(A.n)*Real(A.n+1)*0.5) return false;
+    H.initialize(A.n,A.n,(int)entries.size());
+    for(size_t k=0;k<entries.size();k++) {
+      H.col_offsets[entries[k].first+1]++;
+      H.row_indices[k] = entries[k].second;
+    }
+    for(int j=0;j<A.n;j++) H.col_offsets[j+1] += H.col_offsets[j];
+    target.resize(numPairs);
+    size_t k=0;
+    for(int i=0;i<A.m;i++)
+      for(int a=rowStart[i];a<rowStart[i+1];a++)
+        for(int b=a;b<rowStart[i+1];b++,k++)
+          target[k] = (int)(H.getEntry(cols[a],cols[b]) - &H.val_array[0]);
+    diag.resize(A.n);
+    for(int j=0;j<A.n;j++) {
+      Real* hjj = H.getEntry(j,j);
+      diag[j] = (hjj ? (int)(hjj - &H.val_array[0]) : -1);
+    }
+    return true;
+  }
+
+  void Compute(const Vector& d)
+  {
+    fill(H.val_array.begin(),H.val_array.end(),0.0);
+    size_t k=0;
+    for(size_t i=0;i+1<rowStart.size();i++) {
+      Real d2 = Sqr(d(i));
+      for(int a=rowStart[i];a<rowStart[i+1];a++) {
+        Real da = d2*vals[a];
+        for(int b=a;b<rowStart[i+1];b++,k++)
+          H.val_array[target[k]] += da*vals[b];
+      }
+    }
+  }
+
+  //Same scaling as HConditioner: H <- S^-1 H S^-1 and g <- S^-1 g with
+  //S = sqrt(|diag(H)|).  The solution must be passed through Post().
+  void NormalizeDiagonal(Vector& g)
+  {
+    S.resize(H.n);
+    for(int j=0;j<H.n;j++) {
+      Real hjj = (diag[j] >= 0 ? Abs(H.val_array[diag[j]]) : Zero);
+      S(j) = (hjj == Zero ? One : Sqrt(hjj));
+    }
+    for(int j=0;j<H.n;j++)
+      for(int k=H.col_offsets[j];k<H.col_offsets[j+1];k++)
+        H.val_array[k] /= S(H.row_indices[k])*S(j);
+    for(int i=0;i<g.n;i++) g(i) /= S(i);
+  }
+
+  void Post(Vector& x) const
+  {
+    for(int i=0;i<x.n;i++) x(i) /= S(i);
+  }
+
+  vector<int> rowStart,cols;
+  vector<Real> vals;
+  vector<int> target;
+  vector<int> diag;  //index of H(j,j) in H.val_array, or -1 if not present
+  Vector S;
+  SparseMatrixTemplate_CC<Real> H;
+};
+
 LP_InteriorPointSolver::LP_InteriorPointSolver()
-  :tol_zero(1e-5),tol_inner(1e-7),tol_outer(1e-5), objectiveBreak(-dInf)
+  :tol_zero(1e-5),tol_inner(1e-7),tol_outer(1e-5), objectiveBreak(-dInf),
+   sparseMinVariables(kSparseMinVariables)
 {}
 
 void LP_InteriorPointSolver::SetInitialPoint(const Vector& _x0)
@@ -73,6 +177,7 @@ bool LP_InteriorPointSolver::FindFeasiblePoint()
 	if (verbose>=2) LOG4CXX_INFO(KrisLibrary::logger(), " - create feasibility problem LP" << "\n");
 	lp.SetObjectiveBreak(0);
 	lp.verbose = verbose;
+	lp.sparseMinVariables = sparseMinVariables;
 	
 	if (verbose>=2) LOG4CXX_INFO(KrisLibrary::logger(), " - solve feasibility problem LP" << "\n");
 	bool res = (lp.Solve()!=Infeasible);
@@ -139,6 +244,12 @@ LP_InteriorPointSolver::Result LP_InteriorPointSolver::Solve()
   Vector g;
   Vector dx;
   Vector xcur;
+  //for sparse A, H has a fixed pattern, so the ordering and symbolic
+  //factorization are done once
+  SparseNormalEquations sparseH;
+  SparseLDLDecomposition<Real> sparseLDL;
+  bool useSparse = (A.n >= sparseMinVariables && sparseH.Init(A,kSparseMaxDensity));
+  if(useSparse) sparseLDL.analyze(sparseH.H);
   //LOG4CXX_INFO(KrisLibrary::logger(),"A is "<<MatrixPrinter(A)<<"\n");
   //LOG4CXX_INFO(KrisLibrary::logger(),"b is "<<VectorPrinter(b));
   //KrisLibrary::loggerWait();
@@ -186,42 +297,57 @@ LP_InteriorPointSolver::Result LP_InteriorPointSolver::Solve()
       //d = (bineq-Aineq*xopt)^-1 component-wise
       A.mul(xopt,d);  d.inplaceNegative();  d += p;
       d.inplacePseudoInverse();
-      //Hsub = diag(d)*Aineq
-      d.preMultiply(A,Hsub);
-      //H = Hsub'*Hsub
-      H.mulTransposeA(Hsub,Hsub);		
 
       //g = Aineq'*d+t*c	
       A.mulTranspose(d,g);
       g.madd(c,t);
-      Matrix Htemp=H;
-      Vector gtemp=g;
-      // Solve the system to find Newton direction
-      // Try using a better numerically conditioned matrix
-      HConditioner Hinv(Htemp,gtemp);
-      //if(!Hinv.Solve_SVD(dx)) {
-      if(!Hinv.Solve_Cholesky(dx)) {
-	RobustSVD<Real> svd;
-	if(svd.set(Hinv.A)) {
-	  svd.backSub(Hinv.b,dx);
-	  if(verbose >= 1) LOG4CXX_INFO(KrisLibrary::logger(),"Solved by SVD");
-	  if(verbose >= 2) {
-	    LOG4CXX_INFO(KrisLibrary::logger(),"Singular values "<<svd.svd.W);
-	    LOG4CXX_INFO(KrisLibrary::logger(),"b "<<Hinv.b);
-	    KrisLibrary::loggerWait();
-	  }
-	}
-	else {
-	  if(verbose >= 1) {
-	    //LOG4CXX_INFO(KrisLibrary::logger(),"H Matrix "); H.print();
-	    //LOG4CXX_INFO(KrisLibrary::logger(),"Scale is "); Hinv.S.print();
-	    LOG4CXX_INFO(KrisLibrary::logger(),"Scaled H Matrix "<<MatrixPrinter(Hinv.A)<<"\n");
-	    LOG4CXX_ERROR(KrisLibrary::logger(),"LP: Error performing H^-1*g!");
-	  }
-	  return Error;
-	}
+      bool solved = false;
+      if(useSparse) {
+        sparseH.Compute(d);
+        Vector gtemp=g;
+        sparseH.NormalizeDiagonal(gtemp);
+        if(sparseLDL.factor(sparseH.H)) {
+          sparseLDL.backSub(gtemp,dx);
+          sparseH.Post(dx);
+          solved = IsFinite(dx);
+        }
+        if(!solved && verbose >= 1) LOG4CXX_INFO(KrisLibrary::logger(),"LP: sparse factorization failed, falling back to dense");
+      }
+      if(!solved) {
+        //Hsub = diag(d)*Aineq
+        d.preMultiply(A,Hsub);
+        //H = Hsub'*Hsub
+        H.mulTransposeA(Hsub,Hsub);		
+
+        Matrix Htemp=H;
+        Vector gtemp=g;
+        // Solve the system to find Newton direction
+        // Try using a better numerically conditioned matrix
+        HConditioner Hinv(Htemp,gtemp);
+        //if(!Hinv.Solve_SVD(dx)) {
+        if(!Hinv.Solve_Cholesky(dx)) {
+          RobustSVD<Real> svd;
+          if(svd.set(Hinv.A)) {
+            svd.backSub(Hinv.b,dx);
+            if(verbose >= 1) LOG4CXX_INFO(KrisLibrary::logger(),"Solved by SVD");
+            if(verbose >= 2) {
+              LOG4CXX_INFO(KrisLibrary::logger(),"Singular values "<<svd.svd.W);
+              LOG4CXX_INFO(KrisLibrary::logger(),"b "<<Hinv.b);
+              KrisLibrary::loggerWait();
+            }
+          }
+          else {
+            if(verbose >= 1) {
+              //LOG4CXX_INFO(KrisLibrary::logger(),"H Matrix "); H.print();
+              //LOG4CXX_INFO(KrisLibrary::logger(),"Scale is "); Hinv.S.print();
+              LOG4CXX_INFO(KrisLibrary::logger(),"Scaled H Matrix "<<MatrixPrinter(Hinv.A)<<"\n");
+              LOG4CXX_ERROR(KrisLibrary::logger(),"LP: Error performing H^-1*g!");
+            }
+            return Error;
+          }
+        }
+        Hinv.Post(dx);
       }
-      Hinv.Post(dx);
       //KrisLibrary::loggerWait();
 
       dx.inplaceNegative();
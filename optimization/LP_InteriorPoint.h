@@ -38,6 +38,7 @@ public:
 
   double tol_zero, tol_inner, tol_outer;
   double objectiveBreak;   //stop when f'*x < objectiveBreak
+  int sparseMinVariables;  //use a sparse Newton solve if A has this many columns
   int verbose;
 
 private:
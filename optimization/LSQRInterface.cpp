@@ -7,30 +7,35 @@ using namespace std;
 
 struct SparseMatrixMultiplier : public lsqr_func
 {
-  SparseMatrixMultiplier(const dSparseMatrix_RM& _A) :A(_A) { }
+  SparseMatrixMultiplier(const dSparseMatrix_CR& _A,int _numThreads) :A(_A),numThreads(_numThreads) { }
 
   /* compute  y = y + A*x*/
   virtual void MatrixVectorProduct (const dVector& x, dVector& y)
   {
-    A.madd(x,y);
+    A.madd(x,y,numThreads);
   }
   /* compute  x = x + At*y*/
   virtual void MatrixTransposeVectorProduct (dVector& x, const dVector& y)
   {
-    A.maddTranspose(y,x);
+    A.maddTranspose(y,x,numThreads);
   }
 
-  const dSparseMatrix_RM& A;
+  const dSparseMatrix_CR& A;
+  int numThreads;
 };
 
 LSQRInterface::LSQRInterface()
-  :dampValue(0),relError(0),condLimit(0),maxIters(0),verbose(1)
+  :dampValue(0),relError(0),condLimit(0),maxIters(0),verbose(1),numThreads(0)
 {}
 
 bool LSQRInterface::Solve(const SparseMatrix& A,const Vector& b)
 {
-  dSparseMatrix_RM dA; dA.copy(A);
-  SparseMatrixMultiplier func(dA);
+  //the products are the bulk of the work; the compressed row form is much
+  //faster to traverse than the row maps, and is multithreaded
+  dSparseMatrix_RM dRM; dRM.copy(A);
+  dSparseMatrix_CR dA; dA.set(dRM);
+  dA.buildTransposeIndex();
+  SparseMatrixMultiplier func(dA,numThreads);
   lsqr_input input;
   lsqr_work work;
   lsqr_output output;
@@ -23,6 +23,7 @@ struct LSQRInterface
   Real condLimit;  ///<stop if the estimated condition number of A exceeds condLim
   int maxIters;    ///<maximum number of iterations, set to 0 to use default value
   int verbose;     ///<0 - no output printed, 1 - output to stdout, 2 - output to stderr
+  int numThreads;  ///<threads used for the products with A; <= 0 uses the hardware concurrency
 
   //output quantities
   Vector x;        ///<the solution vector
@@ -9,6 +9,7 @@
 #include <math/indexing.h>
 #include <math/sparsefunction.h>
 #include <math/MatrixPrinter.h>
+#include <math/VectorExpression.h>
 #include <iostream>
 #include "LPRobust.h"
 //#include "LSQRInterface.h"
@@ -105,13 +106,13 @@ ConvergenceResult MinimizationProblem::SolveCG(int& iters)
     dgg=gg=0.0;
     gg = g.normSquared();
     //NOTE: Polak-Ribiere, comment out grad.dot(g) for Fletcher-Reeves
-    dgg = grad.normSquared() + grad.dot(g); 
+    dgg = dot(Expr(grad),Expr(grad)+g);
     if (Sqrt(gg) < tolgrad ) {  //gradient exactly zero, return
       return ConvergenceF;
     }
     gam=Max(dgg/gg,0.0);
     g.setNegative(grad);
-    grad = g; grad.madd(h,gam);
+    Evaluate(grad,Expr(g)+gam*Expr(h));
     h=grad;
   }
   return MaxItersReached;
@@ -317,7 +318,7 @@ ConvergenceResult MinimizationProblem::LineMinimizationStep(const Vector& dx,Rea
       return ConvergenceX;
     }
 
-    x = x0;   x.madd(dx,t);
+    Evaluate(x,Expr(x0)+t*Expr(dx));
     fx = (*f)(x);
     if(fx < fx0-ALF*Abs(t)*slope) break; //ensure sufficient function decrease
     t *= 0.5;
@@ -773,7 +774,7 @@ ConvergenceResult ConstrainedMinimizationProblem::StepTR(Real R)
       Vector xold=x;
       int numSteps=0;
       while(alpha > 1e-3) {
-	x=xold; x.madd(lps.xopt,alpha);
+	Evaluate(x,Expr(xold)+alpha*Expr(lps.xopt));
 	(*C)(x,cx);
 	(*D)(x,dx);
 	fx = (*f)(x);
@@ -954,7 +955,7 @@ ConvergenceResult ConstrainedMinimizationProblem::StepTR(Real R)
 	Real alpha = One;
 	Vector x0=x;
 	while(alpha > 1e-4) {
-	  x = x0; x.madd(lps.xopt,alpha);
+	  Evaluate(x,Expr(x0)+alpha*Expr(lps.xopt));
 	  (*C)(x,cx);
 	  (*D)(x,dx);
 	  fx = (*f)(x);
@@ -990,7 +991,7 @@ ConvergenceResult ConstrainedMinimizationProblem::StepTR(Real R)
       Vector xold=x;
       int numSteps=0;
       while(alpha > 1e-3) {
-	x=xold; x.madd(lps.xopt,alpha);
+	Evaluate(x,Expr(xold)+alpha*Expr(lps.xopt));
 	(*C)(x,cx);
 	(*D)(x,dx);
 	fx = (*f)(x);
@@ -1101,7 +1102,7 @@ ConvergenceResult ConstrainedMinimizationProblem::LineMinimizationStep(const Vec
       x = x0; alpha0 = 0;
       return ConvergenceX;
     }
-    x = x0; x.madd(dx,t);
+    Evaluate(x,Expr(x0)+t*Expr(dx));
     for(int i=0;i<x.n;i++)
       if(IsNaN(x(i))) {
 	LOG4CXX_ERROR(KrisLibrary::logger(),"ConstrainedMinimizationProblem: x is NaN!");
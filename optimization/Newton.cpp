@@ -8,6 +8,7 @@
 #include <math/sparsefunction.h>
 #include <math/MatrixPrinter.h>
 #include <math/VectorPrinter.h>
+#include <math/VectorExpression.h>
 #include "MinNormProblem.h"
 #include "LSQRInterface.h"
 #include <iostream>
@@ -56,9 +57,10 @@ Real InequalityMargin(VectorFieldFunction* c,const Vector& x,int* index)
 
 NewtonRoot::NewtonRoot(VectorFieldFunction* _func)
   :func(_func),tolf(1e-4),tolmin(1e-6),tolx(1e-7),stepMax(10),lambda(0.01),
-   sparse(false),
+   sparse(false),matrixFree(false),
    verbose(0),debug(0)
 {
+  krylov.tolerance = 1e-4;
 }
 
 NewtonRoot::~NewtonRoot()
@@ -341,14 +343,18 @@ ConvergenceResult NewtonRoot::Solve_Sparse(int& iters)
 {
   int m=func->NumDimensions();
   fx.resize(m);
-  SparseVectorFunction* sf;
-  try {
-    sf=dynamic_cast<SparseVectorFunction*>(func);
-  }
-  catch(exception& e) {
-    FatalError("Could not cast VectorFieldFunctions to sparse, exception %s",e.what());    
+  bool jacobianFree = (matrixFree && m == x.n);
+  SparseVectorFunction* sf=NULL;
+  if(!jacobianFree) {
+    try {
+      sf=dynamic_cast<SparseVectorFunction*>(func);
+    }
+    catch(exception& e) {
+      FatalError("Could not cast VectorFieldFunctions to sparse, exception %s",e.what());    
+    }
   }
   SparseMatrix A(m,x.n);
+  Vector rhs,Jp;
 
   if(bmin.n!=0) AABBClamp(x,bmin,bmax);
 
@@ -363,30 +369,56 @@ ConvergenceResult NewtonRoot::Solve_Sparse(int& iters)
   Real stpmax= stepMax*Max(x.norm(),(Real)x.n);
   int maxIters = iters;
   for (iters=0;iters<maxIters;iters++) { 
-    sf->Jacobian_Sparse(x,A);
-    A.mulTranspose(fx,g);
-    xold.copy(x);
-
-    //if x at the bounds, examine descent direction, set those directions
-    //to be constrained
-    if(bmin.n != 0) {
-      for(int i=0;i<x.n;i++) {
-	if(x(i) == bmin(i) && g(i) > 0) {
-	  for(int j=0;j<A.m;j++)
-	    A.rows[j].erase(i);
-	}
-	if(x(i) == bmax(i) && g(i) < 0) {
-	  for(int j=0;j<A.m;j++)
-	    A.rows[j].erase(i);
-	}
+    if(jacobianFree) {
+      //inexact Newton step J p = -f(x), warm-started from the last step
+      JacobianVectorOperator J(func,x,fx);
+      rhs.setNegative(fx);
+      krylov.Solve(J,rhs,p);
+      if(!IsFinite(p)) {
+        LOG4CXX_INFO(KrisLibrary::logger(),"NewtonRoot::Solve_Sparse: Krylov solver returned a non-finite step\n");
+        return ConvergenceError;
+      }
+      //don't step out of the active bounds
+      if(bmin.n != 0) {
+        for(int i=0;i<x.n;i++)
+          if((x(i) == bmin(i) && p(i) < 0) || (x(i) == bmax(i) && p(i) > 0)) p(i) = 0;
       }
+      //J^t f isn't available, so the line search uses the component of
+      //the gradient along p, whose slope is f.(Jp)
+      Jp.clear();
+      J.Mul(p,Jp);
+      Real pnorm2 = p.normSquared();
+      g.clear();
+      g.resize(x.n,Zero);
+      if(pnorm2 > 0) g.mul(p,fx.dot(Jp)/pnorm2);
+      xold.copy(x);
     }
+    else {
+      sf->Jacobian_Sparse(x,A);
+      A.mulTranspose(fx,g);
+      xold.copy(x);
 
-    if(!SolveUnderconstrainedLS(A,fx,p)) {
-      LOG4CXX_INFO(KrisLibrary::logger(),"NewtonRoot::Solve: Unable to compute pseudoinverse of sparse matrix\n");
-      return ConvergenceError;
+      //if x at the bounds, examine descent direction, set those directions
+      //to be constrained
+      if(bmin.n != 0) {
+        for(int i=0;i<x.n;i++) {
+          if(x(i) == bmin(i) && g(i) > 0) {
+            for(int j=0;j<A.m;j++)
+              A.rows[j].erase(i);
+          }
+          if(x(i) == bmax(i) && g(i) < 0) {
+            for(int j=0;j<A.m;j++)
+              A.rows[j].erase(i);
+          }
+        }
+      }
+
+      if(!SolveUnderconstrainedLS(A,fx,p)) {
+        LOG4CXX_INFO(KrisLibrary::logger(),"NewtonRoot::Solve: Unable to compute pseudoinverse of sparse matrix\n");
+        return ConvergenceError;
+      }
+      p.inplaceNegative();
     }
-    p.inplaceNegative();
     Real sum = p.norm();  //Scale if attempted step is too big
     if (sum > stpmax) p.inplaceMul(stpmax/sum);
     check = LineMinimization(g,p,&f); //lnsrch returns new x and f. It also calculates fx at the new x when it calls Merit()
@@ -493,8 +525,8 @@ bool NewtonRoot::LineMinimization(const Vector& g, const Vector& p, Real *f)
   Real alamin=tolx/test;
   Real alam=1.0,alam2;
   for (;;) { //Start of iteration loop.
-    x.copy(xold); x.madd(p,alam);
-    if(!biasDir.empty()) x.madd(biasDir,alam);
+    if(biasDir.empty()) Evaluate(x,Expr(xold)+alam*Expr(p));
+    else Evaluate(x,Expr(xold)+alam*(Expr(p)+biasDir));
     if(bmin.n!=0) {
       AABBClamp(x,bmin,bmax);
     }
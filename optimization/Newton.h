@@ -4,6 +4,7 @@
 #include <KrisLibrary/math/function.h>
 #include <KrisLibrary/math/root.h>
 #include <KrisLibrary/math/SVDecomposition.h>
+#include <KrisLibrary/math/KrylovSolver.h>
 #include <vector>
 
 namespace Math {
@@ -20,6 +21,11 @@ using namespace Math;
  *
  * Can use sparse methods for solving for a SparseVectorFieldFunction if
  * sparse = true.  However, cannot use the bias-vector option.
+ *
+ * If matrixFree = true as well, and the system is square, the Jacobian
+ * is not formed at all: each step solves J p = -f(x) with the Krylov
+ * solver krylov, using finite-difference Jacobian-vector products, and
+ * func needn't be a SparseVectorFieldFunction.
  */
 class NewtonRoot
 {
@@ -42,6 +48,8 @@ public:
   Real lambda;   ///< damped-least-squares constant 
   Vector bmin,bmax; ///< optional bound constraints
   bool sparse;   ///< set to true if should use a sparse least-squares solver. 
+  bool matrixFree;  ///< with sparse, use Jacobian-free Newton-Krylov steps for square systems
+  KrylovSolver krylov;  ///< solver for the matrix-free steps (GMRES, tolerance 1e-4)
   Vector bias;   ///< set this to a bias vector to solve for min ||x-bias|| s.t. func(x)=0
   int verbose;
   int debug;
@@ -6,11 +6,14 @@
 #include "QuadraticProgram.h"
 //#include "QPActiveSetSolver.h"
 #include "LSQRInterface.h"
+#include "LP_InteriorPoint.h"
+#include "Newton.h"
 #include <iostream>
 #include <math/vectorfunction.h>
 #include <math/MatrixPrinter.h>
 #include <math/VectorPrinter.h>
 #include <math/linalgebra.h>
+#include <math/metric.h>
 #include <math/random.h>
 using namespace std;
 
@@ -121,6 +124,38 @@ namespace Optimization {
     LOG4CXX_INFO(KrisLibrary::logger(),"done.");
   }
 
+  //a discretized 1D reaction-diffusion equation, 2.5x_i + 0.1x_i^3 - x_{i-1} - x_{i+1} = 1
+  struct ReactionDiffusionFunction : public VectorFieldFunction
+  {
+    ReactionDiffusionFunction(int _n) : n(_n) {}
+    virtual int NumDimensions() const { return n; }
+    virtual void Eval(const Vector& x,Vector& v)
+    {
+      for(int i=0;i<n;i++) {
+        v(i) = 2.5*x(i) + 0.1*x(i)*x(i)*x(i) - One;
+        if(i > 0) v(i) -= x(i-1);
+        if(i+1 < n) v(i) -= x(i+1);
+      }
+    }
+    int n;
+  };
+
+  void NewtonMatrixFreeSelfTest()
+  {
+    LOG4CXX_INFO(KrisLibrary::logger(),"Testing Jacobian-free Newton solver...");
+    ReactionDiffusionFunction f(100);
+    NewtonRoot newton(&f);
+    newton.sparse = true;
+    newton.matrixFree = true;
+    newton.tolf = 1e-8;
+    newton.x.resize(f.n,Zero);
+    int iters=50;
+    ConvergenceResult res=newton.Solve_Sparse(iters);
+    LOG4CXX_INFO(KrisLibrary::logger(),"Result "<<res<<" iters "<<iters<<", residual "<<newton.MaxDistance(newton.x));
+    Assert(res == ConvergenceF);
+    Assert(newton.MaxDistance(newton.x) < 1e-8);
+  }
+
   void NewtonInequalitySelfTest()
   {
     LOG4CXX_INFO(KrisLibrary::logger(),"Testing inequality-constrained Newton solver...");
@@ -307,6 +342,41 @@ struct RosenbrockFunction : public ScalarFieldFunction
   }
 };
 
+//Badly scaled box constraints with a chain of coupling constraints, large
+//enough that LP_InteriorPointSolver takes the sparse Newton solve.  The
+//result must match the dense solve.
+void LPInteriorPointSelfTest()
+{
+  int n=120;
+  LP_InteriorPointSolver lp;
+  lp.Resize(3*n-1,n);
+  lp.A.setZero();
+  for(int i=0;i<n;i++) {
+    Real s = Pow(10.0,Rand(-2,2));
+    lp.A(2*i,i) = s;  lp.p(2*i) = s*Rand(0.5,1.0);
+    lp.A(2*i+1,i) = -s;  lp.p(2*i+1) = s*Rand(0.5,1.0);
+    lp.c(i) = Rand(-1,1);
+  }
+  for(int i=0;i+1<n;i++) {
+    lp.A(2*n+i,i) = 1;  lp.A(2*n+i,i+1) = 1;  lp.p(2*n+i) = 1;
+  }
+  lp.verbose = 0;
+  Vector x0(n,Zero);
+  lp.SetInitialPoint(x0);
+  LP_InteriorPointSolver::Result res = lp.Solve();
+  if(res != LP_InteriorPointSolver::Optimal) FatalError("Sparse LP_InteriorPointSolver failed, result %d",res);
+  Vector xsparse = lp.GetOptimum();
+
+  lp.sparseMinVariables = n+1;
+  lp.SetInitialPoint(x0);
+  res = lp.Solve();
+  if(res != LP_InteriorPointSolver::Optimal) FatalError("Dense LP_InteriorPointSolver failed, result %d",res);
+  const Vector& xdense = lp.GetOptimum();
+  LOG4CXX_INFO(KrisLibrary::logger(),"LP sparse vs dense: max difference "<<Distance_LInf(xsparse,xdense)<<", objectives "<<lp.c.dot(xsparse)<<" "<<lp.c.dot(xdense));
+  if(!xsparse.isEqual(xdense,1e-4)) FatalError("Sparse and dense LP_InteriorPointSolver results differ");
+  if(!lp.SatisfiesInequalities(xsparse)) FatalError("Sparse LP_InteriorPointSolver result is infeasible");
+}
+
 void MinimizationSelfTest()
 {
   RosenbrockFunction f;
@@ -345,6 +415,8 @@ void MinimizationSelfTest()
   void SelfTest()
   {
     //LSQRSelfTest();
+    NewtonMatrixFreeSelfTest();
+    LPInteriorPointSelfTest();
     QPSelfTest();
     //LCPSelfTest();
     //NewtonInequalitySelfTest();
@@ -0,0 +1,191 @@
+#include <KrisLibrary/Logger.h>
+#include "BatchedKinematics.h"
+#include <KrisLibrary/utils/threadutils.h>
+#include <errors.h>
+using namespace std;
+
+//number of configurations processed together per link
+static const int kFKBlock = 64;
+//don't split batches into pieces smaller than this
+static const int kFKMinPerThread = 256;
+
+BatchedFrames::BatchedFrames()
+  :numLinks(0),size(0)
+{}
+
+void BatchedFrames::resize(int _numLinks,int _size)
+{
+  numLinks = _numLinks;
+  size = _size;
+  data.resize(numLinks*12*size);
+}
+
+void BatchedFrames::get(int k,int link,Frame3D& T) const
+{
+  for(int j=0;j<3;j++)
+    for(int i=0;i<3;i++)
+      T.R(i,j) = component(link,3*j+i)[k];
+  T.t.set(component(link,9)[k],component(link,10)[k],component(link,11)[k]);
+}
+
+//The transform of link i relative to its parent, T0_Parent*T(i->i)(q),
+//written so that its components are linear in (1,cos,sin) of the joint
+//angle (revolute) or in (1,q) (prismatic):
+//  R = B0 + cos(s*q)*B1 + sin(s*q)*B2,  t = t0 + q*tq
+struct LinkFKConstants
+{
+  int parent;
+  bool revolute;
+  Real scale;        //|w| for revolute joints
+  Real B0[9],B1[9],B2[9];
+  Real t0[3],tq[3];
+};
+
+static void GetLinkFKConstants(const RobotLink3D& link,int parent,LinkFKConstants& c)
+{
+  c.parent = parent;
+  const Matrix3& R0 = link.T0_Parent.R;
+  Matrix3 B0,B1,B2;
+  if(link.type == RobotLink3D::Revolute) {
+    //Rodrigues: R(u,a) = uu^t + cos(a)(I-uu^t) + sin(a)[u]
+    c.revolute = true;
+    c.scale = link.w.norm();
+    Vector3 u = (c.scale > 0 ? link.w/c.scale : Vector3(0.0));
+    Matrix3 W,K;
+    W.setOuterProduct(u,u);
+    K.setCrossProduct(u);
+    B0.mul(R0,W);
+    B1.sub(R0,B0);
+    B2.mul(R0,K);
+    link.T0_Parent.t.get(c.t0);
+    Vector3(0.0).get(c.tq);
+  }
+  else {
+    c.revolute = false;
+    c.scale = 1;
+    B0 = R0;
+    B1.setZero();
+    B2.setZero();
+    link.T0_Parent.t.get(c.t0);
+    (R0*link.w).get(c.tq);
+  }
+  for(int j=0;j<3;j++)
+    for(int i=0;i<3;i++) {
+      c.B0[3*j+i] = B0(i,j);
+      c.B1[3*j+i] = B1(i,j);
+      c.B2[3*j+i] = B2(i,j);
+    }
+}
+
+struct BatchedFKTask
+{
+  const vector<LinkFKConstants>* links;
+  const vector<Config>* qs;
+  BatchedFrames* frames;
+  int start,end;
+};
+
+static void BatchedFKRange(const BatchedFKTask& task)
+{
+  const vector<LinkFKConstants>& links = *task.links;
+  BatchedFrames& frames = *task.frames;
+  Real cq[kFKBlock],sq[kFKBlock];
+  Real L[12][kFKBlock];
+  for(int k0=task.start;k0<task.end;k0+=kFKBlock) {
+    int nb = Min(kFKBlock,task.end-k0);
+    for(size_t i=0;i<links.size();i++) {
+      const LinkFKConstants& c = links[i];
+      //local transform relative to the parent
+      for(int k=0;k<nb;k++) {
+        Real qk = (*task.qs)[k0+k](i);
+        if(c.revolute) { cq[k] = Cos(c.scale*qk); sq[k] = Sin(c.scale*qk); }
+        else { cq[k] = qk; sq[k] = 0; }
+      }
+      if(c.revolute) {
+        for(int m=0;m<9;m++)
+          for(int k=0;k<nb;k++)
+            L[m][k] = c.B0[m] + cq[k]*c.B1[m] + sq[k]*c.B2[m];
+        for(int m=0;m<3;m++)
+          for(int k=0;k<nb;k++)
+            L[9+m][k] = c.t0[m];
+      }
+      else {
+        for(int m=0;m<9;m++)
+          for(int k=0;k<nb;k++)
+            L[m][k] = c.B0[m];
+        for(int m=0;m<3;m++)
+          for(int k=0;k<nb;k++)
+            L[9+m][k] = c.t0[m] + cq[k]*c.tq[m];
+      }
+      Real* out[12];
+      for(int m=0;m<12;m++) out[m] = frames.component(i,m)+k0;
+      if(c.parent < 0) {
+        for(int m=0;m<12;m++)
+          for(int k=0;k<nb;k++) out[m][k] = L[m][k];
+        continue;
+      }
+      //world transform: (Rp,tp)*(RL,tL) = (Rp*RL, Rp*tL + tp)
+      const Real* P[12];
+      for(int m=0;m<12;m++) P[m] = frames.component(c.parent,m)+k0;
+      for(int r=0;r<3;r++) {
+        const Real* p0 = P[r];
+        const Real* p1 = P[3+r];
+        const Real* p2 = P[6+r];
+        for(int col=0;col<4;col++) {
+          const Real* l0 = L[3*col];
+          const Real* l1 = L[3*col+1];
+          const Real* l2 = L[3*col+2];
+          Real* o = out[3*col+r];
+          if(col < 3) {
+            for(int k=0;k<nb;k++)
+              o[k] = p0[k]*l0[k] + p1[k]*l1[k] + p2[k]*l2[k];
+          }
+          else {
+            const Real* pt = P[9+r];
+            for(int k=0;k<nb;k++)
+              o[k] = p0[k]*l0[k] + p1[k]*l1[k] + p2[k]*l2[k] + pt[k];
+          }
+        }
+      }
+    }
+  }
+}
+
+static void* BatchedFKThread(void* data)
+{
+  BatchedFKRange(*(const BatchedFKTask*)data);
+  return NULL;
+}
+
+void BatchedForwardKinematics(const RobotKinematics3D& robot,const vector<Config>& qs,BatchedFrames& frames,int numThreads)
+{
+  int n = (int)robot.links.size();
+  int size = (int)qs.size();
+  for(int k=0;k<size;k++)
+    if(qs[k].n != n) FatalError("BatchedForwardKinematics: configuration %d has size %d, robot has %d links",k,qs[k].n,n);
+  vector<LinkFKConstants> links(n);
+  for(int i=0;i<n;i++) {
+    if(robot.parents[i] >= i) FatalError("BatchedForwardKinematics: links must be topologically sorted");
+    GetLinkFKConstants(robot.links[i],robot.parents[i],links[i]);
+  }
+  frames.resize(n,size);
+
+  int nt = Min(ThreadCount(numThreads),Max(1,size/kFKMinPerThread));
+  //split on block boundaries
+  int numBlocks = (size+kFKBlock-1)/kFKBlock;
+  vector<BatchedFKTask> tasks;
+  for(int t=0;t<nt;t++) {
+    BatchedFKTask task;
+    task.links = &links;
+    task.qs = &qs;
+    task.frames = &frames;
+    task.start = Min(size,(numBlocks*t/nt)*kFKBlock);
+    task.end = Min(size,(numBlocks*(t+1)/nt)*kFKBlock);
+    if(task.start < task.end) tasks.push_back(task);
+  }
+  if(tasks.size() <= 1) {
+    if(!tasks.empty()) BatchedFKRange(tasks[0]);
+  }
+  else
+    ThreadRunAll(BatchedFKThread,tasks);
+}
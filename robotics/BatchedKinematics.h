@@ -0,0 +1,47 @@
+#ifndef ROBOTICS_BATCHED_KINEMATICS_H
+#define ROBOTICS_BATCHED_KINEMATICS_H
+
+#include "RobotKinematics3D.h"
+#include <vector>
+
+/** @file BatchedKinematics.h @ingroup Kinematics
+ * @brief Forward kinematics for many configurations at once.
+ */
+
+/** @ingroup Kinematics
+ * @brief The link transforms of a robot for a batch of configurations,
+ * stored in structure-of-arrays order.
+ *
+ * Each transform has 12 components: 0-8 are the rotation in column-major
+ * order (R(i,j) is component 3j+i, like Matrix3), and 9-11 are the
+ * translation.  Component c of link i for configuration k is
+ * data[(i*12+c)*size+k].
+ */
+class BatchedFrames
+{
+public:
+  BatchedFrames();
+  void resize(int numLinks,int size);
+  ///Gets the transform of a link for configuration k
+  void get(int k,int link,Frame3D& T) const;
+  ///Returns the array of component c of a link's transform across the batch
+  inline Real* component(int link,int c) { return &data[(link*12+c)*size]; }
+  inline const Real* component(int link,int c) const { return &data[(link*12+c)*size]; }
+
+  int numLinks,size;
+  std::vector<Real> data;
+};
+
+/** @ingroup Kinematics
+ * @brief Computes the link transforms T_World of the robot for each of the
+ * configurations qs, without changing the robot's state.
+ *
+ * Gives the same frames as UpdateConfig(qs[k]), but each link is
+ * processed for a block of configurations at a time, with the transform
+ * products running along the batch where they vectorize.  The batch is
+ * split across numThreads threads (<= 0 uses the hardware concurrency).
+ * Links must be topologically sorted.
+ */
+void BatchedForwardKinematics(const RobotKinematics3D& robot,const std::vector<Config>& qs,BatchedFrames& frames,int numThreads=0);
+
+#endif
@@ -122,6 +122,10 @@ IKGoalFunction::IKGoalFunction(RobotKinematics3D& _robot,const IKGoal& _goal,con
    positionScale(1),rotationScale(1)
 {
   Assert(goal.posConstraint != IKGoal::PosNone || goal.rotConstraint != IKGoal::RotNone);
+  onChain.resize(robot.links.size(),0);
+  for(int i=goal.link;i>=0;i=robot.parents[i]) onChain[i]=1;
+  for(int i=goal.destLink;i>=0;i=robot.parents[i]) onChain[i]=1;
+  chainMapping.imax = -1;
 }
 
 string IKGoalFunction::Label() const
@@ -309,101 +313,140 @@ Real IKGoalFunction::Eval_i(const Vector& x, int i)
   return Zero;
 }
 
-void IKGoalFunction::Jacobian(const Vector& x, Matrix& J)
+const vector<int>& IKGoalFunction::GetChainColumns()
 {
-  UpdateEERot();
-  for(int k=0;k<x.n;k++) {
-    int baseLink = GetDOF(k);
-    Vector3 dp;
-    robot.GetPositionJacobian(goal.localPosition,goal.link,baseLink,dp);
+  if(chainMapping.imax != activeDofs.imax || chainMapping.offset != activeDofs.offset || chainMapping.mapping != activeDofs.mapping) {
+    chainMapping = activeDofs;
+    chainColumns.resize(0);
+    for(int k=0;k<activeDofs.Size();k++) {
+      int dof = GetDOF(k);
+      if(dof >= 0 && dof < (int)onChain.size() && onChain[dof]) chainColumns.push_back(k);
+    }
+  }
+  return chainColumns;
+}
+
+void IKGoalFunction::JacobianColumn(int baseLink,Real* Jk)
+{
+  Vector3 dp;
+  robot.GetPositionJacobian(goal.localPosition,goal.link,baseLink,dp);
+  if(goal.posConstraint==IKGoal::PosFixed) {
+    for(int j=0;j<3;j++)
+      Jk[j] = positionScale*dp[j];
+  }
+  else if(goal.posConstraint == IKGoal::PosLinear) {
+    Vector3 xb,yb;
+    Vector3 d;
+    if(goal.destLink < 0) d=goal.direction;
+    else d=robot.links[goal.destLink].T_World.R*goal.direction;
+    GetCanonicalBasis(d,xb,yb);
+    Jk[0] = positionScale*dot(dp,xb);
+    Jk[1] = positionScale*dot(dp,yb);
+  }
+  else if(goal.posConstraint == IKGoal::PosPlanar) {
+    Vector3 d;
+    if(goal.destLink < 0) d=goal.direction;
+    else d=robot.links[goal.destLink].T_World.R*goal.direction;
+    Jk[0] = positionScale*dot(dp,d);
+  }
+
+  if(goal.destLink >= 0) {
+    Vector3 dpdest;
+    robot.GetPositionJacobian(goal.endPosition,goal.destLink,baseLink,dpdest);
     if(goal.posConstraint==IKGoal::PosFixed) {
       for(int j=0;j<3;j++)
-	J(j,k) = positionScale*dp[j];
+        Jk[j] -= positionScale*dpdest[j];
     }
     else if(goal.posConstraint == IKGoal::PosLinear) {
+      FatalError("TODO: link-to-link fancy constraints");
       Vector3 xb,yb;
       Vector3 d;
       if(goal.destLink < 0) d=goal.direction;
       else d=robot.links[goal.destLink].T_World.R*goal.direction;
       GetCanonicalBasis(d,xb,yb);
-      J(0,k) = positionScale*dot(dp,xb);
-      J(1,k) = positionScale*dot(dp,yb);
+      Jk[0] -= positionScale*dot(dpdest,xb);
+      Jk[1] -= positionScale*dot(dpdest,yb);
     }
     else if(goal.posConstraint == IKGoal::PosPlanar) {
+      FatalError("TODO: link-to-link fancy constraints");
       Vector3 d;
       if(goal.destLink < 0) d=goal.direction;
       else d=robot.links[goal.destLink].T_World.R*goal.direction;
-      J(0,k) = positionScale*dot(dp,d);
+      Jk[0] -= positionScale*dot(dpdest,d);
     }
+  }
 
+  int m=IKGoal::NumDims(goal.posConstraint);
+  Vector3 dr,dw;
+  if(goal.rotConstraint==IKGoal::RotFixed) {
+    robot.GetOrientationJacobian(goal.link,baseLink,dw);
     if(goal.destLink >= 0) {
-      Vector3 dpdest;
-      robot.GetPositionJacobian(goal.endPosition,goal.destLink,baseLink,dpdest);
-      if(goal.posConstraint==IKGoal::PosFixed) {
-	for(int j=0;j<3;j++)
-	  J(j,k) -= positionScale*dpdest[j];
-      }
-      else if(goal.posConstraint == IKGoal::PosLinear) {
-	FatalError("TODO: link-to-link fancy constraints");
-	Vector3 xb,yb;
-	Vector3 d;
-	if(goal.destLink < 0) d=goal.direction;
-	else d=robot.links[goal.destLink].T_World.R*goal.direction;
-	GetCanonicalBasis(d,xb,yb);
-	J(0,k) -= positionScale*dot(dpdest,xb);
-	J(1,k) -= positionScale*dot(dpdest,yb);
-      }
-      else if(goal.posConstraint == IKGoal::PosPlanar) {
-	FatalError("TODO: link-to-link fancy constraints");
-	Vector3 d;
-	if(goal.destLink < 0) d=goal.direction;
-	else d=robot.links[goal.destLink].T_World.R*goal.direction;
-	J(0,k) -= positionScale*dot(dpdest,d);
-      }
+      //m = moment(Rdiff)
+      //dRdiff = d/dt(R1(q)Rl^T R2^T(q))
+      //       = dR1/dt(q)Rl^TR2^T(q) + R1(q)Rl^TdR2/dt^T(q)
+      //       = [w1]R1 Rl^T R2^T + R1 Rl^T R2^T [-w2]
+      //       = [w1]R1 Rl^T R2^T - [R1 Rl^T R2^R w2] R1 Rl^T R2^T
+      //assume dRdiff = [w]Rdiff, then w = w1-eerot*w2
+      Vector3 dwdest;
+      robot.GetOrientationJacobian(goal.destLink,baseLink,dwdest);
+      dw -= eerot*dwdest;
     }
+    MomentDerivative(eerot,dw,dr);
+    //robot.GetWorldRotationDeriv_Moment(goal.link,baseLink,dr);
+    Jk[m] = rotationScale*dr.x;
+    Jk[m+1] = rotationScale*dr.y;
+    Jk[m+2] = rotationScale*dr.z;
+  }
+  else if(goal.rotConstraint==IKGoal::RotAxis) {
+    Vector3 x,y;
+    Vector3 d;
+    if(goal.destLink < 0) d=goal.endRotation;
+    else d = robot.links[goal.destLink].T_World.R*goal.endRotation;
+    if(goal.destLink >= 0) 
+      FatalError("TODO: link-to-link fancy constraints");
+    GetCanonicalBasis(d,x,y);
+    robot.GetOrientationJacobian(goal.link,baseLink,dr);
+    Vector3 curAxis;
+    robot.links[goal.link].T_World.R.mul(goal.localAxis,curAxis);
+    Vector3 axisRateOfChange = cross(dr,curAxis);
+    Jk[m] = rotationScale*(Sign(dot(curAxis,x))*dot(axisRateOfChange,x)-dot(axisRateOfChange,d));
+    Jk[m+1] = rotationScale*(Sign(dot(curAxis,y))*dot(axisRateOfChange,y)-dot(axisRateOfChange,d));
+  }
+  else if(goal.rotConstraint==IKGoal::RotNone) {
+  }
+  else {
+    LOG4CXX_INFO(KrisLibrary::logger(),"GetIKJacobian(): Invalid number of rotation terms\n");
+    Abort(); 
+  }
+}
 
-    int m=IKGoal::NumDims(goal.posConstraint);
-    Vector3 dr,dw;
-    if(goal.rotConstraint==IKGoal::RotFixed) {
-      robot.GetOrientationJacobian(goal.link,baseLink,dw);
-      if(goal.destLink >= 0) {
-	//m = moment(Rdiff)
-	//dRdiff = d/dt(R1(q)Rl^T R2^T(q))
-	//       = dR1/dt(q)Rl^TR2^T(q) + R1(q)Rl^TdR2/dt^T(q)
-	//       = [w1]R1 Rl^T R2^T + R1 Rl^T R2^T [-w2]
-	//       = [w1]R1 Rl^T R2^T - [R1 Rl^T R2^R w2] R1 Rl^T R2^T
-	//assume dRdiff = [w]Rdiff, then w = w1-eerot*w2
-	Vector3 dwdest;
-	robot.GetOrientationJacobian(goal.destLink,baseLink,dwdest);
-	dw -= eerot*dwdest;
-      }
-      MomentDerivative(eerot,dw,dr);
-      //robot.GetWorldRotationDeriv_Moment(goal.link,baseLink,dr);
-      J(m,k) = rotationScale*dr.x;
-      J(m+1,k) = rotationScale*dr.y;
-      J(m+2,k) = rotationScale*dr.z;
-    }
-    else if(goal.rotConstraint==IKGoal::RotAxis) {
-      Vector3 x,y;
-      Vector3 d;
-      if(goal.destLink < 0) d=goal.endRotation;
-      else d = robot.links[goal.destLink].T_World.R*goal.endRotation;
-      if(goal.destLink >= 0) 
-	FatalError("TODO: link-to-link fancy constraints");
-      GetCanonicalBasis(d,x,y);
-      robot.GetOrientationJacobian(goal.link,baseLink,dr);
-      Vector3 curAxis;
-      robot.links[goal.link].T_World.R.mul(goal.localAxis,curAxis);
-      Vector3 axisRateOfChange = cross(dr,curAxis);
-      J(m,k) = rotationScale*(Sign(dot(curAxis,x))*dot(axisRateOfChange,x)-dot(axisRateOfChange,d));
-      J(m+1,k) = rotationScale*(Sign(dot(curAxis,y))*dot(axisRateOfChange,y)-dot(axisRateOfChange,d));
-    }
-    else if(goal.rotConstraint==IKGoal::RotNone) {
-    }
-    else {
-      LOG4CXX_INFO(KrisLibrary::logger(),"GetIKJacobian(): Invalid number of rotation terms\n");
-      Abort(); 
-    }
+void IKGoalFunction::Jacobian(const Vector& x, Matrix& J)
+{
+  UpdateEERot();
+  J.setZero();
+  Real Jk[6];
+  const vector<int>& cols = GetChainColumns();
+  for(size_t c=0;c<cols.size();c++) {
+    int k=cols[c];
+    JacobianColumn(GetDOF(k),Jk);
+    for(int j=0;j<J.m;j++)
+      J(j,k) = Jk[j];
+  }
+}
+
+void IKGoalFunction::Jacobian_Sparse(const Vector& x,SparseMatrix& J,int row)
+{
+  UpdateEERot();
+  int m=NumDimensions();
+  for(int j=0;j<m;j++)
+    J.rows[row+j].entries.clear();
+  Real Jk[6];
+  const vector<int>& cols = GetChainColumns();
+  for(size_t c=0;c<cols.size();c++) {
+    int k=cols[c];
+    JacobianColumn(GetDOF(k),Jk);
+    for(int j=0;j<m;j++)
+      if(Jk[j] != 0) J.rows[row+j].insert(k,Jk[j]);
   }
 }
 
@@ -764,6 +807,38 @@ void RobotIKFunction::PreEval(const Vector& x)
   CompositeVectorFieldFunction::PreEval(x);
 }
 
+void RobotIKFunction::Jacobian_Sparse(const Vector& x,SparseMatrix& J)
+{
+  J.resize(NumDimensions(),x.n);
+  Matrix mtemp;
+  int offset=0;
+  for(size_t i=0;i<functions.size();i++) {
+    IKGoalFunction* goal = dynamic_cast<IKGoalFunction*>(functions[i].get());
+    int m=functions[i]->NumDimensions();
+    if(goal)
+      goal->Jacobian_Sparse(x,J,offset);
+    else {
+      //other terms (e.g., the COM) are dense
+      mtemp.resize(m,x.n);
+      functions[i]->Jacobian(x,mtemp);
+      J.copySubMatrix(offset,0,mtemp);
+    }
+    offset += m;
+  }
+}
+
+
+SparseRobotIKFunction::SparseRobotIKFunction(RobotIKFunction& f)
+  :function(f)
+{}
+
+void SparseRobotIKFunction::Jacobian_i_Sparse(const Vector& x,int i,SparseVector& Ji)
+{
+  Vector temp(x.n);
+  function.Jacobian_i(x,i,temp);
+  Ji.set(temp);
+}
+
 
 
 
@@ -773,11 +848,18 @@ void RobotIKFunction::PreEval(const Vector& x)
 
 
 RobotIKSolver::RobotIKSolver(RobotIKFunction& f)
-  :solver(&f),function(f),robot(f.robot)
+  :solver(&f),function(f),robot(f.robot),sparseFunction(f)
 {
   solver.svd.preMultiply = false;
 }
 
+void RobotIKSolver::UseSparse(bool sparse)
+{
+  solver.sparse = sparse;
+  if(sparse) solver.func = &sparseFunction;
+  else solver.func = &function;
+}
+
 void RobotIKSolver::UseJointLimits(Real revJointThreshold) 
 {
   //limits
@@ -4,6 +4,7 @@
 #include "RobotKinematics3D.h"
 #include "IK.h"
 #include <KrisLibrary/math/vectorfunction.h>
+#include <KrisLibrary/math/sparsefunction.h>
 #include <KrisLibrary/optimization/Newton.h>
 #include <KrisLibrary/utils/ArrayMapping.h>
 #include <KrisLibrary/utils/DirtyData.h>
@@ -43,6 +44,9 @@ struct RobotIKFunction : public CompositeVectorFieldFunction
   void SetState(const Vector& x) const;
   void GetState(Vector& x) const;
   virtual void PreEval(const Vector& x);
+  ///Computes the Jacobian in sparse form.  IK goals only fill in the
+  ///columns of DOFs on their links' chains to the root.
+  void Jacobian_Sparse(const Vector& x,SparseMatrix& J);
 
   RobotKinematics3D& robot;
 
@@ -50,6 +54,25 @@ struct RobotIKFunction : public CompositeVectorFieldFunction
   //vector<Real> scaleDofs; TODO? enable scaling of dofs
 };
 
+/** @brief Exposes a RobotIKFunction as a SparseVectorFunction, so that it
+ * can be solved with the sparse mode of NewtonRoot.
+ */
+struct SparseRobotIKFunction : public SparseVectorFunction
+{
+  SparseRobotIKFunction(RobotIKFunction& function);
+  virtual std::string Label() const { return function.Label(); }
+  virtual std::string Label(int i) const { return function.Label(i); }
+  virtual int NumDimensions() const { return function.NumDimensions(); }
+  virtual void PreEval(const Vector& x) { function.PreEval(x); }
+  virtual void Eval(const Vector& x,Vector& v) { function.Eval(x,v); }
+  virtual Real Eval_i(const Vector& x,int i) { return function.Eval_i(x,i); }
+  virtual void Jacobian(const Vector& x,Matrix& J) { function.Jacobian(x,J); }
+  virtual void Jacobian_Sparse(const Vector& x,SparseMatrix& J) { function.Jacobian_Sparse(x,J); }
+  virtual void Jacobian_i_Sparse(const Vector& x,int i,SparseVector& Ji);
+
+  RobotIKFunction& function;
+};
+
 /** @brief A Newton-Raphson robot IK solver.
  * 
  * Joint limits are optionally included if the UseJointLimits() functions
@@ -63,6 +86,12 @@ struct RobotIKFunction : public CompositeVectorFieldFunction
  * than t. Specifying a value less than 2pi is useful to avoid local minima
  * for joints with wide ranges, because it allows the joint angle to pass from
  * -pi to pi, and vice versa.
+ *
+ * UseSparse() switches the solver to sparse Jacobians and a sparse
+ * least-squares step, which is faster for robots with many branches
+ * (e.g. several limbs with a goal on each), where each goal only depends on
+ * a small part of the DOFs.  The bias configuration is not used in this
+ * mode.
  */
 struct RobotIKSolver
 {
@@ -71,6 +100,7 @@ struct RobotIKSolver
   void UseJointLimits(const Vector& qmin,const Vector& qmax);
   void UseBiasConfiguration(const Vector& qdesired);
   void ClearJointLimits();
+  void UseSparse(bool sparse=true);
   void RobotToState();
   void StateToRobot();
   bool Solve(Real tolerance,int& iters);
@@ -79,6 +109,7 @@ struct RobotIKSolver
   Optimization::NewtonRoot solver;
   RobotIKFunction& function;
   RobotKinematics3D& robot;
+  SparseRobotIKFunction sparseFunction;
 };
 
 /// Computes the ArrayMapping that only includes ancestor links of the 
@@ -176,9 +207,18 @@ struct IKGoalFunction : public VectorFieldFunction
   virtual void Jacobian(const Vector& x, Matrix& J);
   virtual void Jacobian_i(const Vector& x, int i, Vector& Ji);
   virtual void Hessian_i(const Vector& x,int i,Matrix& Hi);
+  ///Fills rows [row,row+NumDimensions()) of J, with entries only in the
+  ///columns of GetChainColumns()
+  void Jacobian_Sparse(const Vector& x,SparseMatrix& J,int row=0);
+  ///Returns the active DOF indices that lie on the chains from the goal's
+  ///link (and destLink) to the root.  All other Jacobian columns are zero.
+  const std::vector<int>& GetChainColumns();
 
   void UpdateEEPos();
   void UpdateEERot();
+  ///Computes the Jacobian column of DOF baseLink into Jk (NumDimensions()
+  ///entries).  UpdateEERot() must be called first.
+  void JacobianColumn(int baseLink,Real* Jk);
 
   RobotKinematics3D& robot;
   const IKGoal& goal;
@@ -188,6 +228,11 @@ struct IKGoalFunction : public VectorFieldFunction
   DirtyData<Vector3> eepos;
   DirtyData<Matrix3> eerot;
   DirtyData<std::vector<Matrix> > H;
+  //onChain[i] is true if link i is an ancestor of the goal's link or destLink
+  std::vector<char> onChain;
+  //chainColumns is valid for the active DOFs in chainMapping
+  ArrayMapping chainMapping;
+  std::vector<int> chainColumns;
 };
 
 /** @brief Function class that measures the difference between the robot's
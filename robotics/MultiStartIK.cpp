@@ -0,0 +1,192 @@
+#include <KrisLibrary/Logger.h>
+#include "MultiStartIK.h"
+#include <KrisLibrary/math/random.h>
+#include <KrisLibrary/utils/threadutils.h>
+#include <algorithm>
+#include <errors.h>
+using namespace std;
+using namespace Geometry;
+
+IKSolutionCache::IKSolutionCache()
+  :rotationScale(1.0),numDims(-1)
+{}
+
+void IKSolutionCache::Clear()
+{
+  solutions.clear();
+  tree.reset();
+  numDims = -1;
+}
+
+void IKSolutionCache::GetFeature(const vector<IKGoal>& goals,Vector& x) const
+{
+  int n=0;
+  for(size_t i=0;i<goals.size();i++) {
+    if(goals[i].posConstraint != IKGoal::PosNone) n+=3;
+    if(goals[i].rotConstraint == IKGoal::RotFixed || goals[i].rotConstraint == IKGoal::RotAxis) n+=3;
+  }
+  x.resize(n);
+  n=0;
+  for(size_t i=0;i<goals.size();i++) {
+    if(goals[i].posConstraint != IKGoal::PosNone) {
+      goals[i].endPosition.get(x(n),x(n+1),x(n+2));
+      n+=3;
+    }
+    if(goals[i].rotConstraint == IKGoal::RotFixed || goals[i].rotConstraint == IKGoal::RotAxis) {
+      Vector3 r = goals[i].endRotation*rotationScale;
+      r.get(x(n),x(n+1),x(n+2));
+      n+=3;
+    }
+  }
+}
+
+void IKSolutionCache::Add(const vector<IKGoal>& goals,const Config& q)
+{
+  Vector x;
+  GetFeature(goals,x);
+  if(x.n == 0) return;
+  if(numDims < 0) {
+    numDims = x.n;
+    tree.reset(new KDTree);
+  }
+  else if(x.n != numDims) {
+    LOG4CXX_WARN(KrisLibrary::logger(),"IKSolutionCache: goals of a different form than the cache, ignoring");
+    return;
+  }
+  tree->Insert(x,(int)solutions.size(),4);
+  solutions.push_back(q);
+}
+
+void IKSolutionCache::GetSeeds(const vector<IKGoal>& goals,int k,vector<Config>& seeds) const
+{
+  seeds.resize(0);
+  if(!tree || k <= 0) return;
+  Vector x;
+  GetFeature(goals,x);
+  if(x.n != numDims) return;
+  vector<Real> dist(k);
+  vector<int> idx(k);
+  tree->KClosestPoints(x,k,&dist[0],&idx[0]);
+  vector<pair<Real,int> > sorted;
+  for(int i=0;i<k;i++)
+    if(idx[i] >= 0) sorted.push_back(pair<Real,int>(dist[i],idx[i]));
+  sort(sorted.begin(),sorted.end());
+  for(size_t i=0;i<sorted.size();i++)
+    seeds.push_back(solutions[sorted[i].second]);
+}
+
+
+MultiStartIKSolver::MultiStartIKSolver(RobotKinematics3D& _robot)
+  :robot(_robot),numRestarts(100),numCacheSeeds(3),useCache(true),
+   tolerance(1e-3),maxIters(50),numThreads(0),solvedSeed(-1),numSeedsTried(0)
+{}
+
+//state shared by the threads of one solve
+struct MultiStartIKShared
+{
+  const vector<IKGoal>* goals;
+  const vector<int>* activeDofs;
+  const vector<Config>* seeds;
+  Real tolerance;
+  int maxIters;
+
+  Mutex mutex;
+  int nextSeed;       ///<next seed to hand out
+  int solvedSeed;     ///<lowest seed index that succeeded so far
+  int numTried;
+  Config solution;
+};
+
+struct MultiStartIKTask
+{
+  MultiStartIKShared* shared;
+  RobotKinematics3D robot;
+};
+
+static void* MultiStartIKThread(void* data)
+{
+  MultiStartIKTask& task = *(MultiStartIKTask*)data;
+  MultiStartIKShared& shared = *task.shared;
+  RobotIKFunction function(task.robot);
+  function.UseIK(*shared.goals);
+  function.activeDofs.mapping = *shared.activeDofs;
+  RobotIKSolver solver(function);
+  solver.UseJointLimits(TwoPi);
+  solver.solver.verbose = 0;
+  while(true) {
+    int s;
+    {
+      ScopedLock lock(shared.mutex);
+      //seeds are handed out in order, so once one has succeeded, no later
+      //seed can change the result
+      if(shared.nextSeed >= (int)shared.seeds->size() || shared.nextSeed >= shared.solvedSeed)
+        break;
+      s = shared.nextSeed++;
+      shared.numTried++;
+    }
+    task.robot.q = (*shared.seeds)[s];
+    int iters = shared.maxIters;
+    if(solver.Solve(shared.tolerance,iters)) {
+      ScopedLock lock(shared.mutex);
+      if(s < shared.solvedSeed) {
+        shared.solvedSeed = s;
+        shared.solution = task.robot.q;
+      }
+    }
+  }
+  return NULL;
+}
+
+bool MultiStartIKSolver::Solve(const vector<IKGoal>& goals)
+{
+  ArrayMapping dofs;
+  GetDefaultIKDofs(robot,goals,dofs);
+
+  //seeds: the start, then cached solutions, then random samples
+  vector<Config> seeds(1,robot.q);
+  if(useCache) {
+    vector<Config> cached;
+    cache.GetSeeds(goals,numCacheSeeds,cached);
+    for(size_t i=0;i<cached.size();i++)
+      if(cached[i].n == robot.q.n) seeds.push_back(cached[i]);
+  }
+  for(int k=0;k<numRestarts;k++) {
+    Config q = robot.q;
+    for(size_t j=0;j<dofs.mapping.size();j++) {
+      int i = dofs.mapping[j];
+      if(IsFinite(robot.qMin(i)) && IsFinite(robot.qMax(i)))
+        q(i) = Rand(robot.qMin(i),robot.qMax(i));
+      else
+        q(i) += Rand(-Pi,Pi);
+    }
+    seeds.push_back(q);
+  }
+
+  MultiStartIKShared shared;
+  shared.goals = &goals;
+  shared.activeDofs = &dofs.mapping;
+  shared.seeds = &seeds;
+  shared.tolerance = tolerance;
+  shared.maxIters = maxIters;
+  shared.nextSeed = 0;
+  shared.solvedSeed = (int)seeds.size();
+  shared.numTried = 0;
+  int nt = Min(ThreadCount(numThreads),(int)seeds.size());
+  vector<MultiStartIKTask> tasks(nt);
+  for(int t=0;t<nt;t++) {
+    tasks[t].shared = &shared;
+    tasks[t].robot = robot;
+  }
+  if(nt == 1) MultiStartIKThread(&tasks[0]);
+  else ThreadRunAll(MultiStartIKThread,tasks);
+
+  numSeedsTried = shared.numTried;
+  if(shared.solvedSeed == (int)seeds.size()) {
+    solvedSeed = -1;
+    return false;
+  }
+  solvedSeed = shared.solvedSeed;
+  robot.q = shared.solution;
+  if(useCache) cache.Add(goals,robot.q);
+  return true;
+}
@@ -0,0 +1,80 @@
+#ifndef ROBOTICS_MULTI_START_IK_H
+#define ROBOTICS_MULTI_START_IK_H
+
+#include "IKFunctions.h"
+#include <KrisLibrary/geometry/KDTree.h>
+#include <memory>
+
+/** @file MultiStartIK.h
+ * @ingroup Kinematics
+ * @brief An IK solver that tries many starting configurations in
+ * parallel, and remembers previous solutions to seed new queries.
+ */
+
+/** @ingroup Kinematics
+ * @brief A nearest-neighbor cache of solved IK problems, mapping goals to
+ * the configurations that solved them.
+ *
+ * Goals are compared by a feature vector made of the goal positions and
+ * the fixed/axis rotation targets (scaled by rotationScale).  All goal
+ * lists added to one cache should constrain the same links in the same
+ * way; entries whose feature vectors have a different size are ignored.
+ */
+class IKSolutionCache
+{
+public:
+  IKSolutionCache();
+  void Clear();
+  int Size() const { return (int)solutions.size(); }
+  ///Gets the feature vector of the goals, used as the cache key
+  void GetFeature(const std::vector<IKGoal>& goals,Vector& x) const;
+  void Add(const std::vector<IKGoal>& goals,const Config& q);
+  ///Returns the solutions of up to k previous goals closest to goals,
+  ///nearest first
+  void GetSeeds(const std::vector<IKGoal>& goals,int k,std::vector<Config>& seeds) const;
+
+  Real rotationScale;    ///<weight of rotation moments relative to positions (default 1)
+  std::vector<Config> solutions;
+  std::unique_ptr<Geometry::KDTree> tree;
+  int numDims;
+};
+
+/** @ingroup Kinematics
+ * @brief Solves IK problems by running Newton-Raphson solves (as in
+ * SolveIK) from many seeds, on several threads.
+ *
+ * The seeds are, in order: the robot's current configuration, the
+ * solutions of the numCacheSeeds nearest goals in the cache, and
+ * numRestarts random configurations within the joint limits (only the
+ * DOFs found by GetDefaultIKDofs are sampled).  The seeds are handed out
+ * in that order to numThreads threads, each working on its own copy of
+ * the robot, and no new seeds are started once one succeeds.  The
+ * solution from the first successful seed is returned, so the result
+ * doesn't depend on the number of threads.
+ *
+ * On success, robot.q is set to the solution (frames are not updated) and
+ * the solution is added to the cache.
+ */
+class MultiStartIKSolver
+{
+public:
+  MultiStartIKSolver(RobotKinematics3D& robot);
+  bool Solve(const std::vector<IKGoal>& goals);
+
+  RobotKinematics3D& robot;
+  IKSolutionCache cache;
+
+  //settings
+  int numRestarts;       ///<number of random seeds (default 100)
+  int numCacheSeeds;     ///<number of cached solutions to try (default 3)
+  bool useCache;         ///<default true
+  Real tolerance;        ///<IK error tolerance (default 1e-3)
+  int maxIters;          ///<Newton iterations per seed (default 50)
+  int numThreads;        ///<default 0: the hardware concurrency
+
+  //outputs
+  int solvedSeed;        ///<index of the seed that gave the solution (0 is the start configuration), or -1
+  int numSeedsTried;
+};
+
+#endif
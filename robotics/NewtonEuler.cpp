@@ -40,7 +40,7 @@ void Wrench::setShifted(const Wrench& wr,const Vector3& shift)
 
 
 SpatialVector::SpatialVector()
-  :Vector(6,Zero)
+  :SmallVector<Real,6>(Zero)
 {}
 
 void SpatialVector::set(const Vector3& a,const Vector3& b)
@@ -56,7 +56,7 @@ void SpatialVector::get(Vector3& a,Vector3& b) const
 }
 
 SpatialMatrix::SpatialMatrix()
-  :Matrix(6,6,Zero)
+  :SmallMatrix<Real,6,6>(Zero)
 {}
 
 void SpatialMatrix::setUpperLeft(const Matrix3& mat11)
@@ -117,7 +117,6 @@ void SpatialMatrix::getLowerLeft(Matrix3& mat21) const
 
 void SpatialMatrix::setForceShift(const Vector3& origMomentCenter,const Vector3& newMomentCenter)
 {
-  setZero();
   setIdentity();
   Matrix3 cp;
   cp.setCrossProduct(newMomentCenter-origMomentCenter);
@@ -127,7 +126,6 @@ void SpatialMatrix::setForceShift(const Vector3& origMomentCenter,const Vector3&
 
 void SpatialMatrix::setVelocityShift(const Vector3& origRefPoint,const Vector3& newRefPoint)
 {
-  setZero();
   setIdentity();
   Matrix3 cp;
   cp.setCrossProduct(origRefPoint-newRefPoint);
@@ -156,6 +154,31 @@ NewtonEulerSolver::NewtonEulerSolver(RobotDynamics3D& _robot)
     externalWrenches[i].f.setZero();
     externalWrenches[i].m.setZero();
   }
+  inertiaMatrices.resize(robot.links.size());
+  biasingForces.resize(robot.links.size());
+  velDepAccels.resize(robot.links.size());
+  compositeMasses.resize(robot.links.size());
+  compositeMoments.resize(robot.links.size());
+  compositeInertias.resize(robot.links.size());
+  //the LTDL factor only has entries at the ancestors of each link
+  int n = (int)robot.links.size();
+  int nnz = 0;
+  for(int i=0;i<n;i++)
+    for(int j=i;j>=0;j=robot.parents[j]) nnz++;
+  Bfactor.initialize(n,n,nnz);
+  for(int i=0,k=0;i<n;i++) {
+    Bfactor.row_offsets[i] = k;
+    for(int j=i;j>=0;j=robot.parents[j]) k++;
+    int p = k-1;
+    for(int j=i;j>=0;j=robot.parents[j],p--) Bfactor.col_indices[p] = j;
+  }
+  Bfactor.row_offsets[n] = nnz;
+  temp0.resize(robot.links.size(),Zero);
+  temp1.resize(robot.links.size(),Zero);
+  dvelocities.resize(robot.links.size());
+  daccelerations.resize(robot.links.size());
+  djointWrenches.resize(robot.links.size());
+  derivAffected.resize(robot.links.size());
 }
 
 void NewtonEulerSolver::CalcVelocities()
@@ -271,13 +294,11 @@ void NewtonEulerSolver::CalcAccel(const Vector& t,Vector& ddq)
   ddq.resize(robot.links.size());
   inertiaMatrices.resize(robot.links.size());
   biasingForces.resize(robot.links.size());
+  velDepAccels.resize(robot.links.size());
   CalcVelocities();
 
   //initialize the matrices
   Matrix3 Iworld;
-  //velocity dependent accelerations (centrifugal and coriolis terms)
-  //calculated at center of mass!
-  vector<SpatialVector> velDepAccels(robot.links.size());
   for(size_t n=0;n<robot.links.size();n++) {
     //LOG4CXX_INFO(KrisLibrary::logger(),"Velocity n: "<<velocities[n].v<<", "<<velocities[n].w);
     //LOG4CXX_INFO(KrisLibrary::logger()," Vel at com: "<<velocities[n].v + cross(velocities[n].w,robot.links[n].T_World.R*robot.links[n].com));
@@ -446,52 +467,350 @@ void NewtonEulerSolver::CalcAccel(const Vector& t,Vector& ddq)
   }
 }
 
+//gets the motion subspace of joint i, the world velocity (w,v) of the
+//point at the world origin moving with link i, per unit dq(i)
+static inline void GetJointMotion(const RobotKinematics3D& robot,int i,Vector3& w,Vector3& v)
+{
+  const RobotLink3D& link = robot.links[i];
+  if(link.type == RobotLink3D::Revolute) {
+    w = link.T_World.R*link.w;
+    v.setCross(link.T_World.t,w);
+  }
+  else {
+    w.setZero();
+    v = link.T_World.R*link.w;
+  }
+}
+
+//Sums the spatial inertias of the subtrees, for the composite rigid body
+//algorithm.  All spatial quantities are expressed in world coordinates
+//about the world origin, so the subtree inertias can be summed without any
+//transforms.  A body with mass m, center c, and inertia Ic about c has
+//spatial inertia
+//  [Ic - m[c]^2   m[c]]
+//  [-m[c]         m   ]
+//which is stored as the triple (m, h=m*c, Ic - m[c]^2).
+void NewtonEulerSolver::CalcCompositeInertias()
+{
+  int n = (int)robot.links.size();
+  Matrix3 Iworld;
+  for(int i=0;i<n;i++) {
+    const RobotLink3D& link = robot.links[i];
+    Real m = link.mass;
+    Vector3 c = link.T_World*link.com;
+    link.GetWorldInertia(Iworld);
+    //-m[c]^2 = m(|c|^2 I - cc^t)
+    Real cc = c.normSquared();
+    for(int p=0;p<3;p++)
+      for(int q=0;q<3;q++)
+        Iworld(p,q) += m*((p==q ? cc : Zero) - c[p]*c[q]);
+    compositeMasses[i] = m;
+    compositeMoments[i].mul(c,m);
+    compositeInertias[i] = Iworld;
+  }
+  //children come after their parents, so go backward
+  for(int i=n-1;i>=0;i--) {
+    int p = robot.parents[i];
+    if(p < 0) continue;
+    compositeMasses[p] += compositeMasses[i];
+    compositeMoments[p] += compositeMoments[i];
+    compositeInertias[p] += compositeInertias[i];
+  }
+}
+
+//force needed to accelerate the subtree at j along joint j:
+//moment = I*w + h x v, force = M*v + w x h
+static inline void GetCompositeForce(const NewtonEulerSolver& ne,int j,Vector3& mom,Vector3& force)
+{
+  Vector3 wj,vj;
+  GetJointMotion(ne.robot,j,wj,vj);
+  const Vector3& h = ne.compositeMoments[j];
+  mom = ne.compositeInertias[j]*wj + cross(h,vj);
+  force = ne.compositeMasses[j]*vj + cross(wj,h);
+}
+
 void NewtonEulerSolver::CalcKineticEnergyMatrix(Matrix& B)
 {
-  //by virtue of the relationship
-  //Bq'' + C + G = t
-  //if we let q'' = ei, we can get column i of B (denoted Bi)
-  //such that Bi = t-C-G
-  //C+G can be obtained by setting q''=0, then t = C+G
-  B.resize(robot.links.size(),robot.links.size());
-  Vector t0,t;
-  Vector ddq(robot.links.size());
-  ddq.setZero();
-  CalcTorques(ddq,t0);
-  for(int i=0;i<ddq.n;i++) {
-    ddq(i) = 1;
-    CalcTorques(ddq,t);
-    t -= t0;
-    B.copyCol(i,t);
-    ddq(i) = 0;
+  //Composite rigid body algorithm
+  int n = (int)robot.links.size();
+  B.resize(n,n);
+  B.setZero();
+  CalcCompositeInertias();
+  Vector3 wi,vi,mom,force;
+  for(int j=0;j<n;j++) {
+    GetCompositeForce(*this,j,mom,force);
+    //only the ancestors of j (and j itself) feel this force
+    for(int i=j;i>=0;i=robot.parents[i]) {
+      GetJointMotion(robot,i,wi,vi);
+      B(i,j) = B(j,i) = dot(wi,mom) + dot(vi,force);
+    }
   }
 }
 
+bool NewtonEulerSolver::FactorKineticEnergyMatrix()
+{
+  //fill in the lower triangle of B.  Walking up from j visits the entries
+  //of row j from the last (the diagonal) to the first.
+  int n = (int)robot.links.size();
+  CalcCompositeInertias();
+  Real* B = Bfactor.val_array;
+  Vector3 wi,vi,mom,force;
+  for(int j=0;j<n;j++) {
+    GetCompositeForce(*this,j,mom,force);
+    int k = Bfactor.row_offsets[j+1]-1;
+    for(int i=j;i>=0;i=robot.parents[i],k--) {
+      GetJointMotion(robot,i,wi,vi);
+      B[k] = dot(wi,mom) + dot(vi,force);
+    }
+  }
+  //Featherstone's LTDL factorization, B = L^t D L.  Row k of L is only
+  //nonzero at the ancestors of k, so the elimination only needs to
+  //visit ancestor pairs.  The ancestors of i are a suffix of those of k,
+  //so rows i and k are traversed in step.
+  for(int k=n-1;k>=0;k--) {
+    int kdiag = Bfactor.row_offsets[k+1]-1;
+    if(!(B[kdiag] > 0)) return false;
+    int ki = kdiag-1;
+    for(int i=robot.parents[k];i>=0;i=robot.parents[i],ki--) {
+      Real a = B[ki]/B[kdiag];
+      int ij = Bfactor.row_offsets[i+1]-1;
+      for(int kj=ki;ij>=Bfactor.row_offsets[i];ij--,kj--)
+        B[ij] -= a*B[kj];
+      B[ki] = a;
+    }
+  }
+  return true;
+}
+
+void NewtonEulerSolver::SolveKineticEnergyMatrix(const Vector& f,Vector& x) const
+{
+  int n = (int)robot.links.size();
+  Assert(f.n == n);
+  if(&x != &f) x.copy(f);
+  const Real* L = Bfactor.val_array;
+  const int* cols = Bfactor.col_indices;
+  const int* offsets = Bfactor.row_offsets;
+  //solve L^t y = f
+  for(int i=n-1;i>=0;i--)
+    for(int k=offsets[i];k+1<offsets[i+1];k++)
+      x(cols[k]) -= L[k]*x(i);
+  for(int i=0;i<n;i++)
+    x(i) /= L[offsets[i+1]-1];
+  //solve L x = D^-1 y
+  for(int i=0;i<n;i++)
+    for(int k=offsets[i];k+1<offsets[i+1];k++)
+      x(i) -= L[k]*x(cols[k]);
+}
+
+//Derivatives of the inverse dynamics recursion in CalcTorques with
+//respect to a single variable, either q(k) (isVel=false) or dq(k)
+//(isVel=true).  Assumes CalcTorques has just been called, and writes the
+//derivatives of the torques into dt.
+//
+//When q(k) changes, every link in the subtree of k moves rigidly:
+//revolute joints rotate it about the axis z through the joint origin ok,
+//so a point x moves by z x (x-ok) and a vector r by z x r; prismatic
+//joints translate it along z.
+static void CalcTorquesDerivVar(NewtonEulerSolver& ne,const Vector& ddq,int k,bool isVel,Vector& dt)
+{
+  RobotDynamics3D& robot = ne.robot;
+  int n = (int)robot.links.size();
+  const RobotLink3D& lk = robot.links[k];
+  bool rotk = (!isVel && lk.type == RobotLink3D::Revolute);
+  bool transk = (!isVel && lk.type == RobotLink3D::Prismatic);
+  Vector3 zk = lk.T_World.R*lk.w;
+  const Vector3& ok = lk.T_World.t;
+
+  //forward pass over the subtree of k: velocities and accelerations
+  Vector3 z,dz,d,dd,dop,don;
+  for(int i=0;i<n;i++) {
+    int p = robot.parents[i];
+    ne.derivAffected[i] = (i==k || (i>k && p>=0 && ne.derivAffected[p]) ? 1 : 0);
+    RigidBodyVelocity& dv = ne.dvelocities[i];
+    RigidBodyVelocity& da = ne.daccelerations[i];
+    if(!ne.derivAffected[i]) {
+      dv.v.setZero(); dv.w.setZero();
+      da.v.setZero(); da.w.setZero();
+      continue;
+    }
+    const RobotLink3D& li = robot.links[i];
+    z = li.T_World.R*li.w;
+    if(rotk) dz.setCross(zk,z);
+    else dz.setZero();
+    //derivative of this link's origin
+    if(rotk) don.setCross(zk,li.T_World.t-ok);
+    else if(transk) don = zk;
+    else don.setZero();
+    Real dqi = (isVel && i==k ? One : Zero);
+    const RigidBodyVelocity& vi = ne.velocities[i];
+    if(p >= 0) {
+      const RigidBodyVelocity& vp = ne.velocities[p];
+      const RigidBodyVelocity& ap = ne.accelerations[p];
+      const RigidBodyVelocity& dvp = ne.dvelocities[p];
+      const RigidBodyVelocity& dap = ne.daccelerations[p];
+      //the parent's origin only moves if the parent is in the subtree
+      if(i != k && rotk) dop.setCross(zk,robot.links[p].T_World.t-ok);
+      else if(i != k && transk) dop = zk;
+      else dop.setZero();
+      d = li.T_World.t - robot.links[p].T_World.t;
+      dd = don - dop;
+      //v = vp + wp x d + (prismatic) dq z, w = wp + (revolute) dq z
+      dv.v = dvp.v + cross(dvp.w,d) + cross(vp.w,dd);
+      dv.w = dvp.w;
+      if(li.type == RobotLink3D::Revolute) dv.w += dqi*z + robot.dq(i)*dz;
+      else dv.v += dqi*z + robot.dq(i)*dz;
+      //a = ap + alphap x d + 2 wp x (v-vp) - wp x (wp x d) + (prismatic) ddq z
+      //alpha = alphap - w x wp + (revolute) ddq z
+      da.v = dap.v + cross(dap.w,d) + cross(ap.w,dd);
+      da.v += Two*(cross(dvp.w,vi.v-vp.v) + cross(vp.w,dv.v-dvp.v));
+      da.v -= cross(dvp.w,cross(vp.w,d)) + cross(vp.w,cross(dvp.w,d)+cross(vp.w,dd));
+      da.w = dap.w - cross(dv.w,vp.w) - cross(vi.w,dvp.w);
+    }
+    else {
+      dv.v.setZero(); dv.w.setZero();
+      da.v.setZero(); da.w.setZero();
+      if(li.type == RobotLink3D::Revolute) dv.w += dqi*z + robot.dq(i)*dz;
+      else dv.v += dqi*z + robot.dq(i)*dz;
+    }
+    if(li.type == RobotLink3D::Revolute) da.w += ddq(i)*dz;
+    else da.v += ddq(i)*dz;
+  }
+
+  //backward pass: wrenches on the subtree of k and its ancestors
+  Vector3 cl,dcl,dcw,vcm,dvcm,df,dm,Iw,dIw,temp;
+  Matrix3 I,dI,Z;
+  if(rotk) Z.setCrossProduct(zk);
+  for(int i=n-1;i>=0;i--) {
+    Wrench& dw = ne.djointWrenches[i];
+    dw.f.setZero();
+    dw.m.setZero();
+    //wrench derivatives are nonzero on the subtree (marked 1) and on the
+    //ancestors of k (marked 2 here)
+    if(!ne.derivAffected[i]) {
+      for(size_t c=0;c<ne.children[i].size();c++)
+        if(ne.derivAffected[ne.children[i][c]]) ne.derivAffected[i] = 2;
+      if(!ne.derivAffected[i]) {
+        dt(i) = 0;
+        continue;
+      }
+    }
+    const RobotLink3D& li = robot.links[i];
+    const RigidBodyVelocity& vi = ne.velocities[i];
+    const RigidBodyVelocity& ai = ne.accelerations[i];
+    const RigidBodyVelocity& dvi = ne.dvelocities[i];
+    const RigidBodyVelocity& dai = ne.daccelerations[i];
+    bool moves = ne.derivAffected[i]==1 && (rotk || transk);
+    bool rotates = ne.derivAffected[i]==1 && rotk;
+    cl = li.T_World.R*li.com;
+    Vector3 cw = cl + li.T_World.t;
+    if(rotates) dcl.setCross(zk,cl);
+    else dcl.setZero();
+    if(rotates) dcw.setCross(zk,cw-ok);
+    else if(moves) dcw = zk;
+    else dcw.setZero();
+    li.GetWorldInertia(I);
+    if(rotates) {
+      //d(R I R^t) = [z] I - I [z]
+      Matrix3 ZI,IZ;
+      ZI.mul(Z,I);
+      IZ.mul(I,Z);
+      dI.sub(ZI,IZ);
+    }
+    //force: f = m*(a + alpha x cl + w x (w x cl)) - fext
+    dvcm = dai.v + cross(dai.w,cl) + cross(ai.w,dcl) + cross(dvi.w,cross(vi.w,cl)) + cross(vi.w,cross(dvi.w,cl)+cross(vi.w,dcl));
+    df.mul(dvcm,li.mass);
+    //moment: m = I alpha + w x I w - mext
+    Iw = I*vi.w;
+    dIw = I*dvi.w;
+    dm = I*dai.w + cross(dvi.w,Iw) + cross(vi.w,dIw);
+    if(rotates) {
+      dm += dI*ai.w;
+      dm += cross(vi.w,dI*vi.w);
+    }
+    //children's wrenches
+    for(size_t j=0;j<ne.children[i].size();j++) {
+      int c = ne.children[i][j];
+      const Wrench& Fc = ne.jointWrenches[c];
+      const Wrench& dFc = ne.djointWrenches[c];
+      const Vector3& oc = robot.links[c].T_World.t;
+      Vector3 doc;
+      if(ne.derivAffected[c]==1 && rotk) doc.setCross(zk,oc-ok);
+      else if(ne.derivAffected[c]==1 && transk) doc = zk;
+      else doc.setZero();
+      df += dFc.f;
+      dm += dFc.m + cross(doc-dcw,Fc.f) + cross(oc-cw,dFc.f);
+    }
+    //joint wrench: F = f, M = mcm + cl x f
+    const Wrench& Fi = ne.jointWrenches[i];
+    dw.f = df;
+    dw.m = dm + cross(dcl,Fi.f) + cross(cl,df);
+    z = li.T_World.R*li.w;
+    if(rotates) dz.setCross(zk,z);
+    else dz.setZero();
+    if(li.type == RobotLink3D::Revolute)
+      dt(i) = dot(dw.m,z) + dot(Fi.m,dz);
+    else
+      dt(i) = dot(dw.f,z) + dot(Fi.f,dz);
+  }
+}
+
+void NewtonEulerSolver::CalcTorquesDeriv(const Vector& ddq,Matrix& dt_dq,Matrix& dt_dqdot)
+{
+  int n = (int)robot.links.size();
+  Assert(ddq.n == n);
+  CalcTorques(ddq,temp1);
+  dt_dq.resize(n,n);
+  dt_dqdot.resize(n,n);
+  for(int k=0;k<n;k++) {
+    Vector col;
+    dt_dq.getColRef(k,col);
+    CalcTorquesDerivVar(*this,ddq,k,false,col);
+    dt_dqdot.getColRef(k,col);
+    CalcTorquesDerivVar(*this,ddq,k,true,col);
+  }
+}
+
+bool NewtonEulerSolver::CalcAccelDeriv(const Vector& t,Matrix& dddq_dq,Matrix& dddq_dqdot)
+{
+  //differentiating B(q) ddq(q,dq,t) + C(q,dq) + G(q) = t gives
+  //dddq/dx = -B^-1 dID/dx, with the inverse dynamics ID evaluated at the
+  //forward dynamics solution
+  if(!FactorKineticEnergyMatrix()) return false;
+  CalcAccel(t,temp0);
+  CalcTorquesDeriv(temp0,dddq_dq,dddq_dqdot);
+  for(int k=0;k<dddq_dq.n;k++) {
+    Vector col;
+    dddq_dq.getColRef(k,col);
+    SolveKineticEnergyMatrix(col,col);
+    col.inplaceNegative();
+    dddq_dqdot.getColRef(k,col);
+    SolveKineticEnergyMatrix(col,col);
+    col.inplaceNegative();
+  }
+  return true;
+}
+
 void NewtonEulerSolver::MulKineticEnergyMatrix(const Vector& x,Vector& Bx)
 {
   Assert(x.n == (int)robot.links.size());
-  Vector t0;
-  Vector ddq(robot.links.size());
-  ddq.setZero();
-  CalcTorques(ddq,t0);
+  temp1.setZero();
+  CalcTorques(temp1,temp0);
   CalcTorques(x,Bx);
-  Bx -= t0;
+  Bx -= temp0;
 }
 
 void NewtonEulerSolver::MulKineticEnergyMatrix(const Matrix& A,Matrix& BA)
 {
   Assert(A.m == (int)robot.links.size());
-  Vector t0;
-  Vector ddq(robot.links.size());
-  ddq.setZero();
-  CalcTorques(ddq,t0);
+  temp1.setZero();
+  CalcTorques(temp1,temp0);
   BA.resize(A.m,A.n);
   for(int i=0;i<A.n;i++) {
     Vector Ai,BAi;
     A.getColRef(i,Ai);
     BA.getColRef(i,BAi);
     CalcTorques(Ai,BAi);
-    BAi -= t0;
+    BAi -= temp0;
   }
 }
 
@@ -699,6 +1018,23 @@ void NewtonEulerSolver::SelfTest()
   }
   LOG4CXX_INFO(KrisLibrary::logger(),"NewtonEulerSolver::SelfTest() Passed kinetic energy matrix test.");
 
+  //check the LTDL solve
+  if(!FactorKineticEnergyMatrix()) {
+    LOG4CXX_ERROR(KrisLibrary::logger(),"LTDL factorization of the kinetic energy matrix failed!");
+    Abort();
+  }
+  for(int i=0;i<ddq.n;i++)
+    ddq(i) = Rand(-One,One);
+  Btrue.mul(ddq,t);
+  SolveKineticEnergyMatrix(t,ddqtest);
+  if(!ddq.isEqual(ddqtest,1e-6*Max(One,ddq.maxAbsElement()))) {
+    LOG4CXX_ERROR(KrisLibrary::logger(),"LTDL solve doesn't invert the kinetic energy matrix!");
+    LOG4CXX_ERROR(KrisLibrary::logger(),"Desired: "<<VectorPrinter(ddq));
+    LOG4CXX_ERROR(KrisLibrary::logger(),"Result: "<<VectorPrinter(ddqtest));
+    Abort();
+  }
+  LOG4CXX_INFO(KrisLibrary::logger(),"NewtonEulerSolver::SelfTest() Passed LTDL test.");
+
   //check inverse kinetic energy computations
   Matrix Binv;
   CalcKineticEnergyMatrixInverse(Binv);
@@ -731,15 +1067,16 @@ void NewtonEulerSolver::CalcKineticEnergyMatrixInverse(Matrix& Binv)
   //such that Bi = t-B^-1(C+G)
   //-B^-1(C+G) can be obtained by setting t=0, then q'' = -B^-1(C+G)
   Binv.resize(robot.links.size(),robot.links.size());
-  Vector t(robot.links.size());
-  Vector ddq0,ddq;
+  Vector& t = temp1;
+  Vector& ddq0 = temp0;
   t.setZero();
   CalcAccel(t,ddq0);
   for(int i=0;i<t.n;i++) {
+    Vector Binvi;
+    Binv.getColRef(i,Binvi);
     t(i) = 1;
-    CalcAccel(t,ddq);
-    ddq -= ddq0;
-    Binv.copyCol(i,ddq);
+    CalcAccel(t,Binvi);
+    Binvi -= ddq0;
     t(i) = 0;
   }
 }
@@ -747,40 +1084,35 @@ void NewtonEulerSolver::CalcKineticEnergyMatrixInverse(Matrix& Binv)
 void NewtonEulerSolver::MulKineticEnergyMatrixInverse(const Vector& x,Vector& Binvx)
 {
   Assert(x.n == (int)robot.links.size());
-  Vector t(robot.links.size());
-  Vector ddq0;
-  t.setZero();
-  CalcAccel(t,ddq0);
+  temp1.setZero();
+  CalcAccel(temp1,temp0);
   CalcAccel(x,Binvx);
-  Binvx -= ddq0;
+  Binvx -= temp0;
 }
 
 void NewtonEulerSolver::MulKineticEnergyMatrixInverse(const Matrix& A,Matrix& BinvA)
 {
   Assert(A.m == (int)robot.links.size());
-  Vector t(robot.links.size());
-  Vector ddq0;
-  t.setZero();
-  CalcAccel(t,ddq0);
+  temp1.setZero();
+  CalcAccel(temp1,temp0);
   BinvA.resize(A.m,A.n);
   for(int i=0;i<A.n;i++) {
     Vector Ai,BAi;
     A.getColRef(i,Ai);
     BinvA.getColRef(i,BAi);
     CalcAccel(Ai,BAi);
-    BAi -= ddq0;
+    BAi -= temp0;
   }
 }
 
 void NewtonEulerSolver::CalcResidualTorques(Vector& CG)
 {
-  Vector ddq(robot.links.size(),Zero);
-  CalcTorques(ddq,CG);
+  temp1.setZero();
+  CalcTorques(temp1,CG);
 }
 
 void NewtonEulerSolver::CalcResidualAccel(Vector& ddq0)
 {
-  Vector t(robot.links.size(),Zero);
-  CalcAccel(t,ddq0);
+  temp1.setZero();
+  CalcAccel(temp1,ddq0);
 }
-
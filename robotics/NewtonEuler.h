@@ -3,6 +3,7 @@
 
 #include "RobotDynamics3D.h"
 #include "Wrench.h"
+#include <KrisLibrary/math/SparseMatrixTemplate.h>
 
 
 /** @ingroup Kinematics
@@ -23,6 +24,23 @@
  *
  * externalWrenches are given about the link's center of mass.  jointWrenches
  * are given about the joint.
+ *
+ * CalcKineticEnergyMatrix uses the composite rigid body algorithm, which
+ * only visits the entries of B that are nonzero: B(i,j) is zero unless
+ * one of i,j is an ancestor of the other.  FactorKineticEnergyMatrix
+ * computes the LTDL factorization B = L^t D L, which has no fill-in
+ * outside of that pattern, and SolveKineticEnergyMatrix uses it to solve
+ * B x = f in O(n*depth) time.
+ *
+ * CalcTorquesDeriv and CalcAccelDeriv give the partial derivatives of
+ * inverse and forward dynamics with respect to q and dq, by
+ * differentiating the recursions above.  Each column takes one pass over
+ * the affected links, so the full Jacobians take O(n^2) time.  The
+ * external wrenches are treated as constant.
+ *
+ * All temporary storage is allocated in the constructor, so the CalcX,
+ * MulX, and factorization methods don't allocate memory as long as their
+ * output arguments already have the right size.
  */
 struct NewtonEulerSolver
 {
@@ -36,6 +54,16 @@ struct NewtonEulerSolver
   void CalcKineticEnergyMatrixInverse(Matrix& Binv);
   void CalcResidualTorques(Vector& CG);
   void CalcResidualAccel(Vector& ddq0);
+  bool FactorKineticEnergyMatrix();   ///<sparse LTDL factorization of the kinetic energy matrix.  Returns false if B is not positive definite.
+  void SolveKineticEnergyMatrix(const Vector& f,Vector& x) const;  ///<solves B x = f using the last factorization (x may equal f)
+  //partial derivatives of the torques from CalcTorques(ddq,t) with respect
+  //to q and the velocity dq.  (The derivative with respect to ddq is the
+  //kinetic energy matrix.)
+  void CalcTorquesDeriv(const Vector& ddq,Matrix& dt_dq,Matrix& dt_dqdot);
+  //partial derivatives of the accelerations from CalcAccel(t,ddq) with
+  //respect to q and dq.  (The derivative with respect to t is B^-1.)
+  //Returns false if B is not positive definite.
+  bool CalcAccelDeriv(const Vector& t,Matrix& dddq_dq,Matrix& dddq_dqdot);
 
   //helpers (also assume current state of robot has been updated)
   void MulKineticEnergyMatrix(const Vector& x,Vector& Bx);
@@ -43,6 +71,7 @@ struct NewtonEulerSolver
   void MulKineticEnergyMatrixInverse(const Vector& x,Vector& Binvx);
   void MulKineticEnergyMatrixInverse(const Matrix& A,Matrix& BinvA);
   void CalcVelocities();
+  void CalcCompositeInertias();
   void CalcLinkAccel(const Vector& ddq);
   void SelfTest();
 
@@ -56,6 +85,15 @@ struct NewtonEulerSolver
   std::vector<Wrench> jointWrenches;  ///<element i is the force on link i from the joint to its parent
   std::vector<SpatialMatrix> inertiaMatrices;  ///<element i is the i'th inertia matrix computed in the featherstone algorithm
   std::vector<SpatialVector> biasingForces;     ///<element i is the i'th biasing force computed in the featherstone algorithm
+  std::vector<SpatialVector> velDepAccels;      ///<element i is the velocity dependent (centrifugal and coriolis) acceleration of link i about its center of mass
+  std::vector<Real> compositeMasses;             ///<element i is the mass of the subtree rooted at i
+  std::vector<Vector3> compositeMoments;         ///<element i is the first mass moment (mass*com) of the subtree, in world coordinates
+  std::vector<Matrix3> compositeInertias;        ///<element i is the rotational inertia of the subtree about the world origin
+  SparseMatrixTemplate_CR<Real> Bfactor;  ///<L (off-diagonal) and D (diagonal) of the LTDL factorization.  Row i holds the ancestors of i in increasing order, then i.
+  Vector temp0,temp1;   ///<temporaries for the helpers
+  std::vector<RigidBodyVelocity> dvelocities,daccelerations;  ///<derivatives of velocities/accelerations w.r.t. one variable
+  std::vector<Wrench> djointWrenches;   ///<derivatives of jointWrenches w.r.t. one variable
+  std::vector<char> derivAffected;      ///<1 for links that move with the variable, 2 for their ancestors
 };
 
 #endif
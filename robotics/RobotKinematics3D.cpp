@@ -14,6 +14,7 @@ void RobotKinematics3D::Initialize(int numLinks)
   q.resize(numLinks,Zero);
   qMin.resize(numLinks,-Inf);
   qMax.resize(numLinks,Inf);
+  InvalidateFrames();
 }
 
 void RobotKinematics3D::InitializeRigidObject()
@@ -23,6 +24,7 @@ void RobotKinematics3D::InitializeRigidObject()
   q.resize(6,Zero);
   qMin.resize(6,-Inf);
   qMax.resize(6,Inf);
+  InvalidateFrames();
   links[0].SetTranslationJoint(Vector3(1,0,0));
   links[1].SetTranslationJoint(Vector3(0,1,0));
   links[2].SetTranslationJoint(Vector3(0,0,1));
@@ -159,28 +161,18 @@ void RobotKinematics3D::UpdateFrames()
 {
   //based on the values in q, update the frames T
   //Assert(HasValidOrdering());
-  Frame3D Ti;
   //get local transform T(i->i)(q)
   //then do the parent transformations to get them to T(i->0)(q)
   //since the chain is top down, we can loop straight through
   //given parent j and T(j->0)(q), we have
   //T(i->0)(q) = T(j->0)(q)*T0(i->j)*T(i->i)(q)
-  for(size_t i=0;i<links.size();i++) {
-    RobotLink3D& li = links[i];
-    li.GetLocalTransform(q(i),Ti);
-    int pi=parents[i];
-    if(pi==-1)
-      li.T_World.mul(li.T0_Parent,Ti);
-    else {
-      li.T_World.mul(links[pi].T_World,li.T0_Parent);
-      li.T_World*=Ti;
-    }
-  }
+  if(frameVersions.size() != links.size()) InvalidateFrames();
+  for(size_t i=0;i<links.size();i++)
+    UpdateLinkFrame(i);
 }
 
 void RobotKinematics3D::UpdateSelectedFrames(int link,int base)
 {
-  Frame3D Ti;
   vector<int> updlinks;
   while(link != base) {
     updlinks.push_back(link);
@@ -189,18 +181,88 @@ void RobotKinematics3D::UpdateSelectedFrames(int link,int base)
   if(base != -1)
     updlinks.push_back(base);
   reverse(updlinks.begin(),updlinks.end());
-  for(size_t k=0;k<updlinks.size();k++) {
-    int i = updlinks[k];
-    RobotLink3D& li = links[i];
-    li.GetLocalTransform(q(i),Ti);
-    int pi=parents[i];
-    if(pi==-1)
-      li.T_World.mul(li.T0_Parent,Ti);
-    else {
-      li.T_World.mul(links[pi].T_World,li.T0_Parent);
-      li.T_World*=Ti;
+  if(frameVersions.size() != links.size()) InvalidateFrames();
+  for(size_t k=0;k<updlinks.size();k++)
+    UpdateLinkFrame(updlinks[k]);
+}
+
+void RobotKinematics3D::UpdateLinkFrame(int i)
+{
+  Frame3D Ti;
+  RobotLink3D& li = links[i];
+  li.GetLocalTransform(q(i),Ti);
+  int pi=parents[i];
+  if(pi==-1) {
+    li.T_World.mul(li.T0_Parent,Ti);
+    frameParentVersions[i] = 0;
+  }
+  else {
+    li.T_World.mul(links[pi].T_World,li.T0_Parent);
+    li.T_World*=Ti;
+    frameParentVersions[i] = frameVersions[pi];
+  }
+  qFrames(i) = q(i);
+  frameInvalid[i] = 0;
+  frameVersions[i]++;
+}
+
+//true if link i needs an update given that its parent is current
+static inline bool FrameChanged(const RobotKinematics3D& robot,int i)
+{
+  if(robot.frameInvalid[i]) return true;
+  if(robot.q(i) != robot.qFrames(i)) return true;
+  int p = robot.parents[i];
+  return (p >= 0 && robot.frameParentVersions[i] != robot.frameVersions[p]);
+}
+
+//updates the ancestors of link top down, then link itself
+static void UpdateChangedFramesRecurse(RobotKinematics3D& robot,int link)
+{
+  if(robot.parents[link] >= 0)
+    UpdateChangedFramesRecurse(robot,robot.parents[link]);
+  if(FrameChanged(robot,link))
+    robot.UpdateLinkFrame(link);
+}
+
+int RobotKinematics3D::UpdateChangedFrames()
+{
+  if(frameVersions.size() != links.size()) InvalidateFrames();
+  //links are topologically sorted, so a recomputed parent has already
+  //bumped its version by the time its children are checked
+  int numUpdated = 0;
+  for(size_t i=0;i<links.size();i++) {
+    if(FrameChanged(*this,i)) {
+      UpdateLinkFrame(i);
+      numUpdated++;
     }
   }
+  return numUpdated;
+}
+
+void RobotKinematics3D::UpdateChangedFrames(int link)
+{
+  if(frameVersions.size() != links.size()) InvalidateFrames();
+  UpdateChangedFramesRecurse(*this,link);
+}
+
+bool RobotKinematics3D::IsFrameCurrent(int link) const
+{
+  if(frameVersions.size() != links.size()) return false;
+  for(int i=link;i>=0;i=parents[i])
+    if(FrameChanged(*this,i)) return false;
+  return true;
+}
+
+void RobotKinematics3D::InvalidateFrames()
+{
+  //versions only increase, so that data derived from the old frames
+  //stays out of date
+  frameVersions.resize(links.size(),0);
+  frameParentVersions.resize(links.size(),0);
+  qFrames.resize(links.size(),Zero);
+  frameInvalid.assign(links.size(),1);
+  for(size_t i=0;i<links.size();i++)
+    frameVersions[i]++;
 }
 
 bool RobotKinematics3D::InJointLimits(const Config& q) const
@@ -691,12 +753,16 @@ Real RobotKinematics3D::PointDistanceBound(const Vector3& pi,int i,const Config&
 
   Real distanceToPoint=pi.norm();
   while(n != -1) {
+    Real wn = links[n].w.norm();
     if(links[n].type == RobotLink3D::Prismatic)
-      sumdist += Abs(q1(n)-q2(n));
+      sumdist += wn*Abs(q1(n)-q2(n));
     else
-      sumdist += distanceToPoint*Abs(q1(n)-q2(n));
+      sumdist += wn*distanceToPoint*Abs(q1(n)-q2(n));
 
     distanceToPoint += links[n].T0_Parent.t.norm();
+    //the joint's translation also moves the point away from the parent
+    if(links[n].type == RobotLink3D::Prismatic)
+      distanceToPoint += wn*Max(Abs(q1(n)),Abs(q2(n)));
     n = parents[n];
   }
   return sumdist;
@@ -4,6 +4,7 @@
 #include "RobotLink3D.h"
 #include "Chain.h"
 #include <KrisLibrary/math/matrix.h>
+#include <stdint.h>
 
 /** @file RobotKinematics3D.h @ingroup Kinematics 
  * Defines a Config and a RobotKinematics3D.
@@ -29,6 +30,17 @@ typedef Vector Config;
  * (i.e. in planners, simulators, etc.) so you should count on the state
  * being changed.  If you need to store state, copy out the current
  * configuration.
+ *
+ * When only a few joints change between updates, UpdateChangedFrames()
+ * recomputes only the links whose joint values differ from those used in
+ * the last update, and their descendants.  UpdateChangedFrames(link)
+ * does the same lazily, for just the links that the given link depends
+ * on, so it can be called right before querying that link.  Each link
+ * has a version counter, frameVersions[i], which is incremented whenever
+ * its frame is recomputed, so that derived data (e.g., collision geometry
+ * transforms) can tell whether it is stale.  Versions start at 1, so 0
+ * never matches a computed frame.  If T0_Parent, the joint
+ * axes, or the parents are changed, call InvalidateFrames().
  */
 class RobotKinematics3D : public Chain
 {
@@ -52,6 +64,17 @@ public:
   void UpdateSelectedFrames(int link,int root=-1);
   /// sets the current config q and updates frames
   void UpdateConfig(const Config& q);
+  /// updates only the frames affected by joints that changed since the
+  /// last update, and returns the number of links that were recomputed
+  int UpdateChangedFrames();
+  /// updates only the frames that link depends on, if they have changed
+  void UpdateChangedFrames(int link);
+  /// returns true if the frame of link is consistent with q
+  bool IsFrameCurrent(int link) const;
+  /// marks all frames as needing an update
+  void InvalidateFrames();
+  /// computes the frame of link i from its parent's frame and q(i)
+  void UpdateLinkFrame(int i);
 
   /// returns true if q is within joint limits
   bool InJointLimits(const Config& q) const;
@@ -86,7 +109,9 @@ public:
   bool GetOrientationJacobian(int i, int j, Vector3& dw) const;
   bool GetPositionJacobian(const Vector3& pi, int i, int j, Vector3& dv) const;
   ///gets the jacobian matrix of pi w.r.t q
-  ///row 0-2 are angular, 3-5 are translational
+  ///row 0-2 are angular, 3-5 are translational.  J is only reallocated if
+  ///its dimensions differ from 6 x q.n, so it may refer to preallocated
+  ///storage (e.g., a SmallMatrix, via getRef).
   void GetFullJacobian(const Vector3& pi, int i, Matrix& J) const;
   ///rows 3-5 of the above
   void GetPositionJacobian(const Vector3& pi, int i, Matrix& J) const;
@@ -110,7 +135,9 @@ public:
   void GetDirectionalHessian(const Vector3& pm, int m, const Vector3& v, Matrix& Hpv) const;
 
   ///Upper bounds the distance traveled by the point (attached to link i's
-  ///frame) when moving from q1 to q2 (in a linear interpolation).
+  ///frame) when moving from q1 to q2 (in a linear interpolation).  Only
+  ///|pi| is used, so this also bounds the motion of any point within |pi|
+  ///of link i's origin.
   Real PointDistanceBound(const Vector3& pi,int i,const Config& q1,const Config& q2) const;
   ///A closer upper bound than the previous.  Overwrites robot's state.
   Real PointDistanceBound2(const Vector3& pi,int i,const Config& q1,const Config& q2);
@@ -123,6 +150,14 @@ public:
   std::vector<RobotLink3D> links;
   Config q;           ///< current configuration
   Vector qMin,qMax;   ///< joint limits
+
+  ///Bookkeeping for the selective updates: the version of each link's
+  ///frame, the joint value and parent version it was computed from, and
+  ///whether the frame was invalidated since
+  std::vector<uint64_t> frameVersions;
+  std::vector<uint64_t> frameParentVersions;
+  Config qFrames;
+  std::vector<char> frameInvalid;
 };
 
 
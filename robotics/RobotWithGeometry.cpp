@@ -3,6 +3,8 @@
 #include <meshing/IO.h>
 #include <errors.h>
 #include <Timer.h>
+#include <math/random.h>
+#include <utils/threadutils.h>
 #include <GLdraw/GL.h>
 #include <GLdraw/drawextra.h>
 //#include <GLdraw/drawMesh.h>
@@ -41,6 +43,8 @@ void RobotWithGeometry::Initialize(int n)
   geometry.resize(n);
   selfCollisions.resize(n,n,NULL);
   envCollisions.resize(n,NULL);
+  geometryFrameVersions.clear();
+  geometryBounds.clear();
 }
 
 void RobotWithGeometry::Merge(const std::vector<RobotWithGeometry*>& robots)
@@ -55,6 +59,8 @@ void RobotWithGeometry::Merge(const std::vector<RobotWithGeometry*>& robots)
   geometry.resize(n);
   selfCollisions.resize(n,n,NULL);
   envCollisions.resize(n,NULL);
+  geometryFrameVersions.clear();
+  geometryBounds.clear();
   
   size_t nl = 0;
   vector<size_t> offset(robots.size());
@@ -87,6 +93,8 @@ const RobotWithGeometry& RobotWithGeometry::operator = (const RobotWithGeometry&
   geometry.resize(n);
   selfCollisions.resize(n,n,NULL);
   envCollisions.resize(n,NULL);
+  geometryFrameVersions.clear();
+  geometryBounds.clear();
   geometry = rhs.geometry;
   for(int j=0;j<n;j++) {
     if(rhs.envCollisions[j])
@@ -109,6 +117,8 @@ const RobotWithGeometry& RobotWithGeometry::operator = (const RobotDynamics3D& r
   geometry.resize(n);
   selfCollisions.resize(n,n,NULL);
   envCollisions.resize(n,NULL);
+  geometryFrameVersions.clear();
+  geometryBounds.clear();
   return *this;
 }
 
@@ -197,6 +207,103 @@ void RobotWithGeometry::CleanupSelfCollisions()
       SafeDelete(selfCollisions(i,j));
 }
 
+//state for one thread of DisableNeverCollidingPairs
+struct NeverCollideTask
+{
+  const RobotWithGeometry* robot;
+  const vector<Config>* samples;
+  const vector<pair<int,int> >* pairs;
+  int start,end;
+  vector<char> collided;
+};
+
+static void* NeverCollideThread(void* data)
+{
+  NeverCollideTask& task = *(NeverCollideTask*)data;
+  const RobotWithGeometry& robot = *task.robot;
+  const vector<pair<int,int> >& pairs = *task.pairs;
+  //this thread's copies of the kinematics and geometry
+  RobotKinematics3D kin = robot;
+  vector<shared_ptr<RobotWithGeometry::CollisionGeometry> > geometry(robot.links.size());
+  for(size_t k=0;k<pairs.size();k++) {
+    int i=pairs[k].first,j=pairs[k].second;
+    if(!geometry[i]) geometry[i] = make_shared<RobotWithGeometry::CollisionGeometry>(*robot.geometry[i]);
+    if(!geometry[j]) geometry[j] = make_shared<RobotWithGeometry::CollisionGeometry>(*robot.geometry[j]);
+  }
+  vector<shared_ptr<RobotWithGeometry::CollisionQuery> > queries(pairs.size());
+  for(size_t k=0;k<pairs.size();k++)
+    queries[k] = make_shared<RobotWithGeometry::CollisionQuery>(*geometry[pairs[k].first],*geometry[pairs[k].second]);
+  vector<int> active(pairs.size());
+  for(size_t k=0;k<pairs.size();k++) active[k]=(int)k;
+  task.collided.assign(pairs.size(),0);
+  vector<AABB3D> bbs(robot.links.size());
+  for(int s=task.start;s<task.end && !active.empty();s++) {
+    kin.UpdateConfig((*task.samples)[s]);
+    for(size_t i=0;i<geometry.size();i++)
+      if(geometry[i]) {
+        geometry[i]->SetTransform(kin.links[i].T_World);
+        bbs[i] = geometry[i]->GetAABB();
+      }
+    for(size_t a=0;a<active.size();a++) {
+      int k=active[a];
+      if(!bbs[pairs[k].first].intersects(bbs[pairs[k].second])) continue;
+      if(queries[k]->Collide()) {
+        task.collided[k] = 1;
+        active[a] = active.back();
+        active.resize(active.size()-1);
+        a--;
+      }
+    }
+  }
+  return NULL;
+}
+
+int RobotWithGeometry::DisableNeverCollidingPairs(int numSamples,int numThreads)
+{
+  vector<pair<int,int> > pairs;
+  for(int i=0;i<selfCollisions.m;i++)
+    for(int j=i+1;j<selfCollisions.n;j++)
+      if(selfCollisions(i,j) && !IsGeometryEmpty(i) && !IsGeometryEmpty(j))
+        pairs.push_back(pair<int,int>(i,j));
+  if(pairs.empty() || numSamples <= 0) return 0;
+
+  //sample on this thread so the result doesn't depend on the thread count
+  vector<Config> samples(numSamples);
+  for(int s=0;s<numSamples;s++) {
+    samples[s] = q;
+    for(size_t i=0;i<links.size();i++) {
+      if(IsFinite(qMin(i)) && IsFinite(qMax(i)))
+        samples[s](i) = Rand(qMin(i),qMax(i));
+      else if(links[i].type == RobotLink3D::Revolute)
+        samples[s](i) = Rand(-Pi,Pi);
+    }
+  }
+
+  int nt = Min(ThreadCount(numThreads),numSamples);
+  vector<NeverCollideTask> tasks(nt);
+  for(int t=0;t<nt;t++) {
+    tasks[t].robot = this;
+    tasks[t].samples = &samples;
+    tasks[t].pairs = &pairs;
+    tasks[t].start = numSamples*t/nt;
+    tasks[t].end = numSamples*(t+1)/nt;
+  }
+  if(nt == 1) NeverCollideThread(&tasks[0]);
+  else ThreadRunAll(NeverCollideThread,tasks);
+
+  int numDisabled = 0;
+  for(size_t k=0;k<pairs.size();k++) {
+    bool collided = false;
+    for(int t=0;t<nt;t++)
+      if(tasks[t].collided[k]) collided = true;
+    if(!collided) {
+      SafeDelete(selfCollisions(pairs[k].first,pairs[k].second));
+      numDisabled++;
+    }
+  }
+  return numDisabled;
+}
+
 void RobotWithGeometry::UpdateGeometry()
 {
   for(size_t i=0;i<links.size();i++) 
@@ -206,6 +313,20 @@ void RobotWithGeometry::UpdateGeometry()
 void RobotWithGeometry::UpdateGeometry(int i)
 {
   if(geometry[i]) geometry[i]->SetTransform(links[i].T_World);
+  if(geometryFrameVersions.size() == links.size() && frameVersions.size() == links.size())
+    geometryFrameVersions[i] = frameVersions[i];
+}
+
+void RobotWithGeometry::UpdateChangedGeometry()
+{
+  UpdateChangedFrames();
+  if(geometryFrameVersions.size() != links.size())
+    geometryFrameVersions.assign(links.size(),0);
+  for(size_t i=0;i<links.size();i++)
+    if(geometryFrameVersions[i] != frameVersions[i]) {
+      UpdateGeometry(i);
+      geometryFrameVersions[i] = frameVersions[i];
+    }
 }
 
 void RobotWithGeometry::InitMeshCollision(CollisionGeometry& mesh)
@@ -251,11 +372,11 @@ bool RobotWithGeometry::SelfCollision(const vector<int>& bodies,Real distance)
   vector<int> validbodies;
   validbodies.reserve(bodies.size());
   for(size_t i=0;i<bodies.size();i++) 
-    if(!IsGeometryEmpty(i)) validbodies.push_back(bodies[i]);
+    if(!IsGeometryEmpty(bodies[i])) validbodies.push_back(bodies[i]);
   vector<AABB3D> bbs(validbodies.size());
   for(size_t i=0;i<validbodies.size();i++) 
-    bbs[i] = geometry[validbodies[i]]->GetAABB();
-  if(distance != 0) {
+    bbs[i] = GetGeometryBounds(validbodies[i]).aabb;
+  if(distance > 0) {
     //adjust bounding  boxes
     Vector3 d(distance*0.5);
     for(size_t i=0;i<bbs.size();i++) {
@@ -267,7 +388,7 @@ bool RobotWithGeometry::SelfCollision(const vector<int>& bodies,Real distance)
   //now check collisions, ensuring BBs overlap
   for(size_t i=0;i<validbodies.size();i++) {
     for(size_t j=i+1;j<validbodies.size();j++) {
-      CollisionQuery* query=selfCollisions(validbodies[i],validbodies[j]);
+      CollisionQuery* query=selfCollisions(Min(validbodies[i],validbodies[j]),Max(validbodies[i],validbodies[j]));
       if(query == NULL) continue;
       if(!bbs[i].intersects(bbs[j])) continue;
       if(UnderCollisionMargin(query,distance)) return true;
@@ -289,10 +410,10 @@ bool RobotWithGeometry::SelfCollision(const vector<int>& set1,const vector<int>&
   if(valid1.empty() || valid2.empty()) return false;
   vector<AABB3D> bbs1(valid1.size()),bbs2(valid2.size());
   for(size_t i=0;i<valid1.size();i++) 
-    bbs1[i] = geometry[valid1[i]]->GetAABB();
+    bbs1[i] = GetGeometryBounds(valid1[i]).aabb;
   for(size_t i=0;i<valid2.size();i++) 
-    bbs2[i] = geometry[valid2[i]]->GetAABB();
-  if(distance != 0) {
+    bbs2[i] = GetGeometryBounds(valid2[i]).aabb;
+  if(distance > 0) {
     //adjust bounding  boxes
     Vector3 d(distance*0.5);
     for(size_t i=0;i<bbs1.size();i++) {
@@ -318,7 +439,8 @@ bool RobotWithGeometry::SelfCollision(const vector<int>& set1,const vector<int>&
 	valid2.resize(valid2.size()-1);
 	i--;
       }
-    bb2 = bbs1[0];
+    if(valid2.empty()) return false;
+    bb2 = bbs2[0];
     for(size_t i=1;i<bbs2.size();i++)
       bb2.setUnion(bbs2[i]);
     for(size_t i=0;i<valid1.size();i++)
@@ -335,7 +457,7 @@ bool RobotWithGeometry::SelfCollision(const vector<int>& set1,const vector<int>&
   //now check collisions, ensuring BBs overlap
   for(size_t i=0;i<valid1.size();i++) {
     for(size_t j=0;j<valid2.size();j++) {
-      CollisionQuery* query=selfCollisions(valid2[i],valid2[j]);
+      CollisionQuery* query=selfCollisions(Min(valid1[i],valid2[j]),Max(valid1[i],valid2[j]));
       if(query == NULL) continue;
       if(!bbs1[i].intersects(bbs2[j])) continue;
       if(UnderCollisionMargin(query,distance)) return true;
@@ -344,67 +466,82 @@ bool RobotWithGeometry::SelfCollision(const vector<int>& set1,const vector<int>&
   return false;
 }
 
-bool RobotWithGeometry::SelfCollision(Real distance)
+const RobotWithGeometry::GeometryBounds& RobotWithGeometry::GetGeometryBounds(int i)
 {
-  //get world space bounding boxes for quick reject test
-  vector<int> validbodies;
-  validbodies.reserve(links.size());
-  for(size_t i=0;i<links.size();i++) 
-    if(!IsGeometryEmpty(i)) validbodies.push_back(i);
-  vector<AABB3D> bbs(validbodies.size());
-  for(size_t i=0;i<validbodies.size();i++) {
-    bbs[i] = geometry[validbodies[i]]->GetAABB();
+  if(geometryBounds.size() != geometry.size()) {
+    GeometryBounds invalid;
+    invalid.source = NULL;
+    geometryBounds.assign(geometry.size(),invalid);
   }
-  if(distance != 0) {
-    //adjust bounding  boxes
-    Vector3 d(distance*0.5);
-    for(size_t i=0;i<bbs.size();i++) {
-      bbs[i].bmin -= d;
-      bbs[i].bmax += d;
-    }
+  GeometryBounds& b = geometryBounds[i];
+  RigidTransform T = geometry[i]->GetTransform();
+  if(b.source != geometry[i].get() || !(b.T.R == T.R) || !(b.T.t == T.t)) {
+    b.source = geometry[i].get();
+    b.T = T;
+    b.aabb = geometry[i]->GetAABB();
+    b.obb = geometry[i]->GetBB();
   }
-  //if |validbodies| > 300, you may want to use the functions in geometry/RangeQuery.h
-  //now check collisions, ensuring BBs overlap
-  for(size_t i=0;i<validbodies.size();i++) {
-    for(size_t j=i+1;j<validbodies.size();j++) {
-      CollisionQuery* query=selfCollisions(validbodies[i],validbodies[j]);
-      if(query == NULL) continue;
-      if(!bbs[i].intersects(bbs[j])) continue;
-      if(UnderCollisionMargin(query,distance)) return true;
+  return b;
+}
+
+static inline bool IntersectsExpanded(const Box3D& a,const Box3D& b,Real d)
+{
+  if(d == 0) return a.intersects(b);
+  Box3D a2=a,b2=b;
+  a2.dims += Vector3(d*2.0);
+  a2.origin -= d*(a2.xbasis+a2.ybasis+a2.zbasis);
+  b2.dims += Vector3(d*2.0);
+  b2.origin -= d*(b2.xbasis+b2.ybasis+b2.zbasis);
+  return a2.intersects(b2);
+}
+
+void RobotWithGeometry::SelfCollisionCandidates(vector<pair<int,int> >& pairs,Real distance)
+{
+  pairs.resize(0);
+  //penetration allowances don't shrink the boxes
+  Real d = (distance > 0 ? distance*0.5 : 0);
+  //sweep along x, in order of the lower bounds
+  vector<pair<Real,int> > order;
+  order.reserve(links.size());
+  for(size_t i=0;i<links.size();i++)
+    if(!IsGeometryEmpty(i)) order.push_back(pair<Real,int>(GetGeometryBounds(i).aabb.bmin.x,(int)i));
+  sort(order.begin(),order.end());
+  for(size_t a=0;a<order.size();a++) {
+    int i=order[a].second;
+    const GeometryBounds& bi = geometryBounds[i];
+    Real xmax = bi.aabb.bmax.x + 2*d;
+    for(size_t b=a+1;b<order.size();b++) {
+      if(order[b].first > xmax) break;
+      int j=order[b].second;
+      if(selfCollisions(Min(i,j),Max(i,j)) == NULL) continue;
+      const GeometryBounds& bj = geometryBounds[j];
+      if(bi.aabb.bmin.y > bj.aabb.bmax.y + 2*d || bj.aabb.bmin.y > bi.aabb.bmax.y + 2*d) continue;
+      if(bi.aabb.bmin.z > bj.aabb.bmax.z + 2*d || bj.aabb.bmin.z > bi.aabb.bmax.z + 2*d) continue;
+      if(!IntersectsExpanded(bi.obb,bj.obb,d)) continue;
+      pairs.push_back(pair<int,int>(Min(i,j),Max(i,j)));
     }
   }
+}
+
+bool RobotWithGeometry::SelfCollision(Real distance)
+{
+  SelfCollisionCandidates(candidatePairs,distance);
+  for(size_t k=0;k<candidatePairs.size();k++) {
+    CollisionQuery* query=selfCollisions(candidatePairs[k].first,candidatePairs[k].second);
+    if(UnderCollisionMargin(query,distance)) return true;
+  }
   return false;
 }
 
 void RobotWithGeometry::SelfCollisions(vector<pair<int,int> >& pairs,Real distance)
 {
-  //get world space bounding boxes for quick reject test
-  vector<int> validbodies;
-  validbodies.reserve(links.size());
-  for(size_t i=0;i<links.size();i++) 
-    if(!IsGeometryEmpty(i)) validbodies.push_back(i);
-  vector<AABB3D> bbs(validbodies.size());
-  for(size_t i=0;i<validbodies.size();i++) 
-    bbs[i] = geometry[validbodies[i]]->GetAABB();
-  if(distance != 0) {
-    //adjust bounding  boxes
-    Vector3 d(distance*0.5);
-    for(size_t i=0;i<bbs.size();i++) {
-      bbs[i].bmin -= d;
-      bbs[i].bmax += d;
-    }
+  SelfCollisionCandidates(candidatePairs,distance);
+  //report in the same (i,j) order as a full enumeration
+  sort(candidatePairs.begin(),candidatePairs.end());
+  for(size_t k=0;k<candidatePairs.size();k++) {
+    CollisionQuery* query=selfCollisions(candidatePairs[k].first,candidatePairs[k].second);
+    if(UnderCollisionMargin(query,distance)) pairs.push_back(candidatePairs[k]);
   }
-  //if |validbodies| > 300, you may want to use the functions in geometry/RangeQuery.h
-  //now check collisions, ensuring BBs overlap
-  for(size_t i=0;i<validbodies.size();i++) {
-    for(size_t j=i+1;j<validbodies.size();j++) {
-      CollisionQuery* query=selfCollisions(validbodies[i],validbodies[j]);
-      if(query == NULL) continue;
-      if(!bbs[i].intersects(bbs[j])) continue;
-      if(UnderCollisionMargin(query,distance)) pairs.push_back(pair<int,int>(validbodies[i],validbodies[j]));
-    }
-  }
-
 }
 
 
@@ -21,6 +21,15 @@ class RobotWithGeometry : public RobotDynamics3D
 public:
   typedef Geometry::AnyCollisionGeometry3D CollisionGeometry;
   typedef Geometry::AnyCollisionQuery CollisionQuery;
+  ///World-space bounding volumes of a geometry, cached for the self-collision
+  ///broad phase until the geometry moves
+  struct GeometryBounds
+  {
+    const CollisionGeometry* source;  ///<the geometry the bounds were computed for
+    RigidTransform T;    ///<the geometry's transform when the bounds were computed
+    AABB3D aabb;
+    Box3D obb;
+  };
   
   RobotWithGeometry();
   RobotWithGeometry(const RobotDynamics3D& rhs);
@@ -39,6 +48,12 @@ public:
   void InitSelfCollisionPairs(const Array2D<bool>& collision);
   void GetSelfCollisionPairs(Array2D<bool>& collision) const;
   void CleanupSelfCollisions();
+  /// Samples numSamples random configurations within the joint limits and
+  /// disables the self-collision pairs that collide in none of them.  The
+  /// samples are checked on numThreads threads (<= 0 uses the hardware
+  /// concurrency), each with its own copy of the geometry.  Returns the
+  /// number of pairs disabled.
+  int DisableNeverCollidingPairs(int numSamples,int numThreads=0);
 
   ///Creates this into a mega-robot from several other robots
   void Merge(const std::vector<RobotWithGeometry*>& robots);
@@ -51,9 +66,21 @@ public:
   /// Call this before querying self collisions
   virtual void UpdateGeometry();
   virtual void UpdateGeometry(int i);
+  /// Updates the changed frames (see UpdateChangedFrames()) and then only
+  /// the geometries whose frames were recomputed since they were last set.
+  /// Assumes geometries shared with other robots are not moved by them.
+  void UpdateChangedGeometry();
   /// Call this before querying environment collisions 
   virtual void InitMeshCollision(CollisionGeometry& mesh);
 
+  /// Returns the bounding volumes of geometry i, recomputing them if the
+  /// geometry has moved since they were cached
+  const GeometryBounds& GetGeometryBounds(int i);
+  /// Self-collision broad phase: returns the enabled pairs (i<j) whose
+  /// bounding boxes, each expanded by distance/2, overlap.  Pairs are found
+  /// by sweeping the AABBs along x and then tested with the OBBs.
+  void SelfCollisionCandidates(std::vector<std::pair<int,int> >& pairs,Real distance=0);
+
   virtual bool SelfCollision(Real distance=0);
   /// Query self-collision between links indexed by bodies. Faster than direct enumeration.
   virtual bool SelfCollision(const std::vector<int>& bodies, Real distance=0);
@@ -74,6 +101,14 @@ public:
   ///matrix(i,j) of collisions between bodies, i < j (upper triangular)
   Array2D<CollisionQuery*> selfCollisions;
   std::vector<CollisionQuery*> envCollisions;
+  ///frameVersions[i] at the time geometry i's transform was last set (0
+  ///if never)
+  std::vector<uint64_t> geometryFrameVersions;
+
+  ///cached bounding volumes of the geometries
+  std::vector<GeometryBounds> geometryBounds;
+  ///temporary for the broad phase
+  std::vector<std::pair<int,int> > candidatePairs;
 };
 
 #endif
@@ -1,10 +1,20 @@
 #include <KrisLibrary/Logger.h>
 #include <math/random.h>
 #include <math/VectorPrinter.h>
+#include <math/MatrixPrinter.h>
 #include <math3d/random.h>
 #include "Rotation.h"
 #include "NewtonEuler.h"
 #include "RLG.h"
+#include "BatchedKinematics.h"
+#include "MultiStartIK.h"
+#include "RobotWithGeometry.h"
+#include "SweptVolumeEdgeChecker.h"
+#include "Stability.h"
+#include <geometry/ConvexHull2D.h>
+#include <geometry/Fitting.h>
+#include <math3d/Plane3D.h>
+#include <meshing/MeshPrimitives.h>
 #include <errors.h>
 #include "SelfTest.h"
 using namespace Math;
@@ -298,4 +308,629 @@ void TestNewtonEuler()
     //ne.SetGravityWrenches(Vector3(0,0,-9.8));
     ne.SelfTest();
   }
+  //a branched robot, where B is sparse
+  int n=10;
+  robot.Initialize(n);
+  MakePlanarChain(robot,n,One);
+  for(int i=1;i<n;i++) robot.parents[i] = RandInt(i);
+  for(int i=0;i<n;i++) {
+    robot.q(i) = Rand(-1.0,1.0);
+    robot.dq(i) = Rand(-10.0,10.0);
+  }
+  robot.UpdateFrames();
+  robot.UpdateDynamics();
+  NewtonEulerSolver ne(robot);
+  ne.SelfTest();
+}
+
+void TestBatchedKinematics()
+{
+  //a tree with general axes, offsets, and prismatic joints
+  int n=12;
+  RobotKinematics3D robot;
+  MakePlanarChain(robot,n,One);
+  for(int i=0;i<n;i++) {
+    if(i > 0) robot.parents[i] = RandInt(i);
+    RigidTransform T;
+    QuaternionRotation rot(RandRotation());
+    rot.getMatrix(T.R);
+    SampleCube(One,T.t);
+    robot.links[i].T0_Parent = T;
+    Vector3 w;
+    SampleSphere(Rand(0.5,2.0),w);
+    if(i%3 == 2) robot.links[i].SetTranslationJoint(w);
+    else robot.links[i].SetRotationJoint(w);
+  }
+  robot.links[1].SetRotationJoint(Vector3(1,0,0));
+  vector<Config> qs(300);
+  for(size_t k=0;k<qs.size();k++) {
+    qs[k].resize(n);
+    for(int i=0;i<n;i++) qs[k](i) = Rand(-Pi,Pi);
+  }
+  BatchedFrames frames;
+  for(int numThreads=1;numThreads<=2;numThreads++) {
+    BatchedForwardKinematics(robot,qs,frames,numThreads);
+    Assert(frames.numLinks == n && frames.size == (int)qs.size());
+    for(size_t k=0;k<qs.size();k++) {
+      robot.UpdateConfig(qs[k]);
+      for(int i=0;i<n;i++) {
+        Frame3D T;
+        frames.get(k,i,T);
+        if(!T.R.isEqual(robot.links[i].T_World.R,1e-8) || !T.t.isEqual(robot.links[i].T_World.t,1e-8)) {
+          LOG4CXX_ERROR(KrisLibrary::logger(),"Batched FK mismatch at config "<<k<<" link "<<i);
+          Abort();
+        }
+      }
+    }
+  }
+}
+
+void TestChangedFrames()
+{
+  int n=30;
+  RobotKinematics3D robot;
+  MakePlanarChain(robot,n,One);
+  for(int i=1;i<n;i++) robot.parents[i] = RandInt(i);
+  robot.InvalidateFrames();
+  for(int i=0;i<n;i++) robot.q(i) = Rand(-Pi,Pi);
+  int numUpdated = robot.UpdateChangedFrames();
+  int numUpdated2 = robot.UpdateChangedFrames();
+  if(numUpdated != n || numUpdated2 != 0) {
+    LOG4CXX_ERROR(KrisLibrary::logger(),"UpdateChangedFrames updated "<<numUpdated<<" then "<<numUpdated2<<" frames, should be "<<n<<" then 0");
+    Abort();
+  }
+  RobotKinematics3D ref = robot;
+  for(int iter=0;iter<100;iter++) {
+    //move a couple of joints; the moved links and their descendants
+    //should be recomputed, and nothing else
+    vector<bool> moved(n,false);
+    for(int m=0;m<2;m++) {
+      int j = RandInt(n);
+      robot.q(j) = Rand(-Pi,Pi);
+      moved[j] = true;
+    }
+    for(int i=0;i<n;i++)
+      if(robot.parents[i] >= 0 && moved[robot.parents[i]]) moved[i] = true;
+    ref.UpdateConfig(robot.q);
+    vector<uint64_t> versions = robot.frameVersions;
+    if(iter%2==0) {
+      //lazy update of a single link
+      int k = RandInt(n);
+      robot.UpdateChangedFrames(k);
+      if(!robot.IsFrameCurrent(k) || !robot.links[k].T_World.R.isEqual(ref.links[k].T_World.R,1e-12) || !robot.links[k].T_World.t.isEqual(ref.links[k].T_World.t,1e-12)) {
+        LOG4CXX_ERROR(KrisLibrary::logger(),"Lazy frame update mismatch at iteration "<<iter<<" link "<<k);
+        Abort();
+      }
+      for(int i=0;i<n;i++)
+        if(robot.frameVersions[i] != versions[i] && !moved[i]) {
+          LOG4CXX_ERROR(KrisLibrary::logger(),"Lazy frame update of link "<<k<<" recomputed unmoved link "<<i);
+          Abort();
+        }
+    }
+    robot.UpdateChangedFrames();
+    for(int i=0;i<n;i++) {
+      bool recomputed = (robot.frameVersions[i] == versions[i]+1);
+      if(!robot.IsFrameCurrent(i) || recomputed != moved[i] || !robot.links[i].T_World.R.isEqual(ref.links[i].T_World.R,1e-12) || !robot.links[i].T_World.t.isEqual(ref.links[i].T_World.t,1e-12)) {
+        LOG4CXX_ERROR(KrisLibrary::logger(),"Changed frame update mismatch at iteration "<<iter<<" link "<<i<<", moved "<<(int)moved[i]<<", recomputed "<<(int)recomputed);
+        Abort();
+      }
+    }
+  }
+  //invalidation forces a full update
+  robot.links[0].T0_Parent.t.x += 1;
+  robot.InvalidateFrames();
+  bool current = robot.IsFrameCurrent(n-1);
+  numUpdated = robot.UpdateChangedFrames();
+  if(current || numUpdated != n) {
+    LOG4CXX_ERROR(KrisLibrary::logger(),"After InvalidateFrames, UpdateChangedFrames updated "<<numUpdated<<" frames, should be "<<n);
+    Abort();
+  }
+}
+
+//checks an analytic Jacobian of CalcTorques(arg) or CalcAccel(arg) (if
+//forward is true) with respect to x (robot.q or robot.dq) against central
+//differences
+static bool CheckDynamicsDeriv(const char* name,const Matrix& J,Vector& x,RobotDynamics3D& robot,NewtonEulerSolver& ne,
+			       const Vector& arg,bool forward,Real h=1e-6,Real tol=1e-4)
+{
+  Vector f1,f2,x0=x;
+  Matrix Jdiff(J.m,J.n);
+  for(int k=0;k<x.n;k++) {
+    x(k) = x0(k)+h;
+    robot.UpdateFrames();
+    if(forward) ne.CalcAccel(arg,f2); else ne.CalcTorques(arg,f2);
+    x(k) = x0(k)-h;
+    robot.UpdateFrames();
+    if(forward) ne.CalcAccel(arg,f1); else ne.CalcTorques(arg,f1);
+    x(k) = x0(k);
+    f2 -= f1;
+    f2 /= Two*h;
+    Jdiff.copyCol(k,f2);
+  }
+  robot.UpdateFrames();
+  if(!J.isEqual(Jdiff,tol*Max(One,Jdiff.maxAbsElement()))) {
+    LOG4CXX_ERROR(KrisLibrary::logger(),"Error computing "<<name<<"!");
+    LOG4CXX_ERROR(KrisLibrary::logger(),"Analytic:\n"<<MatrixPrinter(J));
+    LOG4CXX_ERROR(KrisLibrary::logger(),"Finite difference:\n"<<MatrixPrinter(Jdiff));
+    return false;
+  }
+  return true;
+}
+
+void TestDynamicsDerivatives()
+{
+  //a branched robot with prismatic joints, under gravity
+  int n=8;
+  RobotDynamics3D robot;
+  robot.Initialize(n);
+  MakePlanarChain(robot,n,One);
+  for(int i=1;i<n;i++) robot.parents[i] = RandInt(i);
+  for(int i=0;i<n;i++) {
+    Vector3 w;
+    SampleSphere(One,w);
+    if(i%3 == 1) robot.links[i].SetTranslationJoint(w);
+    else robot.links[i].SetRotationJoint(w);
+    robot.links[i].com.set(Rand(-0.5,0.5),Rand(-0.5,0.5),Rand(-0.5,0.5));
+    robot.links[i].inertia.setIdentity();
+    robot.links[i].inertia *= Rand(0.1,0.5);
+    robot.q(i) = Rand(-1.0,1.0);
+    robot.dq(i) = Rand(-2.0,2.0);
+  }
+  robot.UpdateFrames();
+  NewtonEulerSolver ne(robot);
+  ne.SetGravityWrenches(Vector3(0,0,-9.8));
+  Vector ddq(n),t(n);
+  for(int i=0;i<n;i++) {
+    ddq(i) = Rand(-1.0,1.0);
+    t(i) = Rand(-1.0,1.0);
+  }
+  Matrix Jq,Jdq;
+  ne.CalcTorquesDeriv(ddq,Jq,Jdq);
+  if(!CheckDynamicsDeriv("dt/dq",Jq,robot.q,robot,ne,ddq,false)) Abort();
+  if(!CheckDynamicsDeriv("dt/dqdot",Jdq,robot.dq,robot,ne,ddq,false)) Abort();
+  if(!ne.CalcAccelDeriv(t,Jq,Jdq)) {
+    LOG4CXX_ERROR(KrisLibrary::logger(),"CalcAccelDeriv failed");
+    Abort();
+  }
+  if(!CheckDynamicsDeriv("dddq/dq",Jq,robot.q,robot,ne,t,true)) Abort();
+  if(!CheckDynamicsDeriv("dddq/dqdot",Jdq,robot.dq,robot,ne,t,true)) Abort();
+}
+
+void TestMultiStartIK()
+{
+  int n=6;
+  RobotKinematics3D robot;
+  MakePlanarChain(robot,n,One);
+  MultiStartIKSolver solver(robot);
+  for(int numThreads=1;numThreads<=3;numThreads++) {
+    solver.numThreads = numThreads;
+    for(int iter=0;iter<10;iter++) {
+      //a reachable goal, from a random configuration
+      Config qgoal(n);
+      for(int i=0;i<n;i++) qgoal(i) = Rand(robot.qMin(i),robot.qMax(i));
+      robot.UpdateConfig(qgoal);
+      vector<IKGoal> goals(1);
+      goals[0].link = n-1;
+      goals[0].localPosition.set(1,0,0);
+      goals[0].SetFixedPosition(robot.links[n-1].T_World*goals[0].localPosition);
+      robot.q.setZero();
+      if(!solver.Solve(goals)) {
+        LOG4CXX_ERROR(KrisLibrary::logger(),"MultiStartIKSolver failed on a reachable goal");
+        Abort();
+      }
+      Assert(solver.solvedSeed >= 0 && solver.numSeedsTried > solver.solvedSeed);
+      robot.UpdateFrames();
+      Assert(RobotIKError(robot,goals[0]) <= solver.tolerance);
+      Assert(robot.InJointLimits(robot.q));
+    }
+  }
+  Assert(solver.cache.Size() == 30);
+  //cached solutions are returned nearest first
+  vector<IKGoal> goals(1);
+  goals[0].link = n-1;
+  goals[0].localPosition.set(1,0,0);
+  goals[0].SetFixedPosition(Vector3(2,1,0));
+  solver.cache.Add(goals,robot.q);
+  goals[0].endPosition.x += 1e-3;
+  vector<Config> seeds;
+  solver.cache.GetSeeds(goals,3,seeds);
+  Assert(seeds.size() == 3);
+  Assert(seeds[0] == robot.q);
+}
+
+void TestSparseIK()
+{
+  //a torso with four limbs
+  int ntorso=3,nlimb=6,nlimbs=4;
+  int n=ntorso+nlimb*nlimbs;
+  RobotKinematics3D robot;
+  MakePlanarChain(robot,n,One);
+  vector<int> tips;
+  for(int l=0;l<nlimbs;l++) {
+    int base = ntorso+l*nlimb;
+    robot.parents[base] = ntorso-1;
+    QuaternionRotation rot(RandRotation());
+    rot.getMatrix(robot.links[base].T0_Parent.R);
+    tips.push_back(base+nlimb-1);
+  }
+  Config qgoal(n);
+  for(int i=0;i<n;i++) qgoal(i) = Rand(robot.qMin(i),robot.qMax(i))*0.5;
+  robot.UpdateConfig(qgoal);
+  vector<IKGoal> goals(nlimbs);
+  for(int l=0;l<nlimbs;l++) {
+    goals[l].link = tips[l];
+    goals[l].localPosition.set(1,0,0);
+    goals[l].SetFixedPosition(robot.links[tips[l]].T_World*goals[l].localPosition);
+    if(l%2 == 0) goals[l].SetFixedRotation(robot.links[tips[l]].T_World.R);
+  }
+  //the last goal is relative to the first limb
+  goals[nlimbs-1].destLink = tips[0];
+  robot.links[tips[0]].T_World.mulInverse(goals[nlimbs-1].endPosition,goals[nlimbs-1].endPosition);
+
+  robot.q.setZero();
+  robot.UpdateFrames();
+  RobotIKFunction f(robot);
+  f.UseIK(goals);
+  GetDefaultIKDofs(robot,goals,f.activeDofs);
+  Vector x(f.activeDofs.Size());
+  f.GetState(x);
+  f.PreEval(x);
+  Matrix J;
+  f.Jacobian(x,J);
+  SparseMatrix sJ;
+  f.Jacobian_Sparse(x,sJ);
+  Matrix J2;
+  sJ.get(J2);
+  if(!J.isEqual(J2,1e-10)) {
+    LOG4CXX_ERROR(KrisLibrary::logger(),"Sparse IK Jacobian doesn't match the dense one");
+    LOG4CXX_ERROR(KrisLibrary::logger(),MatrixPrinter(J));
+    LOG4CXX_ERROR(KrisLibrary::logger(),MatrixPrinter(J2));
+    Abort();
+  }
+  //check against differencing, and that the goals only touch their chains
+  Matrix Jdiff(J.m,J.n);
+  Vector xtemp=x,f1(J.m),f2(J.m);
+  Real h=1e-5;
+  for(int k=0;k<x.n;k++) {
+    xtemp(k) = x(k)+h; f(xtemp,f1);
+    xtemp(k) = x(k)-h; f(xtemp,f2);
+    xtemp(k) = x(k);
+    for(int i=0;i<J.m;i++) Jdiff(i,k) = (f1(i)-f2(i))/(2*h);
+  }
+  f.PreEval(x);
+  if(!J.isEqual(Jdiff,1e-5)) {
+    LOG4CXX_ERROR(KrisLibrary::logger(),"IK Jacobian doesn't match differencing");
+    LOG4CXX_ERROR(KrisLibrary::logger(),MatrixPrinter(J));
+    LOG4CXX_ERROR(KrisLibrary::logger(),MatrixPrinter(Jdiff));
+    Abort();
+  }
+  int nnz=0;
+  for(int i=0;i<sJ.m;i++) nnz += (int)sJ.rows[i].entries.size();
+  Assert(nnz < J.m*J.n/2);
+
+  //solve from near the goal configuration, with the last goal in world
+  //coordinates
+  goals[nlimbs-1].destLink = -1;
+  robot.UpdateConfig(qgoal);
+  goals[nlimbs-1].endPosition = robot.links[tips[nlimbs-1]].T_World*goals[nlimbs-1].localPosition;
+  for(int i=0;i<n;i++) robot.q(i) = qgoal(i)+Rand(-0.3,0.3);
+  robot.UpdateFrames();
+  GetDefaultIKDofs(robot,goals,f.activeDofs);
+  RobotIKSolver solver(f);
+  solver.UseSparse();
+  solver.UseJointLimits(TwoPi);
+  int iters=100;
+  bool res=solver.Solve(1e-4,iters);
+  robot.UpdateFrames();
+  if(!res) {
+    LOG4CXX_ERROR(KrisLibrary::logger(),"Sparse IK solve failed after "<<iters<<" iters");
+    for(size_t i=0;i<goals.size();i++)
+      LOG4CXX_ERROR(KrisLibrary::logger(),"  goal "<<i<<" error "<<RobotIKError(robot,goals[i]));
+    Abort();
+  }
+  for(size_t i=0;i<goals.size();i++)
+    Assert(RobotIKError(robot,goals[i]) <= 1e-3);
+}
+
+void TestSelfCollisionBroadPhase()
+{
+  //a root with two branches of box links, too far apart to touch
+  int nbranch=6;
+  int n=1+2*nbranch;
+  RobotWithGeometry robot;
+  robot.Initialize(n);
+  MakePlanarChain(robot,n,One);
+  robot.parents[1+nbranch] = 0;
+  robot.links[1].T0_Parent.t.set(0,10,0);
+  robot.links[1+nbranch].T0_Parent.t.set(0,-10,0);
+  for(int i=0;i<n;i++) {
+    AABB3D bb(Vector3(0,-0.2,-0.2),Vector3(1,0.2,0.2));
+    robot.geometry[i] = make_shared<RobotWithGeometry::CollisionGeometry>(GeometricPrimitive3D(bb));
+  }
+  robot.InitCollisions();
+  robot.InitAllSelfCollisions();
+  Array2D<bool> allPairs;
+  robot.GetSelfCollisionPairs(allPairs);
+
+  int numCollisions=0;
+  for(int iter=0;iter<200;iter++) {
+    Config q(n);
+    for(int i=0;i<n;i++) q(i) = Rand(robot.qMin(i),robot.qMax(i));
+    robot.UpdateConfig(q);
+    robot.UpdateGeometry();
+    vector<pair<int,int> > pairs,brute;
+    robot.SelfCollisions(pairs);
+    for(int i=0;i<n;i++)
+      for(int j=i+1;j<n;j++)
+        if(robot.selfCollisions(i,j) && robot.selfCollisions(i,j)->Collide())
+          brute.push_back(pair<int,int>(i,j));
+    if(pairs != brute) {
+      LOG4CXX_ERROR(KrisLibrary::logger(),"Self-collision broad phase gave "<<pairs.size()<<" collisions, enumeration gave "<<brute.size());
+      Abort();
+    }
+    Assert(robot.SelfCollision() == !brute.empty());
+    numCollisions += (int)brute.size();
+  }
+  Assert(numCollisions > 0);
+
+  //the result doesn't depend on the number of threads
+  RobotWithGeometry robot2(robot);
+  Srand(1);
+  int numDisabled = robot.DisableNeverCollidingPairs(300,1);
+  Srand(1);
+  int numDisabled2 = robot2.DisableNeverCollidingPairs(300,3);
+  if(numDisabled != numDisabled2) {
+    LOG4CXX_ERROR(KrisLibrary::logger(),"DisableNeverCollidingPairs disabled "<<numDisabled<<" pairs with 1 thread, "<<numDisabled2<<" with 3");
+    Abort();
+  }
+  Array2D<bool> pairs1,pairs2;
+  robot.GetSelfCollisionPairs(pairs1);
+  robot2.GetSelfCollisionPairs(pairs2);
+  int numEnabled=0;
+  for(int i=0;i<n;i++)
+    for(int j=i+1;j<n;j++) {
+      Assert(pairs1(i,j) == pairs2(i,j));
+      //links on different branches never collide
+      bool cross = (i >= 1 && i <= nbranch && j > nbranch);
+      if(cross) Assert(!pairs1(i,j));
+      if(pairs1(i,j)) numEnabled++;
+      if(!allPairs(i,j)) Assert(!pairs1(i,j));
+    }
+  if(numEnabled == 0 || numDisabled < nbranch*nbranch) {
+    LOG4CXX_ERROR(KrisLibrary::logger(),"DisableNeverCollidingPairs left "<<numEnabled<<" pairs enabled, disabled "<<numDisabled);
+    Abort();
+  }
+}
+
+//free space of a robot among obstacles
+struct RobotGeometryCSpace : public CSpace
+{
+  RobotGeometryCSpace(RobotWithGeometry& _robot) : robot(_robot),numFeasibilityChecks(0) {}
+  virtual void Sample(Config& x) {
+    x.resize(robot.q.n);
+    for(int i=0;i<x.n;i++) x(i) = Rand(robot.qMin(i),robot.qMax(i));
+  }
+  virtual bool IsFeasible(const Config& x) {
+    numFeasibilityChecks++;
+    robot.UpdateConfig(x);
+    robot.UpdateGeometry();
+    for(size_t i=0;i<robot.links.size();i++)
+      if(robot.MeshCollision(i)) return false;
+    return !robot.SelfCollision();
+  }
+
+  RobotWithGeometry& robot;
+  int numFeasibilityChecks;
+};
+
+void TestSweptVolumeEdgeChecker()
+{
+  int n=5;
+  RobotWithGeometry robot;
+  robot.Initialize(n);
+  MakePlanarChain(robot,n,One);
+  for(int i=0;i<n;i++) {
+    Meshing::TriMesh mesh;
+    Meshing::MakeTriBox(1,1,1,0.9,0.2,0.2,mesh);
+    for(size_t v=0;v<mesh.verts.size();v++) mesh.verts[v] += Vector3(0.05,-0.1,-0.1);
+    robot.geometry[i] = make_shared<RobotWithGeometry::CollisionGeometry>(mesh);
+  }
+  Meshing::TriMesh obstacleMesh;
+  Meshing::MakeTriBox(1,1,1,1,1,1,obstacleMesh);
+  for(size_t v=0;v<obstacleMesh.verts.size();v++) obstacleMesh.verts[v] += Vector3(2.5,1.5,-0.5);
+  RobotWithGeometry::CollisionGeometry obstacle(obstacleMesh);
+  obstacle.InitCollisionData();
+  robot.InitCollisions();
+  robot.InitAllSelfCollisions();
+  robot.InitMeshCollision(obstacle);
+
+  RobotGeometryCSpace space(robot);
+  int numVisible=0,numChecked=0;
+  int sweptChecks=0,epsilonChecks=0;
+  for(int iter=0;iter<100;iter++) {
+    Config a,b;
+    space.Sample(a);
+    space.Sample(b);
+    for(int i=0;i<n;i++) b(i) = a(i) + (b(i)-a(i))*0.3;
+    if(!space.IsFeasible(a) || !space.IsFeasible(b)) continue;
+    numChecked++;
+    SweptVolumeEdgeChecker swept(&space,robot,a,b);
+    bool sweptVisible = swept.IsVisible();
+    space.numFeasibilityChecks = 0;
+    EpsilonEdgeChecker eps(&space,a,b,1e-3);
+    bool epsVisible = eps.IsVisible();
+    //certified edges are truly free
+    if(sweptVisible && !epsVisible) {
+      LOG4CXX_ERROR(KrisLibrary::logger(),"SweptVolumeEdgeChecker certified an edge that collides");
+      Abort();
+    }
+    if(sweptVisible) {
+      numVisible++;
+      sweptChecks += swept.numFeasibilityChecks;
+      epsilonChecks += space.numFeasibilityChecks;
+    }
+  }
+  Assert(numVisible > 0);
+  Assert(sweptChecks < epsilonChecks);
+}
+
+void TestEquilibriumWarmStart()
+{
+  if(!Optimization::GLPKInterface::Enabled()) {
+    LOG4CXX_INFO(KrisLibrary::logger(),"TestEquilibriumWarmStart: GLPK not available, skipping");
+    return;
+  }
+  //four feet on flat ground, and one on a slope
+  vector<ContactPoint> contacts(5);
+  contacts[0].x.set(0,0,0);
+  contacts[1].x.set(1,0,0);
+  contacts[2].x.set(1,1,0);
+  contacts[3].x.set(0,1,0);
+  contacts[4].x.set(0.5,1.5,0.3);
+  for(int i=0;i<4;i++) contacts[i].n.set(0,0,1);
+  contacts[4].n.set(0,-0.5,1);
+  contacts[4].n.inplaceNormalize();
+  for(size_t i=0;i<contacts.size();i++) contacts[i].kFriction = 0.5;
+  Vector3 fext(0,0,-9.8);
+  int numFCEdges = 4;
+
+  //a slowly moving COM
+  vector<Vector3> coms(200);
+  Vector3 com(0.5,0.5,1);
+  for(size_t i=0;i<coms.size();i++) {
+    com.x += Rand(-0.05,0.05);
+    com.y += Rand(-0.05,0.05);
+    coms[i] = com;
+  }
+  EquilibriumTester tester;
+  vector<bool> results;
+  tester.TestCOMs(contacts,fext,numFCEdges,coms,results);
+  vector<Vector3> f;
+  for(size_t i=0;i<coms.size();i++) {
+    bool cold = TestCOMEquilibrium(contacts,fext,numFCEdges,coms[i],f);
+    if(cold != results[i]) {
+      LOG4CXX_ERROR(KrisLibrary::logger(),"Warm-started equilibrium test differs at COM "<<coms[i]<<": "<<(int)results[i]<<" vs "<<(int)cold);
+      Abort();
+    }
+  }
+  //changing gravity in between keeps the result consistent
+  Vector3 fext2(1,0,-9.8);
+  for(size_t i=0;i<coms.size();i+=10) {
+    bool warm = tester.TestCOM(contacts,(i%20==0?fext:fext2),numFCEdges,coms[i]);
+    bool cold = TestCOMEquilibrium(contacts,(i%20==0?fext:fext2),numFCEdges,coms[i],f);
+    if(warm != cold) {
+      LOG4CXX_ERROR(KrisLibrary::logger(),"Equilibrium test after a gravity change differs at COM "<<coms[i]<<": "<<(int)warm<<" vs "<<(int)cold);
+      Abort();
+    }
+  }
+}
+
+void TestSupportPolygonQueries()
+{
+  //binary search point-in-polygon agrees with the halfplane test
+  for(int iter=0;iter<20;iter++) {
+    int n = 3+RandInt(98);
+    vector<Geometry::PointRay2D> pts(n);
+    for(int i=0;i<n;i++) {
+      pts[i].x = Rand(-1,1);
+      pts[i].y = Rand(-1,1);
+      pts[i].isRay = false;
+    }
+    Geometry::UnboundedPolytope2D poly;
+    poly.vertices.resize(n+1);
+    int k = Geometry::ConvexHull2D_Chain_Unsorted(&pts[0],n,&poly.vertices[0]);
+    poly.vertices.resize(k);
+    poly.CalcPlanes();
+    for(int j=0;j<1000;j++) {
+      Vector2 x(Rand(-1.5,1.5),Rand(-1.5,1.5));
+      if(Abs(poly.Margin(x)) < 1e-8) continue;
+      if(poly.ContainsBounded(x) != poly.Contains(x)) {
+        LOG4CXX_ERROR(KrisLibrary::logger(),"ContainsBounded disagrees with Contains at "<<x<<", margin "<<poly.Margin(x));
+        Abort();
+      }
+    }
+  }
+
+  if(!Optimization::GLPKInterface::Enabled()) {
+    LOG4CXX_INFO(KrisLibrary::logger(),"TestSupportPolygonQueries: GLPK not available, skipping equilibrium tests");
+    return;
+  }
+  vector<ContactPoint> contacts(4);
+  contacts[0].x.set(0,0,0);
+  contacts[1].x.set(1,0,0);
+  contacts[2].x.set(1,1,0.2);
+  contacts[3].x.set(0,1,0);
+  for(size_t i=0;i<contacts.size();i++) {
+    contacts[i].n.set(Rand(-0.2,0.2),Rand(-0.2,0.2),1);
+    contacts[i].n.inplaceNormalize();
+    contacts[i].kFriction = 0.5;
+  }
+  Vector3 fext(0,0,-9.8);
+  int numFCEdges = 4;
+  EquilibriumTester tester;
+  tester.UseSupportPolygon(true);
+  std::shared_ptr<const OrientedSupportPolygon> sp = tester.GetSupportPolygon(contacts,fext,numFCEdges);
+  if(sp != tester.GetSupportPolygon(contacts,fext,numFCEdges)) {
+    LOG4CXX_ERROR(KrisLibrary::logger(),"Support polygon was not reused from the cache");
+    Abort();
+  }
+  vector<Vector3> f;
+  for(int j=0;j<500;j++) {
+    Vector3 com(Rand(-0.5,1.5),Rand(-0.5,1.5),1);
+    //the polygon is an inner approximation
+    if(tester.TestCOM(contacts,fext,numFCEdges,com))
+      Assert(TestCOMEquilibrium(contacts,fext,numFCEdges,com,f));
+  }
+
+  //with room for two polygons, the least recently used one is evicted,
+  //and a held polygon outlives its cache entry
+  tester.UseSupportPolygon(true,2);
+  Vector3 fext2(0.5,0,-9.8),fext3(0,0.5,-9.8);
+  std::shared_ptr<const OrientedSupportPolygon> sp2 = tester.GetSupportPolygon(contacts,fext2,numFCEdges);
+  tester.GetSupportPolygon(contacts,fext,numFCEdges);  //now the most recent
+  tester.GetSupportPolygon(contacts,fext3,numFCEdges);  //evicts fext2
+  if(sp != tester.GetSupportPolygon(contacts,fext,numFCEdges) || sp2 == tester.GetSupportPolygon(contacts,fext2,numFCEdges)) {
+    LOG4CXX_ERROR(KrisLibrary::logger(),"Support polygon cache did not evict the least recently used entry");
+    Abort();
+  }
+  Vector3 com(0.5,0.5,1);
+  if(sp2->TestCOM(com) != tester.TestCOM(contacts,fext2,numFCEdges,com)) {
+    LOG4CXX_ERROR(KrisLibrary::logger(),"Evicted support polygon gives a different result");
+    Abort();
+  }
+}
+
+void TestFitPlanes()
+{
+  //noisy samples of random planes, with an empty set in the middle
+  int size=50;
+  vector<vector<Vector3> > pts(size);
+  for(int k=0;k<size;k++) {
+    if(k == 7) continue;
+    Vector3 n,u,v;
+    SampleSphere(1,n);
+    n.getOrthogonalBasis(u,v);
+    Real offset = Rand(-2,2);
+    pts[k].resize(3+RandInt(30));
+    for(size_t i=0;i<pts[k].size();i++)
+      pts[k][i] = n*offset + u*Rand(-1,1) + v*Rand(-1,1) + n*Rand(-0.01,0.01);
+  }
+  vector<Plane3D> planes;
+  vector<int> valid;
+  int numValid = Geometry::FitPlanes(pts,planes,valid);
+  if(numValid != size-1 || valid[7]) {
+    LOG4CXX_ERROR(KrisLibrary::logger(),"FitPlanes fit "<<numValid<<" of "<<size-1<<" nonempty sets, empty set valid "<<valid[7]);
+    Abort();
+  }
+  for(int k=0;k<size;k++) {
+    if(k == 7) continue;
+    Plane3D p;
+    if(!Geometry::FitPlane(pts[k],p)) FatalError("FitPlane failed on set %d",k);
+    //same plane, up to the sign of the normal
+    Real s = (dot(p.normal,planes[k].normal) < 0 ? -One : One);
+    if(!valid[k] || !p.normal.isEqual(planes[k].normal*s,1e-6) || Abs(p.offset-planes[k].offset*s) > 1e-6) {
+      LOG4CXX_ERROR(KrisLibrary::logger(),"FitPlanes set "<<k<<" gave "<<planes[k].normal<<", "<<planes[k].offset<<", FitPlane gave "<<p.normal<<", "<<p.offset);
+      Abort();
+    }
+  }
 }
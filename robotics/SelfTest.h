@@ -7,5 +7,15 @@
 void TestRotations();
 void TestRLG();
 void TestNewtonEuler();
+void TestBatchedKinematics();
+void TestChangedFrames();
+void TestDynamicsDerivatives();
+void TestMultiStartIK();
+void TestSparseIK();
+void TestSelfCollisionBroadPhase();
+void TestSweptVolumeEdgeChecker();
+void TestEquilibriumWarmStart();
+void TestSupportPolygonQueries();
+void TestFitPlanes();
 
 #endif
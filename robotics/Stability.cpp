@@ -4,6 +4,7 @@
 #include <geometry/PolytopeProjection.h>
 #include <iostream>
 #include <algorithm>
+#include <functional>
 #include <list>
 using namespace std;
 using namespace Geometry;
@@ -720,17 +721,105 @@ bool TestAnyCOMEquilibrium(const vector<CustomContactPoint2D>& contacts,const Ve
 
 
 EquilibriumTester::EquilibriumTester()
-  :testingAnyCOM(false),conditioningShift(Zero),numFCEdges(0)
+  :testingAnyCOM(false),conditioningShift(Zero),numFCEdges(0),basisValid(false),
+   useSupportPolygon(false),supportPolygonCacheSize(64),supportPolygonClock(0)
 {}
 
+static bool SameContacts(const vector<ContactPoint>& a,const vector<ContactPoint>& b)
+{
+  if(a.size() != b.size()) return false;
+  for(size_t i=0;i<a.size();i++)
+    if(a[i].x != b[i].x || a[i].n != b[i].n || a[i].kFriction != b[i].kFriction) return false;
+  return true;
+}
+
 bool EquilibriumTester::TestCOM(const std::vector<ContactPoint>& contacts,const Vector3& fext,int numFCEdges,const Vector3& com)
 {
   if(contacts.empty()) return false;
-  Setup(contacts,fext,numFCEdges,com);
-  testedCOM = com;
+  if(useSupportPolygon)
+    return GetSupportPolygon(contacts,fext,numFCEdges)->TestCOM(com);
+  if(!testingAnyCOM && numFCEdges == this->numFCEdges && SameContacts(contacts,setupContacts)) {
+    //only the equality bounds change, so the last basis is reused
+    testedCOM = com;
+    ChangeGravity(fext);
+  }
+  else {
+    Setup(contacts,fext,numFCEdges,com);
+    testedCOM = com;
+  }
   return TestCurrent();
 }
 
+void EquilibriumTester::TestCOMs(const std::vector<ContactPoint>& contacts,const Vector3& fext,int numFCEdges,const std::vector<Vector3>& coms,std::vector<bool>& results)
+{
+  results.resize(coms.size());
+  for(size_t i=0;i<coms.size();i++)
+    results[i] = TestCOM(contacts,fext,numFCEdges,coms[i]);
+}
+
+struct EquilibriumTester::SupportPolygonCacheEntry
+{
+  std::vector<ContactPoint> contacts;
+  Vector3 fext;
+  int numFCEdges;
+  size_t lastUsed;
+  OrientedSupportPolygon polygon;
+};
+
+static inline void HashCombine(size_t& seed,Real x)
+{
+  seed ^= std::hash<Real>()(x) + 0x9e3779b9 + (seed<<6) + (seed>>2);
+}
+
+static size_t ContactSetHash(const vector<ContactPoint>& contacts,const Vector3& fext,int numFCEdges)
+{
+  size_t seed = (size_t)numFCEdges;
+  for(int k=0;k<3;k++) HashCombine(seed,fext[k]);
+  for(size_t i=0;i<contacts.size();i++) {
+    for(int k=0;k<3;k++) HashCombine(seed,contacts[i].x[k]);
+    for(int k=0;k<3;k++) HashCombine(seed,contacts[i].n[k]);
+    HashCombine(seed,contacts[i].kFriction);
+  }
+  return seed;
+}
+
+void EquilibriumTester::UseSupportPolygon(bool enable,int maxCacheSize)
+{
+  useSupportPolygon = enable;
+  supportPolygonCacheSize = maxCacheSize;
+  if(!enable || (int)supportPolygons.size() > maxCacheSize) supportPolygons.clear();
+}
+
+shared_ptr<const OrientedSupportPolygon> EquilibriumTester::GetSupportPolygon(const std::vector<ContactPoint>& contacts,const Vector3& fext,int numFCEdges)
+{
+  size_t key = ContactSetHash(contacts,fext,numFCEdges);
+  std::map<size_t,shared_ptr<SupportPolygonCacheEntry> >::iterator i=supportPolygons.find(key);
+  if(i != supportPolygons.end()) {
+    const shared_ptr<SupportPolygonCacheEntry>& entry = i->second;
+    //check for hash collisions
+    if(entry->numFCEdges == numFCEdges && entry->fext == fext && SameContacts(entry->contacts,contacts)) {
+      entry->lastUsed = ++supportPolygonClock;
+      return shared_ptr<const OrientedSupportPolygon>(entry,&entry->polygon);
+    }
+    supportPolygons.erase(i);
+  }
+  //evict the least recently used polygon
+  while(!supportPolygons.empty() && (int)supportPolygons.size() >= supportPolygonCacheSize) {
+    std::map<size_t,shared_ptr<SupportPolygonCacheEntry> >::iterator oldest=supportPolygons.begin();
+    for(i=supportPolygons.begin();i!=supportPolygons.end();i++)
+      if(i->second->lastUsed < oldest->second->lastUsed) oldest=i;
+    supportPolygons.erase(oldest);
+  }
+  shared_ptr<SupportPolygonCacheEntry> entry = make_shared<SupportPolygonCacheEntry>();
+  entry->contacts = contacts;
+  entry->fext = fext;
+  entry->numFCEdges = numFCEdges;
+  entry->lastUsed = ++supportPolygonClock;
+  entry->polygon.Set(contacts,fext,numFCEdges);
+  if(supportPolygonCacheSize > 0) supportPolygons[key] = entry;
+  return shared_ptr<const OrientedSupportPolygon>(entry,&entry->polygon);
+}
+
 bool EquilibriumTester::TestCOM(const std::vector<CustomContactPoint>& contacts,const Vector3& fext,const Vector3& com)
 {
   if(contacts.empty()) return false;
@@ -787,6 +876,8 @@ void EquilibriumTester::Setup(const std::vector<ContactPoint>& contacts,const Ve
   lp.A.copySubMatrix(6,0,temp);
   GetForceMinimizationDirection(contacts,lp.c);
   lp.minimize = true;
+  setupContacts = contacts;
+  basisValid = false;
 }
 
 /**
@@ -832,6 +923,8 @@ void EquilibriumTester::Setup(const std::vector<CustomContactPoint>& contacts,co
 
   GetForceMinimizationDirection(contacts,lp.c);
   lp.minimize = true;
+  setupContacts.clear();
+  basisValid = false;
 }
 
 void EquilibriumTester::Setup(const CustomContactFormation& contacts,const Vector3& fext,const Vector3& com)
@@ -870,6 +963,8 @@ void EquilibriumTester::Setup(const CustomContactFormation& contacts,const Vecto
 
   GetForceMinimizationDirection(contacts,lp.c);
   lp.minimize = true;
+  setupContacts.clear();
+  basisValid = false;
 }
 
 bool EquilibriumTester::TestAnyCOM(const std::vector<ContactPoint>& contacts,const Vector3& fext,int numFCEdges)
@@ -945,6 +1040,8 @@ void EquilibriumTester::SetupAnyCOM(const std::vector<ContactPoint>& contacts,co
   lp.c.setZero();
   GetForceMinimizationDirection(contacts,lp.c);
   lp.minimize = true;
+  setupContacts.clear();
+  basisValid = false;
 }
 
 /**
@@ -997,6 +1094,8 @@ void EquilibriumTester::SetupAnyCOM(const std::vector<CustomContactPoint>& conta
   lp.c.setZero();
   GetForceMinimizationDirection(contacts,lp.c);
   lp.minimize = true;
+  setupContacts.clear();
+  basisValid = false;
 }
 
 /**
@@ -1049,6 +1148,8 @@ void EquilibriumTester::SetupAnyCOM(const CustomContactFormation& contacts,const
   lp.c.setZero();
   GetForceMinimizationDirection(contacts,lp.c);
   lp.minimize = true;
+  setupContacts.clear();
+  basisValid = false;
 }
 
 void EquilibriumTester::ChangeContacts(const std::vector<ContactPoint>& contacts)
@@ -1065,6 +1166,8 @@ void EquilibriumTester::ChangeContacts(const std::vector<ContactPoint>& contacts
   lp.A.copySubMatrix(6,0,temp);
 
   GetForceMinimizationDirection(contacts,lp.c);
+  setupContacts.clear();
+  basisValid = false;
 } 
 
 void EquilibriumTester::ChangeContact(int i,ContactPoint& contact)
@@ -1086,6 +1189,8 @@ void EquilibriumTester::ChangeContact(int i,ContactPoint& contact)
 
   //change objective -- not strictly necessary
   contact.n.get(lp.c(i*3),lp.c(i*3+1),lp.c(i*3+2));
+  setupContacts.clear();
+  basisValid = false;
 }
 
 void EquilibriumTester::ChangeGravity(const Vector3& fext)
@@ -1098,6 +1203,7 @@ void EquilibriumTester::ChangeGravity(const Vector3& fext)
     for(int p=0;p<3;p++)
       for(int q=0;q<3;q++)
 	lp.A(3+p,numContacts*3+q) = crossProd(p,q);
+    basisValid = false;
     lp.q(0) = lp.p(0) = -fext.x;
     lp.q(1) = lp.p(1) = -fext.y;
     lp.q(2) = lp.p(2) = -fext.z;
@@ -1120,6 +1226,7 @@ void EquilibriumTester::ChangeCOM(const Vector3& com)
   if(testingAnyCOM) {
   }
   else {
+    testedCOM = com;
     Vector3 fext(lp.q(0),lp.q(1),lp.q(2));
     Vector3 mext;
     mext.setCross(com-conditioningShift,fext);
@@ -1131,7 +1238,10 @@ void EquilibriumTester::ChangeCOM(const Vector3& com)
 
 bool EquilibriumTester::TestCurrent()
 {
-  Optimization::LinearProgram::Result res=lps.Solve(lp);
+  Optimization::LinearProgram::Result res;
+  if(basisValid) res=lps.Solve_NewBounds(lp);
+  else res=lps.Solve(lp);
+  basisValid = (res != Optimization::LinearProgram::Error);
   if(res == Optimization::LinearProgram::Feasible) {
     return true;
   }
@@ -1156,6 +1266,7 @@ void EquilibriumTester::SetRobustnessFactor(Real frobust)
   //all forces must be within this distance of the friction cone edge
   for(int i=6;i<lp.p.n;i++)
     lp.p(i) = frobust;
+  setupContacts.clear();
 }
 
 void EquilibriumTester::SetRobustnessFactor(int i,Real frobust)
@@ -1163,6 +1274,7 @@ void EquilibriumTester::SetRobustnessFactor(int i,Real frobust)
   Assert(numFCEdges > 0);
   for(int j=0;j<numFCEdges;j++)
     lp.p(6+i*numFCEdges+j) = frobust;
+  setupContacts.clear();
 }
 
 void EquilibriumTester::LimitContactForce(int i,Real maximum,const Vector3& dir)
@@ -1173,6 +1285,8 @@ void EquilibriumTester::LimitContactForce(int i,Real maximum,const Vector3& dir)
   v(i*3+1)=dir.y;
   v(i*3+2)=dir.z;
   lp.AddConstraint(-Inf,v,maximum);
+  setupContacts.clear();
+  basisValid = false;
 }
 
 void EquilibriumTester::LimitContactForceSum(const std::vector<int>& indices,Real maximum,const Vector3& dir)
@@ -1186,6 +1300,8 @@ void EquilibriumTester::LimitContactForceSum(const std::vector<int>& indices,Rea
     v(i*3+2)=dir.z;
   }
   lp.AddConstraint(-Inf,v,maximum);
+  setupContacts.clear();
+  basisValid = false;
 }
 
 void EquilibriumTester::GetForceVector(Vector& f) const
@@ -1223,6 +1339,8 @@ void EquilibriumTester::Clear()
   testingAnyCOM = false;
   lp.Resize(0,0);
   lp.A.clear();
+  setupContacts.clear();
+  basisValid = false;
 }
 
 int EquilibriumTester::NumContacts() const
@@ -1254,6 +1372,17 @@ int EquilibriumTester::NumFCEdges() const
 
 
 
+SupportPolygon::SupportPolygon()
+  :numFCEdges(0),bounded(false)
+{}
+
+static bool HasRays(const vector<PointRay2D>& vertices)
+{
+  for(size_t i=0;i<vertices.size();i++)
+    if(vertices[i].isRay) return true;
+  return false;
+}
+
 /* max_{x,y,f} ax+by s.t.
  * sum fi + G = 0
  * sum pi x fi + (x,y,z)x G = 0
@@ -1348,6 +1477,7 @@ bool SupportPolygon::Set(const std::vector<ContactPoint>& cp,const Vector3& _fex
   expander.maxDepth = maxExpandDepth;
   expander.Expand();
   expander.Create(*this);
+  bounded = !HasRays(vertices);
 
   /*
   for(size_t i=0;i<planes.size();i++) {
@@ -1451,6 +1581,7 @@ bool SupportPolygon::Set(const std::vector<CustomContactPoint>& cp,const Vector3
   expander.maxDepth = maxExpandDepth;
   expander.Expand();
   expander.Create(*this);
+  bounded = !HasRays(vertices);
 
   /*
   for(size_t i=0;i<planes.size();i++) {
@@ -1548,6 +1679,7 @@ bool SupportPolygon::Set(const CustomContactFormation& cp,const Vector3& _fext,i
   expander.maxDepth = maxExpandDepth;
   expander.Expand();
   expander.Create(*this);
+  bounded = !HasRays(vertices);
 
   return true;
 }
@@ -1557,6 +1689,7 @@ bool SupportPolygon::Set(const CustomContactFormation& cp,const Vector3& _fext,i
 
 bool SupportPolygon::TestCOM(const Vector3& com) const
 {
+  if(bounded) return ContainsBounded(Vector2(com.x,com.y));
   return Contains(Vector2(com.x,com.y));
 }
 
@@ -5,6 +5,8 @@
 #include <KrisLibrary/geometry/UnboundedPolytope2D.h>
 #include <KrisLibrary/optimization/LinearProgram.h>
 #include <KrisLibrary/optimization/LPRobust.h>
+#include <map>
+#include <memory>
 
 /// Tests whether the contacts admit force closure
 bool TestForceClosure(const std::vector<ContactPoint>& contacts,int numFCEdges);
@@ -32,6 +34,8 @@ bool TestCOMEquilibrium(const std::vector<CustomContactPoint2D>& contacts,const
 bool TestAnyCOMEquilibrium(const std::vector<ContactPoint2D>& contacts,const Vector2& fext);
 bool TestAnyCOMEquilibrium(const std::vector<CustomContactPoint2D>& contacts,const Vector2& fext);
 
+class OrientedSupportPolygon;
+
 /** @ingroup Robotics
  * @brief Testing COM equilibrium given some number of contacts.
  *
@@ -40,9 +44,17 @@ bool TestAnyCOMEquilibrium(const std::vector<CustomContactPoint2D>& contacts,con
  * the same number of contacts.  They also let you do more sophisticated
  * things with robustness and force limiting.
  *
+ * The LP solver's basis is kept between solves.  If only the COM, gravity,
+ * or robustness factors change (ChangeCOM(), ChangeGravity() with a fixed
+ * COM, SetRobustnessFactor()), TestCurrent() warm-starts from the previous
+ * basis rather than solving from scratch.  TestCOM() with ContactPoints
+ * does this automatically when the contacts and numFCEdges are the same as
+ * in the last call, and TestCOMs() tests a batch of COMs this way.
+ *
  * However, if the contacts remain the same, and you're testing a large number
  * of COMs (10-20), it's better to use the SupportPolygon class to compute the
- * entire support polygon.
+ * entire support polygon.  UseSupportPolygon() makes TestCOM() do this
+ * automatically, caching the polygon of each contact set.
  *
  * @sa SupportPolygon
  */
@@ -59,6 +71,22 @@ class EquilibriumTester
   bool TestCOM(const std::vector<ContactPoint>& contacts,const Vector3& fext,int numFCEdges,const Vector3& com);
   bool TestCOM(const std::vector<CustomContactPoint>& contacts,const Vector3& fext,const Vector3& com);
   bool TestCOM(const CustomContactFormation& contacts,const Vector3& fext,const Vector3& com);
+  ///Tests each of the COMs for equilibrium under the same contacts,
+  ///warm-starting each LP from the last.  results[i] is set to whether
+  ///coms[i] is stable.
+  void TestCOMs(const std::vector<ContactPoint>& contacts,const Vector3& fext,int numFCEdges,const std::vector<Vector3>& coms,std::vector<bool>& results);
+  ///If enabled, TestCOM() and TestCOMs() with ContactPoints test the COM
+  ///against the support polygon of the contacts, which is computed once
+  ///per contact set and cached (up to maxCacheSize polygons, evicting the
+  ///least recently used one when full).  Each test is
+  ///then an O(log n) point-in-polygon test rather than an LP.  The polygon
+  ///is an inner approximation of the support region, so the test is
+  ///conservative, and the contact forces are not computed.
+  void UseSupportPolygon(bool enable,int maxCacheSize=64);
+  ///Returns the support polygon of the contacts, from the cache if possible.
+  ///The polygon stays valid as long as the pointer is held, even after it
+  ///is evicted from the cache.
+  std::shared_ptr<const OrientedSupportPolygon> GetSupportPolygon(const std::vector<ContactPoint>& contacts,const Vector3& fext,int numFCEdges);
   bool TestAnyCOM(const std::vector<ContactPoint>& contacts,const Vector3& fext,int numFCEdges);
   bool TestAnyCOM(const std::vector<CustomContactPoint>& contacts,const Vector3& fext);
   bool TestAnyCOM(const CustomContactFormation& contacts,const Vector3& fext);
@@ -86,6 +114,20 @@ class EquilibriumTester
   Vector3 testedCOM;
   Vector3 conditioningShift;
   int numFCEdges;
+  ///contacts of the last Setup() with ContactPoints, if the LP hasn't been
+  ///modified since other than by ChangeCOM/ChangeGravity
+  std::vector<ContactPoint> setupContacts;
+  ///true if the solver's basis belongs to an LP with the current
+  ///constraint matrix and objective
+  bool basisValid;
+
+  struct SupportPolygonCacheEntry;
+  bool useSupportPolygon;
+  int supportPolygonCacheSize;
+  ///incremented on each cache access, for LRU eviction
+  size_t supportPolygonClock;
+  ///support polygons keyed by a hash of the contacts, fext and numFCEdges
+  std::map<size_t,std::shared_ptr<SupportPolygonCacheEntry> > supportPolygons;
 };
 
 
@@ -94,8 +136,9 @@ class EquilibriumTester
  *
  * To test stability call the Set() method, then call the TestCOM() method.
  * This first computes the entire support polygon, and the second tests
- * for inclusion in the polygon.  This is faster than the static 
- * TestCOMEquilibrium() method if you need to test a large number of COMs.
+ * for inclusion in the polygon (in O(log n) time if it's bounded).  This
+ * is faster than the static TestCOMEquilibrium() method if you need to
+ * test a large number of COMs.
  *
  * In the future, the incremental, adaptive algorithm of Bretl 2006 may be
  * implemented.
@@ -108,6 +151,7 @@ class EquilibriumTester
 class SupportPolygon : public Geometry::UnboundedPolytope2D
 {
 public:
+  SupportPolygon();
   bool Set(const std::vector<ContactPoint>& contacts,const Vector3& fext,int numFCEdges,int maxExpandDepth=6);
   bool Set(const std::vector<CustomContactPoint>& contacts,const Vector3& fext,int maxExpandDepth=6);
   bool Set(const CustomContactFormation& contacts,const Vector3& fext,int maxExpandDepth=6);
@@ -118,6 +162,7 @@ public:
   Vector3 fext;
   int numFCEdges;
   std::vector<ContactPoint> contacts;
+  bool bounded;   ///<true if the polygon has no rays, set by Set()
 };
 
 /** @ingroup Robotics
@@ -0,0 +1,139 @@
+#include <KrisLibrary/Logger.h>
+#include "SweptVolumeEdgeChecker.h"
+#include <errors.h>
+using namespace std;
+
+SweptVolumeEdgeChecker::SweptVolumeEdgeChecker(CSpace* space,RobotWithGeometry& _robot,const InterpolatorPtr& path,Real _epsilon)
+  :EdgeChecker(space,path),robot(_robot),epsilon(_epsilon),maxDepth(30),checkSelfCollisions(true),relErr(0.1),
+   numFeasibilityChecks(0),numDistanceQueries(0)
+{
+  Init();
+}
+
+SweptVolumeEdgeChecker::SweptVolumeEdgeChecker(CSpace* space,RobotWithGeometry& _robot,const Config& a,const Config& b,Real _epsilon)
+  :EdgeChecker(space,a,b),robot(_robot),epsilon(_epsilon),maxDepth(30),checkSelfCollisions(true),relErr(0.1),
+   numFeasibilityChecks(0),numDistanceQueries(0)
+{
+  Init();
+}
+
+void SweptVolumeEdgeChecker::Init()
+{
+  radii.resize(robot.links.size());
+  for(size_t i=0;i<robot.links.size();i++)
+    radii[i] = LinkRadius(i);
+}
+
+Real SweptVolumeEdgeChecker::LinkRadius(int i) const
+{
+  if(robot.IsGeometryEmpty(i)) return 0;
+  //local bounding box, before the geometry's transform is applied
+  AABB3D bb = robot.geometry[i]->AnyGeometry3D::GetAABB();
+  Real r = 0;
+  for(int k=0;k<8;k++) {
+    Vector3 corner((k&1)?bb.bmax.x:bb.bmin.x,(k&2)?bb.bmax.y:bb.bmin.y,(k&4)?bb.bmax.z:bb.bmin.z);
+    r = Max(r,corner.norm());
+  }
+  return r + Max(robot.geometry[i]->margin,(Real)0);
+}
+
+EdgePlannerPtr SweptVolumeEdgeChecker::Copy() const
+{
+  auto e = make_shared<SweptVolumeEdgeChecker>(space,robot,path,epsilon);
+  e->maxDepth = maxDepth;
+  e->checkSelfCollisions = checkSelfCollisions;
+  e->relErr = relErr;
+  return e;
+}
+
+EdgePlannerPtr SweptVolumeEdgeChecker::ReverseCopy() const
+{
+  auto e = make_shared<SweptVolumeEdgeChecker>(space,robot,make_shared<ReverseInterpolator>(path),epsilon);
+  e->maxDepth = maxDepth;
+  e->checkSelfCollisions = checkSelfCollisions;
+  e->relErr = relErr;
+  return e;
+}
+
+Real SweptVolumeEdgeChecker::GetMotionBounds(const Config& a,const Config& b,vector<Real>& bounds) const
+{
+  bounds.resize(robot.links.size());
+  Real bmax = 0;
+  for(size_t i=0;i<robot.links.size();i++) {
+    if(robot.IsGeometryEmpty(i)) bounds[i] = 0;
+    else bounds[i] = robot.PointDistanceBound(Vector3(radii[i],0,0),i,a,b);
+    bmax = Max(bmax,bounds[i]);
+  }
+  return bmax;
+}
+
+void SweptVolumeEdgeChecker::GetClearance(const Config& q,Real bound,Clearance& c)
+{
+  robot.UpdateConfig(q);
+  robot.UpdateGeometry();
+  //distances are only needed up to the largest motion of a link pair; the
+  //queries return an upper bound within relErr of the true distance
+  Real queryBound = 2*bound*(1+relErr);
+  c.env.assign(robot.links.size(),Inf);
+  for(size_t i=0;i<robot.links.size();i++) {
+    if(i >= robot.envCollisions.size() || !robot.envCollisions[i]) continue;
+    numDistanceQueries++;
+    Real d = robot.envCollisions[i]->Distance(0,relErr,queryBound);
+    c.env[i] = Max(d,(Real)0)/(1+relErr);
+  }
+  c.self.assign(selfPairs.size(),Inf);
+  for(size_t k=0;k<selfPairs.size();k++) {
+    RobotWithGeometry::CollisionQuery* query = robot.selfCollisions(selfPairs[k].first,selfPairs[k].second);
+    numDistanceQueries++;
+    Real d = query->Distance(0,relErr,queryBound);
+    c.self[k] = Max(d,(Real)0)/(1+relErr);
+  }
+}
+
+bool SweptVolumeEdgeChecker::CheckSegment(Real ua,Real ub,const Config& a,const Config& b,const Clearance& ca,const Clearance& cb,int depth)
+{
+  vector<Real> bounds;
+  Real bmax = GetMotionBounds(a,b,bounds);
+  bool certified = true;
+  for(size_t i=0;i<bounds.size() && certified;i++)
+    if(bounds[i] >= ca.env[i] + cb.env[i]) certified = false;
+  for(size_t k=0;k<selfPairs.size() && certified;k++) {
+    int i=selfPairs[k].first,j=selfPairs[k].second;
+    if(bounds[i]+bounds[j] >= ca.self[k] + cb.self[k]) certified = false;
+  }
+  if(certified) return true;
+  if(epsilon > 0 && space->Distance(a,b) <= epsilon) return true;
+  if(depth >= maxDepth) {
+    LOG4CXX_INFO(KrisLibrary::logger(),"SweptVolumeEdgeChecker: couldn't certify a segment after "<<depth<<" bisections");
+    return false;
+  }
+
+  Real um = (ua+ub)*0.5;
+  Config m;
+  path->Eval(um,m);
+  numFeasibilityChecks++;
+  if(!space->IsFeasible(m)) return false;
+  Clearance cm;
+  GetClearance(m,bmax,cm);
+  return CheckSegment(ua,um,a,m,ca,cm,depth+1) && CheckSegment(um,ub,m,b,cm,cb,depth+1);
+}
+
+bool SweptVolumeEdgeChecker::IsVisible()
+{
+  numFeasibilityChecks = 0;
+  numDistanceQueries = 0;
+  selfPairs.resize(0);
+  if(checkSelfCollisions) {
+    for(int i=0;i<robot.selfCollisions.m;i++)
+      for(int j=i+1;j<robot.selfCollisions.n;j++)
+        if(robot.selfCollisions(i,j)) selfPairs.push_back(pair<int,int>(i,j));
+  }
+  const Config& a = path->Start();
+  const Config& b = path->End();
+  vector<Real> bounds;
+  Real bmax = GetMotionBounds(a,b,bounds);
+  Clearance ca,cb;
+  GetClearance(a,bmax,ca);
+  GetClearance(b,bmax,cb);
+  return CheckSegment(path->ParamStart(),path->ParamEnd(),a,b,ca,cb,0);
+}
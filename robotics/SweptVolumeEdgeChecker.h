@@ -0,0 +1,78 @@
+#ifndef ROBOTICS_SWEPT_VOLUME_EDGE_CHECKER_H
+#define ROBOTICS_SWEPT_VOLUME_EDGE_CHECKER_H
+
+#include "RobotWithGeometry.h"
+#include <KrisLibrary/planning/EdgePlanner.h>
+
+/** @file SweptVolumeEdgeChecker.h
+ * @ingroup Robot
+ * @brief An edge checker that certifies robot paths collision free using
+ * bounds on how far the links move.
+ */
+
+/** @ingroup Robot
+ * @brief Checks a robot path by bounding the volume swept by each link.
+ *
+ * Over a segment from qa to qb, no point on link i's geometry moves farther
+ * than the bound M_i given by PointDistanceBound, using the radius of the
+ * geometry about the link's origin.  If the clearance d_i of link i from
+ * the environment satisfies M_i < d_i(qa) + d_i(qb), the link can't touch
+ * the environment anywhere on the segment.  Likewise, a self-collision pair
+ * (i,j) is certified if M_i + M_j < d_ij(qa) + d_ij(qb).  Segments that
+ * can't be certified are bisected, and the midpoint is checked with
+ * space->IsFeasible().  Free space far from obstacles is covered by a few
+ * long segments, so far fewer feasibility checks are needed than with
+ * EpsilonEdgeChecker.
+ *
+ * The environment is given by the robot's envCollisions queries (see
+ * RobotWithGeometry::InitMeshCollision), and self collisions by the enabled
+ * selfCollisions.  The path must move each joint monotonically between its
+ * endpoints (e.g., linear interpolation).  As with the other checkers, the
+ * endpoints are assumed to be feasible.  The robot's state is overwritten.
+ *
+ * If epsilon > 0, segments shorter than epsilon are accepted once their
+ * endpoints are feasible, as in EpsilonEdgeChecker.  Otherwise, checking
+ * only stops when the path is certified or found infeasible, or when
+ * maxDepth bisections are reached, in which case the edge is conservatively
+ * reported as infeasible.
+ */
+class SweptVolumeEdgeChecker : public EdgeChecker
+{
+public:
+  SweptVolumeEdgeChecker(CSpace* space,RobotWithGeometry& robot,const InterpolatorPtr& path,Real epsilon=0);
+  SweptVolumeEdgeChecker(CSpace* space,RobotWithGeometry& robot,const Config& a,const Config& b,Real epsilon=0);
+  virtual bool IsVisible();
+  virtual EdgePlannerPtr Copy() const;
+  virtual EdgePlannerPtr ReverseCopy() const;
+
+  ///Returns the radius of link i's geometry about the link's origin
+  Real LinkRadius(int i) const;
+
+  RobotWithGeometry& robot;
+  Real epsilon;
+  int maxDepth;               ///<default 30
+  bool checkSelfCollisions;   ///<default true
+  Real relErr;                ///<relative error of the distance queries (default 0.1)
+
+  //statistics of the last IsVisible call
+  int numFeasibilityChecks;
+  int numDistanceQueries;
+
+protected:
+  ///lower bounds on the clearances at a configuration
+  struct Clearance
+  {
+    std::vector<Real> env;    ///<per link
+    std::vector<Real> self;   ///<per pair in selfPairs
+  };
+
+  void Init();
+  void GetClearance(const Config& q,Real bound,Clearance& c);
+  Real GetMotionBounds(const Config& a,const Config& b,std::vector<Real>& bounds) const;
+  bool CheckSegment(Real ua,Real ub,const Config& a,const Config& b,const Clearance& ca,const Clearance& cb,int depth);
+
+  std::vector<Real> radii;
+  std::vector<std::pair<int,int> > selfPairs;
+};
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <KrisLibrary/math/vector.h>
 #include <KrisLibrary/math/matrix.h>
+#include <KrisLibrary/math/SmallMatrix.h>
 #include <KrisLibrary/math3d/primitives.h>
 using namespace Math;
 using namespace Math3D;
@@ -24,9 +25,17 @@ struct Wrench
   Vector3 f,m;
 };
 
-struct SpatialVector : public Vector
+/** @brief A 6-D spatial vector (force/moment, or linear/angular velocity or
+ * acceleration).
+ *
+ * Stored inline, so temporaries never allocate.  Use getRef() to pass it to
+ * functions that take a Vector.
+ */
+struct SpatialVector : public SmallVector<Real,6>
 {
   SpatialVector();
+  using SmallVector<Real,6>::set;
+  using SmallVector<Real,6>::get;
   void set(const Vector3& a,const Vector3& b);
   void get(Vector3& a,Vector3& b) const;
   void setForce(const Vector3& force,const Vector3& moment)
@@ -37,7 +46,12 @@ struct SpatialVector : public Vector
   { set(linAccel,angAccel); }
 };
 
-struct SpatialMatrix : public Matrix
+/** @brief A 6x6 spatial transform or inertia matrix.
+ *
+ * Stored inline, so temporaries never allocate.  Use getRef() to pass it to
+ * functions that take a Matrix.
+ */
+struct SpatialMatrix : public SmallMatrix<Real,6,6>
 {
   SpatialMatrix();
   void setUpperLeft(const Matrix3& mat11);
@@ -48,6 +48,7 @@ typedef std::condition_variable Condition;
 inline Thread ThreadStart(void* (*fn)(void*), void* data = NULL) { return std::thread(fn, data); }
 inline void ThreadJoin(Thread& thread) { thread.join(); }
 inline void ThreadYield() { std::this_thread::yield(); }
+inline int ThreadHardwareConcurrency() { return (int)std::thread::hardware_concurrency(); }
 
 #endif //USE_CPP_THREADS
 
@@ -61,6 +62,7 @@ typedef boost::interprocess::interprocess_condition Condition;
 inline Thread ThreadStart(void* (*fn)(void*),void* data=NULL) { return boost::thread(fn,data); }
 inline void ThreadJoin(Thread& thread) { thread.join(); }
 inline void ThreadYield() { boost::this_thread::yield(); }
+inline int ThreadHardwareConcurrency() { return (int)boost::thread::hardware_concurrency(); }
 
 #endif //USE_BOOST_THREADS
 
@@ -74,6 +76,8 @@ inline Thread ThreadStart(void* (*fn)(void*),void* data=NULL) {
 }
 inline void ThreadJoin(Thread& thread) { pthread_join(thread,NULL); }
 inline void ThreadYield() { pthread_yield(); }
+#include <unistd.h>
+inline int ThreadHardwareConcurrency() { return (int)sysconf(_SC_NPROCESSORS_ONLN); }
 struct Mutex
 {
   Mutex() { mutex = PTHREAD_MUTEX_INITIALIZER; }
@@ -111,4 +115,33 @@ void ThreadSleep(double duration);
 inline void ThreadSleep(double duration) { usleep(int(duration*1000000)); }
 #endif
 
+#include <vector>
+
+/** @brief Runs fn on each element of data in parallel and waits for all of
+ * them to complete.
+ *
+ * data[0] is processed in the calling thread, and one new thread is started
+ * for each of the remaining items.
+ */
+template <class Data>
+void ThreadRunAll(void* (*fn)(void*),std::vector<Data>& data)
+{
+  if(data.empty()) return;
+  std::vector<Thread> threads;
+  for(size_t i=1;i<data.size();i++)
+    threads.push_back(ThreadStart(fn,&data[i]));
+  fn(&data[0]);
+  for(size_t i=0;i<threads.size();i++)
+    ThreadJoin(threads[i]);
+}
+
+///Returns the number of worker threads to use given a requested number.
+///If numThreads <= 0, this is the hardware concurrency.
+inline int ThreadCount(int numThreads)
+{
+  if(numThreads > 0) return numThreads;
+  int n = ThreadHardwareConcurrency();
+  return (n > 0 ? n : 1);
+}
+
 #endif //THREAD_UTILS_H